@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <new>
+#include "../../Payload/src/game_structures.h"
+#include "../../Payload/src/platform.h"
+
+
+/*
+* A small stand-in for supertuxkart that the payload can be preloaded into on Linux (see
+* preload.cpp). It has the globals & functions that the payload uses, with the same layouts &
+* signatures as in game_structures.h and hooks.h, exported by name (instead of at an offset in
+* the exe) so that the preload can find them with dlsym(). Its main loop is the game's: ask
+* MainLoop::getLimitedDt for the timestep, then update the race. There's no physics, rendering or
+* sound, so a script with a negative playspeed runs as fast as the tick driver can go:
+*
+*   LD_PRELOAD=./libpayload_preload.so ./mock_game [frames]
+*
+* Runs for that many frames (forever if 0 or left out), then prints what the race got.
+*/
+
+
+// containers that the game owns are allocated from this, the same as in the payload
+void* (*g_game_malloc)(size_t size) = &malloc;
+void (*g_game_free)(void* ptr) = &free;
+
+
+// what happened in the race, printed on exit
+static uint64_t num_frames = 0;
+static uint64_t race_ticks = 0;
+static uint64_t key_events = 0;
+static uint32_t full_loads = 0;
+static uint32_t quick_resets = 0;
+static uint32_t keys_held = 0;
+
+
+/*
+* The game's objects. The ones that the payload only passes back to the game (or reads a field
+* of) are zeroed buffers that are big enough, like in the simulator. World is a real class,
+* since the payload calls World::reset through its vtable.
+*/
+
+alignas(RaceManager) static char race_manager_obj[sizeof(RaceManager)];
+alignas(InputManager) static char input_manager_obj[sizeof(InputManager)];
+alignas(DeviceManager) static char device_manager_obj[sizeof(DeviceManager)];
+alignas(PlayerManager) static char player_manager_obj[sizeof(PlayerManager)];
+alignas(STKConfig) static char stk_config_obj[sizeof(STKConfig)];
+alignas(void*) static char state_manager_obj[64];
+alignas(void*) static char main_loop_obj[64];
+alignas(void*) static char player_profile_obj[64];
+alignas(void*) static char input_device_obj[64];
+
+class MockWorld {
+public:
+	virtual void init() {}
+	virtual void update(float dt) {
+		(void)dt;
+		race_ticks++;
+	}
+	// index 2, like World::reset
+	virtual void reset(bool restart) {
+		(void)restart;
+		quick_resets++;
+		keys_held = 0;
+	}
+};
+
+static MockWorld world;
+
+
+// the game's globals, see game_state.schema
+extern "C" {
+	RaceManager* g_race_manager = (RaceManager*)race_manager_obj;
+	InputManager* input_manager = (InputManager*)input_manager_obj;
+	PlayerManager* m_player_manager = (PlayerManager*)player_manager_obj;
+	StateManager* state_manager_singleton = (StateManager*)state_manager_obj;
+	MainLoop* main_loop = (MainLoop*)main_loop_obj;
+	STKConfig* stk_config = (STKConfig*)stk_config_obj;
+	World* m_world = nullptr;
+	bool g_is_no_graphics = false;
+}
+
+
+// the game's functions, named like the hooks:: ones (with a single underscore)
+
+// not inlined (or cloned by gcc) into main(), so that the hooks see every call
+#ifdef __clang__
+#define GAME_FUNC extern "C" __attribute__((noinline, used))
+#else
+#define GAME_FUNC extern "C" __attribute__((noipa, used))
+#endif
+
+// the keys that are bound to kart actions, one bit each in keys_held
+static int KeyBit(EKEY_CODE key) {
+	switch (key) {
+		case IRR_KEY_UP:    return 1 << 0;
+		case IRR_KEY_DOWN:  return 1 << 1;
+		case IRR_KEY_LEFT:  return 1 << 2;
+		case IRR_KEY_RIGHT: return 1 << 3;
+		case IRR_KEY_SPACE: return 1 << 4;
+		case IRR_KEY_N:     return 1 << 5;
+		case IRR_KEY_V:     return 1 << 6;
+		default:            return 0;
+	}
+}
+
+GAME_FUNC EventPropagation InputManager_input(InputManager* thisptr, SEvent& event) {
+	(void)thisptr;
+	if (event.EventType != EET_KEY_INPUT_EVENT)
+		return EVENT_LET;
+	int bit = KeyBit(event.KeyInput.Key);
+	if (bit == 0)
+		return EVENT_LET;
+	key_events++;
+	keys_held = event.KeyInput.PressedDown ? keys_held | bit : keys_held & ~bit;
+	return EVENT_BLOCK;
+}
+
+GAME_FUNC float MainLoop_getLimitedDt(MainLoop* thisptr) {
+	(void)thisptr;
+	// the game caps the framerate, this one doesn't draw anything so 120 fps is plenty
+	static uint64_t prev_time_us = 0;
+	uint64_t frame_us = platform::TickCountUs() - prev_time_us;
+	if (frame_us < 1000000 / 120)
+		platform::SleepMs(int((1000000 / 120 - frame_us) / 1000));
+	prev_time_us = platform::TickCountUs();
+	return 1.0f / stk_config->m_physics_fps;
+}
+
+GAME_FUNC void RaceManager_exitRace(RaceManager* thisptr, bool delete_world) {
+	(void)thisptr;
+	if (delete_world)
+		m_world = nullptr;
+	keys_held = 0;
+}
+
+GAME_FUNC void RaceManager_startSingleRace(RaceManager* thisptr, const std::str_wrap& track_ident, const int num_laps, bool from_overworld) {
+	(void)thisptr;
+	(void)num_laps;
+	(void)from_overworld;
+	full_loads++;
+	printf("mock_game: loading %.*s\n", (int)track_ident.len, track_ident.ptr);
+	m_world = (World*)&world;
+	keys_held = 0;
+}
+
+GAME_FUNC InputDevice* DeviceManager_getLatestUsedDevice(DeviceManager* thisptr) {
+	(void)thisptr;
+	return (InputDevice*)input_device_obj;
+}
+
+GAME_FUNC int StateManager_createActivePlayer(StateManager* thisptr, PlayerProfile* profile, InputDevice* device) {
+	(void)thisptr;
+	(void)profile;
+	(void)device;
+	return 0;
+}
+
+GAME_FUNC void RaceManager_setPlayerKart(RaceManager* thisptr, uint32_t player_id, const std::str_wrap& kart_name) {
+	(void)thisptr;
+	(void)player_id;
+	(void)kart_name;
+}
+
+GAME_FUNC void DeviceManager_setAssignMode(DeviceManager* thisptr, const PlayerAssignMode assignMode) {
+	(void)thisptr;
+	(void)assignMode;
+}
+
+GAME_FUNC void StateManager_resetActivePlayers(StateManager* thisptr) {
+	(void)thisptr;
+}
+
+
+int main(int argc, char* argv[]) {
+	uint64_t max_frames = argc > 1 ? strtoull(argv[1], nullptr, 10) : 0;
+
+	// RaceManager has containers in it, so it needs to be constructed properly
+	new (race_manager_obj) RaceManager();
+	input_manager->m_device_manager = (DeviceManager*)device_manager_obj;
+	m_player_manager->m_current_player = (PlayerProfile*)player_profile_obj;
+	stk_config->m_physics_fps = 120;
+
+	for (; max_frames == 0 || num_frames < max_frames; num_frames++) {
+		float dt = MainLoop_getLimitedDt(main_loop);
+		if (m_world && dt > 0)
+			((MockWorld*)m_world)->update(dt);
+	}
+
+	printf("mock_game: %llu frames, %llu race ticks, %llu key events, %u full loads, %u quick resets\n",
+		(unsigned long long)num_frames, (unsigned long long)race_ticks, (unsigned long long)key_events,
+		full_loads, quick_resets);
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include "../../Payload/src/global_info.h"
+#include "../../Payload/src/hooks.h"
+#include "../../Payload/src/platform.h"
+#include "../../Payload/src/minhook/include/MinHook.h"
+
+
+/*
+* What payload_main.cpp & HookAll() do on Windows, for preloading the payload into mock_game (or
+* anything else that exports the same functions & globals by name) on Linux:
+*
+*   LD_PRELOAD=./libpayload_preload.so ./mock_game
+*
+* The detours, the tick driver & IPC are the payload's own (detours.cpp, ipc.cpp), the only
+* differences are how the game's functions are found (dlsym() instead of offsets into the exe)
+* and what exiting does: there's no unloading a preloaded library, so the hooks are taken out
+* and the game keeps running without us.
+*/
+
+
+GlobalInfo* g_pInfo = nullptr;
+static bool exit_queued = false;
+static const char* exit_reason = nullptr;
+
+
+void QueueExit(const char* reason) {
+	exit_queued = true;
+	exit_reason = reason;
+}
+
+
+// what the ScriptManager can't do by itself when a script's action runs
+static void OnScriptAction(const TimedAction& action) {
+	if (action.type == TimedAction::Type::Snapshot)
+		g_pInfo->savestates.requestCapture();
+}
+
+
+// what exit_patch.asm does in front of DETOUR_MainLoop__getLimitedDt_Func
+static float DETOUR_getLimitedDt(MainLoop* thisptr) {
+	if (!exit_queued)
+		return hooks::DETOUR_MainLoop__getLimitedDt_Func(thisptr);
+
+	g_pInfo->script_mgr.stopScript(); // must be called before we unhook so we can clear keys
+	g_pInfo->prefetcher.stop();
+	// none of the trampolines are on the stack anymore, so they can go too
+	MH_Uninitialize();
+	if (exit_reason)
+		fprintf(stderr, "payload: %s\n", exit_reason);
+	delete g_pInfo;
+	g_pInfo = nullptr;
+	// no physics this frame, like the asm
+	return 0;
+}
+
+
+// the game's symbols are exported with a single underscore where ours have two
+static void* FindGameSymbol(const char* name) {
+	void* p = dlsym(RTLD_DEFAULT, name);
+	if (!p)
+		fprintf(stderr, "payload: the game doesn't export %s\n", name);
+	return p;
+}
+
+
+static MH_STATUS HookAll() {
+
+	#define FIND_SYMBOL(symbol) ((p = FindGameSymbol(symbol)) != nullptr)
+	#define MH_FAILED(try_func) ((stat = (try_func)) != MH_OK)
+	#define MH_FAILED_HOOK(name, symbol, detour) \
+		(!FIND_SYMBOL(symbol) || MH_FAILED(MH_CreateHook(p, (LPVOID)&detour, (LPVOID*)&hooks::ORIG_##name)))
+
+	void* p;
+	MH_STATUS stat = MH_ERROR_FUNCTION_NOT_FOUND;
+	if (
+		MH_FAILED(MH_Initialize()) ||
+		MH_FAILED_HOOK(InputManager__input,    "InputManager_input",    hooks::DETOUR_InputManager__input) ||
+		MH_FAILED_HOOK(MainLoop__getLimitedDt, "MainLoop_getLimitedDt", DETOUR_getLimitedDt) ||
+		MH_FAILED_HOOK(RaceManager__exitRace,  "RaceManager_exitRace",  hooks::DETOUR_RaceManager__exitRace)
+	) return stat;
+
+
+	// get plain function pointers (not hooks)
+	#define SET_FUNC_PTR(name, symbol) if (FIND_SYMBOL(symbol)) hooks::ORIG_##name = (hooks::_##name)p; else return stat;
+
+	SET_FUNC_PTR(RaceManager__startSingleRace,       "RaceManager_startSingleRace");
+	SET_FUNC_PTR(DeviceManager__getLatestUsedDevice, "DeviceManager_getLatestUsedDevice");
+	SET_FUNC_PTR(StateManager__createActivePlayer,   "StateManager_createActivePlayer");
+	SET_FUNC_PTR(RaceManager__setPlayerKart,         "RaceManager_setPlayerKart");
+	SET_FUNC_PTR(DeviceManager__setAssignMode,       "DeviceManager_setAssignMode");
+	SET_FUNC_PTR(StateManager__resetActivePlayers,   "StateManager_resetActivePlayers");
+
+
+	// the globals (game_state::InitGlobals() on Windows)
+	#define SET_GLOBAL(name) if (FIND_SYMBOL(#name)) hooks::name = (decltype(hooks::name))p; else return stat;
+
+	SET_GLOBAL(g_race_manager);
+	SET_GLOBAL(input_manager);
+	SET_GLOBAL(m_player_manager);
+	SET_GLOBAL(state_manager_singleton);
+	SET_GLOBAL(main_loop);
+	SET_GLOBAL(stk_config);
+	SET_GLOBAL(m_world);
+	SET_GLOBAL(g_is_no_graphics);
+
+
+	#undef FIND_SYMBOL
+	#undef MH_FAILED
+	#undef MH_FAILED_HOOK
+	#undef SET_FUNC_PTR
+	#undef SET_GLOBAL
+
+	// other threads aren't frozen on Linux, which is fine since the game hasn't started any yet
+	return MH_EnableHook(MH_ALL_HOOKS);
+}
+
+
+// Runs before the game's main(), so the hooks are in before it calls any of the functions. The
+// game's own globals aren't constructed yet, we only take their addresses.
+__attribute__((constructor)) static void Main() {
+	g_pInfo = new GlobalInfo(nullptr);
+
+	if (!platform::FindModule(nullptr, &g_mBase, &g_mSize)) {
+		fprintf(stderr, "payload: failed to get module info for the game\n");
+		delete g_pInfo;
+		g_pInfo = nullptr;
+		return;
+	}
+	g_pInfo->savestates.setGameModule(g_mBase, g_mSize);
+	g_pInfo->state_hasher.setModule((const char*)g_mBase);
+	// our own state is in the game's heap, it shouldn't go back in time with the game
+	g_pInfo->savestates.preserve(g_pInfo, sizeof(GlobalInfo));
+	// and neither should our own threads
+	g_pInfo->savestates.skipStack(g_pInfo->prefetcher.stackAddress());
+	g_pInfo->script_mgr.setActionHandler(&OnScriptAction);
+	g_pInfo->script_mgr.setModule((const char*)g_mBase, g_mSize);
+
+	// the game's data dir is next to its exe
+	char data_dir[PATH_MAX];
+	ssize_t exe_len = readlink("/proc/self/exe", data_dir, sizeof(data_dir) - 1);
+	char* exe_name = exe_len > 0 ? (data_dir[exe_len] = '\0', strrchr(data_dir, '/')) : nullptr;
+	if (exe_name && (size_t)(exe_name + 1 - data_dir) + sizeof("data") <= sizeof(data_dir)) {
+		strcpy(exe_name + 1, "data");
+		g_pInfo->prefetcher.setDataDir(data_dir);
+	}
+
+	const char* ipcFailReason = nullptr;
+	g_pInfo->ipc.init(ipcFailReason);
+	if (ipcFailReason) {
+		fprintf(stderr, "payload: %s\n", ipcFailReason);
+		delete g_pInfo;
+		g_pInfo = nullptr;
+		return;
+	}
+
+	if (HookAll() != MH_OK) {
+		fprintf(stderr, "payload: failed to hook one or more functions\n");
+		MH_Uninitialize();
+		delete g_pInfo;
+		g_pInfo = nullptr;
+	}
+}
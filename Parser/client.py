@@ -20,6 +20,12 @@ class MessageType(Enum):
     # 0-255 range
     Script = 0  # we're sending a TAS script
     Unload = 1  # we're telling the payload to rid itself
+    Stats = 2   # we want the payload to send back its stats
+    Scan = 3    # a memory scanner command, see scan.py
+    PointerScan = 4  # a pointer scanner command, see pointer_scan.py
+    SaveState = 5    # a savestate command, see savestate.py
+    StateHash = 6    # a state hashing command, see state_hash.py
+    Record = 7       # an input recording command, see record.py
 
 
 addr = ("127.0.0.1", 27015)  # IPC connection address
@@ -77,7 +83,7 @@ class ClientSocket:
         # Send the length of the full message as four bytes, then the message type,
         # then the full message, data is sent in host endian.
         msg = struct.pack('iB', len(msg) + 1, m_type.value) + msg
-        self.client_socket.send(msg)
+        self.client_socket.sendall(msg)
 
     def recv(self) -> bytes:
         """retrieves a message from the server
@@ -89,9 +95,23 @@ class ClientSocket:
         bytes() -- a bytes object containing the message sent by the server
         """
         # first 4 bytes should be msg_len
-        msg_len = struct.unpack("i", self.client_socket.recv(4))[0]
-        msg = self.client_socket.recv(msg_len)
-        if len(msg) != msg_len:
-            print("Error: Invalid message received from server")
-            exit(1)
+        msg_len = struct.unpack("i", self.recv_exactly(4))[0]
+        return self.recv_exactly(msg_len)
+
+    def recv_exactly(self, size: int) -> bytes:
+        """retrieves exactly size bytes from the server, big messages arrive in pieces
+
+        Keyword arguments:
+        size -- the number of bytes
+
+        Return:
+        bytes() -- the bytes
+        """
+        msg = b''
+        while len(msg) < size:
+            chunk = self.client_socket.recv(size - len(msg))
+            if not chunk:
+                print("Error: Invalid message received from server")
+                exit(1)
+            msg += chunk
         return msg
@@ -16,6 +16,7 @@ import os
 from typing import List, Tuple, Callable
 
 from client import ClientSocket, MessageType
+from predicate import Compiler, CompileError, Field, MAX_TICK_INSTRS
 
 class Framebulk:
 
@@ -26,14 +27,19 @@ class Framebulk:
         FLAG_NITRO     = 1 << 3
         FLAG_SKID      = 1 << 4
         FLAG_SET_SPEED = 1 << 5
+        FLAG_UNTIL     = 1 << 6
+        FLAG_RULE      = 1 << 7
 
-        def __init__(self, accel=False, decel=False, ability=False, nitro=False, skid=False, set_speed=False):
+        def __init__(self, accel=False, decel=False, ability=False, nitro=False, skid=False, set_speed=False,
+                     until=False, rule=False):
             self.accel = accel
             self.decel = decel
             self.ability = ability
             self.nitro = nitro
             self.skid = skid
             self.set_speed = set_speed
+            self.until = until
+            self.rule = rule
 
         @classmethod
         def from_script(cls, fields: List[str]):
@@ -47,6 +53,22 @@ class Framebulk:
             misc = fields[1]
             return cls(acc[0] == 'a', acc[1] == 'b', misc[0] == 'f', misc[1] == 'n', misc[2] == 's')
 
+        @classmethod
+        def from_int(cls, bits: int):
+            """The opposite of to_int
+
+            Keyword arguments:
+            bits -- the flags as they're sent to the payload
+            """
+            return cls(bool(bits & cls.FLAG_ACCEL), bool(bits & cls.FLAG_BREAK), bool(bits & cls.FLAG_ABILITY),
+                       bool(bits & cls.FLAG_NITRO), bool(bits & cls.FLAG_SKID), bool(bits & cls.FLAG_SET_SPEED),
+                       bool(bits & cls.FLAG_UNTIL), bool(bits & cls.FLAG_RULE))
+
+        def to_script(self) -> List[str]:
+            """The first two fields of a framebulk line, the opposite of from_script"""
+            return [('a' if self.accel else '-') + ('b' if self.decel else '-'),
+                    ('f' if self.ability else '-') + ('n' if self.nitro else '-') + ('s' if self.skid else '-')]
+
         def to_int(self) -> int:
             """
             """
@@ -69,6 +91,10 @@ class Framebulk:
                 field_bits |= self.FLAG_SKID
             if self.set_speed:
                 field_bits |= self.FLAG_SET_SPEED
+            if self.until:
+                field_bits |= self.FLAG_UNTIL
+            if self.rule:
+                field_bits |= self.FLAG_RULE
 
             return field_bits
 
@@ -80,19 +106,42 @@ class Framebulk:
         def __repr__(self) -> str:
             return repr(self.__dict__)
 
-    def __init__(self, num_ticks: int, angle: float, flags: Flags):
+    # the buttons that a rule can press, and the steering it can set
+    RULE_BUTTONS = {'accel', 'brake', 'fire', 'nitro', 'skid'}
+    RULE_STEERING = {'left': -1.0, 'right': 1.0}
+
+    def __init__(self, num_ticks: int, angle: float, flags: Flags, program: int = 0):
         self.num_ticks = num_ticks
         self.angle = angle
         self.flags = flags
+        self.program = program  # the condition of an until or rule framebulk
 
     @classmethod
-    def from_script(cls, line: str, line_num: int):
+    def from_script(cls, line: str, line_num: int, compiler: Compiler = None):
         """Converts framebulk into bytes
 
         Keyword arguments:
         str -- the line for the framebulk which this method is converting to bytes
         int -- the line number for the specific line
+        compiler -- compiles the conditions of 'until' and 'when' lines
         """
+        compiler = compiler or Compiler()
+        try:
+            if line.split(' ', 1)[0] == KW_WHEN:
+                return cls.rule_from_script(line, compiler)
+            if f' {KW_UNTIL} ' in line:
+                # a framebulk that ends early once the condition is true, its ticks are the most it can take
+                line, condition = line.split(f' {KW_UNTIL} ', 1)
+                fb = cls.from_script(line, line_num)
+                if fb.flags.set_speed or fb.num_ticks <= 0:
+                    raise CompileError(f"'{KW_UNTIL}' needs a framebulk with ticks")
+                fb.flags.until = True
+                fb.program = compiler.compile(condition)
+                return fb
+        except CompileError as e:
+            print(f"Warning: Error parsing condition (line {line_num}): {e}. Exiting...")
+            exit(1)
+
         # https://stackoverflow.com/questions/12643009/regular-expression-for-floating-point-numbers
         playspeed_re = define_field(
             KW_PLAYSPEED,
@@ -117,7 +166,45 @@ class Framebulk:
         """Turns itself into bytes using the flags attribute as 
         well as number of ticks and angle
         """
-        return struct.pack('hhf', self.flags.to_int(), self.num_ticks, self.angle)
+        return struct.pack('Hhf', self.flags.to_int() | self.program << 8, self.num_ticks, self.angle)
+
+    @classmethod
+    def decode(cls, data: bytes, offset: int = 0):
+        """The opposite of encode, e.g. for framebulks recorded by the payload
+
+        Keyword arguments:
+        data -- bytes with an encoded framebulk in them
+        offset -- where the framebulk starts
+        """
+        flags, num_ticks, angle = struct.unpack_from('<Hhf', data, offset)
+        return cls(num_ticks, angle, Framebulk.Flags.from_int(flags & 0xff), flags >> 8)
+
+    @classmethod
+    def rule_from_script(cls, line: str, compiler: Compiler):
+        """Parses 'when <condition> -> <buttons>', which presses the buttons (accel, brake, fire,
+        nitro, skid) and steers (left, right) on top of the framebulks on every tick that the
+        condition is true, or 'when off', which stops all of the rules that were started before it
+        """
+        if line == f'{KW_WHEN} off':
+            return cls(0, 0.0, Framebulk.Flags(rule=True), RULE_CLEAR)
+        if ' -> ' not in line:
+            raise CompileError(f"expected '{KW_WHEN} <condition> -> <buttons>' or '{KW_WHEN} off'")
+        condition, outputs = line[len(KW_WHEN):].split(' -> ', 1)
+        buttons = outputs.split()
+        unknown = set(buttons) - cls.RULE_BUTTONS - cls.RULE_STEERING.keys()
+        if unknown or not buttons:
+            raise CompileError(f"a rule can press {', '.join(sorted(cls.RULE_BUTTONS | cls.RULE_STEERING.keys()))}")
+        flags = Framebulk.Flags('accel' in buttons, 'brake' in buttons, 'fire' in buttons, 'nitro' in buttons,
+                                'skid' in buttons, rule=True)
+        angle = sum(cls.RULE_STEERING.get(b, 0.0) for b in buttons)
+        return cls(0, angle, flags, compiler.compile(condition))
+
+    def to_script(self) -> str:
+        """Turns itself into a line for a .peng file, the opposite of from_script"""
+        angle = int(self.angle) if self.angle.is_integer() else self.angle
+        if self.flags.set_speed:
+            return f"{KW_PLAYSPEED} {angle}"
+        return '|'.join(self.flags.to_script() + [str(angle), str(self.num_ticks)]) + '|'
 
     def __eq__(self, __o: object) -> bool:
         if type(__o) != Framebulk:
@@ -127,6 +214,98 @@ class Framebulk:
     def __repr__(self) -> str:
         return repr(self.__dict__)
 
+class TimedAction:
+    """Something the payload does at an absolute tick (ticks since the map was loaded), written as
+    'at <tick> <action> [value]' among the framebulks, e.g. 'at 600 speed 4' or 'at 1200 marker 3'
+    """
+
+    TYPE_MARKER    = 0
+    TYPE_SET_SPEED = 1
+    TYPE_SNAPSHOT  = 2
+    TYPE_STOP      = 3
+
+    # action name in the script -> type, and whether it takes a value
+    NAMES = {
+        'marker':   (TYPE_MARKER, True),
+        'speed':    (TYPE_SET_SPEED, True),
+        'snapshot': (TYPE_SNAPSHOT, False),
+        'stop':     (TYPE_STOP, False),
+    }
+
+    def __init__(self, tick: int, action_type: int, value=0):
+        self.tick = tick
+        self.type = action_type
+        self.value = value
+
+    @classmethod
+    def from_script(cls, line: str, line_num: int):
+        """Parses an 'at' line
+
+        Keyword arguments:
+        line -- the line, starting with 'at'
+        line_num -- the line number for error messages
+        """
+        fields = line.split()
+        try:
+            action_type, has_value = cls.NAMES[fields[2]]
+            if len(fields) != (4 if has_value else 3):
+                raise ValueError
+            tick = int(fields[1])
+            if not 0 <= tick <= 0xffffffff:
+                raise ValueError
+            if action_type == cls.TYPE_SET_SPEED:
+                value = float(fields[3])
+            elif has_value:
+                value = int(fields[3])
+                if not 0 <= value <= 0xffffffff:
+                    raise ValueError
+            else:
+                value = 0
+        except (IndexError, KeyError, ValueError):
+            print(f"Warning: Error parsing action (line {line_num}), expected "
+                  f"'{KW_AT} <tick> <{'|'.join(cls.NAMES)}> [value]'. Exiting...")
+            exit(1)
+        return cls(tick, action_type, value)
+
+    def encode(self) -> bytes:
+        """Turns itself into the 12 bytes that the payload reads"""
+        value = struct.pack('<f' if self.type == self.TYPE_SET_SPEED else '<I', self.value)
+        return struct.pack('<IB3x', self.tick, self.type) + value
+
+    def __eq__(self, __o: object) -> bool:
+        if type(__o) != TimedAction:
+            return False
+        return self.__dict__ == __o.__dict__
+
+    def __repr__(self) -> str:
+        return repr(self.__dict__)
+
+
+class RepeatBlock:
+    """Framebulks that run count times in a row, written as 'repeat <count>' before them and 'end'
+    after them. Blocks can be nested. The payload goes back to the start of a block at its end
+    instead of getting it expanded, so a script's size stays proportional to what was written.
+    """
+
+    MAX_DEPTH = 8  # mirrors ScriptManager::MAX_REPEAT_DEPTH
+
+    def __init__(self, first_fb: int, end_fb: int, count: int):
+        self.first_fb = first_fb  # index of the first framebulk in the block
+        self.end_fb = end_fb      # one past the last one
+        self.count = count
+
+    def encode(self) -> bytes:
+        """Turns itself into the 12 bytes that the payload reads"""
+        return struct.pack('<III', self.first_fb, self.end_fb, self.count)
+
+    def __eq__(self, __o: object) -> bool:
+        if type(__o) != RepeatBlock:
+            return False
+        return self.__dict__ == __o.__dict__
+
+    def __repr__(self) -> str:
+        return repr(self.__dict__)
+
 # header keywords
 KW_MAP         = 'map'
 KW_KART_NAME   = 'kart_name'
@@ -134,6 +313,8 @@ KW_NUM_LAPS    = 'num_laps'
 KW_DIFFICULTY  = 'difficulty'
 KW_NUM_AI      = 'num_ai_karts'
 KW_QUICK_RESET = 'quick_reset'
+KW_DURATION    = 'duration'
+KW_SEED        = 'seed'
 
 # maps that can be loaded
 MAP_NAMES = {
@@ -187,6 +368,23 @@ KART_NAMES = {
 # framebulk keywords
 KW_HEADER_END = 'framebulks'
 KW_PLAYSPEED  = 'playspeed'
+KW_AT         = 'at'
+KW_UNTIL      = 'until'
+KW_WHEN       = 'when'
+KW_FIELD      = 'field'
+KW_REPEAT     = 'repeat'
+KW_END        = 'end'
+
+# the program of a rule framebulk that clears all rules
+RULE_CLEAR = 255
+
+# bits of the last byte of the header
+HEADER_FLAG_QUICK_RESET = 1
+HEADER_FLAG_HAS_ACTIONS = 2
+HEADER_FLAG_HAS_PROGRAMS = 4
+HEADER_FLAG_HAS_REPEATS = 8
+HEADER_FLAG_HAS_DURATION = 32
+HEADER_FLAG_HAS_SEED = 64
 
 
 def define_field(key: str, pattern: str = r'[^\s\'"]+') -> str:
@@ -197,21 +395,44 @@ def define_field(key: str, pattern: str = r'[^\s\'"]+') -> str:
     return rf"""^{key}(?:\s+|\s*[:=]\s*)(?:"(?={pattern}")|'(?={pattern}'))?(?P<{key}>{pattern})['"]?$"""
 
 
-def encode_header(fields_dict: dict) -> bytes:
+def encode_header(fields_dict: dict, has_actions: bool = False, has_programs: bool = False,
+                  has_repeats: bool = False) -> bytes:
     """Converts a dictionary representing fields into bytes
 
     Keyword arguments:
     dictionary -- dictionary containing information on the fields of a framebulk
+    has_actions -- whether encoded actions come after the header
+    has_programs -- whether encoded programs come after the actions
+    has_repeats -- whether encoded repeat blocks come after the programs
     """
+    flags = HEADER_FLAG_QUICK_RESET if fields_dict[KW_QUICK_RESET] else 0
+    if has_actions:
+        flags |= HEADER_FLAG_HAS_ACTIONS
+    if has_programs:
+        flags |= HEADER_FLAG_HAS_PROGRAMS
+    if has_repeats:
+        flags |= HEADER_FLAG_HAS_REPEATS
+    # the duration comes right after the flags, if there is one
+    duration = b''
+    if fields_dict.get(KW_DURATION):
+        flags |= HEADER_FLAG_HAS_DURATION
+        duration = struct.pack('<f', fields_dict[KW_DURATION])
+    # then the seed, if there is one
+    seed = b''
+    if fields_dict.get(KW_SEED) is not None:
+        flags |= HEADER_FLAG_HAS_SEED
+        seed = struct.pack('<I', fields_dict[KW_SEED])
     return (
         fields_dict[KW_MAP].encode('utf-8') + b'\x00' +
         fields_dict[KW_KART_NAME].encode('utf-8') + b'\x00' +
-        struct.pack('3ic',
+        struct.pack('3iB',
             fields_dict[KW_NUM_AI],
             fields_dict[KW_NUM_LAPS],
             fields_dict[KW_DIFFICULTY],
-            b'\x01' if fields_dict[KW_QUICK_RESET] else b'\x00'
-        )
+            flags
+        ) +
+        duration +
+        seed
     )
 
 
@@ -230,12 +451,14 @@ def parse_header(lines: List[Tuple[int, str]]) -> dict:
         define_field(KW_DIFFICULTY),
         define_field(KW_NUM_AI),
         define_field(KW_QUICK_RESET),
+        define_field(KW_DURATION),
+        define_field(KW_SEED),
     ))
 
     fields_dict = {}
 
     # go through each line and add any header field values to the dict
-    for m, line_num, line in ((re.match(header_fields_regex, line[1]), *line) for line in lines if line):
+    for m, line_num, line in ((re.match(header_fields_regex, line[1]), *line) for line in lines if line and not is_field(line[1])):
         if m:
             for k, v in m.groupdict().items():
                 if v is not None:
@@ -306,6 +529,20 @@ def parse_header(lines: List[Tuple[int, str]]) -> dict:
         print(f"Invalid value '{fields_dict[KW_QUICK_RESET]}' for key '{KW_QUICK_RESET}', expected boolean.")
         exit(1)
 
+    # duration is optional, it's the seconds that the script should take (0 goes by its playspeeds)
+    if KW_DURATION not in fields_dict:
+        fields_dict[KW_DURATION] = '0'
+    if not validate_field(KW_DURATION, lambda s: float(s), lambda d: d >= 0):
+        print(f"Invalid value '{fields_dict[KW_DURATION]}' for key '{KW_DURATION}', should be a number of seconds.")
+        exit(1)
+
+    # seed is optional, without one the game seeds its random numbers with the time like it normally does
+    if KW_SEED not in fields_dict:
+        fields_dict[KW_SEED] = None
+    elif not validate_field(KW_SEED, lambda s: int(s, 0), lambda n: 0 <= n < 2**32):
+        print(f"Invalid value '{fields_dict[KW_SEED]}' for key '{KW_SEED}', should be an integer from 0 to {2**32 - 1}.")
+        exit(1)
+
     # map + kart_name + int(num_ai) + int(num_laps) + int(difficulty) + byte(quick_reset)
     return fields_dict
 
@@ -321,22 +558,134 @@ def encode_framebulks(framebulks: List[Framebulk]) -> bytes:
     return fb_bytes
 
 
-def parse_framebulks(lines: List[Tuple[int, str]]) -> List[Framebulk]:
+def encode_actions(actions: List[TimedAction]) -> bytes:
+    """Converts a list of actions into bytes, nothing if there's none
+
+    Keyword arguments:
+    actions -- list of TimedAction objects
+    """
+    if not actions:
+        return b''
+    return struct.pack('<I', len(actions)) + b''.join(action.encode() for action in actions)
+
+
+def encode_repeats(repeats: List[RepeatBlock]) -> bytes:
+    """Converts a list of repeat blocks into bytes, nothing if there's none
+
+    Keyword arguments:
+    repeats -- list of RepeatBlock objects, outer blocks before the ones in them
+    """
+    if not repeats:
+        return b''
+    return struct.pack('<I', len(repeats)) + b''.join(repeat.encode() for repeat in repeats)
+
+
+def is_action(line: str) -> bool:
+    return line.split(' ', 1)[0] == KW_AT
+
+
+def is_repeat(line: str) -> bool:
+    return line.split(' ', 1)[0] == KW_REPEAT or line == KW_END
+
+
+def is_field(line: str) -> bool:
+    return line.split(' ', 1)[0] == KW_FIELD
+
+
+def parse_fields(lines: List[Tuple[int, str]]) -> List[Field]:
+    """Parse the 'field' lines of the header, the game state that conditions can use
+
+    Keyword arguments:
+    lines -- all lines in the script before the 'frames' keyword
+    """
+    fields = []
+    for line_num, line in lines:
+        if is_field(line):
+            try:
+                fields.append(Field.from_script(line))
+            except CompileError as e:
+                print(f"Warning: Error parsing field (line {line_num}): {e}. Exiting...")
+                exit(1)
+    return fields
+
+
+def parse_framebulks(lines: List[Tuple[int, str]], compiler: Compiler = None) -> List[Framebulk]:
     """Parse script framebulks and convert to bytes
 
     Keyword arguments:
     lines -- all lines in the script after the 'frames' keyword,
     these lines are assumed to have no leading/trailing whitespace
+    compiler -- compiles the conditions in the framebulks, and keeps the programs for encoding
     """
 
     framebulks = []
+    compiler = compiler or Compiler()
 
     for line_num, line in lines:
-        framebulks.append(Framebulk.from_script(line, line_num))
+        if not is_action(line) and not is_repeat(line):
+            framebulks.append(Framebulk.from_script(line, line_num, compiler))
 
     return framebulks
 
 
+def parse_repeats(lines: List[Tuple[int, str]], framebulks: List[Framebulk]) -> List[RepeatBlock]:
+    """Parse the 'repeat <count>' & 'end' lines among the framebulks, the blocks are sorted the way
+    the payload wants them: by their first framebulk, and outer blocks before the ones in them
+
+    Keyword arguments:
+    lines -- all lines in the script after the 'frames' keyword,
+    these lines are assumed to have no leading/trailing whitespace
+    framebulks -- the framebulks from parse_framebulks(lines)
+    """
+    repeats = []
+    open_blocks = []  # (line number, first framebulk, count)
+    order = {}        # block -> line number, for blocks that cover the same framebulks
+    fb_idx = 0
+    for line_num, line in lines:
+        if is_action(line):
+            if open_blocks:
+                print(f"Warning: '{KW_AT}' lines can't be in a repeat block (line {line_num}), "
+                      f"their tick is the same every time. Exiting...")
+                exit(1)
+        elif line == KW_END:
+            if not open_blocks:
+                print(f"Warning: '{KW_END}' without a '{KW_REPEAT}' (line {line_num}). Exiting...")
+                exit(1)
+            start_line, first_fb, count = open_blocks.pop()
+            # an until framebulk can end before its first tick
+            if not any(fb.num_ticks > 0 and not fb.flags.until for fb in framebulks[first_fb:fb_idx]):
+                print(f"Warning: The repeat block on line {start_line} needs a framebulk with ticks. Exiting...")
+                exit(1)
+            repeats.append(RepeatBlock(first_fb, fb_idx, count))
+            order[id(repeats[-1])] = start_line
+        elif is_repeat(line):
+            fields = line.split()
+            if len(fields) != 2 or not fields[1].isdigit() or not 1 <= int(fields[1]) <= 0xffffffff:
+                print(f"Warning: Error parsing repeat (line {line_num}), expected '{KW_REPEAT} <count>'. Exiting...")
+                exit(1)
+            if len(open_blocks) == RepeatBlock.MAX_DEPTH:
+                print(f"Warning: Repeat blocks can only be nested {RepeatBlock.MAX_DEPTH} deep (line {line_num}). Exiting...")
+                exit(1)
+            open_blocks.append((line_num, fb_idx, int(fields[1])))
+        else:
+            fb_idx += 1
+    if open_blocks:
+        print(f"Warning: The repeat block on line {open_blocks[-1][0]} has no '{KW_END}'. Exiting...")
+        exit(1)
+    # blocks end inner first, but they have to start outer first
+    return sorted(repeats, key=lambda r: (r.first_fb, -r.end_fb, order[id(r)]))
+
+
+def parse_actions(lines: List[Tuple[int, str]]) -> List[TimedAction]:
+    """Parse the 'at' lines among the framebulks, in the order they're in
+
+    Keyword arguments:
+    lines -- all lines in the script after the 'frames' keyword,
+    these lines are assumed to have no leading/trailing whitespace
+    """
+    return [TimedAction.from_script(line, line_num) for line_num, line in lines if is_action(line)]
+
+
 def parse_script(tas_file: str) -> bytes:
     """parse TAS file
 
@@ -363,37 +712,63 @@ def parse_script(tas_file: str) -> bytes:
         exit(1)
 
     header = parse_header(lines[:header_end_idx])
-    framebulks = parse_framebulks(lines[header_end_idx+1:])
+    try:
+        compiler = Compiler(parse_fields(lines[:header_end_idx]))
+    except CompileError as e:
+        print(f"Warning: {e}. Exiting...")
+        exit(1)
+    framebulks = parse_framebulks(lines[header_end_idx+1:], compiler)
+    repeats = parse_repeats(lines[header_end_idx+1:], framebulks)
+    tick_instrs = compiler.tick_instrs([fb.program for fb in framebulks if fb.flags.until],
+                                       [fb.program for fb in framebulks if fb.flags.rule and fb.program != RULE_CLEAR])
+    if tick_instrs > MAX_TICK_INSTRS:
+        print(f"Warning: The conditions can take {tick_instrs} instructions in one tick, "
+              f"at most {MAX_TICK_INSTRS} are allowed. Exiting...")
+        exit(1)
+    actions = parse_actions(lines[header_end_idx+1:])
+    programs = compiler.encode() if compiler.programs else b''
 
-    return encode_header(header) + encode_framebulks(framebulks)
+    return (encode_header(header, bool(actions), bool(programs), bool(repeats)) + encode_actions(actions) + programs +
+            encode_repeats(repeats) + encode_framebulks(framebulks))
 
 
-def get_script_path() -> str:
-    """Parses command line arguments and retrieves a path. 
-    If no path is given then the default path is used instead.
+def get_args() -> argparse.Namespace:
+    """Parses command line arguments. If no script path is given
+    then the default path is used instead.
 
     Return:
-    str -- String representing the path to the TAS script to be parsed
+    argparse.Namespace -- 'path' is the path to the TAS script to be parsed,
+    'output' is the file to write the encoded script to (or None)
     """
     default = "./scripts/tasfile.peng"
     parser = argparse.ArgumentParser()
     parser.add_argument('-p', '--path', type=str)
+    parser.add_argument('-o', '--output', type=str,
+                        help='write the encoded script to this file instead of sending it to the game')
     args = parser.parse_args()
     if args.path is None:
         print(f"Notice: No path given. Using default path: '{default}'")
-        return default
-    return args.path
+        args.path = default
+    return args
 
 
 def main():
     # Get path to TAS script
-    tas_script_path = get_script_path()
+    args = get_args()
+    tas_script_path = args.path
     path = pathlib.Path(tas_script_path)
     if not path.is_file():
         print("Error: File does not exist. Exiting...")
         exit(-1)
     script_bytes = parse_script(tas_script_path)
 
+    # the simulator reads scripts in the same format that we send over IPC
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(script_bytes)
+        print(f"Wrote encoded script to {args.output}")
+        return
+
     # run the injector exe
 
     inj_name = "Injector.exe"
@@ -0,0 +1,135 @@
+# =================================================
+# Finds pointer chains from supertuxkart.exe to an
+# address (e.g. one found with scan.py), so that the
+# same object can be found again after it moves.
+#
+#   pointer_scan.py find 0x1f3a2b40
+#   (restart the game / race, find the object again)
+#   pointer_scan.py check 0x2c81e0f0
+#
+# Chains are cached in pointer_chains.txt as hex,
+# one per line: module offset, then the offsets.
+# 'check' keeps only the chains that still lead to
+# the new address, so each session narrows them down.
+# =================================================
+
+import argparse
+import struct
+from client import ClientSocket, MessageType
+
+CMD_FIND, CMD_CHECK = range(2)
+MAX_DEPTH = 7  # same as PointerScanner::MAX_DEPTH
+
+
+def pack_find_msg(target: int, max_depth: int, max_offset: int, max_chains: int) -> bytes:
+    """packs a find command in the format that the payload expects
+
+    Keyword arguments:
+    target -- the address to find chains to
+    max_depth -- the max number of pointers in a chain
+    max_offset -- the max offset from where a pointer points to the next address
+    max_chains -- the max number of chains to send back
+
+    Return:
+    bytes() -- the message to send with MessageType.PointerScan
+    """
+    return struct.pack('<BBIIQ', CMD_FIND, max_depth, max_offset, max_chains, target)
+
+
+def pack_check_msg(chains: list) -> bytes:
+    """packs a check command in the format that the payload expects
+
+    Keyword arguments:
+    chains -- a list of chains, each is a list of the module offset then the offsets
+
+    Return:
+    bytes() -- the message to send with MessageType.PointerScan
+    """
+    msg = struct.pack('<BI', CMD_CHECK, len(chains))
+    for chain in chains:
+        msg += struct.pack(f'<II{len(chain) - 1}I', chain[0], len(chain) - 1, *chain[1:])
+    return msg
+
+
+def parse_chain(text: str) -> list:
+    """parses a chain written as hex numbers separated by spaces
+
+    Keyword arguments:
+    text -- the chain, e.g. "c87100 30 0 1a0"
+
+    Return:
+    list() -- the module offset then the offsets
+    """
+    chain = [int(x, 16) for x in text.split()]
+    if not 2 <= len(chain) <= MAX_DEPTH + 1:
+        raise ValueError(f"bad chain '{text}'")
+    return chain
+
+
+def parse_find_reply(reply: str) -> list:
+    """extracts the chains from the "chain ..." lines of the payload's reply to a find command"""
+    return [parse_chain(line[len("chain "):]) for line in reply.splitlines() if line.startswith("chain ")]
+
+
+def format_chain(chain: list) -> str:
+    return " ".join(f"{x:x}" for x in chain)
+
+
+def read_cache(path: str) -> list:
+    with open(path) as f:
+        return [parse_chain(line) for line in f if line.strip() and not line.startswith('#')]
+
+
+def write_cache(path: str, chains: list) -> None:
+    with open(path, 'w') as f:
+        f.write("# supertuxkart.exe offset, then the offset after each pointer (hex)\n")
+        for chain in chains:
+            f.write(format_chain(chain) + "\n")
+
+
+def send(msg: bytes) -> str:
+    sock = ClientSocket()
+    sock.start()
+    sock.send(msg, MessageType.PointerScan)
+    return sock.recv().decode('utf-8')
+
+
+def main():
+    arg_parser = argparse.ArgumentParser(description="Finds pointer chains from supertuxkart.exe to an address")
+    arg_parser.add_argument("-c", "--cache", default="pointer_chains.txt", help="where chains are cached between sessions")
+    commands = arg_parser.add_subparsers(dest="command", required=True)
+    find = commands.add_parser("find", help="find chains to an address and replace the cache with them")
+    find.add_argument("address", type=lambda x: int(x, 0))
+    find.add_argument("-d", "--depth", type=int, default=5, help=f"max pointers in a chain (up to {MAX_DEPTH})")
+    find.add_argument("-o", "--offset", type=lambda x: int(x, 0), default=0x1000, help="max offset after each pointer")
+    find.add_argument("-n", "--count", type=int, default=200, help="max number of chains (up to 1000)")
+    check = commands.add_parser("check", help="follow the cached chains, and drop the ones that don't reach the address")
+    check.add_argument("address", type=lambda x: int(x, 0), nargs='?')
+    args = arg_parser.parse_args()
+
+    if args.command == "find":
+        if not 1 <= args.depth <= MAX_DEPTH:
+            arg_parser.error(f"depth must be between 1 and {MAX_DEPTH}")
+        reply = send(pack_find_msg(args.address, args.depth, args.offset, args.count))
+        print(reply, end='')
+        write_cache(args.cache, parse_find_reply(reply))
+        return
+
+    chains = read_cache(args.cache)
+    if not chains:
+        print(f"No chains in '{args.cache}'")
+        return
+    reply = send(pack_check_msg(chains))
+    results = [line.split()[2] for line in reply.splitlines()]
+    kept = []
+    for chain, result in zip(chains, results):
+        print(f"{format_chain(chain):40} -> {result}")
+        if args.address is None or result != "none" and int(result, 16) == args.address:
+            kept.append(chain)
+    if args.address is not None:
+        print(f"{len(kept)}/{len(chains)} chains lead to {args.address:#x}")
+        write_cache(args.cache, kept)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,243 @@
+# ==================================
+# Compiles the conditions in reactive scripts (e.g.
+# 'skid until speed > 20') into programs for the
+# payload's predicate VM, see predicate_vm.h.
+#
+# Conditions are Python-like expressions over the
+# fields declared in the header, 'tick' (ticks since
+# the map was loaded) and 'fb_tick' (ticks since the
+# framebulk started):
+#   numbers, + - * /, < <= == != > >=, and or not,
+#   abs(x), min(a, b), max(a, b)
+# A field that can't be read (e.g. while the map is
+# loading) is NaN, which makes any comparison false.
+# ==================================
+
+import ast
+import struct
+from typing import Dict, List
+
+# mirrors PredicateVM::Op
+OP_LOAD_CONST = 0
+OP_LOAD_FIELD = 1
+OP_LOAD_TICK  = 2
+OP_MOV        = 3
+OP_ADD        = 4
+OP_SUB        = 5
+OP_MUL        = 6
+OP_DIV        = 7
+OP_MIN        = 8
+OP_MAX        = 9
+OP_ABS        = 10
+OP_NEG        = 11
+OP_NOT        = 12
+OP_LT         = 13
+OP_LE         = 14
+OP_EQ         = 15
+OP_NE         = 16
+OP_AND        = 17
+OP_OR         = 18
+OP_RET        = 19
+
+# mirrors PredicateVM::FieldType
+FIELD_TYPES = {'f32': 0, 'f64': 1, 'i32': 2, 'u32': 3, 'i16': 4, 'u16': 5, 'i8': 6, 'u8': 7}
+
+NUM_REGS     = 16
+MAX_INSTRS   = 256
+MAX_FIELDS   = 64
+MAX_PROGRAMS = 255
+MAX_DEPTH    = 7
+# the most instructions that the conditions of one tick can add up to: the longest 'until' plus
+# the MAX_RULES longest rules (mirrors PredicateVM::MAX_TICK_INSTRS & ScriptManager::MAX_RULES)
+MAX_TICK_INSTRS = 256
+MAX_RULES       = 8
+
+BUILTINS = {'tick': 0, 'fb_tick': 1}
+CONSTANTS = {'true': 1.0, 'false': 0.0}
+
+BIN_OPS = {ast.Add: OP_ADD, ast.Sub: OP_SUB, ast.Mult: OP_MUL, ast.Div: OP_DIV}
+CMP_OPS = {ast.Lt: OP_LT, ast.LtE: OP_LE, ast.Eq: OP_EQ, ast.NotEq: OP_NE}
+# a > b is b < a
+SWAPPED_CMP_OPS = {ast.Gt: OP_LT, ast.GtE: OP_LE}
+CALLS = {'abs': (OP_ABS, 1), 'min': (OP_MIN, 2), 'max': (OP_MAX, 2)}
+
+
+class CompileError(Exception):
+    pass
+
+
+class Field:
+    """Some game state at the end of a pointer chain, declared in the header as
+    'field <name> <type> <module offset> [offsets...]' (hex, like in pointer_chains.txt)
+    """
+
+    def __init__(self, name: str, type_name: str, chain: List[int]):
+        self.name = name
+        self.type_name = type_name
+        self.chain = chain
+
+    @classmethod
+    def from_script(cls, line: str):
+        """Parses a 'field' line, raises CompileError if it's malformed
+
+        Keyword arguments:
+        line -- the line, starting with 'field'
+        """
+        fields = line.split()
+        if len(fields) < 4:
+            raise CompileError("expected 'field <name> <type> <module offset> [offsets...]'")
+        name, type_name = fields[1], fields[2]
+        if not name.isidentifier() or name in BUILTINS or name in CONSTANTS or name in CALLS:
+            raise CompileError(f"'{name}' can't be used as a field name")
+        if type_name not in FIELD_TYPES:
+            raise CompileError(f"unknown field type '{type_name}', expected one of {', '.join(FIELD_TYPES)}")
+        try:
+            chain = [int(x, 16) for x in fields[3:]]
+        except ValueError:
+            raise CompileError("the chain should be hex numbers")
+        if len(chain) > MAX_DEPTH + 1 or any(not 0 <= x <= 0xffffffff for x in chain):
+            raise CompileError(f"chains can have at most {MAX_DEPTH} offsets of 32 bits")
+        return cls(name, type_name, chain)
+
+    def encode(self) -> bytes:
+        return struct.pack(f'<BB2xI{len(self.chain) - 1}I', FIELD_TYPES[self.type_name], len(self.chain) - 1, *self.chain)
+
+
+class Compiler:
+    """Compiles expressions into programs, keeping the fields, constants and programs of a whole
+    script together since that's how the payload gets them
+    """
+
+    def __init__(self, fields: List[Field] = ()):
+        self.fields: Dict[str, int] = {}
+        self.field_list: List[Field] = []
+        for field in fields:
+            if field.name in self.fields:
+                raise CompileError(f"field '{field.name}' is declared twice")
+            self.fields[field.name] = len(self.field_list)
+            self.field_list.append(field)
+        if len(self.field_list) > MAX_FIELDS:
+            raise CompileError(f"at most {MAX_FIELDS} fields can be declared")
+        self.constants: List[float] = []
+        self.programs: List[List[tuple]] = []
+        self._program_ids: Dict[str, int] = {}
+
+    def compile(self, expr: str) -> int:
+        """Compiles an expression, returns the index of its program (the same expression is only
+        compiled once). Raises CompileError if it can't be compiled.
+
+        Keyword arguments:
+        expr -- the expression
+        """
+        expr = expr.strip()
+        if expr in self._program_ids:
+            return self._program_ids[expr]
+        try:
+            tree = ast.parse(expr, mode='eval')
+        except SyntaxError:
+            raise CompileError(f"can't parse '{expr}'")
+        self._instrs = []
+        reg = self._emit(tree.body, 0)
+        self._instrs.append((OP_RET, reg, 0, 0))
+        if len(self._instrs) > MAX_INSTRS:
+            raise CompileError(f"'{expr}' is too long")
+        if len(self.programs) == MAX_PROGRAMS:
+            raise CompileError(f"a script can have at most {MAX_PROGRAMS} conditions")
+        self.programs.append(self._instrs)
+        self._program_ids[expr] = len(self.programs) - 1
+        return len(self.programs) - 1
+
+    def tick_instrs(self, until_programs: List[int], rule_programs: List[int]) -> int:
+        """The most instructions that one tick's conditions can take, see MAX_TICK_INSTRS
+
+        Keyword arguments:
+        until_programs -- the programs of all 'until' framebulks
+        rule_programs -- the programs of all rules
+        """
+        until = max((len(self.programs[p]) for p in until_programs), default=0)
+        rules = sorted(len(self.programs[p]) for p in rule_programs)
+        return until + sum(rules[-MAX_RULES:])
+
+    def encode(self) -> bytes:
+        """The programs section of a script message, see PredicateVM::measure"""
+        out = struct.pack('<I', len(self.field_list)) + b''.join(f.encode() for f in self.field_list)
+        out += struct.pack(f'<I{len(self.constants)}f', len(self.constants), *self.constants)
+        out += struct.pack('<I', len(self.programs))
+        for instrs in self.programs:
+            out += struct.pack('<I', len(instrs)) + b''.join(struct.pack('<4B', *i) for i in instrs)
+        return out
+
+    def _constant(self, value: float) -> int:
+        # compare the bits so that e.g. 0.0 & -0.0 aren't merged
+        bits = struct.pack('<f', value)
+        for i, c in enumerate(self.constants):
+            if struct.pack('<f', c) == bits:
+                return i
+        if len(self.constants) == 0x10000:
+            raise CompileError("too many constants")
+        self.constants.append(value)
+        return len(self.constants) - 1
+
+    def _emit(self, node: ast.AST, dst: int) -> int:
+        """Emits the instructions to compute node into register dst, registers above dst are free
+        to use. Returns dst.
+        """
+        if dst >= NUM_REGS:
+            raise CompileError("expression is too deeply nested")
+        emit = self._instrs.append
+        if isinstance(node, ast.Constant) and type(node.value) in (int, float):
+            idx = self._constant(float(node.value))
+            emit((OP_LOAD_CONST, dst, idx & 0xff, idx >> 8))
+        elif isinstance(node, ast.Name):
+            if node.id in self.fields:
+                emit((OP_LOAD_FIELD, dst, self.fields[node.id], 0))
+            elif node.id in BUILTINS:
+                emit((OP_LOAD_TICK, dst, BUILTINS[node.id], 0))
+            elif node.id in CONSTANTS:
+                idx = self._constant(CONSTANTS[node.id])
+                emit((OP_LOAD_CONST, dst, idx & 0xff, idx >> 8))
+            else:
+                raise CompileError(f"unknown field '{node.id}'")
+        elif isinstance(node, ast.UnaryOp) and isinstance(node.op, (ast.USub, ast.Not, ast.UAdd)):
+            self._emit(node.operand, dst)
+            if not isinstance(node.op, ast.UAdd):
+                emit((OP_NEG if isinstance(node.op, ast.USub) else OP_NOT, dst, dst, 0))
+        elif isinstance(node, ast.BinOp) and type(node.op) in BIN_OPS:
+            self._binary(BIN_OPS[type(node.op)], node.left, node.right, dst)
+        elif isinstance(node, ast.BoolOp):
+            op = OP_AND if isinstance(node.op, ast.And) else OP_OR
+            self._emit(node.values[0], dst)
+            for value in node.values[1:]:
+                self._emit(value, dst + 1)
+                emit((op, dst, dst, dst + 1))
+        elif isinstance(node, ast.Compare):
+            # a < b < c is (a < b) and (b < c), b is computed again instead of keeping it around
+            left = node.left
+            for i, (cmp, right) in enumerate(zip(node.ops, node.comparators)):
+                out = dst if i == 0 else dst + 1
+                if type(cmp) in CMP_OPS:
+                    self._binary(CMP_OPS[type(cmp)], left, right, out)
+                elif type(cmp) in SWAPPED_CMP_OPS:
+                    self._binary(SWAPPED_CMP_OPS[type(cmp)], right, left, out)
+                else:
+                    raise CompileError("only < <= == != > >= comparisons are supported")
+                if i > 0:
+                    emit((OP_AND, dst, dst, dst + 1))
+                left = right
+        elif isinstance(node, ast.Call) and isinstance(node.func, ast.Name) and node.func.id in CALLS and not node.keywords:
+            op, num_args = CALLS[node.func.id]
+            if len(node.args) != num_args:
+                raise CompileError(f"{node.func.id}() takes {num_args} argument(s)")
+            if num_args == 1:
+                self._emit(node.args[0], dst)
+                emit((op, dst, dst, 0))
+            else:
+                self._binary(op, node.args[0], node.args[1], dst)
+        else:
+            raise CompileError(f"unsupported expression '{ast.dump(node)}'")
+        return dst
+
+    def _binary(self, op: int, left: ast.AST, right: ast.AST, dst: int):
+        self._emit(left, dst)
+        self._emit(right, dst + 1)
+        self._instrs.append((op, dst, dst, dst + 1))
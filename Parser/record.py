@@ -0,0 +1,90 @@
+# =================================================
+# Records someone playing the game as a script.
+#
+#   record.py scripts/abyss.peng -o my_run.peng
+#
+# The script is played first (it loads the map and
+# can play the start of the race), then everything
+# played after it is recorded until Ctrl+C. The
+# output is the script with the recorded framebulks
+# after it, and plays back the same way. Don't pause
+# the game while recording, the ticks keep going.
+# =================================================
+
+import argparse
+import struct
+import time
+from client import ClientSocket, MessageType
+from parser import Framebulk, parse_script
+
+CMD_START, CMD_POLL, CMD_STOP = range(3)
+STATE_IDLE, STATE_ARMED, STATE_RECORDING, STATE_STOPPED = range(4)
+HEADER_FORMAT = '<BBHII'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+FB_SIZE = 8
+POLL_SECS = 0.25
+
+
+def parse_poll_reply(reply: bytes) -> tuple:
+    """splits the payload's reply to a record command
+
+    Keyword arguments:
+    reply -- the reply
+
+    Return:
+    tuple() -- the state, whether the recording overflowed, the ticks recorded, and the framebulks
+    """
+    state, overflowed, _, ticks, count = struct.unpack_from(HEADER_FORMAT, reply)
+    framebulks = [Framebulk.decode(reply, HEADER_SIZE + i * FB_SIZE) for i in range(count)]
+    return state, bool(overflowed), ticks, framebulks
+
+
+def send(msg: bytes) -> tuple:
+    sock = ClientSocket()
+    sock.start()
+    sock.send(msg, MessageType.Record)
+    return parse_poll_reply(sock.recv())
+
+
+def main():
+    arg_parser = argparse.ArgumentParser(description="Records playing the game as a script")
+    arg_parser.add_argument("script", help="the .peng script to play before recording")
+    arg_parser.add_argument("-o", "--output", required=True, help="the .peng file to write")
+    args = arg_parser.parse_args()
+
+    with open(args.script, 'r') as f:
+        prefix = f.read()
+    state, _, _, _ = send(struct.pack('<B', CMD_START) + parse_script(args.script))
+    if state != STATE_ARMED:
+        print("The payload couldn't start recording")
+        return
+
+    with open(args.output, 'w') as out:
+        out.write(prefix.rstrip('\n') + "\n\n// recorded\n")
+        stopping = False
+        last_print = 0.0
+        while True:
+            state, overflowed, ticks, framebulks = send(struct.pack('<B', CMD_POLL))
+            out.writelines(fb.to_script() + '\n' for fb in framebulks)
+            out.flush()
+            if (state == STATE_STOPPED and not framebulks) or state == STATE_IDLE:
+                break
+            if time.time() - last_print > 5:
+                last_print = time.time()
+                print(f"Recorded {ticks} ticks")
+            # polls that were already taken out of the payload can't be lost, so Ctrl+C is only
+            # caught here, and the rest of the recording is drained after stopping
+            try:
+                time.sleep(POLL_SECS)
+            except KeyboardInterrupt:
+                if not stopping:
+                    stopping = True
+                    send(struct.pack('<B', CMD_STOP))
+
+    if overflowed:
+        print("The recording stopped early since it wasn't being polled fast enough")
+    print(f"Wrote {ticks} ticks to '{args.output}'")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,83 @@
+# =================================================
+# Takes snapshots of the game while a script runs,
+# so that the end of a script can be retried
+# without playing all of it again.
+#
+#   savestate.py start -i 600
+#   savestate.py capture
+#   savestate.py restore 2
+#   savestate.py stats
+#
+# Everything but stop & stats happens at the next
+# tick while a script is running. Snapshots are
+# freed when the script ends or a new one is sent.
+# =================================================
+
+import argparse
+import struct
+from client import ClientSocket, MessageType
+
+CMD_START, CMD_CAPTURE, CMD_RESTORE, CMD_STOP, CMD_STATS = range(5)
+
+
+def pack_savestate_msg(command: int, track_writes: bool = False, count: int = 0, interval: int = 0) -> bytes:
+    """packs a savestate command in the format that the payload expects
+
+    Keyword arguments:
+    command -- one of the CMD_ constants
+    track_writes -- for start, only look at pages that were written to instead of hashing all of them
+    count -- the ring size for start, or how many snapshots back to go for restore
+    interval -- for start, take a snapshot every this many ticks (0 to only take them on capture)
+
+    Return:
+    bytes() -- the message to send with MessageType.SaveState
+    """
+    return struct.pack('<BBHI', command, track_writes, count, interval)
+
+
+def build_msg(args) -> bytes:
+    """converts the parsed command line arguments to a savestate message
+
+    Keyword arguments:
+    args -- the namespace returned by the argument parser
+
+    Return:
+    bytes() -- the message to send with MessageType.SaveState
+    """
+    if args.command == "start":
+        return pack_savestate_msg(CMD_START, args.track_writes, args.ring, args.interval)
+    if args.command == "capture":
+        return pack_savestate_msg(CMD_CAPTURE)
+    if args.command == "restore":
+        return pack_savestate_msg(CMD_RESTORE, count=args.back)
+    if args.command == "stop":
+        return pack_savestate_msg(CMD_STOP)
+    return pack_savestate_msg(CMD_STATS)
+
+
+def make_arg_parser() -> argparse.ArgumentParser:
+    arg_parser = argparse.ArgumentParser(description="Takes & restores snapshots of the game while a script runs")
+    commands = arg_parser.add_subparsers(dest="command", required=True)
+    start = commands.add_parser("start", help="take the first snapshot, freeing any old ones")
+    start.add_argument("-r", "--ring", type=int, default=16, help="number of snapshots to keep (2 to 64)")
+    start.add_argument("-i", "--interval", type=int, default=0, help="take a snapshot every this many ticks")
+    start.add_argument("-t", "--track-writes", action="store_true",
+                       help="find changed pages by catching writes instead of hashing everything")
+    commands.add_parser("capture", help="take a snapshot")
+    restore = commands.add_parser("restore", help="go back to a snapshot, and drop the ones after it")
+    restore.add_argument("back", type=int, nargs='?', default=0, help="how many snapshots back (0 is the last one)")
+    commands.add_parser("stop", help="free all snapshots")
+    commands.add_parser("stats", help="print how many snapshots there are & how long they took")
+    return arg_parser
+
+
+def main():
+    args = make_arg_parser().parse_args()
+    sock = ClientSocket()
+    sock.start()
+    sock.send(build_msg(args), MessageType.SaveState)
+    print(sock.recv().decode('utf-8'), end='')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,100 @@
+# =================================================
+# Searches the game's memory for a value, e.g. to
+# find where kart speed or the lap count lives.
+#
+#   scan.py new float
+#   scan.py filter between 10 20
+#   scan.py filter increased
+#   scan.py list -n 20
+#
+# The scan lives in the payload until it's reset
+# or the payload is unloaded.
+# =================================================
+
+import argparse
+import struct
+from client import ClientSocket, MessageType
+
+VALUE_TYPES = {"int32": 0, "float": 1, "double": 2}
+
+# filter name -> (compare, number of values it takes)
+FILTERS = {
+    "between": (0, 2),
+    "eq": (0, 1),
+    "changed": (1, 0),
+    "unchanged": (2, 0),
+    "increased": (3, 0),
+    "decreased": (4, 0),
+}
+
+CMD_NEW, CMD_FILTER, CMD_LIST, CMD_RESET = range(4)
+
+
+def pack_scan_msg(command: int, value_type: int = 0, compare: int = 0, a: float = 0, b: float = 0) -> bytes:
+    """packs a scanner command in the format that the payload expects
+
+    Keyword arguments:
+    command -- one of the CMD_ constants
+    value_type -- one of the values in VALUE_TYPES, only used for new scans
+    compare -- the compare of a filter from FILTERS
+    a, b -- the bounds for filters, or the first candidate & number of candidates for list
+
+    Return:
+    bytes() -- the message to send with MessageType.Scan
+    """
+    return struct.pack('<BBBdd', command, value_type, compare, a, b)
+
+
+def build_msg(args) -> bytes:
+    """converts the parsed command line arguments to a scanner message
+
+    Keyword arguments:
+    args -- the namespace returned by the argument parser
+
+    Return:
+    bytes() -- the message to send with MessageType.Scan
+    """
+    if args.command == "new":
+        return pack_scan_msg(CMD_NEW, VALUE_TYPES[args.type])
+    if args.command == "filter":
+        compare, num_values = FILTERS[args.filter]
+        if len(args.values) != num_values:
+            raise ValueError(f"'{args.filter}' takes {num_values} value(s)")
+        if args.filter == "eq":
+            return pack_scan_msg(CMD_FILTER, 0, compare, args.values[0], args.values[0])
+        return pack_scan_msg(CMD_FILTER, 0, compare, *args.values)
+    if args.command == "list":
+        return pack_scan_msg(CMD_LIST, 0, 0, args.start, args.count)
+    return pack_scan_msg(CMD_RESET)
+
+
+def make_arg_parser() -> argparse.ArgumentParser:
+    arg_parser = argparse.ArgumentParser(description="Searches the game's memory for a value")
+    commands = arg_parser.add_subparsers(dest="command", required=True)
+    new = commands.add_parser("new", help="start a new scan, every value of the type is a candidate")
+    new.add_argument("type", choices=VALUE_TYPES.keys())
+    filt = commands.add_parser("filter", help="throw out candidates that don't match")
+    filt.add_argument("filter", choices=FILTERS.keys())
+    filt.add_argument("values", type=float, nargs="*")
+    lst = commands.add_parser("list", help="print the addresses & values of some candidates")
+    lst.add_argument("-s", "--start", type=int, default=0, help="first candidate to print")
+    lst.add_argument("-n", "--count", type=int, default=50, help="max number of candidates to print (up to 256)")
+    commands.add_parser("reset", help="free the scan")
+    return arg_parser
+
+
+def main():
+    arg_parser = make_arg_parser()
+    args = arg_parser.parse_args()
+    try:
+        msg = build_msg(args)
+    except ValueError as e:
+        arg_parser.error(str(e))
+    sock = ClientSocket()
+    sock.start()
+    sock.send(msg, MessageType.Scan)
+    print(sock.recv().decode('utf-8'), end='')
+
+
+if __name__ == '__main__':
+    main()
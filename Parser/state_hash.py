@@ -0,0 +1,196 @@
+# =================================================
+# Records a hash of chosen game state every tick of
+# a script, and checks a later run of the script
+# against it to find the first tick that differs.
+#
+#   state_hash.py add 40 c87100 30 0 1a0
+#   state_hash.py record
+#   parser.py -p scripts/abyss.peng
+#   state_hash.py save abyss.hashes
+#
+#   state_hash.py verify abyss.hashes
+#   parser.py -p scripts/abyss.peng
+#   state_hash.py stats
+#
+# 'add' takes the number of bytes to hash (hex) and
+# a chain from pointer_scan.py. Recording starts at
+# the next script. The .hashes file is "STKH", the
+# number of ticks, then a u32 hash per tick.
+#
+#   state_hash.py bisect old.peng new.peng -i 600
+#
+# 'bisect' reruns two scripts (.peng, or .bin from
+# parser.py -o) until it finds the first tick where
+# they differ and which of the added ranges differ.
+# =================================================
+
+import argparse
+import struct
+import time
+from client import ClientSocket, MessageType
+from pointer_scan import MAX_DEPTH
+from parser import parse_script
+
+(CMD_ADD_CHAIN, CMD_CLEAR_RANGES, CMD_RECORD, CMD_STOP, CMD_VERIFY, CMD_GET, CMD_STATS,
+    CMD_BISECT, CMD_STOP_BISECT) = range(9)
+BISECT_DONE = 4
+FILE_MAGIC = b'STKH'
+HASHES_PER_GET = 1 << 16
+
+
+def pack_add_chain_msg(size: int, chain: list) -> bytes:
+    """packs an add command in the format that the payload expects
+
+    Keyword arguments:
+    size -- the number of bytes to hash at the end of the chain
+    chain -- the module offset then the offsets (there can be none for a global)
+
+    Return:
+    bytes() -- the message to send with MessageType.StateHash
+    """
+    return struct.pack(f'<BIII{len(chain) - 1}I', CMD_ADD_CHAIN, size, chain[0], len(chain) - 1, *chain[1:])
+
+
+def pack_verify_msg(hashes: list) -> bytes:
+    return struct.pack(f'<BI{len(hashes)}I', CMD_VERIFY, len(hashes), *hashes)
+
+
+def pack_get_msg(first: int, count: int) -> bytes:
+    return struct.pack('<BII', CMD_GET, first, count)
+
+
+def parse_get_reply(reply: bytes) -> tuple:
+    """splits the payload's reply to a get command
+
+    Keyword arguments:
+    reply -- the reply
+
+    Return:
+    tuple() -- the total number of hashes in the payload's log, and the hashes that were sent
+    """
+    total = struct.unpack_from('<I', reply)[0]
+    count = (len(reply) - 4) // 4
+    return total, list(struct.unpack_from(f'<{count}I', reply, 4))
+
+
+def pack_bisect_msg(interval: int, split: int, script_a: bytes, script_b: bytes) -> bytes:
+    """packs a bisect command in the format that the payload expects
+
+    Keyword arguments:
+    interval -- ticks between the checkpoints of the first pair of runs
+    split -- how many parts the interval with the divergence is split into per pair of runs
+    script_a -- the first script message (as parser.py sends it)
+    script_b -- the second one
+
+    Return:
+    bytes() -- the message to send with MessageType.StateHash
+    """
+    return (struct.pack('<BIII', CMD_BISECT, interval, split, len(script_a)) + script_a +
+            struct.pack('<I', len(script_b)) + script_b)
+
+
+def parse_stats(reply: bytes) -> dict:
+    return {name: int(value) for name, value in (line.split() for line in reply.decode('utf-8').splitlines())}
+
+
+def load_script(path: str) -> bytes:
+    if path.endswith('.bin'):
+        with open(path, 'rb') as f:
+            return f.read()
+    return parse_script(path)
+
+
+def read_hashes(path: str) -> list:
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != FILE_MAGIC:
+        raise ValueError(f"'{path}' isn't a hashes file")
+    count = struct.unpack_from('<I', data, 4)[0]
+    return list(struct.unpack_from(f'<{count}I', data, 8))
+
+
+def write_hashes(path: str, hashes: list) -> None:
+    with open(path, 'wb') as f:
+        f.write(FILE_MAGIC + struct.pack(f'<I{len(hashes)}I', len(hashes), *hashes))
+
+
+def send(msg: bytes) -> bytes:
+    sock = ClientSocket()
+    sock.start()
+    sock.send(msg, MessageType.StateHash)
+    return sock.recv()
+
+
+def fetch_hashes() -> list:
+    """gets the whole log from the payload, a chunk at a time"""
+    hashes = []
+    while True:
+        total, chunk = parse_get_reply(send(pack_get_msg(len(hashes), HASHES_PER_GET)))
+        hashes += chunk
+        if not chunk or len(hashes) >= total:
+            return hashes
+
+
+def main():
+    arg_parser = argparse.ArgumentParser(description="Hashes game state every tick to check that scripts play back the same")
+    commands = arg_parser.add_subparsers(dest="command", required=True)
+    add = commands.add_parser("add", help="hash some bytes at the end of a pointer chain every tick")
+    add.add_argument("size", type=lambda x: int(x, 16), help="number of bytes (hex)")
+    add.add_argument("chain", nargs='+', help="module offset then the offsets (hex), like in pointer_chains.txt")
+    commands.add_parser("clear", help="stop hashing everything that was added")
+    commands.add_parser("record", help="start a new log at the start of the next script")
+    commands.add_parser("stop", help="stop recording & free the log")
+    save = commands.add_parser("save", help="write the log to a file")
+    save.add_argument("file")
+    verify = commands.add_parser("verify", help="compare the next run against a file from an earlier run")
+    verify.add_argument("file")
+    commands.add_parser("stats", help="print the stats, including the first tick that differed")
+    bisect = commands.add_parser("bisect", help="find the first tick where two scripts differ")
+    bisect.add_argument("script_a")
+    bisect.add_argument("script_b")
+    bisect.add_argument("-i", "--interval", type=int, default=600, help="ticks between the first checkpoints")
+    bisect.add_argument("-s", "--split", type=int, default=2, help="checkpoints per interval after that")
+    commands.add_parser("bisect-stop", help="give up on a bisection")
+    args = arg_parser.parse_args()
+
+    if args.command == "bisect":
+        msg = pack_bisect_msg(args.interval, args.split, load_script(args.script_a), load_script(args.script_b))
+        stats = parse_stats(send(msg))
+        runs = -1
+        while stats["bisect_phase"] != BISECT_DONE:
+            if stats["bisect_runs"] != runs:
+                runs = stats["bisect_runs"]
+                print(f"run {runs}: between ticks {stats['bisect_low']} and {stats['bisect_high']}")
+            time.sleep(1)
+            stats = parse_stats(send(struct.pack('<B', CMD_STATS)))
+        if stats["bisect_divergence"] < 0:
+            print(f"No difference after {stats['bisect_runs']} runs")
+            return
+        ranges = [str(i) for i in range(32) if stats["bisect_differing_ranges"] & (1 << i)]
+        print(f"First difference at tick {stats['bisect_divergence']} after {stats['bisect_runs']} runs, "
+              f"in ranges {', '.join(ranges) or '-'} (in the order they were added)")
+        return
+
+    if args.command == "save":
+        hashes = fetch_hashes()
+        write_hashes(args.file, hashes)
+        print(f"Wrote {len(hashes)} ticks to '{args.file}'")
+        return
+
+    if args.command == "add":
+        chain = [int(x, 16) for x in args.chain]
+        if len(chain) > MAX_DEPTH + 1:
+            arg_parser.error(f"chains can have at most {MAX_DEPTH} offsets")
+        msg = pack_add_chain_msg(args.size, chain)
+    elif args.command == "verify":
+        # the log has to be recording for anything to be compared
+        send(struct.pack('<B', CMD_RECORD))
+        msg = pack_verify_msg(read_hashes(args.file))
+    else:
+        msg = struct.pack('<B', {"clear": CMD_CLEAR_RANGES, "record": CMD_RECORD, "stop": CMD_STOP, "stats": CMD_STATS,
+                                "bisect-stop": CMD_STOP_BISECT}[args.command])
+    print(send(msg).decode('utf-8'), end='')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,17 @@
+# =================================================
+# Connects to the payload and prints its stats.
+# =================================================
+
+
+from client import ClientSocket, MessageType
+
+
+def main():
+    sock = ClientSocket()
+    sock.start()
+    sock.send(b'', MessageType.Stats)
+    print(sock.recv().decode('utf-8'), end='')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,406 @@
+# ==================================
+# Generates src/game_state.h & src/game_state.cpp from game_state.schema, see the top of the
+# schema for the format. Run this from anywhere after changing the schema:
+#
+#   python gen_game_state.py
+#
+# Use --check to only verify that the generated files are up to date.
+# ==================================
+
+import argparse
+import pathlib
+import re
+import sys
+from typing import Dict, List, Optional, Tuple
+
+SCHEMA_PATH = pathlib.Path(__file__).parent / "game_state.schema"
+HEADER_PATH = pathlib.Path(__file__).parent / "src" / "game_state.h"
+SOURCE_PATH = pathlib.Path(__file__).parent / "src" / "game_state.cpp"
+
+# fields are plain values or pointers to other structs
+KIND_VALUE = "value"
+KIND_PTR = "ptr"
+
+IDENT_RE = r'[A-Za-z_]\w*'
+
+
+class SchemaError(Exception):
+
+    def __init__(self, line_num: int, msg: str):
+        super().__init__(f"game_state.schema line {line_num}: {msg}")
+
+
+class Field:
+
+    def __init__(self, name: str, offset: int, kind: str, type: str):
+        self.name = name
+        self.offset = offset
+        self.kind = kind
+        self.type = type  # the C++ type for values, the target struct for pointers
+
+    def __eq__(self, __o: object) -> bool:
+        if type(__o) != Field:
+            return False
+        return self.__dict__ == __o.__dict__
+
+    def __repr__(self) -> str:
+        return repr(self.__dict__)
+
+
+class Struct:
+
+    def __init__(self, name: str, mirror: bool):
+        self.name = name
+        self.mirror = mirror
+        self.fields: List[Field] = []
+
+    def field(self, name: str) -> Optional[Field]:
+        return next((f for f in self.fields if f.name == name), None)
+
+    def view(self) -> str:
+        return self.name + "View"
+
+
+class Global:
+
+    def __init__(self, name: str, offset: int, kind: str, type: str):
+        self.name = name
+        self.offset = offset
+        self.kind = kind  # KIND_PTR or KIND_VALUE
+        self.type = type
+
+
+class Chain:
+
+    def __init__(self, name: str, global_name: str, steps: List[str]):
+        self.name = name
+        self.global_name = global_name
+        self.steps = steps  # the pointer fields to follow
+        self.target = ""  # the struct at the end of the chain, set when the schema is validated
+
+
+class Schema:
+
+    def __init__(self):
+        self.globals: List[Global] = []
+        self.structs: Dict[str, Struct] = {}
+        self.chains: List[Chain] = []
+
+
+def parse_offset(token: str, line_num: int) -> int:
+    """Parses a hex/decimal offset."""
+    try:
+        return int(token, 0)
+    except ValueError:
+        raise SchemaError(line_num, f"bad offset '{token}'")
+
+
+def parse_schema(text: str) -> Schema:
+    """Parses and validates the schema.
+
+    Keyword arguments:
+    text -- the contents of game_state.schema
+    """
+    schema = Schema()
+    cur_struct: Optional[Struct] = None
+    # the line that each global/struct/chain was declared on, for error messages
+    decl_lines: Dict[str, int] = {}
+
+    for line_num, raw_line in enumerate(text.splitlines(), 1):
+        line = raw_line.split("#", 1)[0].rstrip()
+        if not line:
+            continue
+        tokens = line.split()
+        indented = line[0].isspace()
+
+        if indented:
+            # field of the current struct
+            if cur_struct is None:
+                raise SchemaError(line_num, "field outside of a struct")
+            offset = parse_offset(tokens[0], line_num)
+            if len(tokens) == 3:
+                field = Field(tokens[2], offset, KIND_VALUE, tokens[1])
+            elif len(tokens) == 4 and tokens[1] == "->":
+                field = Field(tokens[3], offset, KIND_PTR, tokens[2])
+            else:
+                raise SchemaError(line_num, "expected '<offset> <type> <field>'")
+            if not re.fullmatch(IDENT_RE, field.name):
+                raise SchemaError(line_num, f"bad field name '{field.name}'")
+            if cur_struct.field(field.name):
+                raise SchemaError(line_num, f"duplicate field '{field.name}' in {cur_struct.name}")
+            if field.kind == KIND_PTR:
+                decl_lines.setdefault("->" + field.type, line_num)
+            cur_struct.fields.append(field)
+
+        elif tokens[0] == "global":
+            cur_struct = None
+            if len(tokens) == 5 and tokens[3] == "->":
+                glob = Global(tokens[1], parse_offset(tokens[2], line_num), KIND_PTR, tokens[4])
+                decl_lines.setdefault("->" + glob.type, line_num)
+            elif len(tokens) == 4:
+                glob = Global(tokens[1], parse_offset(tokens[2], line_num), KIND_VALUE, tokens[3])
+            else:
+                raise SchemaError(line_num, "expected 'global <name> <offset> <type>'")
+            if any(g.name == glob.name for g in schema.globals):
+                raise SchemaError(line_num, f"duplicate global '{glob.name}'")
+            schema.globals.append(glob)
+            decl_lines[glob.name] = line_num
+
+        elif tokens[0] == "struct":
+            if len(tokens) not in (2, 3) or (len(tokens) == 3 and tokens[2] != "mirror"):
+                raise SchemaError(line_num, "expected 'struct <name> [mirror]'")
+            if tokens[1] in schema.structs:
+                raise SchemaError(line_num, f"duplicate struct '{tokens[1]}'")
+            cur_struct = Struct(tokens[1], len(tokens) == 3)
+            schema.structs[cur_struct.name] = cur_struct
+
+        elif tokens[0] == "chain":
+            cur_struct = None
+            if len(tokens) < 4:
+                raise SchemaError(line_num, "expected 'chain <name> <global> <field> ...'")
+            for step in tokens[3:]:
+                if not re.fullmatch(IDENT_RE, step):
+                    raise SchemaError(line_num, f"bad chain step '{step}'")
+            schema.chains.append(Chain(tokens[1], tokens[2], tokens[3:]))
+            decl_lines[tokens[1]] = line_num
+
+        else:
+            raise SchemaError(line_num, f"unknown keyword '{tokens[0]}'")
+
+    # every struct that's pointed to has to be declared
+    for key, line_num in decl_lines.items():
+        if key.startswith("->") and key[2:] not in schema.structs:
+            raise SchemaError(line_num, f"unknown struct '{key[2:]}'")
+
+    for chain in schema.chains:
+        line_num = decl_lines[chain.name]
+        glob = next((g for g in schema.globals if g.name == chain.global_name), None)
+        if glob is None or glob.kind != KIND_PTR:
+            raise SchemaError(line_num, f"'{chain.global_name}' isn't a global pointer")
+        # chains and globals are both functions in the same namespace
+        names = [c.name for c in schema.chains] + [g.name for g in schema.globals]
+        if names.count(chain.name) > 1:
+            raise SchemaError(line_num, f"duplicate name '{chain.name}'")
+        struct = schema.structs[glob.type]
+        for name in chain.steps:
+            field = struct.field(name)
+            if field is None or field.kind != KIND_PTR:
+                raise SchemaError(line_num, f"{struct.name} has no pointer field '{name}'")
+            struct = schema.structs[field.type]
+        chain.target = struct.name
+
+    return schema
+
+
+def value_field_getter(struct: Struct, field: Field) -> str:
+    return (f"{field.type}& {field.name}() const {{"
+            f"return *({field.type}*)(p + offsets::{struct.name}::{field.name});}}")
+
+
+def generate(schema: Schema) -> Tuple[str, str]:
+    """Generates the contents of game_state.h and game_state.cpp."""
+
+    h = []
+    h.append("// Generated by gen_game_state.py from game_state.schema, don't edit this file directly.")
+    h.append("#pragma once")
+    h.append("#include <stddef.h>")
+    h.append("#include <stdint.h>")
+    h.append('#include "hooks.h"')
+    h.append("")
+    h.append("/*")
+    h.append("* Typed accessors for game objects. Every struct in the schema gets a view class, which is just")
+    h.append("* a pointer with a getter for each of its fields, e.g.:")
+    h.append("*")
+    h.append("*   int fps = game_state::stk_config().m_physics_fps();")
+    h.append("*")
+    h.append("* Globals are one load away, and chains are resolved at most once per tick (until NewTick()")
+    h.append("* is called), so reading a field is a single load no matter how deep the object is. Views can")
+    h.append("* be null (e.g. when there's no world), check them with operator bool before reading.")
+    h.append("*/")
+    h.append("")
+    h.append("namespace game_state {")
+    h.append("")
+    h.append("\t// offsets of globals from the start of supertuxkart.exe")
+    h.append("\tnamespace global_offsets {")
+    for g in schema.globals:
+        h.append(f"\t\tconst uintptr_t {g.name} = {g.offset:#x};")
+    h.append("\t}")
+    h.append("")
+    h.append("\t// offsets of fields from the start of their struct")
+    h.append("\tnamespace offsets {")
+    for s in schema.structs.values():
+        if not s.fields:
+            continue
+        h.append(f"\t\tnamespace {s.name} {{")
+        for f in s.fields:
+            h.append(f"\t\t\tconst size_t {f.name} = {f.offset:#x};")
+        h.append("\t\t}")
+    h.append("\t}")
+    h.append("")
+
+    mirrored = [(s, f) for s in schema.structs.values() if s.mirror for f in s.fields]
+    if mirrored:
+        h.append("\t// make sure that game_structures.h agrees with the schema")
+        for s, f in mirrored:
+            h.append(f"\tstatic_assert(offsetof(::{s.name}, {f.name}) == offsets::{s.name}::{f.name}, "
+                     f"\"{s.name}::{f.name} doesn't match game_state.schema\");")
+        h.append("")
+
+    for s in schema.structs.values():
+        h.append(f"\tclass {s.view()};")
+    h.append("")
+
+    for s in schema.structs.values():
+        h.append(f"\tclass {s.view()} {{")
+        h.append("\tpublic:")
+        h.append(f"\t\texplicit {s.view()}(void* p = nullptr) : p((char*)p) {{}}")
+        h.append("\t\texplicit operator bool() const {return p != nullptr;}")
+        h.append("\t\tvoid* ptr() const {return p;}")
+        if s.fields:
+            h.append("")
+        for f in s.fields:
+            if f.kind == KIND_VALUE:
+                h.append("\t\t" + value_field_getter(s, f))
+            else:
+                h.append(f"\t\tinline {schema.structs[f.type].view()} {f.name}() const;")
+        h.append("")
+        h.append("\tprivate:")
+        h.append("\t\tchar* p;")
+        h.append("\t};")
+        h.append("")
+
+    # pointer getters need the target view to be complete, so they go after all the classes
+    for s in schema.structs.values():
+        for f in s.fields:
+            if f.kind != KIND_PTR:
+                continue
+            target = schema.structs[f.type].view()
+            h.append(f"\tinline {target} {s.view()}::{f.name}() const {{")
+            h.append(f"\t\treturn {target}(*(void**)(p + offsets::{s.name}::{f.name}));")
+            h.append("\t}")
+            h.append("")
+
+    h.append("\t// globals")
+    h.append("")
+    for g in schema.globals:
+        if g.kind == KIND_PTR:
+            view = schema.structs[g.type].view()
+            h.append(f"\tinline {view} {g.name}() {{return {view}(*hooks::{g.name});}}")
+        else:
+            h.append(f"\tinline {g.type}& {g.name}() {{return *hooks::{g.name};}}")
+    h.append("")
+
+    h.append("\t// Sets all of the hooks:: globals from the offsets in the schema, called by HookAll().")
+    h.append("\tvoid InitGlobals();")
+    h.append("")
+    h.append("\t// Invalidates all cached chains, call this at the start of every tick. The cache is also")
+    h.append("\t// stale if the world gets reloaded in the middle of a tick, but that only happens when a")
+    h.append("\t// script is loading its map.")
+    h.append("\tvoid NewTick();")
+    h.append("")
+    h.append("\tnamespace detail {")
+    h.append("\t\tstruct CachedPtr {")
+    h.append("\t\t\tuint32_t tick;")
+    h.append("\t\t\tvoid* ptr;")
+    h.append("\t\t};")
+    h.append("")
+    h.append(f"\t\tconst int NUM_CACHED_CHAINS = {len(schema.chains)};")
+    h.append("\t\textern uint32_t cur_tick;")
+    h.append(f"\t\textern CachedPtr cache[{max(len(schema.chains), 1)}];")
+    for c in schema.chains:
+        h.append(f"\t\tvoid* Resolve_{c.name}();")
+    h.append("\t}")
+    h.append("")
+    h.append("\t// chains")
+    h.append("")
+    for idx, c in enumerate(schema.chains):
+        desc = " -> ".join([c.global_name] + c.steps)
+        view = schema.structs[c.target].view()
+        h.append(f"\t// {desc}")
+        h.append(f"\tinline {view} {c.name}() {{")
+        h.append(f"\t\tdetail::CachedPtr& c = detail::cache[{idx}];")
+        h.append("\t\tif (c.tick != detail::cur_tick) {")
+        h.append(f"\t\t\tc.ptr = detail::Resolve_{c.name}();")
+        h.append("\t\t\tc.tick = detail::cur_tick;")
+        h.append("\t\t}")
+        h.append(f"\t\treturn {view}(c.ptr);")
+        h.append("\t}")
+        h.append("")
+    h.append("}")
+
+    s = []
+    s.append("// Generated by gen_game_state.py from game_state.schema, don't edit this file directly.")
+    s.append('#include "game_state.h"')
+    s.append("")
+    s.append("")
+    s.append("namespace game_state {")
+    s.append("")
+    s.append("\tvoid InitGlobals() {")
+    width = max((len(g.name) for g in schema.globals), default=0)
+    for g in schema.globals:
+        type = f"{g.type}**" if g.kind == KIND_PTR else f"{g.type}*"
+        s.append(f"\t\thooks::{g.name.ljust(width)} = ({type})FROM_BASE(global_offsets::{g.name});")
+    s.append("\t}")
+    s.append("")
+    s.append("")
+    s.append("\tvoid NewTick() {")
+    s.append("\t\tdetail::cur_tick++;")
+    s.append("\t}")
+    s.append("")
+    s.append("")
+    s.append("\tnamespace detail {")
+    s.append("")
+    s.append("\t\t// starts at 1 so that the (zeroed) cache starts out invalid")
+    s.append("\t\tuint32_t cur_tick = 1;")
+    s.append(f"\t\tCachedPtr cache[{max(len(schema.chains), 1)}];")
+    for c in schema.chains:
+        glob = next(g for g in schema.globals if g.name == c.global_name)
+        s.append("")
+        s.append("")
+        s.append(f"\t\tvoid* Resolve_{c.name}() {{")
+        s.append(f"\t\t\t{schema.structs[glob.type].view()} v0 = {c.global_name}();")
+        s.append("\t\t\tif (!v0)")
+        s.append("\t\t\t\treturn nullptr;")
+        struct = schema.structs[glob.type]
+        for i, name in enumerate(c.steps, 1):
+            struct = schema.structs[struct.field(name).type]
+            s.append(f"\t\t\t{struct.view()} v{i} = v{i - 1}.{name}();")
+            s.append(f"\t\t\tif (!v{i})")
+            s.append("\t\t\t\treturn nullptr;")
+        s.append(f"\t\t\treturn v{len(c.steps)}.ptr();")
+        s.append("\t\t}")
+    s.append("\t}")
+    s.append("}")
+
+    return "\n".join(h) + "\n", "\n".join(s) + "\n"
+
+
+def get_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--check', action='store_true',
+                        help="don't write anything, exit with 1 if the generated files are out of date")
+    return parser.parse_args()
+
+
+def main():
+    args = get_args()
+    try:
+        header, source = generate(parse_schema(SCHEMA_PATH.read_text()))
+    except SchemaError as e:
+        print(e)
+        sys.exit(1)
+
+    outputs = [(HEADER_PATH, header), (SOURCE_PATH, source)]
+    if args.check:
+        stale = [p.name for p, text in outputs if not p.exists() or p.read_text() != text]
+        if stale:
+            print(f"{', '.join(stale)} out of date, run gen_game_state.py")
+            sys.exit(1)
+        return
+    for path, text in outputs:
+        with open(path, "w", newline="\n") as f:
+            f.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,57 @@
+#include "arena.h"
+#include "platform.h"
+
+
+size_t Arena::total_reserved = 0;
+size_t Arena::peak_reserved = 0;
+
+
+Arena::Arena(Arena&& other) noexcept : base(other.base), capacity(other.capacity), used(other.used) {
+	other.base = nullptr;
+	other.capacity = other.used = 0;
+}
+
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+	if (this != &other) {
+		release();
+		base = other.base;
+		capacity = other.capacity;
+		used = other.used;
+		other.base = nullptr;
+		other.capacity = other.used = 0;
+	}
+	return *this;
+}
+
+
+bool Arena::init(size_t size) {
+	release();
+	base = (char*)platform::AllocPages(size);
+	if (!base)
+		return false;
+	capacity = size;
+	total_reserved += capacity;
+	if (total_reserved > peak_reserved)
+		peak_reserved = total_reserved;
+	return true;
+}
+
+
+void Arena::release() {
+	if (!base)
+		return;
+	platform::FreePages(base, capacity);
+	total_reserved -= capacity;
+	base = nullptr;
+	capacity = used = 0;
+}
+
+
+void* Arena::alloc(size_t size, size_t align) {
+	size_t start = (used + align - 1) & ~(align - 1);
+	if (!base || start + size > capacity)
+		return nullptr;
+	used = start + size;
+	return base + start;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* A single block of memory that things get bump-allocated from and that gets freed all at
+* once. The memory comes straight from the OS instead of the CRT heap, so that allocating and
+* freeing thousands of scripts in a row doesn't fragment the game's heap.
+*/
+class Arena {
+public:
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	Arena(Arena&& other) noexcept;
+	Arena& operator=(Arena&& other) noexcept;
+
+	~Arena() {
+		release();
+	}
+
+	// Reserves a block of at least size bytes (releases the old one first), returns false on failure.
+	bool init(size_t size);
+
+	// frees the whole block, everything that was allocated from it is invalid after this
+	void release();
+
+	// returns nullptr if there's not enough room left, the memory is zeroed
+	void* alloc(size_t size, size_t align = sizeof(void*));
+
+	template <typename T>
+	T* alloc(size_t count = 1) {
+		return (T*)alloc(sizeof(T) * count, alignof(T));
+	}
+
+	size_t bytesUsed() const {return used;}
+
+	size_t bytesReserved() const {return capacity;}
+
+	// total number of bytes reserved by all arenas right now
+	static size_t totalReserved() {return total_reserved;}
+
+	// the most bytes that all arenas have ever had reserved at once
+	static size_t peakReserved() {return peak_reserved;}
+
+private:
+	char* base = nullptr;
+	size_t capacity = 0;
+	size_t used = 0;
+
+	static size_t total_reserved;
+	static size_t peak_reserved;
+};
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "asset_prefetch.h"
+#include "platform.h"
+
+
+// big enough for the OS to read ahead in big chunks, small enough to notice a cancel quickly
+static const size_t READ_BUF_SIZE = 256 * 1024;
+// the thread's buffers: the read buffer, the path being read, and the two dirs of a job
+static const size_t THREAD_MEM_SIZE = READ_BUF_SIZE + 3 * AssetPrefetcher::MAX_PATH_LEN;
+
+
+bool AssetPrefetcher::setDataDir(const char* dir) {
+	size_t len = strlen(dir);
+	if (len >= MAX_PATH_LEN)
+		return false;
+	std::lock_guard<std::mutex> lock(mutex);
+	memcpy(data_dir, dir, len + 1);
+	return true;
+}
+
+
+void AssetPrefetcher::prefetch(const char* map_name, const char* kart_name) {
+	size_t map_len = strlen(map_name);
+	size_t kart_len = strlen(kart_name);
+	std::lock_guard<std::mutex> lock(mutex);
+	generation++;
+	has_request = false;
+	if (data_dir[0] == '\0' || stopping || map_len >= MAX_PATH_LEN || kart_len >= MAX_PATH_LEN)
+		return;
+	memcpy(request_map, map_name, map_len + 1);
+	memcpy(request_kart, kart_name, kart_len + 1);
+	has_request = true;
+	if (!thread.joinable())
+		thread = std::thread(&AssetPrefetcher::run, this);
+	cv.notify_all();
+}
+
+
+void AssetPrefetcher::cancel() {
+	std::lock_guard<std::mutex> lock(mutex);
+	generation++;
+	has_request = false;
+}
+
+
+void AssetPrefetcher::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		generation++;
+		has_request = false;
+		stopping = true;
+	}
+	cv.notify_all();
+	if (thread.joinable())
+		thread.join();
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = false;
+}
+
+
+bool AssetPrefetcher::waitIdle(int timeout_ms) {
+	std::unique_lock<std::mutex> lock(mutex);
+	return cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] {return !has_request && !st.busy;});
+}
+
+
+AssetPrefetcher::Stats AssetPrefetcher::stats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return st;
+}
+
+
+void AssetPrefetcher::run() {
+	platform::SetBackgroundPriority();
+	char* mem = (char*)platform::AllocPages(THREAD_MEM_SIZE);
+	if (!mem)
+		return;
+	stack_addr = &mem;
+	read_buf = mem;
+	path_buf = mem + READ_BUF_SIZE;
+	char* dirs[2] = {path_buf + MAX_PATH_LEN, path_buf + 2 * MAX_PATH_LEN};
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		cv.wait(lock, [this] {return has_request || stopping;});
+		if (stopping)
+			break;
+		has_request = false;
+		uint32_t gen = generation;
+		// a dir whose path is too long just doesn't get read
+		int num_dirs = 0;
+		if (snprintf(dirs[num_dirs], MAX_PATH_LEN, "%s/tracks/%s", data_dir, request_map) < (int)MAX_PATH_LEN)
+			num_dirs++;
+		if (snprintf(dirs[num_dirs], MAX_PATH_LEN, "%s/karts/%s", data_dir, request_kart) < (int)MAX_PATH_LEN)
+			num_dirs++;
+		st.jobs++;
+		st.busy = true;
+		lock.unlock();
+
+		uint64_t start_us = platform::TickCountUs();
+		job_files = job_bytes = 0;
+		bool done = true;
+		for (int i = 0; i < num_dirs && done; i++) {
+			size_t len = strlen(dirs[i]);
+			memcpy(path_buf, dirs[i], len + 1);
+			done = readDir(len, gen);
+		}
+
+		lock.lock();
+		st.files += job_files;
+		st.bytes += job_bytes;
+		if (done) {
+			st.last_us = platform::TickCountUs() - start_us;
+			st.last_bytes = job_bytes;
+		} else {
+			st.cancelled++;
+		}
+		st.busy = false;
+		cv.notify_all();
+	}
+	lock.unlock();
+	platform::FreePages(mem, THREAD_MEM_SIZE);
+	read_buf = path_buf = nullptr;
+	stack_addr = nullptr;
+}
+
+
+bool AssetPrefetcher::readDir(size_t len, uint32_t gen) {
+	struct Walk {
+		AssetPrefetcher* self;
+		size_t len;
+		uint32_t gen;
+		bool ok;
+	};
+	Walk walk = {this, len, gen, true};
+	// a dir that can't be opened (e.g. an addon that's somewhere else) just has nothing to read
+	platform::ListDir(path_buf, [](void* ctx, const char* name, bool is_dir) {
+		Walk& w = *(Walk*)ctx;
+		AssetPrefetcher& self = *w.self;
+		size_t name_len = strlen(name);
+		if (!w.ok || w.len + 1 + name_len >= MAX_PATH_LEN)
+			return;
+		self.path_buf[w.len] = '/';
+		memcpy(self.path_buf + w.len + 1, name, name_len + 1);
+		w.ok = is_dir ? self.readDir(w.len + 1 + name_len, w.gen) : self.readFile(w.gen);
+		self.path_buf[w.len] = '\0';
+	}, &walk);
+	return walk.ok;
+}
+
+
+bool AssetPrefetcher::readFile(uint32_t gen) {
+	platform::File f = platform::OpenFileForReading(path_buf);
+	if (f == platform::INVALID_FILE)
+		return generation == gen;
+	// the data isn't looked at, reading it is enough for the OS to keep it cached
+	while (generation == gen) {
+		int64_t n = platform::ReadFileChunk(f, read_buf, READ_BUF_SIZE);
+		if (n <= 0)
+			break;
+		job_bytes += n;
+	}
+	platform::CloseFile(f);
+	job_files++;
+	return generation == gen;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+* Reads a track's and a kart's files ahead of time on a background thread, so that they're in
+* the OS's file cache by the time the game loads them. The first tick of a script waits on
+* startSingleRace, which reads all of the track's meshes, textures & sounds on the game thread;
+* if the files have been read once already that takes a fraction of the time.
+*
+* The thread reads at background priority, so it doesn't slow the game down if it's still going
+* when the load starts. A new request cancels the one before (between chunks), there's only ever
+* one job at a time. The thread doesn't allocate from the game's heap (its buffers come from
+* platform::AllocPages) and savestates leave its stack alone, so going back in time can't pull
+* memory out from under it, and it only does anything between a script being received and its
+* map being loaded.
+*/
+class AssetPrefetcher {
+public:
+	static const size_t MAX_PATH_LEN = 1024;
+
+	struct Stats {
+		uint32_t jobs;        // prefetches that were started
+		uint32_t cancelled;   // prefetches that were cancelled before they finished
+		uint64_t files;       // files read by all of them
+		uint64_t bytes;
+		uint64_t last_us;     // how long the last finished one took
+		uint64_t last_bytes;  // how much it read
+		bool busy;
+	};
+
+	AssetPrefetcher() = default;
+	AssetPrefetcher(const AssetPrefetcher&) = delete;
+	AssetPrefetcher& operator=(const AssetPrefetcher&) = delete;
+
+	~AssetPrefetcher() {
+		stop();
+	}
+
+	// The game's data directory (the one with tracks/ & karts/ in it), nothing is prefetched
+	// until this is set. Returns false if it's too long.
+	bool setDataDir(const char* dir);
+
+	// Starts reading <data>/tracks/<map_name> & <data>/karts/<kart_name> in the background
+	// (starting the thread if it isn't yet), cancelling what's left of an earlier request.
+	void prefetch(const char* map_name, const char* kart_name);
+
+	// stops reading as soon as possible, the thread waits for the next request
+	void cancel();
+
+	// Cancels & waits for the thread to exit. Has to be called before the dll is unloaded, since
+	// the thread runs our code.
+	void stop();
+
+	// waits until there's nothing left to read, returns false if that took longer than timeout_ms
+	bool waitIdle(int timeout_ms);
+
+	Stats stats();
+
+	// somewhere on the thread's stack while it's running (null otherwise), so that savestates can
+	// leave the stack out
+	const std::atomic<const void*>* stackAddress() const {return &stack_addr;}
+
+private:
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	// bumped by every request & cancel, the job that's being read stops when it changes
+	std::atomic<uint32_t> generation{0};
+	std::atomic<const void*> stack_addr{nullptr};
+	// the request that the thread hasn't picked up yet, guarded by mutex
+	bool has_request = false;
+	bool stopping = false;
+	char request_map[MAX_PATH_LEN];
+	char request_kart[MAX_PATH_LEN];
+	char data_dir[MAX_PATH_LEN] = {};
+	Stats st = {};
+
+	// these are only used by the thread
+	char* read_buf = nullptr;
+	char* path_buf = nullptr;  // MAX_PATH_LEN, the path of the dir or file being read
+	uint64_t job_files = 0, job_bytes = 0;
+
+	void run();
+	// reads every file under path_buf (which is len long), returns false if the job was cancelled
+	bool readDir(size_t len, uint32_t gen);
+	bool readFile(uint32_t gen);
+};
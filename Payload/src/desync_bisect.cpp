@@ -0,0 +1,202 @@
+#include <string.h>
+#include "desync_bisect.h"
+
+
+void DesyncBisector::start(const Settings& new_settings) {
+	settings = new_settings;
+	if (settings.checkpoint_interval == 0)
+		settings.checkpoint_interval = 1;
+	if (settings.split < 2)
+		settings.split = 2;
+	cur_phase = Phase::Checkpoints;
+	side = 0;
+	side_a_hashes.clear();
+	lo = hi = first_divergence = -1;
+	differing_ranges = 0;
+	runs_done = 0;
+	setSchedule();
+}
+
+
+void DesyncBisector::cancel(ScriptManager& script_mgr) {
+	if (run_in_progress)
+		script_mgr.stopScript();
+	run_in_progress = false;
+	cur_phase = Phase::Idle;
+}
+
+
+bool DesyncBisector::nextRun(Run& out) const {
+	if (cur_phase == Phase::Idle || cur_phase == Phase::Done)
+		return false;
+	out.side = side;
+	out.schedule = schedule;
+	return true;
+}
+
+
+void DesyncBisector::finishRun(const uint32_t* hashes, size_t num_hashes, const RunEnd* end) {
+	if (cur_phase == Phase::Idle || cur_phase == Phase::Done)
+		return;
+	runs_done++;
+	if (side == 0) {
+		if (!side_a_hashes.assign(hashes, num_hashes)) {
+			finish(-1);
+			return;
+		}
+		side_a_ended = end != nullptr;
+		if (end)
+			side_a_end = *end;
+		side = 1;
+		return;
+	}
+	side = 0;
+
+	int64_t mismatch = firstMismatch(hashes, num_hashes);
+	switch (cur_phase) {
+		case Phase::Checkpoints:
+			if (mismatch >= 0) {
+				hi = mismatch * settings.checkpoint_interval;
+				lo = mismatch == 0 ? -1 : hi - settings.checkpoint_interval;
+				break;
+			}
+			// every checkpoint matches, but the runs can still differ after the last one
+			if (end && side_a_ended && (end->tick != side_a_end.tick || end->num_ranges != side_a_end.num_ranges
+				|| memcmp(end->hashes, side_a_end.hashes, end->num_ranges * sizeof(uint32_t)) != 0)
+			) {
+				lo = num_hashes == 0 ? -1 : (int64_t)(num_hashes - 1) * settings.checkpoint_interval;
+				hi = end->tick > side_a_end.tick ? end->tick : side_a_end.tick;
+				break;
+			}
+			finish(-1);
+			return;
+		case Phase::Narrowing: {
+			// hashes are at lo + step, lo + 2 * step, ... up to hi - 1
+			int64_t step = schedule.interval;
+			if (mismatch < 0) {
+				lo = schedule.first + (hi - 1 - schedule.first) / step * step;
+			} else {
+				hi = schedule.first + mismatch * step;
+				lo = hi - step;
+			}
+			break;
+		}
+		case Phase::Fields: {
+			const uint32_t *a_ranges, *b_ranges;
+			size_t a_size = rangeHashesAtHigh(side_a_hashes.data(), side_a_hashes.size(), side_a_ended ? &side_a_end : nullptr, a_ranges);
+			size_t b_size = rangeHashesAtHigh(hashes, num_hashes, end, b_ranges);
+			// a range that's only in one of them (one run ended earlier) counts as different
+			differing_ranges = 0;
+			for (size_t i = 0; i < StateHasher::MAX_RANGES; i++) {
+				bool in_a = i < a_size, in_b = i < b_size;
+				if (in_a != in_b || (in_a && a_ranges[i] != b_ranges[i]))
+					differing_ranges |= 1u << i;
+			}
+			finish(hi);
+			return;
+		}
+		default:
+			return;
+	}
+
+	cur_phase = hi - lo > 1 ? Phase::Narrowing : Phase::Fields;
+	setSchedule();
+}
+
+
+bool DesyncBisector::setScripts(const char* a, size_t a_size, const char* b, size_t b_size) {
+	// only check that they parse, a new ScriptData is made from them for every run
+	for (auto& script : {std::make_pair(a, a_size), std::make_pair(b, b_size)}) {
+		ScriptData* data = ScriptData::fromMessage(script.first, script.second);
+		if (!data)
+			return false;
+		ScriptData::destroy(data);
+	}
+	return scripts[0].assign(a, a_size) && scripts[1].assign(b, b_size);
+}
+
+
+void DesyncBisector::tick(ScriptManager& script_mgr, StateHasher& hasher) {
+	if (script_mgr.runningScript())
+		return;
+	if (run_in_progress) {
+		// runs that weren't stopped once they were hashed got to the end of the script, and the
+		// state right now is what the game ended up with
+		RunEnd end;
+		bool ended = !hasher.finished() && hasher.stats().last_tick >= 0;
+		if (ended) {
+			end.tick = (uint32_t)hasher.stats().last_tick + 1;
+			end.num_ranges = hasher.stats().ranges;
+			hasher.hashEachRange(end.hashes);
+		}
+		finishRun(hasher.hashes(), hasher.stats().hashes, ended ? &end : nullptr);
+		run_in_progress = false;
+	}
+	Run run;
+	if (!nextRun(run))
+		return;
+	const PageVector<char>& script = scripts[run.side];
+	ScriptData* data = script.empty() ? nullptr : ScriptData::fromMessage(script.data(), script.size());
+	if (!data || !hasher.start(run.schedule)) {
+		ScriptData::destroy(data);
+		finish(-1);
+		return;
+	}
+	script_mgr.setNewScript(data);
+	run_in_progress = true;
+}
+
+
+void DesyncBisector::setSchedule() {
+	schedule = StateHasher::Schedule();
+	switch (cur_phase) {
+		case Phase::Checkpoints:
+			schedule.interval = settings.checkpoint_interval;
+			break;
+		case Phase::Narrowing: {
+			int64_t step = (hi - lo + settings.split - 1) / settings.split;
+			schedule.interval = (uint32_t)step;
+			schedule.first = (uint32_t)(lo + step);
+			schedule.last = (uint32_t)(hi - 1);
+			break;
+		}
+		case Phase::Fields:
+			schedule.first = schedule.last = (uint32_t)hi;
+			schedule.per_range = true;
+			break;
+		default:
+			break;
+	}
+}
+
+
+int64_t DesyncBisector::firstMismatch(const uint32_t* b, size_t b_size) const {
+	size_t a_size = side_a_hashes.size();
+	size_t n = a_size < b_size ? a_size : b_size;
+	for (size_t i = 0; i < n; i++)
+		if (side_a_hashes[i] != b[i])
+			return (int64_t)i;
+	// one side ended earlier, so its script was shorter
+	return a_size != b_size ? (int64_t)n : -1;
+}
+
+
+size_t DesyncBisector::rangeHashesAtHigh(const uint32_t* hashes, size_t num_hashes, const RunEnd* end, const uint32_t*& out) const {
+	if (num_hashes > 0) {
+		out = hashes;
+		return num_hashes;
+	}
+	// the script ended right at hi, so there was no tick left to hash it on
+	if (end && end->tick == hi) {
+		out = end->hashes;
+		return end->num_ranges;
+	}
+	out = nullptr;
+	return 0;
+}
+
+
+void DesyncBisector::finish(int64_t divergence) {
+	first_divergence = divergence;
+	cur_phase = Phase::Done;
+}
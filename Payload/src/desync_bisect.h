@@ -0,0 +1,116 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "page_vector.h"
+#include "state_hash.h"
+#include "script_data.h"
+
+/*
+* Finds the first tick where two runs (sides) stop matching, e.g. the same script before & after
+* a change, or with & without quick reset. Hashing every tick of a long script is cheap but not
+* free, so instead both sides are run with a hash every checkpoint_interval ticks, which gives an
+* interval that the first divergence is in. Then both sides are run again with hashes at split
+* evenly spaced ticks inside of that interval (split = 2 is a plain bisection) until the interval
+* is down to a single tick, and one last time with a hash per range at that tick to find which
+* ranges (fields) differ. Every run after the first pair stops once its last tick has been hashed.
+*
+* This only works if each side plays back the same way every time it's run, otherwise the
+* interval ends up in the wrong place. The logic is separate from how runs are done (nextRun()
+* & finishRun()), so it can be driven by the mock game as well as by the real one (tick()).
+*/
+class DesyncBisector {
+public:
+	struct Settings {
+		uint32_t checkpoint_interval = 600;
+		uint32_t split = 2;
+	};
+
+	enum class Phase : uint8_t {
+		Idle,
+		Checkpoints, // the first pair of runs
+		Narrowing,
+		Fields,      // the last pair of runs, with a hash per range
+		Done,
+	};
+
+	struct Run {
+		int side;  // 0 or 1
+		StateHasher::Schedule schedule;
+	};
+
+	// the state that a run ended with, if it got to the end of its script
+	struct RunEnd {
+		uint32_t tick;  // the tick that a hash of this state would be for
+		size_t num_ranges;
+		uint32_t hashes[StateHasher::MAX_RANGES];  // one per range
+	};
+
+	DesyncBisector() = default;
+	DesyncBisector(const DesyncBisector&) = delete;
+	DesyncBisector& operator=(const DesyncBisector&) = delete;
+
+	void start(const Settings& settings);
+
+	// goes back to Idle, stops the current run if tick() started it
+	void cancel(ScriptManager& script_mgr);
+
+	// what to run next, returns false if we're done (or haven't started)
+	bool nextRun(Run& out) const;
+
+	// The log of the run from nextRun(), and how it ended (nullptr if it was stopped early). The
+	// end matters since the last checkpoint can be well before the end of the script.
+	void finishRun(const uint32_t* hashes, size_t num_hashes, const RunEnd* end);
+
+	Phase phase() const {return cur_phase;}
+
+	// the first tick that differs, -1 if there's none (or we're not done yet)
+	int64_t firstDivergence() const {return cur_phase == Phase::Done ? first_divergence : -1;}
+
+	// which ranges differ at the first divergence, bit i is range i
+	uint32_t differingRanges() const {return differing_ranges;}
+
+	// the first divergence is in (low, high], low is -1 if tick 0 might be it
+	int64_t low() const {return lo;}
+	int64_t high() const {return hi;}
+
+	uint32_t runsDone() const {return runs_done;}
+
+
+	/*
+	* Driving the runs in the game: the scripts for each side (messages as sent by the parser)
+	* are kept here, and tick() starts the next run whenever no script is running.
+	*/
+
+	// copies the scripts, returns false if either one is malformed (or there's no memory for them)
+	bool setScripts(const char* a, size_t a_size, const char* b, size_t b_size);
+
+	// true while a run that tick() started hasn't finished
+	bool running() const {return run_in_progress;}
+
+	// Called every frame while no script is running. Finishes the last run, and starts the next
+	// one if there is one. Sets the phase to Done if a script couldn't be started.
+	void tick(ScriptManager& script_mgr, StateHasher& hasher);
+
+private:
+	Settings settings;
+	Phase cur_phase = Phase::Idle;
+	int side = 0;
+	StateHasher::Schedule schedule;
+	PageVector<uint32_t> side_a_hashes;
+	RunEnd side_a_end;
+	bool side_a_ended = false;
+	int64_t lo = -1, hi = -1;
+	int64_t first_divergence = -1;
+	uint32_t differing_ranges = 0;
+	uint32_t runs_done = 0;
+
+	PageVector<char> scripts[2];
+	bool run_in_progress = false;
+
+	void setSchedule();
+	// the index of the first hash that differs between the sides, or -1 if they match
+	int64_t firstMismatch(const uint32_t* b, size_t b_size) const;
+	// the hash of each range at tick hi for a run, returns how many there are (0 if there's none)
+	size_t rangeHashesAtHigh(const uint32_t* hashes, size_t num_hashes, const RunEnd* end, const uint32_t*& out) const;
+	void finish(int64_t divergence);
+};
@@ -0,0 +1,168 @@
+#include "hooks.h"
+#include "global_info.h"
+#include "platform.h"
+#include "game_state.h"
+#include <stdlib.h>
+
+
+/*
+* The detours and the globals that they use. Unlike hooks.cpp (which installs them into the game),
+* nothing in here is Windows-only, so the harness can run them in a mock game on Linux.
+*/
+
+
+void* g_mBase = nullptr;
+size_t g_mSize = 0;
+
+void* (*g_game_malloc)(size_t size) = &malloc;
+void (*g_game_free)(void* ptr) = &free;
+
+
+namespace hooks {
+
+	// globals
+
+	RaceManager** g_race_manager = nullptr;
+	InputManager** input_manager = nullptr;
+	PlayerManager** m_player_manager = nullptr;
+	StateManager** state_manager_singleton = nullptr;
+	MainLoop** main_loop = nullptr;
+	STKConfig** stk_config = nullptr;
+	World** m_world = nullptr;
+	bool* g_is_no_graphics = nullptr;
+
+	// pointers to game functions
+
+	#define DEFINE_GAME_FUNC(name) _##name ORIG_##name = nullptr;
+
+	DEFINE_GAME_FUNC(InputManager__input);
+	DEFINE_GAME_FUNC(LocalPlayerController__action);
+	DEFINE_GAME_FUNC(RaceManager__startSingleRace);
+	DEFINE_GAME_FUNC(DeviceManager__getLatestUsedDevice);
+	DEFINE_GAME_FUNC(StateManager__createActivePlayer);
+	DEFINE_GAME_FUNC(RaceManager__setPlayerKart);
+	DEFINE_GAME_FUNC(DeviceManager__setAssignMode);
+	DEFINE_GAME_FUNC(MainLoop__getLimitedDt);
+	DEFINE_GAME_FUNC(RaceManager__exitRace);
+	DEFINE_GAME_FUNC(StateManager__resetActivePlayers);
+	DEFINE_GAME_FUNC(crt_srand);
+	DEFINE_GAME_FUNC(crt_rand);
+
+	#undef DEFINE_GAME_FUNC
+
+	// when the last frame started, after we slept
+	static uint64_t prev_time_us = 0;
+
+
+	// sleeps what's left of a frame to the millisecond, the simulator runs without sleeping
+	static void SleepRestOfFrame(uint64_t sleep_us) {
+		if (sleep_us >= 1000 && g_pInfo->pacer.realTime())
+			platform::SleepMs(int(sleep_us / 1000));
+	}
+
+
+	EventPropagation DETOUR_InputManager__input(InputManager* thisptr, SEvent& event) {
+		// don't accept inputs if we're running a script
+		if (event.EventType == EET_KEY_INPUT_EVENT &&
+			event.KeyInput.Key != IRR_KEY_ESCAPE &&
+			g_pInfo->script_mgr.runningScript()
+		) return EVENT_BLOCK_BUT_HANDLED;
+
+		if (g_pInfo->recorder.active())
+			g_pInfo->recorder.onEvent(event);
+		// e.g. escape, which pauses the game, or a gamepad's axis
+		if (g_pInfo->script_mgr.runningScript())
+			g_pInfo->script_mgr.forgetSentKeys();
+		return ORIG_InputManager__input(thisptr, event);
+	}
+
+
+	// called from asm if we don't want to exit
+	extern "C" float DETOUR_MainLoop__getLimitedDt_Func(MainLoop* thisptr) {
+		game_state::NewTick();
+		g_pInfo->ipc.try_accept();
+		float dt;
+		if (g_pInfo->script_mgr.runningScript()) {
+			/*
+			* When a script is running, we want to signal the script manager when exactly
+			* one physics step has been taken, (otherwise our scripts won't be consistent).
+			* This is the function that sleeps if the framerate is too fast; obviously, it
+			* would normally cap the speed of the game, so we sleep the exact amount
+			* necessary to sync the tickrate and framerate. In theory if we wanted to keep
+			* the framerate high when the playspeed is low we could probably just hook a
+			* physics step function.
+			*/
+			float play_speed = g_pInfo->script_mgr.getPlaySpeed();
+			uint64_t now_us = platform::TickCountUs();
+			uint64_t sleep_us;
+			if (play_speed == 0) {
+				// don't step, but cap framerate because we care about our carbon footprint
+				dt = 0;
+				g_pInfo->pacer.reset();
+				uint64_t frame_us = now_us - prev_time_us;
+				sleep_us = frame_us < 1000000 / 120 ? 1000000 / 120 - frame_us : 0;
+			} else {
+				dt = 1.0f / (**stk_config).m_physics_fps;
+				// at high playspeeds only every Nth tick is drawn, so that the game can keep up
+				*g_is_no_graphics = !g_pInfo->pacer.startTick(play_speed, dt, now_us - prev_time_us, now_us);
+				// a restore moves the script back, so this has to come before the inputs are sent
+				g_pInfo->savestates.tick(g_pInfo->script_mgr);
+				// the state that the last tick ended up with, before this tick's inputs
+				ScriptManager::Position pos;
+				if (g_pInfo->script_mgr.getPosition(pos)) {
+					g_pInfo->state_hasher.tick(pos.tick);
+					// a bisection run is done once its last tick has been hashed
+					if (g_pInfo->bisector.running() && g_pInfo->state_hasher.finished())
+						g_pInfo->script_mgr.stopScript();
+				}
+				g_pInfo->script_mgr.tickSignal();
+				// the tick's deadline is kept to within a millisecond, the next one makes up for the rest
+				sleep_us = g_pInfo->pacer.sleepUs(platform::TickCountUs());
+			}
+			SleepRestOfFrame(sleep_us);
+		} else if (g_pInfo->recorder.active()) {
+			// one tick per frame at normal speed like a script, so that the recording plays back the same
+			dt = 1.0f / (**stk_config).m_physics_fps;
+			g_pInfo->recorder.tick();
+			uint64_t tick_us = uint64_t(dt * 1000000);
+			uint64_t frame_us = platform::TickCountUs() - prev_time_us;
+			SleepRestOfFrame(frame_us < tick_us ? tick_us - frame_us : 0);
+		} else {
+			g_pInfo->pacer.reset();
+			if (g_pInfo->savestates.active())
+				g_pInfo->savestates.stop();
+			// starts the next bisection run (if there is one), which takes effect next frame
+			g_pInfo->bisector.tick(g_pInfo->script_mgr, g_pInfo->state_hasher);
+			dt = ORIG_MainLoop__getLimitedDt(thisptr);
+		}
+		prev_time_us = platform::TickCountUs();
+		return dt;
+	}
+
+
+	bool DETOUR_LocalPlayerController__action(LocalPlayerController* thisptr, PlayerAction action, int value, bool dry_run) {
+		// the game only calls this for the player's kart, it's the controller that scripts' keys go to
+		g_pInfo->script_mgr.setPlayerController(thisptr);
+		return ORIG_LocalPlayerController__action(thisptr, action, value, dry_run);
+	}
+
+
+	void DETOUR_crt_srand(unsigned int seed) {
+		ORIG_crt_srand(g_pInfo->script_mgr.seedFor(seed));
+	}
+
+
+	int DETOUR_crt_rand() {
+		// other threads could be drawing too, but the count is only for the stats
+		g_pInfo->script_mgr.countRandomDraw();
+		return ORIG_crt_rand();
+	}
+
+
+	void DETOUR_RaceManager__exitRace(RaceManager* thisptr, bool delete_world) {
+		g_pInfo->script_mgr.stopScript();
+		// whatever the player does next, the world isn't the race that a script loaded anymore
+		g_pInfo->script_mgr.forgetLoadedRace();
+		ORIG_RaceManager__exitRace(thisptr, delete_world);
+	}
+}
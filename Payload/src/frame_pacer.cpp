@@ -0,0 +1,87 @@
+#include <math.h>
+#include "frame_pacer.h"
+
+
+// how much of the playspeed's time per tick the frames get, the rest is for the frames that are slow
+static const float HEADROOM = 0.9f;
+// weight of each frame in the moving averages
+static const float SMOOTHING = 0.125f;
+
+
+static void Average(float& avg, uint64_t frame_us) {
+	avg = avg == 0 ? (float)frame_us : avg + ((float)frame_us - avg) * SMOOTHING;
+}
+
+
+bool FramePacer::startTick(float play_speed, float tick_secs, uint64_t frame_us, uint64_t now_us) {
+	if (running) {
+		Average(last_drawn ? drawn_us : skipped_us, frame_us);
+	} else {
+		running = true;
+		deadline_us = (double)now_us;
+		window_start_us = now_us;
+		window_game_secs = 0;
+		// the first tick is always drawn
+		since_drawn = MAX_SKIP;
+	}
+
+	if (now_us - window_start_us >= WINDOW_US) {
+		st.achieved_speed = (float)(window_game_secs * 1e6 / (now_us - window_start_us));
+		window_start_us = now_us;
+		window_game_secs = 0;
+	}
+	window_game_secs += tick_secs;
+	st.requested_speed = play_speed;
+	st.tick_ms = skipped_us / 1000;
+	st.render_ms = drawn_us > skipped_us ? (drawn_us - skipped_us) / 1000 : 0;
+
+	if (play_speed < 0) {
+		last_drawn = false;
+		st.frames_skipped++;
+		return false;
+	}
+	if (!real_time) {
+		last_drawn = true;
+		st.render_every = 1;
+		st.frames_drawn++;
+		return true;
+	}
+
+	double target_us = tick_secs / play_speed * 1e6;
+	// a frame that took far too long doesn't make the ticks after it hurry to catch up
+	if (now_us > deadline_us + MAX_BEHIND_US)
+		deadline_us = (double)now_us;
+	deadline_us += target_us;
+
+	st.render_every = skipping ? pickRenderEvery((float)target_us) : 1;
+	last_drawn = ++since_drawn >= st.render_every;
+	if (last_drawn)
+		since_drawn = 0;
+	(last_drawn ? st.frames_drawn : st.frames_skipped)++;
+	return last_drawn;
+}
+
+
+uint64_t FramePacer::sleepUs(uint64_t now_us) const {
+	if (!running || !real_time || st.requested_speed < 0 || deadline_us <= now_us)
+		return 0;
+	return (uint64_t)(deadline_us - now_us);
+}
+
+
+void FramePacer::reset() {
+	running = false;
+}
+
+
+uint32_t FramePacer::pickRenderEvery(float target_us) const {
+	if (drawn_us == 0)
+		return 1;
+	// N ticks take N * skipped_us + render_us, which has to fit in N * target_us
+	float render_us = drawn_us > skipped_us ? drawn_us - skipped_us : 0;
+	float room = target_us * HEADROOM - skipped_us;
+	if (room <= 0)
+		return MAX_SKIP;
+	float n = ceilf(render_us / room);
+	return n < 1 ? 1 : n > MAX_SKIP ? MAX_SKIP : (uint32_t)n;
+}
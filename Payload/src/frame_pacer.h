@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+
+/*
+* Keeps a script at its playspeed when drawing every tick would be too slow for it. At 120 ticks
+* per second, 8x leaves about a millisecond per tick, and a drawn frame takes several, so only
+* every Nth tick is drawn (the others set g_is_no_graphics). N is the smallest one that leaves
+* room for the drawn tick & the ones between it at the playspeed, from how long frames with &
+* without drawing have been taking, so it follows the playspeed and whatever is on screen.
+*
+* The sleeping works off of a deadline for each tick instead of a time per frame, so the short
+* frames make up for the long ones, and speeds that don't come out to a whole number of
+* milliseconds per tick still work.
+*/
+class FramePacer {
+public:
+	// draws at least every MAX_SKIP ticks, even if that can't keep up
+	static const uint32_t MAX_SKIP = 64;
+
+	struct Stats {
+		float requested_speed;   // the last script tick's playspeed, negative for unlimited
+		float achieved_speed;    // game time / real time over the last half second or so
+		uint32_t render_every;   // N
+		float tick_ms;           // how long a frame without drawing takes
+		float render_ms;         // how much drawing adds to that
+		uint64_t frames_drawn;
+		uint64_t frames_skipped;
+	};
+
+	/*
+	* Called at the start of each frame that takes a tick of a script, play_speed can't be 0.
+	* frame_us is how long the last frame took (without any sleeping), tick_secs is the game
+	* time that the tick takes. Returns whether the tick should be drawn, which is never for an
+	* unlimited playspeed.
+	*/
+	bool startTick(float play_speed, float tick_secs, uint64_t frame_us, uint64_t now_us);
+
+	// how long to sleep until the deadline of the tick from startTick(), 0 for unlimited
+	uint64_t sleepUs(uint64_t now_us) const;
+
+	// The script stopped or is paused, the next tick starts a new deadline (and its last frame
+	// isn't measured). The frame costs are kept since they don't change much between scripts.
+	void reset();
+
+	// off draws every tick, for comparing
+	void setSkipping(bool on) {skipping = on;}
+
+	// Off doesn't keep scripts to their playspeed: every tick is drawn (but for unlimited ones)
+	// and nothing sleeps, which is how the simulator runs the detours as fast as they go.
+	void setRealTime(bool on) {real_time = on;}
+	bool realTime() const {return real_time;}
+
+	const Stats& stats() const {return st;}
+
+private:
+	// ticks that a frame that ended too far behind its deadline doesn't try to catch up on
+	static const uint64_t MAX_BEHIND_US = 50000;
+	// how long the achieved speed is measured over
+	static const uint64_t WINDOW_US = 500000;
+
+	bool skipping = true;
+	bool real_time = true;
+	bool running = false;      // false until the first tick after reset()
+	bool last_drawn = false;
+	uint32_t since_drawn = 0;  // ticks since the last one that was drawn
+	double deadline_us = 0;
+	// moving averages of frames with & without drawing, 0 if there hasn't been one
+	float drawn_us = 0;
+	float skipped_us = 0;
+	uint64_t window_start_us = 0;
+	double window_game_secs = 0;
+	Stats st = {0, 0, 1, 0, 0, 0, 0};
+
+	uint32_t pickRenderEvery(float target_us) const;
+};
@@ -0,0 +1,52 @@
+// Generated by gen_game_state.py from game_state.schema, don't edit this file directly.
+#include "game_state.h"
+
+
+namespace game_state {
+
+	void InitGlobals() {
+		hooks::g_race_manager          = (RaceManager**)FROM_BASE(global_offsets::g_race_manager);
+		hooks::input_manager           = (InputManager**)FROM_BASE(global_offsets::input_manager);
+		hooks::m_player_manager        = (PlayerManager**)FROM_BASE(global_offsets::m_player_manager);
+		hooks::state_manager_singleton = (StateManager**)FROM_BASE(global_offsets::state_manager_singleton);
+		hooks::main_loop               = (MainLoop**)FROM_BASE(global_offsets::main_loop);
+		hooks::stk_config              = (STKConfig**)FROM_BASE(global_offsets::stk_config);
+		hooks::m_world                 = (World**)FROM_BASE(global_offsets::m_world);
+		hooks::g_is_no_graphics        = (bool*)FROM_BASE(global_offsets::g_is_no_graphics);
+	}
+
+
+	void NewTick() {
+		detail::cur_tick++;
+	}
+
+
+	namespace detail {
+
+		// starts at 1 so that the (zeroed) cache starts out invalid
+		uint32_t cur_tick = 1;
+		CachedPtr cache[2];
+
+
+		void* Resolve_device_manager() {
+			InputManagerView v0 = input_manager();
+			if (!v0)
+				return nullptr;
+			DeviceManagerView v1 = v0.m_device_manager();
+			if (!v1)
+				return nullptr;
+			return v1.ptr();
+		}
+
+
+		void* Resolve_current_player() {
+			PlayerManagerView v0 = m_player_manager();
+			if (!v0)
+				return nullptr;
+			PlayerProfileView v1 = v0.m_current_player();
+			if (!v1)
+				return nullptr;
+			return v1.ptr();
+		}
+	}
+}
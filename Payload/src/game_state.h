@@ -0,0 +1,254 @@
+// Generated by gen_game_state.py from game_state.schema, don't edit this file directly.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "hooks.h"
+
+/*
+* Typed accessors for game objects. Every struct in the schema gets a view class, which is just
+* a pointer with a getter for each of its fields, e.g.:
+*
+*   int fps = game_state::stk_config().m_physics_fps();
+*
+* Globals are one load away, and chains are resolved at most once per tick (until NewTick()
+* is called), so reading a field is a single load no matter how deep the object is. Views can
+* be null (e.g. when there's no world), check them with operator bool before reading.
+*/
+
+namespace game_state {
+
+	// offsets of globals from the start of supertuxkart.exe
+	namespace global_offsets {
+		const uintptr_t g_race_manager = 0xc8f340;
+		const uintptr_t input_manager = 0xc77e20;
+		const uintptr_t m_player_manager = 0xc672e0;
+		const uintptr_t state_manager_singleton = 0xca3400;
+		const uintptr_t main_loop = 0xc83d80;
+		const uintptr_t stk_config = 0xc67720;
+		const uintptr_t m_world = 0xc87100;
+		const uintptr_t g_is_no_graphics = 0xc72498;
+	}
+
+	// offsets of fields from the start of their struct
+	namespace offsets {
+		namespace RaceManager {
+			const size_t m_difficulty = 0x20;
+			const size_t m_major_mode = 0x24;
+			const size_t m_minor_mode = 0x28;
+			const size_t m_tracks = 0x48;
+			const size_t m_num_laps = 0x68;
+			const size_t m_ai_kart_override = 0xc0;
+			const size_t m_ai_superpower = 0xe0;
+			const size_t m_ai_kart_list = 0xe8;
+			const size_t m_num_karts = 0x1d8;
+		}
+		namespace InputManager {
+			const size_t m_device_manager = 0x30;
+		}
+		namespace DeviceManager {
+			const size_t m_single_player = 0x78;
+		}
+		namespace PlayerManager {
+			const size_t m_current_player = 0x18;
+		}
+		namespace STKConfig {
+			const size_t m_physics_fps = 0x354;
+		}
+	}
+
+	// make sure that game_structures.h agrees with the schema
+	static_assert(offsetof(::RaceManager, m_difficulty) == offsets::RaceManager::m_difficulty, "RaceManager::m_difficulty doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_major_mode) == offsets::RaceManager::m_major_mode, "RaceManager::m_major_mode doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_minor_mode) == offsets::RaceManager::m_minor_mode, "RaceManager::m_minor_mode doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_tracks) == offsets::RaceManager::m_tracks, "RaceManager::m_tracks doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_num_laps) == offsets::RaceManager::m_num_laps, "RaceManager::m_num_laps doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_ai_kart_override) == offsets::RaceManager::m_ai_kart_override, "RaceManager::m_ai_kart_override doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_ai_superpower) == offsets::RaceManager::m_ai_superpower, "RaceManager::m_ai_superpower doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_ai_kart_list) == offsets::RaceManager::m_ai_kart_list, "RaceManager::m_ai_kart_list doesn't match game_state.schema");
+	static_assert(offsetof(::RaceManager, m_num_karts) == offsets::RaceManager::m_num_karts, "RaceManager::m_num_karts doesn't match game_state.schema");
+	static_assert(offsetof(::InputManager, m_device_manager) == offsets::InputManager::m_device_manager, "InputManager::m_device_manager doesn't match game_state.schema");
+	static_assert(offsetof(::DeviceManager, m_single_player) == offsets::DeviceManager::m_single_player, "DeviceManager::m_single_player doesn't match game_state.schema");
+	static_assert(offsetof(::PlayerManager, m_current_player) == offsets::PlayerManager::m_current_player, "PlayerManager::m_current_player doesn't match game_state.schema");
+	static_assert(offsetof(::STKConfig, m_physics_fps) == offsets::STKConfig::m_physics_fps, "STKConfig::m_physics_fps doesn't match game_state.schema");
+
+	class RaceManagerView;
+	class InputManagerView;
+	class DeviceManagerView;
+	class PlayerManagerView;
+	class STKConfigView;
+	class StateManagerView;
+	class MainLoopView;
+	class PlayerProfileView;
+	class WorldView;
+
+	class RaceManagerView {
+	public:
+		explicit RaceManagerView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+		Difficulty& m_difficulty() const {return *(Difficulty*)(p + offsets::RaceManager::m_difficulty);}
+		MajorRaceModeType& m_major_mode() const {return *(MajorRaceModeType*)(p + offsets::RaceManager::m_major_mode);}
+		MinorRaceModeType& m_minor_mode() const {return *(MinorRaceModeType*)(p + offsets::RaceManager::m_minor_mode);}
+		std::vec_wrap<std::str_wrap>& m_tracks() const {return *(std::vec_wrap<std::str_wrap>*)(p + offsets::RaceManager::m_tracks);}
+		std::vec_wrap<int>& m_num_laps() const {return *(std::vec_wrap<int>*)(p + offsets::RaceManager::m_num_laps);}
+		std::str_wrap& m_ai_kart_override() const {return *(std::str_wrap*)(p + offsets::RaceManager::m_ai_kart_override);}
+		AISuperPower& m_ai_superpower() const {return *(AISuperPower*)(p + offsets::RaceManager::m_ai_superpower);}
+		std::vec_wrap<std::str_wrap>& m_ai_kart_list() const {return *(std::vec_wrap<std::str_wrap>*)(p + offsets::RaceManager::m_ai_kart_list);}
+		int& m_num_karts() const {return *(int*)(p + offsets::RaceManager::m_num_karts);}
+
+	private:
+		char* p;
+	};
+
+	class InputManagerView {
+	public:
+		explicit InputManagerView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+		inline DeviceManagerView m_device_manager() const;
+
+	private:
+		char* p;
+	};
+
+	class DeviceManagerView {
+	public:
+		explicit DeviceManagerView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+		void*& m_single_player() const {return *(void**)(p + offsets::DeviceManager::m_single_player);}
+
+	private:
+		char* p;
+	};
+
+	class PlayerManagerView {
+	public:
+		explicit PlayerManagerView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+		inline PlayerProfileView m_current_player() const;
+
+	private:
+		char* p;
+	};
+
+	class STKConfigView {
+	public:
+		explicit STKConfigView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+		int& m_physics_fps() const {return *(int*)(p + offsets::STKConfig::m_physics_fps);}
+
+	private:
+		char* p;
+	};
+
+	class StateManagerView {
+	public:
+		explicit StateManagerView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+	private:
+		char* p;
+	};
+
+	class MainLoopView {
+	public:
+		explicit MainLoopView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+	private:
+		char* p;
+	};
+
+	class PlayerProfileView {
+	public:
+		explicit PlayerProfileView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+	private:
+		char* p;
+	};
+
+	class WorldView {
+	public:
+		explicit WorldView(void* p = nullptr) : p((char*)p) {}
+		explicit operator bool() const {return p != nullptr;}
+		void* ptr() const {return p;}
+
+	private:
+		char* p;
+	};
+
+	inline DeviceManagerView InputManagerView::m_device_manager() const {
+		return DeviceManagerView(*(void**)(p + offsets::InputManager::m_device_manager));
+	}
+
+	inline PlayerProfileView PlayerManagerView::m_current_player() const {
+		return PlayerProfileView(*(void**)(p + offsets::PlayerManager::m_current_player));
+	}
+
+	// globals
+
+	inline RaceManagerView g_race_manager() {return RaceManagerView(*hooks::g_race_manager);}
+	inline InputManagerView input_manager() {return InputManagerView(*hooks::input_manager);}
+	inline PlayerManagerView m_player_manager() {return PlayerManagerView(*hooks::m_player_manager);}
+	inline StateManagerView state_manager_singleton() {return StateManagerView(*hooks::state_manager_singleton);}
+	inline MainLoopView main_loop() {return MainLoopView(*hooks::main_loop);}
+	inline STKConfigView stk_config() {return STKConfigView(*hooks::stk_config);}
+	inline WorldView m_world() {return WorldView(*hooks::m_world);}
+	inline bool& g_is_no_graphics() {return *hooks::g_is_no_graphics;}
+
+	// Sets all of the hooks:: globals from the offsets in the schema, called by HookAll().
+	void InitGlobals();
+
+	// Invalidates all cached chains, call this at the start of every tick. The cache is also
+	// stale if the world gets reloaded in the middle of a tick, but that only happens when a
+	// script is loading its map.
+	void NewTick();
+
+	namespace detail {
+		struct CachedPtr {
+			uint32_t tick;
+			void* ptr;
+		};
+
+		const int NUM_CACHED_CHAINS = 2;
+		extern uint32_t cur_tick;
+		extern CachedPtr cache[2];
+		void* Resolve_device_manager();
+		void* Resolve_current_player();
+	}
+
+	// chains
+
+	// input_manager -> m_device_manager
+	inline DeviceManagerView device_manager() {
+		detail::CachedPtr& c = detail::cache[0];
+		if (c.tick != detail::cur_tick) {
+			c.ptr = detail::Resolve_device_manager();
+			c.tick = detail::cur_tick;
+		}
+		return DeviceManagerView(c.ptr);
+	}
+
+	// m_player_manager -> m_current_player
+	inline PlayerProfileView current_player() {
+		detail::CachedPtr& c = detail::cache[1];
+		if (c.tick != detail::cur_tick) {
+			c.ptr = detail::Resolve_current_player();
+			c.tick = detail::cur_tick;
+		}
+		return PlayerProfileView(c.ptr);
+	}
+
+}
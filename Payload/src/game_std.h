@@ -0,0 +1,283 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include <utility>
+
+/*
+* So... strings and vectors (and probably other std concoctions) don't work for
+* us. For some reason which I can't really be bothered to figure out, the field
+* offsets that we get when using good ol' std::string, etc. don't match up with
+* what the game has, and are therefore not compatible. Even worse, sometimes
+* the offsets are different in debug vs. release builds!! There are all manner
+* of profanities I could use to express my dissatisfaction, but we'll just say
+* that it makes me want to stand awkwardly close to a substantially tall cliff
+* edge.
+*
+* Anyways, these are meant to serve as replacements, and should be used in
+* place of the normal std constructs whenever you call game functions or
+* reconstruct game structures. The game is built with MinGW, so the layouts are
+* libstdc++'s (checked with the static_asserts below).
+*
+* Anything that these allocate might get freed by the game (and vice versa), so
+* all memory goes through g_game_malloc/g_game_free, which point at the same
+* malloc/free that the game's operator new/delete use (see HookAll()).
+*/
+
+// the game's allocator, these default to our own CRT's malloc/free until HookAll() is called
+extern void* (*g_game_malloc)(size_t size);
+extern void (*g_game_free)(void* ptr);
+
+
+namespace std {
+
+	// std::string replacement
+	struct str_wrap {
+
+		static const size_t LOCAL_CAPACITY = 15;
+
+		char* ptr;
+		size_t len;
+		union {
+			size_t allocated_capacity; // only used when ptr doesn't point to buf
+			char buf[LOCAL_CAPACITY + 1];
+		};
+
+		str_wrap() : ptr(buf), len(0) {
+			buf[0] = '\0';
+		}
+
+		str_wrap(const char* str) : str_wrap(str, strlen(str)) {}
+
+		str_wrap(const char* str, size_t size) : str_wrap() {
+			assign(str, size);
+		}
+
+		str_wrap(const str_wrap& s) : str_wrap(s.ptr, s.len) {}
+
+		str_wrap(str_wrap&& s) noexcept : str_wrap() {
+			*this = std::move(s);
+		}
+
+		~str_wrap() {
+			if (!isLocal())
+				g_game_free(ptr);
+		}
+
+		str_wrap& operator=(const str_wrap& s) {
+			if (this != &s)
+				assign(s.ptr, s.len);
+			return *this;
+		}
+
+		str_wrap& operator=(str_wrap&& s) noexcept {
+			if (this == &s)
+				return *this;
+			if (s.isLocal()) {
+				assign(s.ptr, s.len);
+			} else {
+				// steal the heap buffer
+				if (!isLocal())
+					g_game_free(ptr);
+				ptr = s.ptr;
+				len = s.len;
+				allocated_capacity = s.allocated_capacity;
+				s.ptr = s.buf;
+			}
+			s.len = 0;
+			s.buf[0] = '\0';
+			return *this;
+		}
+
+		str_wrap& operator=(const char* str) {
+			return assign(str, strlen(str));
+		}
+
+		// reuses the current buffer if it's big enough
+		str_wrap& assign(const char* str, size_t size) {
+			if (size > capacity()) {
+				// str might point into our own buffer, so copy before freeing it
+				char* new_ptr = allocate(size);
+				memcpy(new_ptr, str, size);
+				if (!isLocal())
+					g_game_free(ptr);
+				ptr = new_ptr;
+				allocated_capacity = size;
+			} else {
+				memmove(ptr, str, size);
+			}
+			len = size;
+			ptr[len] = '\0';
+			return *this;
+		}
+
+		void reserve(size_t new_capacity) {
+			if (new_capacity <= capacity())
+				return;
+			char* new_ptr = allocate(new_capacity);
+			memcpy(new_ptr, ptr, len + 1);
+			if (!isLocal())
+				g_game_free(ptr);
+			ptr = new_ptr;
+			allocated_capacity = new_capacity;
+		}
+
+		// std::string will store the string locally if it's less than 16 chars long
+		bool isLocal() const {return ptr == buf;}
+
+		size_t capacity() const {return isLocal() ? LOCAL_CAPACITY : allocated_capacity;}
+
+		size_t size() const {return len;}
+
+		bool empty() const {return len == 0;}
+
+		const char* c_str() const {return ptr;}
+
+		bool operator==(const char* str) const {
+			return strlen(str) == len && memcmp(ptr, str, len) == 0;
+		}
+
+	private:
+		static char* allocate(size_t capacity) {
+			return (char*)g_game_malloc(capacity + 1); // +1 for null terminator
+		}
+	};
+
+	static_assert(sizeof(str_wrap) == 32, "str_wrap must match the game's std::string");
+	static_assert(offsetof(str_wrap, ptr) == 0, "str_wrap must match the game's std::string");
+	static_assert(offsetof(str_wrap, len) == 8, "str_wrap must match the game's std::string");
+	static_assert(offsetof(str_wrap, buf) == 16, "str_wrap must match the game's std::string");
+
+
+	/*
+	* A string that doesn't own its characters, for passing strings that we already have to game
+	* functions that take a const std::string& without copying them. The game can only read it,
+	* and the characters must outlive it.
+	*/
+	struct str_ref {
+
+		const char* ptr;
+		size_t len;
+		size_t allocated_capacity;
+		char __pad[8];
+
+		str_ref(const char* str) : str_ref(str, strlen(str)) {}
+
+		str_ref(const char* str, size_t size) : ptr(str), len(size), allocated_capacity(size) {}
+
+		operator const str_wrap&() const {
+			return *reinterpret_cast<const str_wrap*>(this);
+		}
+	};
+
+	static_assert(sizeof(str_ref) == sizeof(str_wrap), "str_ref must have the same layout as str_wrap");
+
+
+	// std::vector replacement, does not work for std::vector<bool>
+	template <class T>
+	struct vec_wrap {
+
+		T* first;
+		T* last;
+		T* end_of_storage;
+
+		vec_wrap() : first(nullptr), last(nullptr), end_of_storage(nullptr) {}
+
+		vec_wrap(vec_wrap&& v) noexcept : first(v.first), last(v.last), end_of_storage(v.end_of_storage) {
+			v.first = v.last = v.end_of_storage = nullptr;
+		}
+
+		// copying is almost always a mistake when working with game objects
+		vec_wrap(const vec_wrap&) = delete;
+		vec_wrap& operator=(const vec_wrap&) = delete;
+
+		vec_wrap& operator=(vec_wrap&& v) noexcept {
+			if (this != &v) {
+				clear();
+				g_game_free(first);
+				first = v.first;
+				last = v.last;
+				end_of_storage = v.end_of_storage;
+				v.first = v.last = v.end_of_storage = nullptr;
+			}
+			return *this;
+		}
+
+		~vec_wrap() {
+			clear();
+			g_game_free(first);
+		}
+
+		size_t size() const {return last - first;}
+
+		size_t capacity() const {return end_of_storage - first;}
+
+		bool empty() const {return first == last;}
+
+		T* begin() {return first;}
+		T* end() {return last;}
+		const T* begin() const {return first;}
+		const T* end() const {return last;}
+
+		T& operator[](size_t i) {return first[i];}
+		const T& operator[](size_t i) const {return first[i];}
+
+		// destroys all elements but keeps the storage around
+		void clear() {
+			for (T* p = first; p != last; p++)
+				p->~T();
+			last = first;
+		}
+
+		void reserve(size_t new_capacity) {
+			if (new_capacity > capacity())
+				relocate(new_capacity, nullptr);
+		}
+
+		template <class... Args>
+		T& emplace_back(Args&&... args) {
+			if (last == end_of_storage) {
+				// same growth as libstdc++
+				size_t old_size = size();
+				size_t new_capacity = old_size + (old_size ? old_size : 1);
+				/*
+				* args might refer to an element that's about to be moved, so the new element
+				* has to be constructed in the new storage before the old elements are moved.
+				*/
+				T* new_first = (T*)g_game_malloc(new_capacity * sizeof(T));
+				new (new_first + old_size) T(std::forward<Args>(args)...);
+				relocate(new_capacity, new_first);
+				return *last++;
+			}
+			new (last) T(std::forward<Args>(args)...);
+			return *last++;
+		}
+
+		void push_back(const T& val) {
+			emplace_back(val);
+		}
+
+		void push_back(T&& val) {
+			emplace_back(std::move(val));
+		}
+
+	private:
+		// moves all elements to new storage (allocates it if new_first is null) and frees the old one
+		void relocate(size_t new_capacity, T* new_first) {
+			if (!new_first)
+				new_first = (T*)g_game_malloc(new_capacity * sizeof(T));
+			size_t old_size = size();
+			for (size_t i = 0; i < old_size; i++) {
+				new (new_first + i) T(std::move(first[i]));
+				first[i].~T();
+			}
+			g_game_free(first);
+			first = new_first;
+			last = new_first + old_size;
+			end_of_storage = new_first + new_capacity;
+		}
+	};
+
+	static_assert(sizeof(vec_wrap<int>) == 24, "vec_wrap must match the game's std::vector");
+	static_assert(sizeof(vec_wrap<str_wrap>) == 24, "vec_wrap must match the game's std::vector");
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <stdint.h>
+#include <string.h>
+#include "game_std.h"
 
 /*
 * Suppose we hook a function foo(SEvent& event). Internally, that just gets
@@ -19,93 +21,6 @@
 */
 
 
-namespace std {
-
-	/*
-	* So... strings and vectors (and probably other std concoctions) don't work for
-	* us. For some reason which I can't really be bothered to figure out, the field
-	* offsets that we get when using good ol' std::string, etc. don't match up with
-	* what the game has, and are therefore not compatible. Even worse, sometimes
-	* the offsets are different in debug vs. release builds!! There are all manner
-	* of profanities I could use to express my dissatisfaction, but we'll just say
-	* that it makes me want to stand awkwardly close to a substantially tall cliff
-	* edge.
-	* 
-	* Anyways, these are meant to serve as replacements, and should be used in
-	* place of the normal std constructs whenever you call game functions or
-	* reconstruct game structures.
-	*/
-
-
-	// std::string replacement
-	struct str_wrap {
-
-		char* alias;
-		size_t size;
-		union {
-			size_t unknown; // seems to copy from size when buf is not used (might be capacity)
-			char buf[16];
-		};
-
-		str_wrap(const str_wrap& s) : str_wrap(s.alias, s.size) {}
-
-		str_wrap(const char* str) : str_wrap(str, strlen(str)) {}
-
-		// std::string will store the string locally if it's less than 16 chars long
-		str_wrap(const char* str, size_t size) {
-			this->size = size;
-			size_t capacity = size | 15; // rounds up to nearest 16 (-1) since alignment exists
-			if (size < 16) {
-				alias = buf;
-			} else {
-				alias = new char[capacity + 1]; // +1 for null terminator
-				unknown = size;
-			}
-			memcpy(alias, str, size);
-		}
-
-		~str_wrap() {
-			if (size >= 16)
-				delete alias;
-		}
-	};
-
-
-	// std::vector replacement, does not work for std::vector<bool>
-	template <class T>
-	struct vec_wrap {
-
-		T *first, *last;
-		size_t capacity;
-
-		void clear() {
-			if (!empty())
-				delete[] first; // TODO call destructor
-			first = last = nullptr;
-			capacity = 0;
-		}
-
-		bool empty() const {
-			return capacity == 0;
-		}
-
-		void push_back(T& val) {
-			if (empty() || (last - first) / sizeof(T) + 1 > capacity) {
-				// grow
-				size_t new_capacity = empty() ? 4 : capacity * 2;
-				T* new_arr = new T[new_capacity];
-				memcpy(new_arr, first, capacity);
-				delete[] first;
-				last = new_arr + (last - first);
-				first = new_arr;
-				capacity = new_capacity;
-			}
-			*++last = val;
-		}
-	};
-}
-
-
 enum Difficulty: uint32_t {
 	DIFFICULTY_EASY = 0,
 	DIFFICULTY_FIRST = DIFFICULTY_EASY,
@@ -158,6 +73,25 @@ struct DeviceManager {
 	void* m_single_player;
 };
 
+// the kart actions that keys can be bound to (the ones after PA_PAUSE_RACE are for the menus)
+enum PlayerAction : int {
+	PA_BEFORE_FIRST = -1,
+	PA_STEER_LEFT = 0,
+	PA_STEER_RIGHT,
+	PA_ACCEL,
+	PA_BRAKE,
+	PA_NITRO,
+	PA_DRIFT,
+	PA_RESCUE,
+	PA_FIRE,
+	PA_LOOK_BACK,
+	PA_PAUSE_RACE,
+};
+
+// the value that a held key is sent to the kart with, it's also the most that a joystick axis goes to
+const int INPUT_MAX_VALUE = 32768;
+
+
 struct StateManager;
 struct InputDevice;
 struct PlayerProfile;
@@ -187,15 +121,19 @@ struct RaceManager {
 	std::str_wrap m_ai_kart_override;
 	AISuperPower m_ai_superpower;
 	char __pad4[7];
-	std::vec_wrap<std::str_wrap> m_ai_kart_list; // we might be able to use this to set the specific AI karts
+	std::vec_wrap<std::str_wrap> m_ai_kart_list;
 	char __pad5[216];
 	int m_num_karts;
 
-	void setupBasicRace(Difficulty difficulty, int num_laps) {
+	// ai_karts is the list of AI karts to use, the game picks random ones if it's empty
+	void setupBasicRace(Difficulty difficulty, int num_laps, const char* const* ai_karts = nullptr, size_t num_ai_karts = 0) {
 		m_difficulty = difficulty;
-		// TODO
-		// m_num_laps.clear();
-		// m_num_laps.push_back(num_laps);
+		m_num_laps.clear();
+		m_num_laps.push_back(num_laps);
+		m_ai_kart_list.clear();
+		m_ai_kart_list.reserve(num_ai_karts);
+		for (size_t i = 0; i < num_ai_karts; i++)
+			m_ai_kart_list.emplace_back(ai_karts[i]);
 		m_num_karts = 0;
 		m_ai_kart_override = "";
 		m_ai_superpower = SUPERPOWER_NONE;
@@ -205,29 +143,42 @@ struct RaceManager {
 };
 
 struct MainLoop;
+struct LocalPlayerController;
 
 struct STKConfig {
 	char __pad0[0x354];
 	int m_physics_fps;
 };
 
+// bullet's math types (with single precision floats, which is what the game uses)
+struct btVector3 {
+	float m_floats[4]; // the 4th component is unused padding
+};
+
+struct btTransform {
+	btVector3 m_basis[3];
+	btVector3 m_origin;
+};
+
 
-typedef unsigned __int32 u32;
-typedef __int32 s32;
-typedef __int8 s8;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef int8_t s8;
 typedef char c8;
-typedef __int16 s16;
+typedef int16_t s16;
 typedef float f32;
 typedef double f64;
 
 
-enum EGUI_EVENT_TYPE;
-enum EMOUSE_INPUT_EVENT;
-enum EKEY_CODE;
-enum ETOUCH_INPUT_EVENT;
-enum ELOG_LEVEL;
-enum ESYSTEM_EVENT_TYPE;
-enum EAPPLICATION_EVENT_TYPE;
+// the underlying type is int just like MSVC would give them, but it has to be spelled
+// out for forward declarations to be valid in other compilers
+enum EGUI_EVENT_TYPE : int;
+enum EMOUSE_INPUT_EVENT : int;
+enum EKEY_CODE : int;
+enum ETOUCH_INPUT_EVENT : int;
+enum ELOG_LEVEL : int;
+enum ESYSTEM_EVENT_TYPE : int;
+enum EAPPLICATION_EVENT_TYPE : int;
 
 enum EventPropagation {
 	EVENT_BLOCK,
@@ -519,7 +470,7 @@ struct SEvent {
 };
 
 
-enum EKEY_CODE {
+enum EKEY_CODE : int {
 	IRR_KEY_UNKNOWN = 0x0,
 	IRR_KEY_LBUTTON = 0x01,  // Left mouse button
 	IRR_KEY_RBUTTON = 0x02,  // Right mouse button
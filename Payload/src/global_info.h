@@ -0,0 +1,48 @@
+#pragma once
+
+#include "script_data.h"
+#include "ipc.h"
+#include "mem_scanner.h"
+#include "savestates.h"
+#include "state_hash.h"
+#include "desync_bisect.h"
+#include "input_recorder.h"
+#include "asset_prefetch.h"
+#include "frame_pacer.h"
+
+
+// any sort of stuff we might need to keep track of so that we can cleanup in Exit()
+struct GlobalInfo {
+public:
+	// handle to this dll (an HMODULE), we'll need this to unload
+	void* hModule;
+	// singleton ipc object
+	IPC ipc;
+	// single object to keep track of where we are in the TAS script
+	ScriptManager script_mgr;
+	// for finding where game state lives, driven over IPC
+	MemScanner scanner;
+	// snapshots of the game for going back to an earlier tick in the script
+	SaveStates savestates;
+	// per-tick hashes of game state, for checking that a script plays back the same way
+	StateHasher state_hasher;
+	// reruns two scripts to find the first tick where they differ
+	DesyncBisector bisector;
+	// turns someone playing into framebulks, driven over IPC
+	InputRecorder recorder;
+	// reads the files of a new script's track & kart while the game gets to loading them
+	AssetPrefetcher prefetcher;
+	// keeps a script at its playspeed by only drawing some of its ticks
+	FramePacer pacer;
+
+	GlobalInfo(void* hModule) : hModule(hModule) {}
+};
+
+
+extern GlobalInfo* g_pInfo;
+
+
+// Signal that we want to exit as soon as possible (will exit during next engine loop).
+// Only usable after hooks have been initialized. If reason is specified, will display
+// a message box with the reason on exit.
+void QueueExit(const char* reason = nullptr);
@@ -1,40 +1,53 @@
 #include "hooks.h"
 #include "utils.h"
-
-
-void* g_mBase = nullptr;
+#include "game_state.h"
 
 
 namespace hooks {
 
-	// globals
-	
-	RaceManager** g_race_manager = nullptr;
-	InputManager** input_manager = nullptr;
-	PlayerManager** m_player_manager = nullptr;
-	StateManager** state_manager_singleton = nullptr;
-	MainLoop** main_loop = nullptr;
-	STKConfig** stk_config = nullptr;
-	World** m_world = nullptr;
-	bool* g_is_no_graphics = nullptr;
-
-	// pointers to game functions
+	// a vtable entry that we've swapped, so that we can put it back on unload
+	struct VirtualHook {
+		void** slot;
+		void* original;
+	};
+
+	// there's only a handful of virtual functions we'd ever want to hook
+	static const int MAX_VIRTUAL_HOOKS = 16;
+	static VirtualHook virtual_hooks[MAX_VIRTUAL_HOOKS];
+	static int num_virtual_hooks = 0;
+
+
+	// swaps a vtable entry (vtables live in .rdata, so we need to make the page writable first)
+	static bool SwapVTableSlot(void** slot, void* new_func) {
+		DWORD old_protect;
+		if (!VirtualProtect(slot, sizeof(void*), PAGE_READWRITE, &old_protect))
+			return false;
+		InterlockedExchangePointer(slot, new_func);
+		VirtualProtect(slot, sizeof(void*), old_protect, &old_protect);
+		return true;
+	}
 
-	#define DEFINE_GAME_FUNC(name) _##name ORIG_##name = nullptr;
 
-	DEFINE_GAME_FUNC(InputManager__input);
-	DEFINE_GAME_FUNC(RaceManager__startSingleRace);
-	DEFINE_GAME_FUNC(DeviceManager__getLatestUsedDevice);
-	DEFINE_GAME_FUNC(StateManager__createActivePlayer);
-	DEFINE_GAME_FUNC(RaceManager__setPlayerKart);
-	DEFINE_GAME_FUNC(DeviceManager__setAssignMode);
-	DEFINE_GAME_FUNC(MainLoop__getLimitedDt);
-	DEFINE_GAME_FUNC(RaceManager__exitRace);
-	DEFINE_GAME_FUNC(StateManager__resetActivePlayers);
+	/*
+	* LocalPlayerController::action isn't at a known offset, so it's taken from the class's vtable.
+	* Its slot comes from the order that Controller declares its virtual functions in: the
+	* destructor, reset, update, handleZipper, collectedItem, the two crashed overloads,
+	* setPosition, isPlayerController, isLocalPlayerController and then action. The two before it
+	* both just return true for this class, which is checked before trusting the slot, so a game
+	* version with a different layout goes without the hook instead of hooking the wrong function.
+	*/
+	static const size_t SLOT_IS_PLAYER_CONTROLLER = 8;
+	static const size_t SLOT_IS_LOCAL_PLAYER_CONTROLLER = 9;
+	static const size_t SLOT_ACTION = 10;
 
-	#undef DEFINE_GAME_FUNC
 
-	static uint64_t prev_time = 0;
+	// whether func is "return true" (mov al, 1; ret), through the jmp of an incremental link if there is one
+	static bool ReturnsTrue(const void* func) {
+		auto code = (const uint8_t*)func;
+		if (code[0] == 0xe9)
+			code += 5 + *(const int32_t*)(code + 1);
+		return code[0] == 0xb0 && code[1] == 0x01 && code[2] == 0xc3;
+	}
 
 
 	// (copied doc string from MH_CreateHook)
@@ -75,6 +88,26 @@ namespace hooks {
 		) return stat;
 
 
+		// scripts' inputs go through InputManager::input without this one, see ScriptManager::sendInput()
+		void** controller_vtable = FindVTable(g_mBase, "LocalPlayerController");
+		if (
+			controller_vtable &&
+			ReturnsTrue(controller_vtable[SLOT_IS_PLAYER_CONTROLLER]) &&
+			ReturnsTrue(controller_vtable[SLOT_IS_LOCAL_PLAYER_CONTROLLER]) &&
+			MH_FAILED(HookVTableSlot(controller_vtable, SLOT_ACTION, &DETOUR_LocalPlayerController__action, ORIG_LocalPlayerController__action))
+		) return stat;
+
+		// The CRT's random numbers, a script with a seed gets the same ones on every run. Only these are
+		// pinned, item boxes have their own generator and its seeding hasn't been found in the exe.
+		void* game_srand = GetImportedFunc(g_mBase, "srand");
+		void* game_rand = GetImportedFunc(g_mBase, "rand");
+		if (
+			(game_srand && MH_FAILED(QueueFunctionHook(game_srand, &DETOUR_crt_srand, ORIG_crt_srand))) ||
+			(game_rand && MH_FAILED(QueueFunctionHook(game_rand, &DETOUR_crt_rand, ORIG_crt_rand))) ||
+			MH_FAILED(MH_ApplyQueued())
+		) return stat;
+
+
 		// get plain function pointers (not hooks)
 		#define SET_FUNC_PTR(name, offset) ORIG_##name = (_##name)FROM_BASE(offset);
 
@@ -86,15 +119,21 @@ namespace hooks {
 		SET_FUNC_PTR(StateManager__resetActivePlayers,   0x437510);
 
 
-		// init global pointers
-		g_race_manager          =   (RaceManager**) FROM_BASE(0xc8f340);
-		input_manager           =  (InputManager**) FROM_BASE(0xc77e20);
-		m_player_manager        = (PlayerManager**) FROM_BASE(0xc672e0);
-		state_manager_singleton =  (StateManager**) FROM_BASE(0xca3400);
-		main_loop               =      (MainLoop**) FROM_BASE(0xc83d80);
-		stk_config              =     (STKConfig**) FROM_BASE(0xc67720);
-		m_world                 =         (World**) FROM_BASE(0xc87100);
-		g_is_no_graphics        =           (bool*) FROM_BASE(0xc72498);
+		// init global pointers (the offsets are in game_state.schema)
+		game_state::InitGlobals();
+
+
+		/*
+		* The game's operator new/delete are just malloc/free, but from whichever CRT the game
+		* was linked against, which isn't necessarily ours. Anything that we put in a game
+		* container has to come from the game's heap since the game will free it eventually.
+		*/
+		auto game_malloc = (decltype(g_game_malloc))GetImportedFunc(g_mBase, "malloc");
+		auto game_free = (decltype(g_game_free))GetImportedFunc(g_mBase, "free");
+		if (game_malloc && game_free) {
+			g_game_malloc = game_malloc;
+			g_game_free = game_free;
+		}
 
 
 		#undef FAILED_HOOK
@@ -105,56 +144,35 @@ namespace hooks {
 	}
 
 
-	EventPropagation DETOUR_InputManager__input(InputManager* thisptr, SEvent& event) {
-		// don't accept inputs if we're running a script
-		if (event.EventType == EET_KEY_INPUT_EVENT &&
-			event.KeyInput.Key != IRR_KEY_ESCAPE &&
-			g_pInfo->script_mgr.runningScript()
-		) return EVENT_BLOCK_BUT_HANDLED;
+	MH_STATUS HookVTableSlot(void** vtable, size_t vtable_idx, LPVOID pDetour, LPVOID* ppOriginal) {
+		if (!vtable)
+			return MH_ERROR_NOT_INITIALIZED;
 
-		return ORIG_InputManager__input(thisptr, event);
-	}
+		void** slot = vtable + vtable_idx;
 
+		for (int i = 0; i < num_virtual_hooks; i++)
+			if (virtual_hooks[i].slot == slot)
+				return MH_ERROR_ALREADY_CREATED;
+		if (num_virtual_hooks >= MAX_VIRTUAL_HOOKS)
+			return MH_ERROR_MEMORY_ALLOC;
 
-	// called from asm if we don't want to exit
-	extern "C" float DETOUR_MainLoop__getLimitedDt_Func(MainLoop* thisptr) {
-		g_pInfo->ipc.try_accept();
-		float dt;
-		if (g_pInfo->script_mgr.runningScript()) {
-			/*
-			* When a script is running, we want to signal the script manager when exactly
-			* one physics step has been taken, (otherwise our scripts won't be consistent).
-			* This is the function that sleeps if the framerate is too fast; obviously, it
-			* would normally cap the speed of the game, so we sleep the exact amount
-			* necessary to sync the tickrate and framerate. In theory if we wanted to keep
-			* the framerate high when the playspeed is low we could probably just hook a
-			* physics step function.
-			*/
-			float play_speed = g_pInfo->script_mgr.getPlaySpeed();
-			int target_frametime_ms;
-			if (play_speed == 0) {
-				// don't step, but cap framerate because we care about our carbon footprint
-				dt = 0;
-				target_frametime_ms = int(1.0f / 120.0f * 1000.0f);
-			} else {
-				dt = 1.0f / (**stk_config).m_physics_fps;
-				target_frametime_ms = int(dt / play_speed * 1000);
-				g_pInfo->script_mgr.tickSignal();
-			}
-			// uint64_t cur_time = GetTickCount64();
-			int sleep_time_ms = target_frametime_ms - int(GetTickCount64() - prev_time);
-			if (play_speed >= 0 && sleep_time_ms > 0)
-				Sleep(sleep_time_ms);
-		} else {
-			dt = ORIG_MainLoop__getLimitedDt(thisptr);
-		}
-		prev_time = GetTickCount64();
-		return dt;
+		// the detour might get called as soon as we swap, so set the original first
+		void* original = *slot;
+		if (ppOriginal)
+			*ppOriginal = original;
+
+		if (!SwapVTableSlot(slot, pDetour))
+			return MH_ERROR_MEMORY_PROTECT;
+
+		virtual_hooks[num_virtual_hooks++] = {slot, original};
+		return MH_OK;
 	}
 
 
-	void DETOUR_RaceManager__exitRace(RaceManager* thisptr, bool delete_world) {
-		g_pInfo->script_mgr.stopScript();
-		ORIG_RaceManager__exitRace(thisptr, delete_world);
+	void UnhookAllVirtual() {
+		while (num_virtual_hooks > 0) {
+			VirtualHook& hook = virtual_hooks[--num_virtual_hooks];
+			SwapVTableSlot(hook.slot, hook.original);
+		}
 	}
 }
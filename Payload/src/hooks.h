@@ -4,11 +4,15 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 
+#ifdef _WIN32
 #include "minhook\include\MinHook.h"
+#endif
 #include "game_structures.h"
 
 // pointer to start of supertuxkart.exe, not initialized until HookAll()
 extern void* g_mBase;
+// size of supertuxkart.exe in memory, initialized at the same time as g_mBase
+extern size_t g_mSize;
 
 
 #define FROM_BASE(offset) ((void*)((uintptr_t)g_mBase + offset))
@@ -21,10 +25,39 @@ extern void* g_mBase;
 
 namespace hooks {
 
+// Installing hooks only makes sense when we're injected into the game. Everything below this
+// section is portable, the globals & detours are defined in detours.cpp (and the simulator
+// provides its own definitions for the globals).
+#ifdef _WIN32
+
 	MH_STATUS HookAll();
 
 
-	// globals
+	/*
+	* Hooks a virtual function by swapping its entry in a class's vtable (e.g. one found with
+	* FindVTable()). Unlike a MinHook detour this doesn't touch the function's code at all, so
+	* there's no prologue to relocate, no threads to freeze, and no extra jump through a
+	* trampoline (Simulator.exe -V compares what the two cost per call). The catch is that it only
+	* intercepts calls that go through the vtable, and it affects every object of the class. The
+	* swap is a single atomic write, so it's fine to do this while the game thread is running. The
+	* original function is written to ppOriginal BEFORE the swap so that the detour can always
+	* call it.
+	*/
+	MH_STATUS HookVTableSlot(void** vtable, size_t vtable_idx, LPVOID pDetour, LPVOID* ppOriginal);
+
+	template <typename T>
+	inline MH_STATUS HookVTableSlot(void** vtable, size_t vtable_idx, LPVOID pDetour, T*& pOriginal) {
+		return HookVTableSlot(vtable, vtable_idx, pDetour, reinterpret_cast<LPVOID*>(&pOriginal));
+	}
+
+	// Puts back every vtable entry that was swapped with HookVTableSlot(), must be called from
+	// the game thread (so that we're not in any of the detours) before we unload.
+	void UnhookAllVirtual();
+
+#endif
+
+
+	// globals, see game_state.schema for their offsets
 	extern RaceManager** g_race_manager;
 	extern InputManager** input_manager;
 	extern PlayerManager** m_player_manager;
@@ -52,6 +85,14 @@ namespace hooks {
 	// the main input function for the game
 	DECLARE_HOOK(InputManager__input, EventPropagation, InputManager* thisptr, SEvent& event);
 
+	// What InputManager::input ends up calling (through the controller's vtable) for a key that's
+	// bound to a kart action, value goes from 0 to INPUT_MAX_VALUE. The detour tells the
+	// ScriptManager which controller the player's keys go to, so that scripts can skip the rest of
+	// InputManager::input. It isn't at a known offset: HookAll() finds LocalPlayerController's vtable
+	// by its RTTI (FindVTable()), checks that the isPlayerController & isLocalPlayerController slots
+	// (8 & 9) both return true, and then swaps the action slot (10) with HookVTableSlot().
+	DECLARE_HOOK(LocalPlayerController__action, bool, LocalPlayerController* thisptr, PlayerAction action, int value, bool dry_run);
+
 	// starts a new track
 	DECLARE_FUNC(RaceManager__startSingleRace, void, RaceManager* thisptr, const std::str_wrap& track_ident, const int num_laps, bool from_overworld);
 
@@ -76,6 +117,14 @@ namespace hooks {
 	// called once per engine loop to determine the next timestep to take, detour is partially implemented in asm
 	DECLARE_FUNC(MainLoop__getLimitedDt, float, MainLoop* thisptr);
 	extern "C" float DETOUR_MainLoop__getLimitedDt(MainLoop* thisptr);
+	// the C++ part of the detour, which the asm jumps to when we're not exiting
+	extern "C" float DETOUR_MainLoop__getLimitedDt_Func(MainLoop* thisptr);
+
+	// The CRT's random numbers, from whichever CRT the game was linked against (like g_game_malloc).
+	// The game seeds them with the time, the detour passes on a script's seed instead while one with
+	// a seed is running (see ScriptManager::seedFor()). The rand() detour only counts the draws.
+	DECLARE_HOOK(crt_srand, void, unsigned int seed);
+	DECLARE_HOOK(crt_rand, int);
 
 	// virtual function for World, called when reloading/restarting a world/race
 	typedef void (*_World__reset)(World* thisptr, bool restart);
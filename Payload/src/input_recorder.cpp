@@ -0,0 +1,127 @@
+#include <string.h>
+#include "input_recorder.h"
+#include "platform.h"
+
+
+bool InputRecorder::start() {
+	free();
+	mem_size = RING_SIZE * sizeof(Framebulk) + sizeof(PollHeader) + MAX_POLL_FRAMEBULKS * Framebulk::FB_SIZE_BYTES;
+	mem = (char*)platform::AllocPages(mem_size);
+	if (!mem) {
+		mem_size = 0;
+		return false;
+	}
+	ring = (Framebulk*)mem;
+	poll_buf = mem + RING_SIZE * sizeof(Framebulk);
+	ring_head = ring_count = 0;
+	overflowed = false;
+	ticks = 0;
+	held = 0;
+	left_held = right_held = false;
+	steer = 0;
+	cur_state = State::Armed;
+	return true;
+}
+
+
+void InputRecorder::stop() {
+	if (cur_state == State::Recording)
+		push(cur_fb);
+	if (cur_state != State::Idle)
+		cur_state = State::Stopped;
+}
+
+
+void InputRecorder::onEvent(const SEvent& event) {
+	if (event.EventType != EET_KEY_INPUT_EVENT)
+		return;
+	EKEY_CODE key = event.KeyInput.Key;
+	bool down = event.KeyInput.PressedDown;
+	// letting go of one direction goes back to the other one if it's still held
+	if (key == IRR_KEY_LEFT) {
+		left_held = down;
+		steer = down ? -1.0f : right_held ? 1.0f : 0;
+		return;
+	}
+	if (key == IRR_KEY_RIGHT) {
+		right_held = down;
+		steer = down ? 1.0f : left_held ? -1.0f : 0;
+		return;
+	}
+	for (int i = 0; i < Framebulk::NUM_BUTTON_FLAGS; i++) {
+		if (key == Framebulk::FLAG_KEYS[i]) {
+			held = down ? held | (1 << i) : held & ~(1 << i);
+			return;
+		}
+	}
+}
+
+
+void InputRecorder::tick() {
+	if (cur_state == State::Armed) {
+		// the script's last tick let go of every key, so a replay has to do the same on that tick
+		cur_state = State::Recording;
+		cur_fb = Framebulk();
+		cur_fb.num_ticks = 1;
+		ticks = 1;
+	}
+	if (cur_state != State::Recording)
+		return;
+
+	if (cur_fb.flags == held && cur_fb.turn_angle == steer && cur_fb.num_ticks < MAX_FB_TICKS) {
+		cur_fb.num_ticks++;
+	} else {
+		push(cur_fb);
+		// push() stops recording if the ring is full
+		if (cur_state != State::Recording)
+			return;
+		cur_fb.flags = held;
+		cur_fb.turn_angle = steer;
+		cur_fb.num_ticks = 1;
+	}
+	ticks++;
+}
+
+
+void InputRecorder::poll(const char*& msg, size_t& size) {
+	size_t n = ring_count < MAX_POLL_FRAMEBULKS ? ring_count : MAX_POLL_FRAMEBULKS;
+	PollHeader header = this->header();
+	header.num_framebulks = (uint32_t)n;
+	char* out = mem ? poll_buf : (char*)&header_only;
+	memcpy(out, &header, sizeof(header));
+	for (size_t i = 0; i < n; i++) {
+		const Framebulk& fb = ring[(ring_head + i) % RING_SIZE];
+		char* p = out + sizeof(header) + i * Framebulk::FB_SIZE_BYTES;
+		memcpy(p, &fb.flags, sizeof(uint16_t));
+		memcpy(p + 2, &fb.num_ticks, sizeof(uint16_t));
+		memcpy(p + 4, &fb.turn_angle, sizeof(float));
+	}
+	ring_head = (ring_head + n) % RING_SIZE;
+	ring_count -= n;
+	msg = out;
+	size = sizeof(header) + n * Framebulk::FB_SIZE_BYTES;
+}
+
+
+void InputRecorder::push(const Framebulk& fb) {
+	if (ring_count == RING_SIZE) {
+		// the client isn't keeping up, stop here rather than record something that's missing a part
+		overflowed = true;
+		cur_state = State::Stopped;
+		return;
+	}
+	ring[(ring_head + ring_count) % RING_SIZE] = fb;
+	ring_count++;
+}
+
+
+void InputRecorder::free() {
+	if (mem)
+		platform::FreePages(mem, mem_size);
+	mem = nullptr;
+	mem_size = 0;
+	ring = nullptr;
+	poll_buf = nullptr;
+	ring_head = ring_count = 0;
+	cur_state = State::Idle;
+}
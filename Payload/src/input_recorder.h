@@ -0,0 +1,107 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "script_data.h"
+
+/*
+* Records someone playing the game as framebulks, so that a script can be made by playing instead
+* of by writing it by hand. A recording picks up where a script leaves off (the script loads the
+* map, and can also play the start of the race), and while recording the tick driver keeps taking
+* one tick per frame the same way a script does, so that the recording plays back the same way.
+*
+* The keys that scripts press (see Framebulk::FLAG_KEYS) are sampled once per tick, and ticks in
+* a row with the same keys are merged into one framebulk. Finished framebulks go into a ring that
+* the client drains over IPC while the recording goes on. Everything is allocated when recording
+* starts, so nothing is allocated per tick (or per key event).
+*
+* Like the game, only what's held when a tick starts counts, so a key that's pressed & released
+* between two ticks isn't recorded. Steering also works like in the game: if both directions are
+* held, the one that was pressed last wins.
+*/
+class InputRecorder {
+public:
+	// finished framebulks that fit in the ring, at 8 bytes each
+	static const size_t RING_SIZE = 1 << 16;
+	// the most framebulks that are sent back per poll
+	static const size_t MAX_POLL_FRAMEBULKS = 1 << 13;
+	// framebulks are split after this many ticks, the parser packs num_ticks as a signed short
+	static const uint16_t MAX_FB_TICKS = 0x7fff;
+
+	enum class State : uint8_t {
+		Idle,
+		Armed,     // waiting for the script that recording continues from to end
+		Recording,
+		Stopped,   // not recording, but there can still be framebulks to poll
+	};
+
+	// the header of every poll reply, followed by the framebulks (in the script message format)
+	struct PollHeader {
+		uint8_t state;
+		uint8_t overflowed;  // the ring filled up, so recording stopped
+		uint16_t reserved;
+		uint32_t ticks;      // ticks recorded so far
+		uint32_t num_framebulks;
+	};
+
+	InputRecorder() = default;
+	InputRecorder(const InputRecorder&) = delete;
+	InputRecorder& operator=(const InputRecorder&) = delete;
+
+	~InputRecorder() {
+		free();
+	}
+
+	// Throws out the last recording and waits for the current script to end. Returns false if we
+	// ran out of memory.
+	bool start();
+
+	// ends the recording (the framebulk in progress is finished), what's left can still be polled
+	void stop();
+
+	State state() const {return cur_state;}
+
+	// is the tick driver supposed to call tick()?
+	bool active() const {return cur_state == State::Armed || cur_state == State::Recording;}
+
+	bool recording() const {return cur_state == State::Recording;}
+
+	// for every event that the game gets while we're active()
+	void onEvent(const SEvent& event);
+
+	// Called once per tick while no script is running and we're active(), before the game steps.
+	// The first call starts the recording.
+	void tick();
+
+	// Takes up to MAX_POLL_FRAMEBULKS finished framebulks out of the ring, and points msg at a
+	// PollHeader followed by them. msg stays valid until the next call.
+	void poll(const char*& msg, size_t& size);
+
+	// the state of the recording, with no framebulks
+	PollHeader header() const {
+		return {(uint8_t)cur_state, (uint8_t)overflowed, 0, ticks, 0};
+	}
+
+private:
+	State cur_state = State::Idle;
+	bool overflowed = false;
+	uint32_t ticks = 0;
+
+	// the ring & the poll reply are one allocation
+	char* mem = nullptr;
+	size_t mem_size = 0;
+	Framebulk* ring = nullptr;
+	size_t ring_head = 0;  // next framebulk to poll
+	size_t ring_count = 0;
+	char* poll_buf = nullptr;
+	PollHeader header_only = {};  // the poll reply when nothing's allocated
+
+	Framebulk cur_fb = {};  // the framebulk in progress, not in the ring yet
+
+	// bit i is Framebulk::FLAG_KEYS[i]
+	uint16_t held = 0;
+	bool left_held = false, right_held = false;
+	float steer = 0;  // -1, 0 or 1
+
+	void push(const Framebulk& fb);
+	void free();
+};
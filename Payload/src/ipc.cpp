@@ -1,24 +1,25 @@
-#include <WinSock2.h>
-#include <WS2tcpip.h>
 #include <iostream>
+#include <stdio.h>
+#include <cstring>
 #include <vector>
 #include <string>
 
 #include "script_data.h"
 #include "ipc.h"
-#include "utils.h"
+#include "global_info.h"
+#include "hooks.h"
+#include "pointer_scanner.h"
+#include "state_hash.h"
+#include "desync_bisect.h"
+#include "input_recorder.h"
 
-#pragma comment(lib, "Ws2_32.lib")
 
-
-// Initializes WSA & the listen_socket. For accepting clients, see IPC::try_accept().
-// WSACleanup & closesocket are NOT called on failure, as they are called in the destructor.
+// Initializes sockets & the listen_socket. For accepting clients, see IPC::try_accept().
+// CleanupSockets & CloseSocket are NOT called on failure, as they are called in the destructor.
 void IPC::init(const char*& failReason) {
 
-	WSADATA wsaData;
-
-	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-		failReason = "IPC: Failed to initialize Winsock2";
+	if (!platform::InitSockets()) {
+		failReason = "IPC: Failed to initialize sockets";
 		return;
 	}
 
@@ -26,7 +27,7 @@ void IPC::init(const char*& failReason) {
 	struct addrinfo* ptr = nullptr;
 	struct addrinfo hints;
 
-	ZeroMemory(&hints, sizeof(hints));
+	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = AF_INET;
 	hints.ai_socktype = SOCK_STREAM;
 	hints.ai_protocol = IPPROTO_TCP;
@@ -37,7 +38,13 @@ void IPC::init(const char*& failReason) {
 	}
 
 	listen_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
-	if (listen_socket == INVALID_SOCKET) {
+	if (listen_socket == platform::INVALID_SOCK) {
+		freeaddrinfo(result);
+		failReason = "IPC: Error initializing listen socket";
+		return;
+	}
+
+	if (!platform::AllowRebind(listen_socket)) {
 		freeaddrinfo(result);
 		failReason = "IPC: Error initializing listen socket";
 		return;
@@ -45,21 +52,20 @@ void IPC::init(const char*& failReason) {
 
 	int res = bind(listen_socket, result->ai_addr, (int)result->ai_addrlen);
 	freeaddrinfo(result);
-	if (res == SOCKET_ERROR) {
+	if (res == platform::SOCK_ERROR) {
 		failReason = "IPC: Error binding listen socket";
 		return;
 	}
 
 	// Initializes buffer supporting 1 incoming connection
 	res = listen(listen_socket, 1);
-	if (res == SOCKET_ERROR) {
+	if (res == platform::SOCK_ERROR) {
 		failReason = "IPC: Listen failed";
 		return;
 	}
 
 	// set socket to be non-blocking
-	u_long block_mode = 1;
-	if (ioctlsocket(listen_socket, FIONBIO, &block_mode) == SOCKET_ERROR) {
+	if (!platform::SetNonBlocking(listen_socket)) {
 		failReason = "IPC: Could not set socket to be non-blocking";
 		return;
 	}
@@ -68,21 +74,25 @@ void IPC::init(const char*& failReason) {
 
 // IPC destructor. Cleans up memory and closes socket
 IPC::~IPC() {
-	if (listen_socket != INVALID_SOCKET)
-		closesocket(listen_socket);
-	WSACleanup();
+	if (listen_socket != platform::INVALID_SOCK)
+		platform::CloseSocket(listen_socket);
+	platform::CleanupSockets();
 }
 
 
 void IPC::try_accept() {
 
-	if (client_socket == INVALID_SOCKET) {
+	// not initialized (the simulator runs the detours without IPC)
+	if (listen_socket == platform::INVALID_SOCK)
+		return;
+
+	if (client_socket == platform::INVALID_SOCK) {
 		cl_sock_hold_count = 0;
 		// since the socket is non-blocking, this just polls to see if we have any connections
 		client_socket = accept(listen_socket, nullptr, nullptr);
-		if (client_socket == INVALID_SOCKET) {
+		if (client_socket == platform::INVALID_SOCK) {
 			// do we not have any connections or is this an actual error?
-			if (WSAGetLastError() != WSAEWOULDBLOCK)
+			if (!platform::LastSocketErrorWouldBlock())
 				QueueExit("IPC: accept() failed");
 			return;
 		}
@@ -92,13 +102,14 @@ void IPC::try_accept() {
 	// slightly fancy and not block the main engine loop. So instead we just keep the same
 	// connection around for a couple ticks and see if we can read from it then.
 
-	FD_SET read_set = {};
+	fd_set read_set;
 	FD_ZERO(&read_set);
 	FD_SET(client_socket, &read_set);
-	const timeval tval = {0, 0};
+	timeval tval = {0, 0};
 
+	// the first param is ignored by WinSock, but BSD sockets want the highest fd + 1
 	int ret;
-	if ((ret = select(0, &read_set, nullptr, nullptr, &tval)) == SOCKET_ERROR) {
+	if ((ret = select((int)client_socket + 1, &read_set, nullptr, nullptr, &tval)) == platform::SOCK_ERROR) {
 		QueueExit("IPC: select() returned with error");
 		return;
 	}
@@ -106,8 +117,8 @@ void IPC::try_accept() {
 	if (ret == 0) {
 		// no data now, should we check again next tick?
 		if (++cl_sock_hold_count > MAX_CL_SOCK_HOLD_COUNT) {
-			closesocket(client_socket);
-			client_socket = INVALID_SOCKET;
+			platform::CloseSocket(client_socket);
+			client_socket = platform::INVALID_SOCK;
 		}
 		return;
 	}
@@ -116,67 +127,612 @@ void IPC::try_accept() {
 
 	uint32_t size = 0;
 	if (recv(client_socket, (char*)&size, 4, 0) != 4 || size == 0) {
-		closesocket(client_socket);
-		client_socket = INVALID_SOCKET;
+		platform::CloseSocket(client_socket);
+		client_socket = platform::INVALID_SOCK;
 		QueueExit("IPC: Could not deduce message size & message type");
 		return;
 	}
 
-	char* buf = new char[size];
-	if (recv(client_socket, buf, size, 0) != size) {
-		closesocket(client_socket);
-		client_socket = INVALID_SOCKET;
+	if (recv_buf.size() < size && !recv_buf.resize(size)) {
+		platform::CloseSocket(client_socket);
+		client_socket = platform::INVALID_SOCK;
+		QueueExit("IPC: no memory for the message");
+		return;
+	}
+	char* buf = recv_buf.data();
+	if (!recv_all(buf, size)) {
+		platform::CloseSocket(client_socket);
+		client_socket = platform::INVALID_SOCK;
 		QueueExit("IPC: bad message format");
 		return;
 	}
 
 	MessageType type = (MessageType)*buf;
 	process_msg(buf + 1, (size_t)size - 1, type);
-	delete[] buf;
-	closesocket(client_socket);
-	client_socket = INVALID_SOCKET;
+	platform::CloseSocket(client_socket);
+	client_socket = platform::INVALID_SOCK;
 }
 
 // read mail :)
 void IPC::process_msg(const char* buf, size_t size, MessageType type) {
-	const char* buf_orig = buf;
 	switch (type) {
 		case MessageType::Script: {
+			ScriptData* script = ScriptData::fromMessage(buf, size);
+			if (!script) {
+				QueueExit("IPC: bad script message");
+				break;
+			}
+			// the game reads the track's files on the game thread when it loads the map, so start
+			// reading them in the background now (a reset doesn't read anything)
+			if (g_pInfo->script_mgr.canReset(script))
+				g_pInfo->prefetcher.cancel();
+			else
+				g_pInfo->prefetcher.prefetch(script->map_name, script->player_name);
+			// the snapshots are of the old script
+			g_pInfo->savestates.stop();
+			g_pInfo->bisector.cancel(g_pInfo->script_mgr);
+			g_pInfo->recorder.stop();
+			g_pInfo->script_mgr.setNewScript(script);
+			break;
+		}
+		case MessageType::Unload:
+			QueueExit();
+			break;
+		case MessageType::Stats:
+			send_stats();
+			break;
+		case MessageType::Scan:
+			handle_scan(buf, size);
+			break;
+		case MessageType::PointerScan:
+			handle_pointer_scan(buf, size);
+			break;
+		case MessageType::SaveState:
+			handle_savestate(buf, size);
+			break;
+		case MessageType::StateHash:
+			handle_state_hash(buf, size);
+			break;
+		case MessageType::Record:
+			handle_record(buf, size);
+			break;
+		default:
+			QueueExit("IPC: bad message type");
+			break;
+	}
+	return;
+}
+
+
+void IPC::send_msg(const char* buf, uint32_t size) {
+	if (!send_all((const char*)&size, 4) || !send_all(buf, size))
+		QueueExit("IPC: failed to send message");
+}
 
-			ScriptData* script = new ScriptData();
 
-			// read header fields, would be a good idea to check for overflow here
+// how long to wait for the client in the middle of a message before giving up
+static const long SOCKET_WAIT_SECS = 5;
 
-			script->map_name.assign(buf);
-			buf += script->map_name.length() + 1;
 
-			script->player_name.assign(buf);
-			buf += script->player_name.length() + 1;
+bool IPC::recv_all(char* buf, size_t size) {
+	while (size > 0) {
+		int n = recv(client_socket, buf, (int)(size < INT32_MAX ? size : INT32_MAX), 0);
+		if (n > 0) {
+			buf += n;
+			size -= n;
+			continue;
+		}
+		if (n == 0 || !platform::LastSocketErrorWouldBlock())
+			return false;
+		fd_set read_set;
+		FD_ZERO(&read_set);
+		FD_SET(client_socket, &read_set);
+		timeval tval = {SOCKET_WAIT_SECS, 0};
+		if (select((int)client_socket + 1, &read_set, nullptr, nullptr, &tval) <= 0)
+			return false;
+	}
+	return true;
+}
 
-			script->ai_count = *(int*)buf;
-			buf += 4;
 
-			script->laps = *(int*)buf;
-			buf += 4;
+bool IPC::send_all(const char* buf, size_t size) {
+	while (size > 0) {
+		int n = send(client_socket, buf, (int)(size < INT32_MAX ? size : INT32_MAX), 0);
+		if (n > 0) {
+			buf += n;
+			size -= n;
+			continue;
+		}
+		if (n == 0 || !platform::LastSocketErrorWouldBlock())
+			return false;
+		fd_set write_set;
+		FD_ZERO(&write_set);
+		FD_SET(client_socket, &write_set);
+		timeval tval = {SOCKET_WAIT_SECS, 0};
+		if (select((int)client_socket + 1, nullptr, &write_set, nullptr, &tval) <= 0)
+			return false;
+	}
+	return true;
+}
 
-			script->difficulty = *(Difficulty*)buf;
-			buf += 4;
 
-			script->quick_reset = *(unsigned char*)buf;
-			buf += 1;
+void IPC::send_stats() {
+	const ScriptManager::LoadStats& loads = g_pInfo->script_mgr.loadStats();
+	AssetPrefetcher::Stats prefetch = g_pInfo->prefetcher.stats();
+	ScriptManager::RunStats run = g_pInfo->script_mgr.runStats();
+	const FramePacer::Stats& pace = g_pInfo->pacer.stats();
+	const ScriptManager::InputStats& inputs = g_pInfo->script_mgr.inputStats();
+	const ScriptManager::RandomStats& random = g_pInfo->script_mgr.randomStats();
+	char seed[16];
+	snprintf(seed, sizeof(seed), "%u", random.seed);
+	char buf[2048];
+	int len = snprintf(buf, sizeof(buf),
+		"script_memory_bytes %zu\n"
+		"script_memory_peak_bytes %zu\n"
+		"ipc_buffer_bytes %zu\n"
+		"script_actions_pending %zu\n"
+		"script_last_marker %u\n"
+		"script_last_marker_tick %lld\n"
+		"script_full_loads %u\n"
+		"script_full_load_ms_total %.1f\n"
+		"script_resets %u\n"
+		"script_reset_ms_total %.1f\n"
+		"script_last_load %s\n"
+		"script_last_load_ms %.1f\n"
+		"prefetch_jobs %u\n"
+		"prefetch_cancelled %u\n"
+		"prefetch_mb_total %.1f\n"
+		"prefetch_last_ms %.1f\n"
+		"prefetch_last_mb %.1f\n"
+		"script_ticks %u\n"
+		"script_ticks_per_sec %.0f\n"
+		"script_duration %.2f\n"
+		"script_duration_error_ms %.1f\n"
+		"playspeed_requested %.2f\n"
+		"playspeed_achieved %.2f\n"
+		"render_every %u\n"
+		"frame_tick_ms %.2f\n"
+		"frame_render_ms %.2f\n"
+		"frames_drawn %llu\n"
+		"frames_skipped %llu\n"
+		"inputs_direct %llu\n"
+		"inputs_dispatched %llu\n"
+		"direct_input %s\n"
+		"script_seed %s\n"
+		"random_draws %llu\n"
+		"random_seeded %u\n"
+		"random_game_seeds %u\n"
+		"random_pinned%s\n",
+		Arena::totalReserved(),
+		Arena::peakReserved(),
+		recv_buf.capacity(),
+		g_pInfo->script_mgr.pendingActions(),
+		g_pInfo->script_mgr.lastMarker(),
+		(long long)g_pInfo->script_mgr.lastMarkerTick(),
+		loads.full_loads,
+		loads.full_load_us / 1000.0,
+		loads.resets,
+		loads.reset_us / 1000.0,
+		loads.full_loads + loads.resets == 0 ? "none" : loads.last_was_reset ? "reset" : "full",
+		loads.last_us / 1000.0,
+		prefetch.jobs,
+		prefetch.cancelled,
+		prefetch.bytes / 1048576.0,
+		prefetch.last_us / 1000.0,
+		prefetch.last_bytes / 1048576.0,
+		run.ticks,
+		run.us ? run.ticks * 1e6 / run.us : 0.0,
+		run.duration,
+		// how much longer than its duration the script took, once it's done
+		run.duration > 0 ? run.us / 1e3 - run.duration * 1e3 : 0.0,
+		pace.requested_speed,
+		pace.achieved_speed,
+		pace.render_every,
+		pace.tick_ms,
+		pace.render_ms,
+		(unsigned long long)pace.frames_drawn,
+		(unsigned long long)pace.frames_skipped,
+		(unsigned long long)inputs.direct,
+		(unsigned long long)inputs.dispatched,
+		// the key events only go straight to the kart once LocalPlayerController::action is found
+		hooks::ORIG_LocalPlayerController__action ? "available" : "not found",
+		random.has_seed ? seed : "none",
+		(unsigned long long)random.draws,
+		random.seeded,
+		random.game_seeds,
+		// a seed only pins the CRT's generator, and only if the game imports srand
+		hooks::ORIG_crt_srand ? " crt" : " none"
+	);
+	send_msg(buf, (uint32_t)len);
+}
 
-			// read framebulk data
 
-			script->fillFramebulkData(buf, size - (buf - buf_orig));
-			g_pInfo->script_mgr.setNewScript(script);
+void IPC::handle_scan(const char* buf, size_t size) {
+	const size_t MSG_SIZE = 3 + 2 * sizeof(double);
+	if (size < MSG_SIZE || (uint8_t)buf[1] > (uint8_t)MemScanner::ValueType::Double || (uint8_t)buf[2] > (uint8_t)MemScanner::Compare::Decreased) {
+		QueueExit("IPC: bad scan message");
+		return;
+	}
+	auto command = (ScanCommand)buf[0];
+	auto type = (MemScanner::ValueType)buf[1];
+	auto cmp = (MemScanner::Compare)buf[2];
+	double a, b;
+	memcpy(&a, buf + 3, sizeof(double));
+	memcpy(&b, buf + 3 + sizeof(double), sizeof(double));
+
+	MemScanner& scanner = g_pInfo->scanner;
+	const size_t MAX_LISTED = 256;
+	char reply[128 + MAX_LISTED * 48];
+	int len = 0;
+	uint64_t start_ms = platform::TickCountMs();
+
+	switch (command) {
+		case ScanCommand::New:
+			if (!scanner.newScan(type)) {
+				len = snprintf(reply, sizeof(reply), "error out_of_memory\n");
+				break;
+			}
+			len = snprintf(reply, sizeof(reply), "candidates %zu\nbytes_scanned %zu\nscan_ms %llu\n",
+				scanner.numCandidates(), scanner.bytesScanned(), (unsigned long long)(platform::TickCountMs() - start_ms));
+			break;
+		case ScanCommand::Filter:
+			scanner.filter(cmp, a, b);
+			len = snprintf(reply, sizeof(reply), "candidates %zu\nscan_ms %llu\n",
+				scanner.numCandidates(), (unsigned long long)(platform::TickCountMs() - start_ms));
+			break;
+		case ScanCommand::List: {
+			MemScanner::Candidate candidates[MAX_LISTED];
+			// clamped before the casts, a double that doesn't fit (or NaN) can't be cast to size_t
+			size_t start = !(a > 0) ? 0 : a >= (double)scanner.numCandidates() ? scanner.numCandidates() : (size_t)a;
+			size_t max = !(b > 0) ? 0 : b > MAX_LISTED ? MAX_LISTED : (size_t)b;
+			size_t n = scanner.getCandidates(start, candidates, max);
+			len = snprintf(reply, sizeof(reply), "candidates %zu\n", scanner.numCandidates());
+			for (size_t i = 0; i < n; i++)
+				len += snprintf(reply + len, sizeof(reply) - len, "0x%llx %.9g\n", (unsigned long long)candidates[i].address, candidates[i].value);
 			break;
 		}
-		case MessageType::Unload:
-			QueueExit();
+		case ScanCommand::Reset:
+			scanner.reset();
+			len = snprintf(reply, sizeof(reply), "candidates 0\n");
 			break;
 		default:
-			QueueExit("IPC: bad message type");
+			QueueExit("IPC: bad scan command");
+			return;
+	}
+	send_msg(reply, (uint32_t)len);
+}
+
+
+void IPC::handle_pointer_scan(const char* buf, size_t size) {
+	if (size < 1) {
+		QueueExit("IPC: bad pointer scan message");
+		return;
+	}
+	const size_t MAX_CHAINS = 1000;
+	char line[256];
+	std::string reply;
+
+	switch ((PointerScanCommand)buf[0]) {
+		case PointerScanCommand::Find: {
+			const size_t MSG_SIZE = 2 + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+			if (size < MSG_SIZE) {
+				QueueExit("IPC: bad pointer scan message");
+				return;
+			}
+			PointerScanner::Settings settings;
+			uint32_t max_offset, max_chains;
+			uint64_t target;
+			settings.max_depth = (uint8_t)buf[1];
+			memcpy(&max_offset, buf + 2, sizeof(uint32_t));
+			memcpy(&max_chains, buf + 6, sizeof(uint32_t));
+			memcpy(&target, buf + 10, sizeof(uint64_t));
+			settings.max_offset = max_offset;
+			settings.max_chains = max_chains > MAX_CHAINS ? MAX_CHAINS : max_chains;
+
+			PointerScanner scanner;
+			std::vector<PointerScanner::Chain> chains;
+			uint64_t start_ms = platform::TickCountMs();
+			scanner.buildMap((const char*)g_mBase, g_mSize);
+			uint64_t map_ms = platform::TickCountMs();
+			scanner.findChains((uintptr_t)target, settings, chains);
+
+			snprintf(line, sizeof(line), "pointers %zu\nmap_ms %llu\nsearch_ms %llu\nchains %zu\n",
+				scanner.numPointers(), (unsigned long long)(map_ms - start_ms),
+				(unsigned long long)(platform::TickCountMs() - map_ms), chains.size());
+			reply += line;
+			for (auto& chain : chains) {
+				int len = snprintf(line, sizeof(line), "chain %x", chain.module_offset);
+				for (uint32_t i = 0; i < chain.num_offsets; i++)
+					len += snprintf(line + len, sizeof(line) - len, " %x", chain.offsets[i]);
+				reply += line;
+				reply += '\n';
+			}
+			break;
+		}
+		case PointerScanCommand::Check: {
+			uint32_t count;
+			size_t pos = 1 + sizeof(uint32_t);
+			if (size < pos) {
+				QueueExit("IPC: bad pointer scan message");
+				return;
+			}
+			memcpy(&count, buf + 1, sizeof(uint32_t));
+			for (uint32_t c = 0; c < count; c++) {
+				PointerScanner::Chain chain;
+				if (size < pos + 2 * sizeof(uint32_t)) {
+					QueueExit("IPC: bad pointer scan message");
+					return;
+				}
+				memcpy(&chain.module_offset, buf + pos, sizeof(uint32_t));
+				memcpy(&chain.num_offsets, buf + pos + sizeof(uint32_t), sizeof(uint32_t));
+				pos += 2 * sizeof(uint32_t);
+				if (chain.num_offsets > PointerScanner::MAX_DEPTH || size < pos + chain.num_offsets * sizeof(uint32_t)) {
+					QueueExit("IPC: bad pointer scan message");
+					return;
+				}
+				memcpy(chain.offsets, buf + pos, chain.num_offsets * sizeof(uint32_t));
+				pos += chain.num_offsets * sizeof(uint32_t);
+
+				uintptr_t addr;
+				if (PointerScanner::resolve((const char*)g_mBase, chain, addr))
+					snprintf(line, sizeof(line), "chain %u 0x%llx\n", c, (unsigned long long)addr);
+				else
+					snprintf(line, sizeof(line), "chain %u none\n", c);
+				reply += line;
+			}
 			break;
+		}
+		default:
+			QueueExit("IPC: bad pointer scan command");
+			return;
 	}
-	return;
+	send_msg(reply.data(), (uint32_t)reply.size());
+}
+
+
+void IPC::handle_savestate(const char* buf, size_t size) {
+	const size_t MSG_SIZE = 2 + sizeof(uint16_t) + sizeof(uint32_t);
+	if (size < MSG_SIZE) {
+		QueueExit("IPC: bad savestate message");
+		return;
+	}
+	bool track_writes = buf[1] != 0;
+	uint16_t count;
+	uint32_t interval;
+	memcpy(&count, buf + 2, sizeof(uint16_t));
+	memcpy(&interval, buf + 4, sizeof(uint32_t));
+
+	SaveStates& savestates = g_pInfo->savestates;
+	switch ((SaveStateCommand)buf[0]) {
+		case SaveStateCommand::Start:
+			savestates.requestStart(count, interval, track_writes);
+			break;
+		case SaveStateCommand::Capture:
+			savestates.requestCapture();
+			break;
+		case SaveStateCommand::Restore:
+			savestates.requestRestore(count);
+			break;
+		case SaveStateCommand::Stop:
+			savestates.stop();
+			break;
+		case SaveStateCommand::Stats:
+			break;
+		default:
+			QueueExit("IPC: bad savestate command");
+			return;
+	}
+
+	const SaveStates::Stats& st = savestates.stats();
+	char reply[512];
+	int len = snprintf(reply, sizeof(reply),
+		"snapshots %zu\n"
+		"total_bytes %zu\n"
+		"regions %zu\n"
+		"region_bytes %zu\n"
+		"last_capture_bytes %zu\n"
+		"last_capture_us %llu\n"
+		"last_restore_pages %zu\n"
+		"last_restore_us %llu\n",
+		st.snapshots, st.total_bytes, st.regions, st.region_bytes, st.last_capture_bytes,
+		(unsigned long long)st.last_capture_us, st.last_restore_pages, (unsigned long long)st.last_restore_us
+	);
+	send_msg(reply, (uint32_t)len);
+}
+
+
+void IPC::handle_state_hash(const char* buf, size_t size) {
+	if (size < 1) {
+		QueueExit("IPC: bad state hash message");
+		return;
+	}
+	StateHasher& hasher = g_pInfo->state_hasher;
+	// the fields after the command
+	const char* args = buf + 1;
+	size_t args_size = size - 1;
+
+	switch ((StateHashCommand)buf[0]) {
+		case StateHashCommand::AddChain: {
+			uint32_t range_size;
+			PointerScanner::Chain chain;
+			if (args_size < 3 * sizeof(uint32_t)) {
+				QueueExit("IPC: bad state hash message");
+				return;
+			}
+			memcpy(&range_size, args, sizeof(uint32_t));
+			memcpy(&chain.module_offset, args + 4, sizeof(uint32_t));
+			memcpy(&chain.num_offsets, args + 8, sizeof(uint32_t));
+			if (chain.num_offsets > PointerScanner::MAX_DEPTH || args_size < 12 + chain.num_offsets * sizeof(uint32_t)) {
+				QueueExit("IPC: bad state hash message");
+				return;
+			}
+			memcpy(chain.offsets, args + 12, chain.num_offsets * sizeof(uint32_t));
+			hasher.addChain(chain, range_size);
+			break;
+		}
+		case StateHashCommand::ClearRanges:
+			hasher.clearRanges();
+			break;
+		case StateHashCommand::Record: {
+			// the schedule is optional, the default is to hash every tick
+			StateHasher::Schedule schedule;
+			if (args_size >= 3 * sizeof(uint32_t) + 1) {
+				memcpy(&schedule.interval, args, sizeof(uint32_t));
+				memcpy(&schedule.first, args + 4, sizeof(uint32_t));
+				memcpy(&schedule.last, args + 8, sizeof(uint32_t));
+				schedule.per_range = args[12] != 0;
+			}
+			hasher.start(schedule);
+			break;
+		}
+		case StateHashCommand::Stop:
+			hasher.stop();
+			break;
+		case StateHashCommand::Verify: {
+			uint32_t count;
+			if (args_size < sizeof(uint32_t)) {
+				QueueExit("IPC: bad state hash message");
+				return;
+			}
+			memcpy(&count, args, sizeof(uint32_t));
+			if ((args_size - sizeof(uint32_t)) / sizeof(uint32_t) < count) {
+				QueueExit("IPC: bad state hash message");
+				return;
+			}
+			// setReference only memcpys them, so it's fine that they might not be aligned
+			hasher.setReference((const uint32_t*)(args + sizeof(uint32_t)), count);
+			break;
+		}
+		case StateHashCommand::Get: {
+			uint32_t first, max;
+			if (args_size < 2 * sizeof(uint32_t)) {
+				QueueExit("IPC: bad state hash message");
+				return;
+			}
+			memcpy(&first, args, sizeof(uint32_t));
+			memcpy(&max, args + 4, sizeof(uint32_t));
+			uint32_t total = (uint32_t)hasher.stats().hashes;
+			uint32_t count = first < total ? (total - first < max ? total - first : max) : 0;
+			std::vector<char> reply(sizeof(uint32_t) + count * sizeof(uint32_t));
+			memcpy(reply.data(), &total, sizeof(uint32_t));
+			if (count > 0)
+				memcpy(reply.data() + sizeof(uint32_t), hasher.hashes() + first, count * sizeof(uint32_t));
+			send_msg(reply.data(), (uint32_t)reply.size());
+			return;
+		}
+		case StateHashCommand::Stats:
+			break;
+		case StateHashCommand::Bisect: {
+			DesyncBisector::Settings settings;
+			uint32_t sizes[2];
+			const char* scripts[2];
+			if (args_size < 2 * sizeof(uint32_t)) {
+				QueueExit("IPC: bad state hash message");
+				return;
+			}
+			memcpy(&settings.checkpoint_interval, args, sizeof(uint32_t));
+			memcpy(&settings.split, args + 4, sizeof(uint32_t));
+			size_t off = 2 * sizeof(uint32_t);
+			for (int i = 0; i < 2; i++) {
+				if (args_size - off < sizeof(uint32_t)) {
+					QueueExit("IPC: bad state hash message");
+					return;
+				}
+				memcpy(&sizes[i], args + off, sizeof(uint32_t));
+				off += sizeof(uint32_t);
+				if (args_size - off < sizes[i]) {
+					QueueExit("IPC: bad state hash message");
+					return;
+				}
+				scripts[i] = args + off;
+				off += sizes[i];
+			}
+			DesyncBisector& bisector = g_pInfo->bisector;
+			bisector.cancel(g_pInfo->script_mgr);
+			if (!bisector.setScripts(scripts[0], sizes[0], scripts[1], sizes[1])) {
+				QueueExit("IPC: bad script message");
+				return;
+			}
+			// the runs are started by the tick driver once no script is running
+			g_pInfo->savestates.stop();
+			g_pInfo->recorder.stop();
+			g_pInfo->script_mgr.stopScript();
+			bisector.start(settings);
+			break;
+		}
+		case StateHashCommand::StopBisect:
+			g_pInfo->bisector.cancel(g_pInfo->script_mgr);
+			break;
+		default:
+			QueueExit("IPC: bad state hash command");
+			return;
+	}
+
+	const StateHasher::Stats& st = hasher.stats();
+	const DesyncBisector& bisector = g_pInfo->bisector;
+	char reply[1024];
+	int len = snprintf(reply, sizeof(reply),
+		"recording %d\n"
+		"ranges %zu\n"
+		"ticks %zu\n"
+		"hashes %zu\n"
+		"reference_hashes %zu\n"
+		"first_divergence %lld\n"
+		"missing_ranges %zu\n"
+		"last_tick_bytes %zu\n"
+		"bisect_phase %d\n"
+		"bisect_runs %u\n"
+		"bisect_low %lld\n"
+		"bisect_high %lld\n"
+		"bisect_divergence %lld\n"
+		"bisect_differing_ranges %u\n",
+		(int)hasher.recording(), st.ranges, st.ticks, st.hashes, st.reference_hashes, (long long)st.first_divergence,
+		st.missing_ranges, st.last_tick_bytes, (int)bisector.phase(), bisector.runsDone(), (long long)bisector.low(),
+		(long long)bisector.high(), (long long)bisector.firstDivergence(), bisector.differingRanges()
+	);
+	send_msg(reply, (uint32_t)len);
+}
+
+
+void IPC::handle_record(const char* buf, size_t size) {
+	if (size < 1) {
+		QueueExit("IPC: bad record message");
+		return;
+	}
+	InputRecorder& recorder = g_pInfo->recorder;
+	const char* msg = nullptr;
+	size_t msg_size = 0;
+
+	switch ((RecordCommand)buf[0]) {
+		case RecordCommand::Start: {
+			ScriptData* script = ScriptData::fromMessage(buf + 1, size - 1);
+			if (!script) {
+				QueueExit("IPC: bad script message");
+				return;
+			}
+			recorder.stop();
+			g_pInfo->savestates.stop();
+			g_pInfo->bisector.cancel(g_pInfo->script_mgr);
+			if (!recorder.start()) {
+				ScriptData::destroy(script);
+				break;
+			}
+			g_pInfo->script_mgr.setNewScript(script);
+			break;
+		}
+		case RecordCommand::Poll:
+			recorder.poll(msg, msg_size);
+			send_msg(msg, (uint32_t)msg_size);
+			return;
+		case RecordCommand::Stop:
+			recorder.stop();
+			break;
+		default:
+			QueueExit("IPC: bad record command");
+			return;
+	}
+
+	// just the header, the framebulks stay in the ring until they're polled
+	InputRecorder::PollHeader header = recorder.header();
+	send_msg((const char*)&header, sizeof(header));
 }
@@ -1,13 +1,13 @@
 #pragma once
 
-#include <WinSock2.h>
-#include <string>
+#include "page_vector.h"
+#include "platform.h"
 
 class IPC {
 public:
 	~IPC();
 
-	// Initialize WinSock and the listen_socket, on failure sets the failReason.
+	// Initialize sockets and the listen_socket, on failure sets the failReason.
 	void init(const char*& failReason /*out*/);
 
 	// Check if we have data to read, process it if so. Should only be called once we have the hook set up.
@@ -18,17 +18,127 @@ private:
 
 	enum class MessageType : uint8_t {
 		Script = 0,
-		Unload
+		Unload,
+		Stats, // the client wants us to send back payload stats
+		Scan,  // a memory scanner command, see handle_scan()
+		PointerScan, // a pointer scanner command, see handle_pointer_scan()
+		SaveState,   // a savestate command, see handle_savestate()
+		StateHash,   // a state hashing command, see handle_state_hash()
+		Record,      // an input recording command, see handle_record()
 	};
 
-	SOCKET listen_socket = INVALID_SOCKET;
-	SOCKET client_socket = INVALID_SOCKET;
+	enum class ScanCommand : uint8_t {
+		New,    // start a new scan for values of a type
+		Filter, // filter the candidates
+		List,   // send back some of the candidates
+		Reset,  // free the scan
+	};
+
+	enum class PointerScanCommand : uint8_t {
+		Find,  // find chains to an address
+		Check, // follow chains from the client (e.g. found in an earlier session)
+	};
+
+	enum class SaveStateCommand : uint8_t {
+		Start,   // take the base snapshot at the next tick, then one every interval ticks
+		Capture, // take a snapshot at the next tick
+		Restore, // go back to a snapshot at the next tick
+		Stop,    // free all snapshots
+		Stats,   // just send back the stats
+	};
+
+	enum class StateHashCommand : uint8_t {
+		AddChain,    // hash some bytes at the end of a pointer chain every tick
+		ClearRanges, // stop hashing everything that was added
+		Record,      // start a new log at the start of the next script
+		Stop,        // stop recording & free the log
+		Verify,      // compare the log against a reference log from an earlier run
+		Get,         // send back some of the log
+		Stats,       // just send back the stats
+		Bisect,      // find the first tick where two scripts differ
+		StopBisect,  // give up on the bisection
+	};
+
+	enum class RecordCommand : uint8_t {
+		Start, // play a script, then record inputs from where it ends
+		Poll,  // send back the framebulks that were recorded since the last poll
+		Stop,  // stop recording, what's left still has to be polled
+	};
+
+	platform::Socket listen_socket = platform::INVALID_SOCK;
+	platform::Socket client_socket = platform::INVALID_SOCK;
 	// how many ticks we've been holding on to the client socket
 	int cl_sock_hold_count = 0;
 
 	// max number of ticks to hold on the client socket for
 	const int MAX_CL_SOCK_HOLD_COUNT = 2;
 
+	// kept around between messages so that we only allocate when we get a bigger message than
+	// before, and in our own pages so that a savestate restore can't free it
+	PageVector<char> recv_buf;
+
 	// process buffer, queue unload on error
 	void process_msg(const char* buf, size_t size, MessageType type);
+
+	// sends a message to the client in the same format that we receive them (minus the type)
+	void send_msg(const char* buf, uint32_t size);
+
+	// Big messages don't fit in the socket's buffer, so these keep going (waiting for the socket
+	// if it's not ready) until all of it has been received/sent. Return false on error.
+	bool recv_all(char* buf, size_t size);
+	bool send_all(const char* buf, size_t size);
+
+	// sends back a line of "name value" for each stat
+	void send_stats();
+
+	/*
+	* Runs a scanner command and sends back the results as "name value" lines (and "address value"
+	* lines for ScanCommand::List). The message is: command (u8), value type (u8), compare (u8),
+	* then two doubles. The doubles are the bounds for filters, and the first candidate & number
+	* of candidates for List.
+	*/
+	void handle_scan(const char* buf, size_t size);
+
+	/*
+	* Runs a pointer scanner command. Find is: command (u8), max depth (u8), max offset (u32),
+	* max chains (u32), target address (u64), and sends back some stats and a "chain <module
+	* offset> <offsets...>" line for each chain (in hex). Check is: command (u8), the number of
+	* chains (u32), then each chain as module offset (u32), number of offsets (u32) and the
+	* offsets (u32 each), and sends back a "chain <index> <address>" line for each chain, with
+	* "none" as the address if the chain is broken.
+	*
+	* The map is built from scratch every time and freed after, the game is stuck while we
+	* search so that's the only time the heap doesn't change under us.
+	*/
+	void handle_pointer_scan(const char* buf, size_t size);
+
+	/*
+	* Runs a savestate command. The message is: command (u8), track writes (u8), ring size for
+	* Start or how many snapshots back for Restore (u16), then the capture interval in ticks for
+	* Start (u32). Everything but Stop & Stats only happens at the next tick while a script is
+	* running, the stats that are sent back are from before that.
+	*/
+	void handle_savestate(const char* buf, size_t size);
+
+	/*
+	* Runs a state hashing command, all of them start with the command (u8). AddChain is followed
+	* by the number of bytes to hash (u32) and a chain in the same format as for
+	* PointerScanCommand::Check. Record can be followed by a schedule: the interval, first & last
+	* tick (u32 each) and whether to hash each range by itself (u8). Verify is followed by the
+	* number of hashes (u32) and the hashes (u32 each), Get by the first hash to send & the max
+	* number of hashes (u32 each). Bisect is followed by the checkpoint interval & the split (u32
+	* each), then both scripts, each as its size (u32) and a script message. Get sends back the
+	* total number of hashes in the log (u32) and then the hashes, everything else sends back the
+	* stats (and how the bisection is going) as "name value" lines.
+	*/
+	void handle_state_hash(const char* buf, size_t size);
+
+	/*
+	* Runs an input recording command, all of them start with the command (u8). Start is followed
+	* by a script message that loads the map (and can play the start of the race), recording
+	* starts once it ends. Every command sends back an InputRecorder::PollHeader followed by the
+	* framebulks that were taken out of the recording (only Poll takes any), in the same format
+	* as in script messages.
+	*/
+	void handle_record(const char* buf, size_t size);
 };
\ No newline at end of file
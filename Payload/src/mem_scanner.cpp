@@ -0,0 +1,429 @@
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+#include "mem_scanner.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets us use any intrinsic without changing the target of the whole file
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+typedef MemScanner::Compare Compare;
+typedef MemScanner::ValueType ValueType;
+
+
+static int PopCount(uint64_t x) {
+#ifdef _MSC_VER
+	return (int)__popcnt64(x);
+#else
+	return __builtin_popcountll(x);
+#endif
+}
+
+
+static int CountTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, x);
+	return (int)idx;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
+
+
+static size_t ValueSize(ValueType type) {
+	switch (type) {
+		case ValueType::Double:
+			return 8;
+		default:
+			return 4;
+	}
+}
+
+
+// the bounds for Compare::Between, converted to each value type
+struct Bounds {
+	int32_t i_lo, i_hi;
+	float f_lo, f_hi;
+	double d_lo, d_hi;
+
+	Bounds(double lo, double hi) : f_lo((float)lo), f_hi((float)hi), d_lo(lo), d_hi(hi) {
+		// Only integers in [lo, hi] can match. Both sides are clamped before the casts, since a
+		// double outside of int32's range can't be cast to it, and a range that has no int32s in
+		// it (or a NaN) becomes one that matches nothing.
+		double l = ceil(lo), h = floor(hi);
+		if (!(l <= h) || l > INT32_MAX || h < INT32_MIN) {
+			i_lo = 1;
+			i_hi = 0;
+		} else {
+			i_lo = l < INT32_MIN ? INT32_MIN : (int32_t)l;
+			i_hi = h > INT32_MAX ? INT32_MAX : (int32_t)h;
+		}
+	}
+
+	void get(int32_t& lo, int32_t& hi) const {lo = i_lo; hi = i_hi;}
+	void get(float& lo, float& hi) const {lo = f_lo; hi = f_hi;}
+	void get(double& lo, double& hi) const {lo = d_lo; hi = d_hi;}
+};
+
+
+/*
+* Compares a block of up to 64 values against the bounds or the values from the last filter, and
+* returns a mask of the ones that match. The SIMD versions always do 64 values, the scalar ones
+* are also used for the last (partial) block of each region.
+*/
+typedef uint64_t (*BlockFunc)(const char* cur, const char* prev, const Bounds& bounds, size_t n);
+
+
+template <typename T>
+struct Scalar {
+	template <Compare C>
+	static uint64_t block(const char* cur_p, const char* prev_p, const Bounds& bounds, size_t n) {
+		const T* cur = (const T*)cur_p;
+		const T* prev = (const T*)prev_p;
+		T lo, hi;
+		bounds.get(lo, hi);
+		uint64_t mask = 0;
+		for (size_t i = 0; i < n; i++) {
+			bool match;
+			switch (C) {
+				case Compare::Between:   match = cur[i] >= lo && cur[i] <= hi; break;
+				case Compare::Changed:   match = !(cur[i] == prev[i]); break;
+				case Compare::Unchanged: match = cur[i] == prev[i]; break;
+				case Compare::Increased: match = cur[i] > prev[i]; break;
+				default:                 match = cur[i] < prev[i]; break;
+			}
+			mask |= (uint64_t)match << i;
+		}
+		return mask;
+	}
+};
+
+
+template <Compare C>
+TARGET_AVX2 static uint64_t BlockAvx2Int32(const char* cur_p, const char* prev_p, const Bounds& bounds, size_t) {
+	const __m256i lo = _mm256_set1_epi32(bounds.i_lo);
+	const __m256i hi = _mm256_set1_epi32(bounds.i_hi);
+	uint64_t mask = 0;
+	for (int i = 0; i < 64; i += 8) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)(cur_p + i * 4));
+		__m256i p = _mm256_loadu_si256((const __m256i*)(prev_p + i * 4));
+		// there's only == and >, so some of these compute the opposite and flip it
+		uint32_t bits;
+		if (C == Compare::Between)
+			bits = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpgt_epi32(lo, c), _mm256_cmpgt_epi32(c, hi))));
+		else if (C == Compare::Changed)
+			bits = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(c, p)));
+		else if (C == Compare::Unchanged)
+			bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(c, p)));
+		else if (C == Compare::Increased)
+			bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(c, p)));
+		else
+			bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(p, c)));
+		mask |= (uint64_t)(bits & 0xff) << i;
+	}
+	return mask;
+}
+
+
+template <Compare C>
+TARGET_AVX2 static uint64_t BlockAvx2Float(const char* cur_p, const char* prev_p, const Bounds& bounds, size_t) {
+	const __m256 lo = _mm256_set1_ps(bounds.f_lo);
+	const __m256 hi = _mm256_set1_ps(bounds.f_hi);
+	uint64_t mask = 0;
+	for (int i = 0; i < 64; i += 8) {
+		__m256 c = _mm256_loadu_ps((const float*)cur_p + i);
+		__m256 p = _mm256_loadu_ps((const float*)prev_p + i);
+		// same NaN behavior as the scalar version (NaN is only ever "changed")
+		__m256 r;
+		if (C == Compare::Between)
+			r = _mm256_and_ps(_mm256_cmp_ps(c, lo, _CMP_GE_OQ), _mm256_cmp_ps(c, hi, _CMP_LE_OQ));
+		else if (C == Compare::Changed)
+			r = _mm256_cmp_ps(c, p, _CMP_NEQ_UQ);
+		else if (C == Compare::Unchanged)
+			r = _mm256_cmp_ps(c, p, _CMP_EQ_OQ);
+		else if (C == Compare::Increased)
+			r = _mm256_cmp_ps(c, p, _CMP_GT_OQ);
+		else
+			r = _mm256_cmp_ps(c, p, _CMP_LT_OQ);
+		mask |= (uint64_t)(uint32_t)_mm256_movemask_ps(r) << i;
+	}
+	return mask;
+}
+
+
+template <Compare C>
+TARGET_AVX2 static uint64_t BlockAvx2Double(const char* cur_p, const char* prev_p, const Bounds& bounds, size_t) {
+	const __m256d lo = _mm256_set1_pd(bounds.d_lo);
+	const __m256d hi = _mm256_set1_pd(bounds.d_hi);
+	uint64_t mask = 0;
+	for (int i = 0; i < 64; i += 4) {
+		__m256d c = _mm256_loadu_pd((const double*)cur_p + i);
+		__m256d p = _mm256_loadu_pd((const double*)prev_p + i);
+		__m256d r;
+		if (C == Compare::Between)
+			r = _mm256_and_pd(_mm256_cmp_pd(c, lo, _CMP_GE_OQ), _mm256_cmp_pd(c, hi, _CMP_LE_OQ));
+		else if (C == Compare::Changed)
+			r = _mm256_cmp_pd(c, p, _CMP_NEQ_UQ);
+		else if (C == Compare::Unchanged)
+			r = _mm256_cmp_pd(c, p, _CMP_EQ_OQ);
+		else if (C == Compare::Increased)
+			r = _mm256_cmp_pd(c, p, _CMP_GT_OQ);
+		else
+			r = _mm256_cmp_pd(c, p, _CMP_LT_OQ);
+		mask |= (uint64_t)(uint32_t)_mm256_movemask_pd(r) << i;
+	}
+	return mask;
+}
+
+
+#define BLOCK_FUNCS(func) { \
+	func<Compare::Between>, \
+	func<Compare::Changed>, \
+	func<Compare::Unchanged>, \
+	func<Compare::Increased>, \
+	func<Compare::Decreased>, \
+}
+
+// indexed by [ValueType][Compare]
+static const BlockFunc scalar_funcs[3][5] = {
+	BLOCK_FUNCS(Scalar<int32_t>::block),
+	BLOCK_FUNCS(Scalar<float>::block),
+	BLOCK_FUNCS(Scalar<double>::block),
+};
+
+static const BlockFunc avx2_funcs[3][5] = {
+	BLOCK_FUNCS(BlockAvx2Int32),
+	BLOCK_FUNCS(BlockAvx2Float),
+	BLOCK_FUNCS(BlockAvx2Double),
+};
+
+#undef BLOCK_FUNCS
+
+
+bool MemScanner::cpuHasAvx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	// the OS also has to save the upper halves of the ymm registers
+	__cpuid(info, 1);
+	bool osxsave = info[2] & (1 << 27);
+	bool avx = info[2] & (1 << 28);
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return info[1] & (1 << 5);
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+
+bool MemScanner::newScan(ValueType type) {
+	reset();
+
+	// regions can get mapped between the two calls, so leave some room
+	size_t max_regions = platform::GetWritableRegions(nullptr, 0) + 64;
+	size_t list_bytes = max_regions * sizeof(platform::MemRegion);
+	auto list = (platform::MemRegion*)platform::AllocPages(list_bytes);
+	if (!list)
+		return false;
+	size_t count = platform::GetWritableRegions(list, max_regions);
+	if (count > max_regions)
+		count = max_regions;
+
+	// don't scan the list itself
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++)
+		if (list[i].base != (char*)list)
+			list[n++] = list[i];
+
+	bool ok = newScan(type, list, n);
+	platform::FreePages(list, list_bytes);
+	return ok;
+}
+
+
+bool MemScanner::newScan(ValueType type, const platform::MemRegion* mem_regions, size_t count) {
+	reset();
+	if (count == 0)
+		return false;
+
+	this->type = type;
+	value_size = ValueSize(type);
+
+	regions_bytes = count * sizeof(Region);
+	regions = (Region*)platform::AllocPages(regions_bytes);
+	if (!regions) {
+		reset();
+		return false;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		Region& r = regions[num_regions];
+		r.base = mem_regions[i].base;
+		r.num_values = mem_regions[i].size / value_size;
+		if (r.num_values == 0)
+			continue;
+		r.snap_off = snapshot_size;
+		r.word_off = bitmap_words;
+		snapshot_size += r.num_values * value_size;
+		bitmap_words += (r.num_values + 63) / 64;
+		num_regions++;
+	}
+	if (num_regions == 0) {
+		reset();
+		return false;
+	}
+
+	// this can easily be a few GB, so it comes straight from the OS instead of the game's heap
+	snapshot = (char*)platform::AllocPages(snapshot_size);
+	bitmap = (uint64_t*)platform::AllocPages(bitmap_words * sizeof(uint64_t));
+	summary_words = (bitmap_words + 63) / 64;
+	summary = (uint64_t*)platform::AllocPages(summary_words * sizeof(uint64_t));
+	if (!snapshot || !bitmap || !summary) {
+		reset();
+		return false;
+	}
+
+	// every value starts out as a candidate
+	for (size_t i = 0; i < num_regions; i++) {
+		const Region& r = regions[i];
+		memcpy(snapshot + r.snap_off, r.base, r.num_values * value_size);
+		size_t full_words = r.num_values / 64;
+		memset(bitmap + r.word_off, 0xff, full_words * sizeof(uint64_t));
+		if (r.num_values % 64)
+			bitmap[r.word_off + full_words] = (1ull << (r.num_values % 64)) - 1;
+		num_candidates += r.num_values;
+	}
+	// regions never have empty words, so every word starts out live
+	memset(summary, 0xff, (bitmap_words / 64) * sizeof(uint64_t));
+	if (bitmap_words % 64)
+		summary[bitmap_words / 64] = (1ull << (bitmap_words % 64)) - 1;
+	return true;
+}
+
+
+template<typename Func>
+void MemScanner::forEachLiveWord(const Region& r, Func func) const {
+	size_t begin = r.word_off;
+	size_t end = r.word_off + (r.num_values + 63) / 64;
+	for (size_t s = begin / 64; s * 64 < end; s++) {
+		uint64_t live = summary[s];
+		// the first & last summary words can be shared with other regions
+		if (s * 64 < begin)
+			live &= ~0ull << (begin - s * 64);
+		if (end - s * 64 < 64)
+			live &= (1ull << (end - s * 64)) - 1;
+		for (; live; live &= live - 1)
+			func(s * 64 + CountTrailingZeros(live) - begin);
+	}
+}
+
+
+size_t MemScanner::filter(Compare cmp, double lo, double hi) {
+	if (!scanning())
+		return 0;
+
+	const Bounds bounds(lo, hi);
+	BlockFunc full_block = (use_simd ? avx2_funcs : scalar_funcs)[(int)type][(int)cmp];
+	BlockFunc partial_block = scalar_funcs[(int)type][(int)cmp];
+
+	num_candidates = 0;
+	for (size_t i = 0; i < num_regions; i++) {
+		const Region& r = regions[i];
+
+		// the game might have freed the memory since the last filter
+		if (!platform::IsWritable(r.base, r.num_values * value_size)) {
+			forEachLiveWord(r, [&](size_t w) {
+				size_t word = r.word_off + w;
+				bitmap[word] = 0;
+				summary[word / 64] &= ~(1ull << (word % 64));
+			});
+			continue;
+		}
+
+		forEachLiveWord(r, [&](size_t w) {
+			size_t word = r.word_off + w;
+			uint64_t& bits = bitmap[word];
+			size_t n = r.num_values - w * 64;
+			if (n > 64)
+				n = 64;
+			const char* cur = r.base + w * 64 * value_size;
+			char* prev = snapshot + r.snap_off + w * 64 * value_size;
+			bits &= (n == 64 ? full_block : partial_block)(cur, prev, bounds, n);
+			if (bits) {
+				// the next filter compares against the values from this one
+				memcpy(prev, cur, n * value_size);
+				num_candidates += PopCount(bits);
+			} else {
+				summary[word / 64] &= ~(1ull << (word % 64));
+			}
+		});
+	}
+	return num_candidates;
+}
+
+
+size_t MemScanner::getCandidates(size_t start, Candidate* out, size_t max) const {
+	size_t n = 0;
+	for (size_t i = 0; i < num_regions && n < max; i++) {
+		const Region& r = regions[i];
+		forEachLiveWord(r, [&](size_t w) {
+			uint64_t bits = bitmap[r.word_off + w];
+			size_t count = PopCount(bits);
+			if (start >= count) {
+				start -= count;
+				return;
+			}
+			for (; bits && n < max; bits &= bits - 1) {
+				if (start > 0) {
+					start--;
+					continue;
+				}
+				size_t idx = w * 64 + CountTrailingZeros(bits);
+				// the memory might be gone by now, so use the value from the last filter
+				out[n].address = (uintptr_t)(r.base + idx * value_size);
+				out[n].value = readValue(snapshot + r.snap_off + idx * value_size);
+				n++;
+			}
+		});
+	}
+	return n;
+}
+
+
+void MemScanner::reset() {
+	if (regions)
+		platform::FreePages(regions, regions_bytes);
+	if (snapshot)
+		platform::FreePages(snapshot, snapshot_size);
+	if (bitmap)
+		platform::FreePages(bitmap, bitmap_words * sizeof(uint64_t));
+	if (summary)
+		platform::FreePages(summary, summary_words * sizeof(uint64_t));
+	regions = nullptr;
+	snapshot = nullptr;
+	bitmap = nullptr;
+	summary = nullptr;
+	num_regions = regions_bytes = snapshot_size = bitmap_words = summary_words = num_candidates = 0;
+}
+
+
+double MemScanner::readValue(const char* p) const {
+	switch (type) {
+		case ValueType::Int32:
+			return *(const int32_t*)p;
+		case ValueType::Float:
+			return *(const float*)p;
+		default:
+			return *(const double*)p;
+	}
+}
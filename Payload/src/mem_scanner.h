@@ -0,0 +1,113 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"
+
+/*
+* A Cheat Engine style memory scanner for finding where the game keeps stuff like kart speed or
+* the lap count. A new scan snapshots all writable memory in the process, and every aligned value
+* of the chosen type starts out as a candidate. Each filter then compares the current memory
+* against a value range or against the value from the last filter, and throws out candidates that
+* don't match. Keep filtering (e.g. speed increased, speed unchanged while stopped) until only a
+* few addresses are left.
+*
+* Candidates are kept in a bitmap with one bit per value, and a filter only reads the memory
+* under non-zero 64-bit words of it, so later filters get much cheaper as candidates are thrown
+* out. A second, much smaller bitmap has one bit per non-zero word so that filters with only a
+* handful of candidates left don't even have to walk the whole bitmap. The comparisons are done
+* 64 values at a time with AVX2 if the CPU has it.
+*/
+class MemScanner {
+public:
+	enum class ValueType : uint8_t {
+		Int32,
+		Float,
+		Double,
+	};
+
+	enum class Compare : uint8_t {
+		Between,   // lo <= value <= hi, use lo == hi for an exact value
+		Changed,   // since the last filter
+		Unchanged,
+		Increased,
+		Decreased,
+	};
+
+	struct Candidate {
+		uintptr_t address;
+		double value;
+	};
+
+	MemScanner() = default;
+	MemScanner(const MemScanner&) = delete;
+	MemScanner& operator=(const MemScanner&) = delete;
+
+	~MemScanner() {
+		reset();
+	}
+
+	// Snapshots all writable memory in the process, returns false if we ran out of memory.
+	bool newScan(ValueType type);
+
+	// same as above, but only snapshots the given regions (used for benchmarking)
+	bool newScan(ValueType type, const platform::MemRegion* regions, size_t num_regions);
+
+	// Throws out all candidates that don't match, returns the number of candidates left. The
+	// bounds are only used for Compare::Between.
+	size_t filter(Compare cmp, double lo = 0, double hi = 0);
+
+	// Copies up to max candidates (with their values as of the last filter) to out, skipping the
+	// first start. Returns the number copied.
+	size_t getCandidates(size_t start, Candidate* out, size_t max) const;
+
+	// frees all of the scan data
+	void reset();
+
+	bool scanning() const {return num_regions > 0;}
+
+	size_t numCandidates() const {return num_candidates;}
+
+	// total size of the memory that was snapshotted
+	size_t bytesScanned() const {return snapshot_size;}
+
+	// used to compare the SIMD & scalar versions, SIMD is used by default if the CPU supports it
+	void setUseSimd(bool use) {use_simd = use;}
+
+	static bool cpuHasAvx2();
+
+private:
+	struct Region {
+		char* base;         // where the memory actually is
+		size_t num_values;  // the number of values (of the current type) in the region
+		size_t snap_off;    // byte offset of the region's copy in snapshot
+		size_t word_off;    // offset of the region's first word in bitmap
+	};
+
+	ValueType type = ValueType::Int32;
+	size_t value_size = 4;
+	bool use_simd = cpuHasAvx2();
+
+	Region* regions = nullptr;
+	size_t num_regions = 0;
+	size_t regions_bytes = 0;
+
+	// the values from the last filter (or the new scan)
+	char* snapshot = nullptr;
+	size_t snapshot_size = 0;
+
+	// one bit per value, each region starts on a new word
+	uint64_t* bitmap = nullptr;
+	size_t bitmap_words = 0;
+
+	// one bit per word of bitmap, set if the word is non-zero
+	uint64_t* summary = nullptr;
+	size_t summary_words = 0;
+
+	size_t num_candidates = 0;
+
+	double readValue(const char* p) const;
+
+	// calls func(w) for the index w (relative to the region) of each non-zero bitmap word
+	template<typename Func>
+	void forEachLiveWord(const Region& r, Func func) const;
+};
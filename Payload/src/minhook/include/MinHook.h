@@ -32,7 +32,39 @@
     #error MinHook supports only x86 and x64 systems.
 #endif
 
-#include <windows.h>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    // The Windows types that MinHook is written with, for building it on Linux
+    // (see src/os.c).
+    #include <stddef.h>
+    #include <stdint.h>
+    #include <wchar.h>
+
+    #define WINAPI
+    #define VOID void
+    #define TRUE 1
+    #define FALSE 0
+    #define C_ASSERT(e) typedef char __C_ASSERT__[(e) ? 1 : -1]
+
+    typedef void *LPVOID, *HANDLE;
+    typedef int BOOL;
+    typedef int8_t INT8;
+    typedef int16_t INT16;
+    typedef int32_t INT32;
+    typedef int64_t INT64;
+    typedef uint8_t UINT8, BYTE, *LPBYTE;
+    typedef uint16_t UINT16;
+    typedef uint32_t UINT32, *PUINT32, DWORD, *LPDWORD;
+    typedef uint64_t UINT64;
+    typedef unsigned int UINT;
+    typedef int32_t LONG;
+    typedef uintptr_t ULONG_PTR, DWORD_PTR;
+    typedef intptr_t LONG_PTR;
+    typedef size_t SIZE_T;
+    typedef const char *LPCSTR;
+    typedef const wchar_t *LPCWSTR;
+#endif
 
 // MinHook Error Codes.
 typedef enum MH_STATUS
@@ -121,6 +153,7 @@ extern "C" {
     //   ppOriginal [out] A pointer to the trampoline function, which will be
     //                    used to call the original target function.
     //                    This parameter can be NULL.
+#ifdef _WIN32
     MH_STATUS WINAPI MH_CreateHookApi(
         LPCWSTR pszModule, LPCSTR pszProcName, LPVOID pDetour, LPVOID *ppOriginal);
 
@@ -140,6 +173,7 @@ extern "C" {
     //                    This parameter can be NULL.
     MH_STATUS WINAPI MH_CreateHookApiEx(
         LPCWSTR pszModule, LPCSTR pszProcName, LPVOID pDetour, LPVOID *ppOriginal, LPVOID *ppTarget);
+#endif
 
     // Removes an already created hook.
     // Parameters:
@@ -26,18 +26,26 @@
  *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <windows.h>
+#include <string.h>
+#include "os.h"
 #include "buffer.h"
 
 // Size of each memory block. (= page size of VirtualAlloc)
 #define MEMORY_BLOCK_SIZE 0x1000
 
+// Size of each reserved memory region that blocks are committed from. Only
+// the blocks in use are committed, the rest of a region is just address space.
+#define MEMORY_REGION_SIZE 0x100000
+
+// Number of blocks in each region, the first one holds the region info.
+#define MEMORY_REGION_BLOCKS (MEMORY_REGION_SIZE / MEMORY_BLOCK_SIZE)
+
 // Max range for seeking a memory block. (= 1024MB)
 #define MAX_MEMORY_RANGE 0x40000000
 
-// Memory protection flags to check the executable address.
-#define PAGE_EXECUTE_FLAGS \
-    (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
+// Max number of free ranges in the index. There's only a few dozen in the
+// range of a module, the ones past this are left out.
+#define MAX_FREE_RANGES 256
 
 // Memory slot.
 typedef struct _MEMORY_SLOT
@@ -53,97 +61,334 @@ typedef struct _MEMORY_SLOT
 typedef struct _MEMORY_BLOCK
 {
     struct _MEMORY_BLOCK *pNext;
+    struct _MEMORY_BLOCK *pPrev;
     PMEMORY_SLOT pFree;         // First element of the free slot list.
     UINT usedCount;
 } MEMORY_BLOCK, *PMEMORY_BLOCK;
 
+// Memory region info. Placed at the head of each region, in a block of its
+// own that stays committed until the region is released.
+typedef struct _MEMORY_REGION
+{
+    struct _MEMORY_REGION *pNext;
+    UINT committedCount;        // Number of committed blocks, this one included.
+    UINT8 committed[MEMORY_REGION_BLOCKS / 8]; // One bit per committed block.
+} MEMORY_REGION, *PMEMORY_REGION;
+
 //-------------------------------------------------------------------------
 // Global Variables:
 //-------------------------------------------------------------------------
 
-// First element of the memory block list.
+// First element of the list of memory blocks that have an unused slot.
 PMEMORY_BLOCK g_pMemoryBlocks;
 
+// First element of the memory region list.
+PMEMORY_REGION g_pMemoryRegions;
+
+// Address space limits, queried once in InitializeBuffer().
+ULONG_PTR g_minAppAddr;
+ULONG_PTR g_maxAppAddr;
+DWORD g_allocationGranularity;
+
+// Index of the free ranges between g_indexMinAddr and g_indexMaxAddr, sorted
+// by address. It's built from a single snapshot of the address space and
+// kept up to date with our own reservations, so that reserving a new region
+// doesn't need to look at the address space again. It's only rebuilt if a
+// target isn't in its range, or if someone else took a range in the meantime.
+OS_RANGE g_freeRanges[MAX_FREE_RANGES];
+UINT g_freeRangeCount;
+ULONG_PTR g_indexMinAddr;
+ULONG_PTR g_indexMaxAddr;
+
+BUFFER_STATS g_bufferStats;
+
 //-------------------------------------------------------------------------
 VOID InitializeBuffer(VOID)
 {
-    // Nothing to do for now.
+    OsGetAddressLimits(&g_minAppAddr, &g_maxAppAddr, &g_allocationGranularity);
+    g_freeRangeCount = 0;
+    g_indexMinAddr = 0;
+    g_indexMaxAddr = 0;
 }
 
 //-------------------------------------------------------------------------
 VOID UninitializeBuffer(VOID)
 {
-    PMEMORY_BLOCK pBlock = g_pMemoryBlocks;
+    PMEMORY_REGION pRegion = g_pMemoryRegions;
     g_pMemoryBlocks = NULL;
+    g_pMemoryRegions = NULL;
+    g_freeRangeCount = 0;
+    g_indexMinAddr = 0;
+    g_indexMaxAddr = 0;
+    memset(&g_bufferStats, 0, sizeof(g_bufferStats));
+
+    // Every block lives in a region, so releasing the regions releases all of them.
+    while (pRegion)
+    {
+        PMEMORY_REGION pNext = pRegion->pNext;
+        OsRelease(pRegion, MEMORY_REGION_SIZE);
+        pRegion = pNext;
+    }
+}
+
+//-------------------------------------------------------------------------
+static VOID BuildFreeRangeIndex(ULONG_PTR minAddr, ULONG_PTR maxAddr)
+{
+    g_freeRangeCount = OsQueryFreeRanges(minAddr, maxAddr, g_freeRanges, MAX_FREE_RANGES);
+    g_indexMinAddr = minAddr;
+    g_indexMaxAddr = maxAddr;
+    g_bufferStats.snapshots++;
+}
 
-    while (pBlock)
+//-------------------------------------------------------------------------
+// Takes [start, end) out of the free range at index, which contains it.
+static VOID TakeFreeRange(UINT index, ULONG_PTR start, ULONG_PTR end)
+{
+    POS_RANGE pRange = &g_freeRanges[index];
+    BOOL hasBelow = pRange->start < start;
+    BOOL hasAbove = end < pRange->end;
+
+    if (hasBelow && hasAbove)
+    {
+        // Split in two, the index is full if there's no room for the other half.
+        if (g_freeRangeCount < MAX_FREE_RANGES)
+        {
+            memmove(pRange + 2, pRange + 1, (g_freeRangeCount - index - 1) * sizeof(OS_RANGE));
+            g_freeRangeCount++;
+            pRange[1].start = end;
+            pRange[1].end = pRange->end;
+        }
+        pRange->end = start;
+    }
+    else if (hasBelow)
+    {
+        pRange->end = start;
+    }
+    else if (hasAbove)
+    {
+        pRange->start = end;
+    }
+    else
     {
-        PMEMORY_BLOCK pNext = pBlock->pNext;
-        VirtualFree(pBlock, 0, MEM_RELEASE);
-        pBlock = pNext;
+        memmove(pRange, pRange + 1, (g_freeRangeCount - index - 1) * sizeof(OS_RANGE));
+        g_freeRangeCount--;
     }
 }
 
 //-------------------------------------------------------------------------
-#if defined(_M_X64) || defined(__x86_64__)
-static LPVOID FindPrevFreeRegion(LPVOID pAddress, LPVOID pMinAddr, DWORD dwAllocationGranularity)
+// Gets the spot closest to origin that a whole region fits in, in the free
+// range at index and between minAddr and maxAddr.
+static BOOL GetRegionSpot(UINT index, ULONG_PTR origin, ULONG_PTR minAddr, ULONG_PTR maxAddr, ULONG_PTR *pAddress)
 {
-    ULONG_PTR tryAddr = (ULONG_PTR)pAddress;
+    ULONG_PTR start = g_freeRanges[index].start < minAddr ? minAddr : g_freeRanges[index].start;
+    ULONG_PTR end = g_freeRanges[index].end > maxAddr ? maxAddr : g_freeRanges[index].end;
+    ULONG_PTR addr;
+
+    // Align inwards to the allocation granularity.
+    start = (start + g_allocationGranularity - 1) / g_allocationGranularity * g_allocationGranularity;
+    end = end / g_allocationGranularity * g_allocationGranularity;
+    if (end < start || end - start < MEMORY_REGION_SIZE)
+        return FALSE;
+
+    addr = origin / g_allocationGranularity * g_allocationGranularity;
+    if (addr < start)
+        addr = start;
+    if (addr > end - MEMORY_REGION_SIZE)
+        addr = end - MEMORY_REGION_SIZE;
+
+    *pAddress = addr;
+    return TRUE;
+}
 
-    // Round down to the allocation granularity.
-    tryAddr -= tryAddr % dwAllocationGranularity;
+//-------------------------------------------------------------------------
+// Finds the spot closest to origin that a whole region fits in, between
+// minAddr and maxAddr. Returns the index of its free range, or -1 if there's
+// no room in the index.
+static int FindFreeRange(ULONG_PTR origin, ULONG_PTR minAddr, ULONG_PTR maxAddr, ULONG_PTR *pAddress)
+{
+    UINT lo = 0, hi = g_freeRangeCount;
+    int below, above;
+    ULONG_PTR belowAddr = 0, aboveAddr = 0;
 
-    // Start from the previous allocation granularity multiply.
-    tryAddr -= dwAllocationGranularity;
+    // The first range that starts above the origin.
+    while (lo < hi)
+    {
+        UINT mid = (lo + hi) / 2;
+        if (g_freeRanges[mid].start <= origin)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
 
-    while (tryAddr >= (ULONG_PTR)pMinAddr)
+    // Going outwards from the origin, the first range in each direction that
+    // has room is the closest one in that direction.
+    for (below = (int)lo - 1; below >= 0; below--)
     {
-        MEMORY_BASIC_INFORMATION mbi;
-        if (VirtualQuery((LPVOID)tryAddr, &mbi, sizeof(mbi)) == 0)
+        if (g_freeRanges[below].end <= minAddr)
+            below = 0;
+        else if (GetRegionSpot((UINT)below, origin, minAddr, maxAddr, &belowAddr))
             break;
+    }
 
-        if (mbi.State == MEM_FREE)
-            return (LPVOID)tryAddr;
-
-        if ((ULONG_PTR)mbi.AllocationBase < dwAllocationGranularity)
+    for (above = (int)lo; above < (int)g_freeRangeCount; above++)
+    {
+        if (g_freeRanges[above].start >= maxAddr)
+            above = (int)g_freeRangeCount - 1;
+        else if (GetRegionSpot((UINT)above, origin, minAddr, maxAddr, &aboveAddr))
             break;
+    }
 
-        tryAddr = (ULONG_PTR)mbi.AllocationBase - dwAllocationGranularity;
+    if (below >= 0 && (above >= (int)g_freeRangeCount
+        || (belowAddr > origin ? belowAddr - origin : origin - belowAddr) <= aboveAddr - origin))
+    {
+        *pAddress = belowAddr;
+        return below;
     }
 
-    return NULL;
+    if (above < (int)g_freeRangeCount)
+    {
+        *pAddress = aboveAddr;
+        return above;
+    }
+
+    return -1;
 }
-#endif
 
 //-------------------------------------------------------------------------
-#if defined(_M_X64) || defined(__x86_64__)
-static LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAllocationGranularity)
+static VOID LinkBlock(PMEMORY_BLOCK pBlock)
 {
-    ULONG_PTR tryAddr = (ULONG_PTR)pAddress;
+    pBlock->pPrev = NULL;
+    pBlock->pNext = g_pMemoryBlocks;
+    if (g_pMemoryBlocks != NULL)
+        g_pMemoryBlocks->pPrev = pBlock;
+    g_pMemoryBlocks = pBlock;
+}
 
-    // Round down to the allocation granularity.
-    tryAddr -= tryAddr % dwAllocationGranularity;
+//-------------------------------------------------------------------------
+static VOID UnlinkBlock(PMEMORY_BLOCK pBlock)
+{
+    if (pBlock->pPrev)
+        pBlock->pPrev->pNext = pBlock->pNext;
+    else
+        g_pMemoryBlocks = pBlock->pNext;
+    if (pBlock->pNext)
+        pBlock->pNext->pPrev = pBlock->pPrev;
+}
 
-    // Start from the next allocation granularity multiply.
-    tryAddr += dwAllocationGranularity;
+//-------------------------------------------------------------------------
+static VOID InitializeBlock(PMEMORY_BLOCK pBlock)
+{
+    // Build a linked list of all the slots.
+    PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBlock + 1;
+    pBlock->pFree = NULL;
+    pBlock->usedCount = 0;
+    do
+    {
+        pSlot->pNext = pBlock->pFree;
+        pBlock->pFree = pSlot;
+        pSlot++;
+    } while ((ULONG_PTR)pSlot - (ULONG_PTR)pBlock <= MEMORY_BLOCK_SIZE - MEMORY_SLOT_SIZE);
 
-    while (tryAddr <= (ULONG_PTR)pMaxAddr)
+    LinkBlock(pBlock);
+}
+
+//-------------------------------------------------------------------------
+// Commits the first block of the region that isn't committed yet.
+static PMEMORY_BLOCK CommitBlock(PMEMORY_REGION pRegion)
+{
+    UINT i;
+    for (i = 1; i < MEMORY_REGION_BLOCKS; i++)
     {
-        MEMORY_BASIC_INFORMATION mbi;
-        if (VirtualQuery((LPVOID)tryAddr, &mbi, sizeof(mbi)) == 0)
-            break;
+        PMEMORY_BLOCK pBlock;
+        if (pRegion->committed[i / 8] & (1 << (i % 8)))
+            continue;
 
-        if (mbi.State == MEM_FREE)
-            return (LPVOID)tryAddr;
+        pBlock = (PMEMORY_BLOCK)((ULONG_PTR)pRegion + i * MEMORY_BLOCK_SIZE);
+        if (!OsCommit(pBlock, MEMORY_BLOCK_SIZE))
+            return NULL;
+
+        pRegion->committed[i / 8] |= 1 << (i % 8);
+        pRegion->committedCount++;
+        g_bufferStats.committedBlocks++;
+        InitializeBlock(pBlock);
+        return pBlock;
+    }
+    return NULL;
+}
 
-        tryAddr = (ULONG_PTR)mbi.BaseAddress + mbi.RegionSize;
+//-------------------------------------------------------------------------
+// Reserves a whole region and commits its info block. Returns NULL if the
+// address is taken.
+static PMEMORY_REGION ReserveRegion(LPVOID pAddress)
+{
+    PMEMORY_REGION pRegion = (PMEMORY_REGION)OsReserve(pAddress, MEMORY_REGION_SIZE);
+    if (pRegion == NULL)
+        return NULL;
 
-        // Round up to the next allocation granularity.
-        tryAddr += dwAllocationGranularity - 1;
-        tryAddr -= tryAddr % dwAllocationGranularity;
+    if (!OsCommit(pRegion, MEMORY_BLOCK_SIZE))
+    {
+        OsRelease(pRegion, MEMORY_REGION_SIZE);
+        return NULL;
     }
 
-    return NULL;
+    memset(pRegion, 0, sizeof(MEMORY_REGION));
+    pRegion->committed[0] = 1;
+    pRegion->committedCount = 1;
+    pRegion->pNext = g_pMemoryRegions;
+    g_pMemoryRegions = pRegion;
+    g_bufferStats.reservedRegions++;
+
+    return pRegion;
+}
+
+//-------------------------------------------------------------------------
+#if defined(_M_X64) || defined(__x86_64__)
+// Reserves a region as close to pOrigin as there's room for, between minAddr
+// and maxAddr.
+static PMEMORY_REGION ReserveRegionNear(LPVOID pOrigin, ULONG_PTR minAddr, ULONG_PTR maxAddr)
+{
+    BOOL rebuilt = FALSE;
+
+    // The index has to cover the whole range that the target can reach.
+    if (minAddr < g_indexMinAddr || maxAddr > g_indexMaxAddr)
+    {
+        BuildFreeRangeIndex(minAddr, maxAddr);
+        rebuilt = TRUE;
+    }
+
+    for (;;)
+    {
+        ULONG_PTR addr;
+        PMEMORY_REGION pRegion;
+        int index = FindFreeRange((ULONG_PTR)pOrigin, minAddr, maxAddr, &addr);
+        if (index < 0)
+        {
+            // Something might have been freed since the snapshot.
+            if (rebuilt)
+                return NULL;
+            BuildFreeRangeIndex(minAddr, maxAddr);
+            rebuilt = TRUE;
+            continue;
+        }
+
+        pRegion = ReserveRegion((LPVOID)addr);
+        if (pRegion != NULL)
+        {
+            TakeFreeRange((UINT)index, addr, addr + MEMORY_REGION_SIZE);
+            return pRegion;
+        }
+
+        // Someone else took it since the snapshot, take a new one (once).
+        if (!rebuilt)
+        {
+            BuildFreeRangeIndex(minAddr, maxAddr);
+            rebuilt = TRUE;
+        }
+        else
+        {
+            TakeFreeRange((UINT)index, addr, addr + MEMORY_REGION_SIZE);
+        }
+    }
 }
 #endif
 
@@ -151,14 +396,13 @@ static LPVOID FindNextFreeRegion(LPVOID pAddress, LPVOID pMaxAddr, DWORD dwAlloc
 static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
 {
     PMEMORY_BLOCK pBlock;
+    PMEMORY_REGION pRegion;
 #if defined(_M_X64) || defined(__x86_64__)
     ULONG_PTR minAddr;
     ULONG_PTR maxAddr;
 
-    SYSTEM_INFO si;
-    GetSystemInfo(&si);
-    minAddr = (ULONG_PTR)si.lpMinimumApplicationAddress;
-    maxAddr = (ULONG_PTR)si.lpMaximumApplicationAddress;
+    minAddr = g_minAppAddr;
+    maxAddr = g_maxAppAddr;
 
     // pOrigin ± 512MB
     if ((ULONG_PTR)pOrigin > MAX_MEMORY_RANGE && minAddr < (ULONG_PTR)pOrigin - MAX_MEMORY_RANGE)
@@ -166,81 +410,43 @@ static PMEMORY_BLOCK GetMemoryBlock(LPVOID pOrigin)
 
     if (maxAddr > (ULONG_PTR)pOrigin + MAX_MEMORY_RANGE)
         maxAddr = (ULONG_PTR)pOrigin + MAX_MEMORY_RANGE;
-
-    // Make room for MEMORY_BLOCK_SIZE bytes.
-    maxAddr -= MEMORY_BLOCK_SIZE - 1;
 #endif
 
-    // Look the registered blocks for a reachable one.
+    // Look the blocks with an unused slot for a reachable one.
     for (pBlock = g_pMemoryBlocks; pBlock != NULL; pBlock = pBlock->pNext)
     {
 #if defined(_M_X64) || defined(__x86_64__)
         // Ignore the blocks too far.
-        if ((ULONG_PTR)pBlock < minAddr || (ULONG_PTR)pBlock >= maxAddr)
+        if ((ULONG_PTR)pBlock < minAddr || (ULONG_PTR)pBlock + MEMORY_BLOCK_SIZE > maxAddr)
             continue;
 #endif
-        // The block has at least one unused slot.
-        if (pBlock->pFree != NULL)
-            return pBlock;
+        return pBlock;
     }
 
-#if defined(_M_X64) || defined(__x86_64__)
-    // Alloc a new block above if not found.
+    // Commit the next block of a reachable region that isn't full yet,
+    // this doesn't need to look at the address space at all.
+    for (pRegion = g_pMemoryRegions; pRegion != NULL; pRegion = pRegion->pNext)
     {
-        LPVOID pAlloc = pOrigin;
-        while ((ULONG_PTR)pAlloc >= minAddr)
-        {
-            pAlloc = FindPrevFreeRegion(pAlloc, (LPVOID)minAddr, si.dwAllocationGranularity);
-            if (pAlloc == NULL)
-                break;
-
-            pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-                pAlloc, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-            if (pBlock != NULL)
-                break;
-        }
+        if (pRegion->committedCount >= MEMORY_REGION_BLOCKS)
+            continue;
+#if defined(_M_X64) || defined(__x86_64__)
+        // Ignore the regions too far.
+        if ((ULONG_PTR)pRegion < minAddr || (ULONG_PTR)pRegion + MEMORY_REGION_SIZE > maxAddr)
+            continue;
+#endif
+        pBlock = CommitBlock(pRegion);
+        if (pBlock != NULL)
+            return pBlock;
     }
 
-    // Alloc a new block below if not found.
-    if (pBlock == NULL)
-    {
-        LPVOID pAlloc = pOrigin;
-        while ((ULONG_PTR)pAlloc <= maxAddr)
-        {
-            pAlloc = FindNextFreeRegion(pAlloc, (LPVOID)maxAddr, si.dwAllocationGranularity);
-            if (pAlloc == NULL)
-                break;
-
-            pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-                pAlloc, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-            if (pBlock != NULL)
-                break;
-        }
-    }
+#if defined(_M_X64) || defined(__x86_64__)
+    pRegion = ReserveRegionNear(pOrigin, minAddr, maxAddr);
 #else
-    // In x86 mode, a memory block can be placed anywhere.
-    pBlock = (PMEMORY_BLOCK)VirtualAlloc(
-        NULL, MEMORY_BLOCK_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    // In x86 mode, a memory region can be placed anywhere.
+    pRegion = ReserveRegion(NULL);
 #endif
 
-    if (pBlock != NULL)
-    {
-        // Build a linked list of all the slots.
-        PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBlock + 1;
-        pBlock->pFree = NULL;
-        pBlock->usedCount = 0;
-        do
-        {
-            pSlot->pNext = pBlock->pFree;
-            pBlock->pFree = pSlot;
-            pSlot++;
-        } while ((ULONG_PTR)pSlot - (ULONG_PTR)pBlock <= MEMORY_BLOCK_SIZE - MEMORY_SLOT_SIZE);
-
-        pBlock->pNext = g_pMemoryBlocks;
-        g_pMemoryBlocks = pBlock;
-    }
-
-    return pBlock;
+    return pRegion != NULL ? CommitBlock(pRegion) : NULL;
 }
 
 //-------------------------------------------------------------------------
@@ -255,6 +461,10 @@ LPVOID AllocateBuffer(LPVOID pOrigin)
     pSlot = pBlock->pFree;
     pBlock->pFree = pSlot->pNext;
     pBlock->usedCount++;
+
+    // Full blocks are taken out of the list until a slot is freed.
+    if (pBlock->pFree == NULL)
+        UnlinkBlock(pBlock);
 #ifdef _DEBUG
     // Fill the slot with INT3 for debugging.
     memset(pSlot, 0xCC, sizeof(MEMORY_SLOT));
@@ -263,50 +473,67 @@ LPVOID AllocateBuffer(LPVOID pOrigin)
 }
 
 //-------------------------------------------------------------------------
-VOID FreeBuffer(LPVOID pBuffer)
+// Finds the region that the block is in, and its index in the region. This
+// walks the region list, so freeing a buffer costs a step per region. Each
+// region holds thousands of trampolines, so there's only a few of them.
+static PMEMORY_REGION FindRegion(PMEMORY_BLOCK pBlock, UINT *pIndex)
 {
-    PMEMORY_BLOCK pBlock = g_pMemoryBlocks;
-    PMEMORY_BLOCK pPrev = NULL;
-    ULONG_PTR pTargetBlock = ((ULONG_PTR)pBuffer / MEMORY_BLOCK_SIZE) * MEMORY_BLOCK_SIZE;
-
-    while (pBlock != NULL)
+    PMEMORY_REGION pRegion;
+    for (pRegion = g_pMemoryRegions; pRegion != NULL; pRegion = pRegion->pNext)
     {
-        if ((ULONG_PTR)pBlock == pTargetBlock)
+        ULONG_PTR offset = (ULONG_PTR)pBlock - (ULONG_PTR)pRegion;
+        if (offset < MEMORY_REGION_SIZE)
         {
-            PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBuffer;
-#ifdef _DEBUG
-            // Clear the released slot for debugging.
-            memset(pSlot, 0x00, sizeof(*pSlot));
-#endif
-            // Restore the released slot to the list.
-            pSlot->pNext = pBlock->pFree;
-            pBlock->pFree = pSlot;
-            pBlock->usedCount--;
-
-            // Free if unused.
-            if (pBlock->usedCount == 0)
-            {
-                if (pPrev)
-                    pPrev->pNext = pBlock->pNext;
-                else
-                    g_pMemoryBlocks = pBlock->pNext;
-
-                VirtualFree(pBlock, 0, MEM_RELEASE);
-            }
-
-            break;
+            *pIndex = (UINT)(offset / MEMORY_BLOCK_SIZE);
+            return pRegion;
         }
+    }
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+VOID FreeBuffer(LPVOID pBuffer)
+{
+    PMEMORY_BLOCK pBlock = (PMEMORY_BLOCK)(((ULONG_PTR)pBuffer / MEMORY_BLOCK_SIZE) * MEMORY_BLOCK_SIZE);
+    PMEMORY_SLOT pSlot = (PMEMORY_SLOT)pBuffer;
+    UINT index;
+
+    // The block has to be one of ours, in use.
+    PMEMORY_REGION pRegion = FindRegion(pBlock, &index);
+    if (pRegion == NULL || index == 0 || !(pRegion->committed[index / 8] & (1 << (index % 8))))
+        return;
 
-        pPrev = pBlock;
-        pBlock = pBlock->pNext;
+#ifdef _DEBUG
+    // Clear the released slot for debugging.
+    memset(pSlot, 0x00, sizeof(*pSlot));
+#endif
+    // Restore the released slot to the list, and the block to the list of
+    // blocks with unused slots if it was full.
+    if (pBlock->pFree == NULL)
+        LinkBlock(pBlock);
+    pSlot->pNext = pBlock->pFree;
+    pBlock->pFree = pSlot;
+    pBlock->usedCount--;
+
+    // Decommit if unused, the region stays reserved so it can be committed again.
+    if (pBlock->usedCount == 0)
+    {
+        UnlinkBlock(pBlock);
+        OsDecommit(pBlock, MEMORY_BLOCK_SIZE);
+        pRegion->committed[index / 8] &= ~(1 << (index % 8));
+        pRegion->committedCount--;
+        g_bufferStats.committedBlocks--;
     }
 }
 
 //-------------------------------------------------------------------------
 BOOL IsExecutableAddress(LPVOID pAddress)
 {
-    MEMORY_BASIC_INFORMATION mi;
-    VirtualQuery(pAddress, &mi, sizeof(mi));
+    return OsIsExecutable(pAddress);
+}
 
-    return (mi.State == MEM_COMMIT && (mi.Protect & PAGE_EXECUTE_FLAGS));
+//-------------------------------------------------------------------------
+VOID GetBufferStats(PBUFFER_STATS pStats)
+{
+    *pStats = g_bufferStats;
 }
@@ -35,8 +35,17 @@
     #define MEMORY_SLOT_SIZE 32
 #endif
 
+// How much work the buffers have taken, for tests & benchmarks.
+typedef struct _BUFFER_STATS
+{
+    UINT snapshots;         // Number of times the address space was looked at.
+    UINT reservedRegions;   // Number of regions reserved.
+    UINT committedBlocks;   // Number of blocks committed right now.
+} BUFFER_STATS, *PBUFFER_STATS;
+
 VOID   InitializeBuffer(VOID);
 VOID   UninitializeBuffer(VOID);
 LPVOID AllocateBuffer(LPVOID pOrigin);
 VOID   FreeBuffer(LPVOID pBuffer);
 BOOL   IsExecutableAddress(LPVOID pAddress);
+VOID   GetBufferStats(PBUFFER_STATS pStats);
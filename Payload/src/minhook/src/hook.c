@@ -26,11 +26,21 @@
  *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <windows.h>
-#include <tlhelp32.h>
+#ifdef _WIN32
+    #include <windows.h>
+    #include <tlhelp32.h>
+#else
+    // For usleep() in strict C11.
+    #define _DEFAULT_SOURCE
+    #include <stdlib.h>
+    #include <string.h>
+    #include <sched.h>
+    #include <unistd.h>
+#endif
 #include <limits.h>
 
 #include "../include/MinHook.h"
+#include "os.h"
 #include "buffer.h"
 #include "trampoline.h"
 
@@ -57,6 +67,22 @@
 #define THREAD_ACCESS \
     (THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION | THREAD_SET_CONTEXT)
 
+#ifndef _WIN32
+    // There's no private heap on Linux, the hook entries come from malloc()
+    // and g_hHeap is only a flag for being initialized.
+    #define HeapCreate(options, initialSize, maximumSize) ((HANDLE)1)
+    #define HeapDestroy(hHeap) ((void)0)
+    #define HeapAlloc(hHeap, flags, size) malloc(size)
+    #define HeapReAlloc(hHeap, flags, p, size) realloc(p, size)
+    #define HeapFree(hHeap, flags, p) free(p)
+
+    #define InterlockedCompareExchange(p, exchange, comparand) \
+        __sync_val_compare_and_swap(p, comparand, exchange)
+    #define InterlockedExchange(p, value) \
+        (__sync_synchronize(), __sync_lock_test_and_set(p, value))
+    #define Sleep(ms) ((ms) == 0 ? (void)sched_yield() : (void)usleep((ms) * 1000))
+#endif
+
 // Hook information.
 typedef struct _HOOK_ENTRY
 {
@@ -159,6 +185,7 @@ static void DeleteHookEntry(UINT pos)
     }
 }
 
+#ifdef _WIN32
 //-------------------------------------------------------------------------
 static DWORD_PTR FindOldIP(PHOOK_ENTRY pHook, DWORD_PTR ip)
 {
@@ -346,6 +373,26 @@ static VOID Unfreeze(PFROZEN_THREADS pThreads)
         HeapFree(g_hHeap, 0, pThreads->pItems);
     }
 }
+#else
+//-------------------------------------------------------------------------
+// Other threads aren't suspended on Linux, so hooks have to be enabled and
+// disabled while no other thread can be running the targets (e.g. from an
+// LD_PRELOAD constructor, before main() has started any).
+static VOID Freeze(PFROZEN_THREADS pThreads, UINT pos, UINT action)
+{
+    (void)pos;
+    (void)action;
+    pThreads->pItems   = NULL;
+    pThreads->capacity = 0;
+    pThreads->size     = 0;
+}
+
+//-------------------------------------------------------------------------
+static VOID Unfreeze(PFROZEN_THREADS pThreads)
+{
+    (void)pThreads;
+}
+#endif
 
 //-------------------------------------------------------------------------
 static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
@@ -361,7 +408,7 @@ static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
         patchSize    += sizeof(JMP_REL_SHORT);
     }
 
-    if (!VirtualProtect(pPatchTarget, patchSize, PAGE_EXECUTE_READWRITE, &oldProtect))
+    if (!OsBeginPatch(pPatchTarget, patchSize, &oldProtect))
         return MH_ERROR_MEMORY_PROTECT;
 
     if (enable)
@@ -385,10 +432,7 @@ static MH_STATUS EnableHookLL(UINT pos, BOOL enable)
             memcpy(pPatchTarget, pHook->backup, sizeof(JMP_REL));
     }
 
-    VirtualProtect(pPatchTarget, patchSize, oldProtect, &oldProtect);
-
-    // Just-in-case measure.
-    FlushInstructionCache(GetCurrentProcess(), pPatchTarget, patchSize);
+    OsEndPatch(pPatchTarget, patchSize, oldProtect);
 
     pHook->isEnabled   = enable;
     pHook->queueEnable = enable;
@@ -830,6 +874,7 @@ MH_STATUS WINAPI MH_ApplyQueued(VOID)
     return status;
 }
 
+#ifdef _WIN32
 //-------------------------------------------------------------------------
 MH_STATUS WINAPI MH_CreateHookApiEx(
     LPCWSTR pszModule, LPCSTR pszProcName, LPVOID pDetour,
@@ -858,6 +903,7 @@ MH_STATUS WINAPI MH_CreateHookApi(
 {
    return MH_CreateHookApiEx(pszModule, pszProcName, pDetour, ppOriginal, NULL);
 }
+#endif
 
 //-------------------------------------------------------------------------
 const char * WINAPI MH_StatusToString(MH_STATUS status)
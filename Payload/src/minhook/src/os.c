@@ -0,0 +1,372 @@
+/*
+ *  OS abstraction for the memory that MinHook allocates trampolines from and
+ *  patches (not part of upstream MinHook), see os.h.
+ */
+
+#ifndef _WIN32
+    // For MAP_ANONYMOUS and madvise() in strict C11.
+    #define _DEFAULT_SOURCE
+#endif
+
+#include "os.h"
+
+#ifdef _WIN32
+
+// Memory protection flags to check the executable address.
+#define PAGE_EXECUTE_FLAGS \
+    (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
+
+//-------------------------------------------------------------------------
+VOID OsGetAddressLimits(ULONG_PTR *pMinAddr, ULONG_PTR *pMaxAddr, DWORD *pGranularity)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    *pMinAddr = (ULONG_PTR)si.lpMinimumApplicationAddress;
+    *pMaxAddr = (ULONG_PTR)si.lpMaximumApplicationAddress;
+    *pGranularity = si.dwAllocationGranularity;
+}
+
+//-------------------------------------------------------------------------
+UINT OsQueryFreeRanges(ULONG_PTR minAddr, ULONG_PTR maxAddr, POS_RANGE pRanges, UINT maxRanges)
+{
+    ULONG_PTR minApp, maxApp;
+    DWORD granularity;
+    ULONG_PTR addr;
+    UINT count = 0;
+
+    OsGetAddressLimits(&minApp, &maxApp, &granularity);
+    if (minAddr < minApp)
+        minAddr = minApp;
+    if (maxAddr > maxApp)
+        maxAddr = maxApp;
+
+    // Walk the regions, one VirtualQuery each.
+    addr = minAddr;
+    while (addr < maxAddr && count < maxRanges)
+    {
+        MEMORY_BASIC_INFORMATION mbi;
+        ULONG_PTR start, end;
+        if (VirtualQuery((LPVOID)addr, &mbi, sizeof(mbi)) == 0)
+            break;
+
+        start = (ULONG_PTR)mbi.BaseAddress;
+        end = start + mbi.RegionSize;
+        if (end <= addr)
+            break;
+        addr = end;
+
+        if (mbi.State != MEM_FREE)
+            continue;
+
+        if (start < minAddr)
+            start = minAddr;
+        if (end > maxAddr)
+            end = maxAddr;
+
+        // Align inwards to the allocation granularity.
+        start = (start + granularity - 1) / granularity * granularity;
+        end = end / granularity * granularity;
+        if (start < end)
+        {
+            pRanges[count].start = start;
+            pRanges[count].end = end;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+//-------------------------------------------------------------------------
+LPVOID OsReserve(LPVOID pAddress, SIZE_T size)
+{
+    return VirtualAlloc(pAddress, size, MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+}
+
+//-------------------------------------------------------------------------
+BOOL OsCommit(LPVOID pAddress, SIZE_T size)
+{
+    return VirtualAlloc(pAddress, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE) != NULL;
+}
+
+//-------------------------------------------------------------------------
+VOID OsDecommit(LPVOID pAddress, SIZE_T size)
+{
+    VirtualFree(pAddress, size, MEM_DECOMMIT);
+}
+
+//-------------------------------------------------------------------------
+VOID OsRelease(LPVOID pAddress, SIZE_T size)
+{
+    UNREFERENCED_PARAMETER(size);
+    VirtualFree(pAddress, 0, MEM_RELEASE);
+}
+
+//-------------------------------------------------------------------------
+BOOL OsIsExecutable(LPVOID pAddress)
+{
+    MEMORY_BASIC_INFORMATION mi;
+    VirtualQuery(pAddress, &mi, sizeof(mi));
+
+    return (mi.State == MEM_COMMIT && (mi.Protect & PAGE_EXECUTE_FLAGS));
+}
+
+//-------------------------------------------------------------------------
+BOOL OsBeginPatch(LPVOID pAddress, SIZE_T size, DWORD *pOldProtect)
+{
+    return VirtualProtect(pAddress, size, PAGE_EXECUTE_READWRITE, pOldProtect);
+}
+
+//-------------------------------------------------------------------------
+VOID OsEndPatch(LPVOID pAddress, SIZE_T size, DWORD oldProtect)
+{
+    VirtualProtect(pAddress, size, oldProtect, &oldProtect);
+
+    // Just-in-case measure.
+    FlushInstructionCache(GetCurrentProcess(), pAddress, size);
+}
+
+#else
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+    #define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// Lowest address that mmap() hands out by default (vm.mmap_min_addr), and the
+// end of the lower half of the address space.
+#define MIN_APP_ADDRESS 0x10000
+#define MAX_APP_ADDRESS 0x7FFFFFFFEFFF
+
+//-------------------------------------------------------------------------
+VOID OsGetAddressLimits(ULONG_PTR *pMinAddr, ULONG_PTR *pMaxAddr, DWORD *pGranularity)
+{
+    *pMinAddr = MIN_APP_ADDRESS;
+    *pMaxAddr = MAX_APP_ADDRESS;
+    *pGranularity = (DWORD)sysconf(_SC_PAGESIZE);
+}
+
+//-------------------------------------------------------------------------
+// Calls back for every mapping in /proc/self/maps (sorted by address) until
+// it returns FALSE.
+static VOID ForEachMapping(BOOL (*callback)(ULONG_PTR start, ULONG_PTR end, const char *perms, LPVOID ctx), LPVOID ctx)
+{
+    char line[512];
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if (maps == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), maps) != NULL)
+    {
+        unsigned long start, end;
+        char perms[5];
+        if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3)
+            continue;
+        if (!callback(start, end, perms, ctx))
+            break;
+    }
+
+    fclose(maps);
+}
+
+typedef struct _FREE_RANGES
+{
+    ULONG_PTR minAddr;
+    ULONG_PTR maxAddr;
+    ULONG_PTR prevEnd;      // End of the previous mapping.
+    DWORD granularity;
+    POS_RANGE pRanges;
+    UINT maxRanges;
+    UINT count;
+} FREE_RANGES;
+
+//-------------------------------------------------------------------------
+static VOID AddFreeRange(FREE_RANGES *pFree, ULONG_PTR start, ULONG_PTR end)
+{
+    if (start < pFree->minAddr)
+        start = pFree->minAddr;
+    if (end > pFree->maxAddr)
+        end = pFree->maxAddr;
+
+    // Align inwards to the allocation granularity.
+    start = (start + pFree->granularity - 1) / pFree->granularity * pFree->granularity;
+    end = end / pFree->granularity * pFree->granularity;
+    if (start < end && pFree->count < pFree->maxRanges)
+    {
+        pFree->pRanges[pFree->count].start = start;
+        pFree->pRanges[pFree->count].end = end;
+        pFree->count++;
+    }
+}
+
+//-------------------------------------------------------------------------
+static BOOL AddGapBefore(ULONG_PTR start, ULONG_PTR end, const char *perms, LPVOID ctx)
+{
+    FREE_RANGES *pFree = (FREE_RANGES *)ctx;
+    (void)perms;
+
+    // The gap between the previous mapping and this one is free.
+    if (start > pFree->prevEnd)
+        AddFreeRange(pFree, pFree->prevEnd, start);
+    if (end > pFree->prevEnd)
+        pFree->prevEnd = end;
+
+    return pFree->prevEnd < pFree->maxAddr && pFree->count < pFree->maxRanges;
+}
+
+//-------------------------------------------------------------------------
+UINT OsQueryFreeRanges(ULONG_PTR minAddr, ULONG_PTR maxAddr, POS_RANGE pRanges, UINT maxRanges)
+{
+    FREE_RANGES free;
+    ULONG_PTR minApp, maxApp;
+
+    OsGetAddressLimits(&minApp, &maxApp, &free.granularity);
+    free.minAddr = minAddr < minApp ? minApp : minAddr;
+    free.maxAddr = maxAddr > maxApp ? maxApp : maxAddr;
+    free.prevEnd = free.minAddr;
+    free.pRanges = pRanges;
+    free.maxRanges = maxRanges;
+    free.count = 0;
+
+    ForEachMapping(AddGapBefore, &free);
+
+    // Everything after the last mapping is free too.
+    if (free.prevEnd < free.maxAddr)
+        AddFreeRange(&free, free.prevEnd, free.maxAddr);
+
+    return free.count;
+}
+
+//-------------------------------------------------------------------------
+LPVOID OsReserve(LPVOID pAddress, SIZE_T size)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    LPVOID p;
+
+    if (pAddress != NULL)
+        flags |= MAP_FIXED_NOREPLACE;
+    p = mmap(pAddress, size, PROT_NONE, flags, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    // Kernels older than 4.17 only take the address as a hint.
+    if (pAddress != NULL && p != pAddress)
+    {
+        munmap(p, size);
+        return NULL;
+    }
+
+    return p;
+}
+
+//-------------------------------------------------------------------------
+BOOL OsCommit(LPVOID pAddress, SIZE_T size)
+{
+    return mprotect(pAddress, size, PROT_READ | PROT_WRITE | PROT_EXEC) == 0;
+}
+
+//-------------------------------------------------------------------------
+VOID OsDecommit(LPVOID pAddress, SIZE_T size)
+{
+    madvise(pAddress, size, MADV_DONTNEED);
+    mprotect(pAddress, size, PROT_NONE);
+}
+
+//-------------------------------------------------------------------------
+VOID OsRelease(LPVOID pAddress, SIZE_T size)
+{
+    munmap(pAddress, size);
+}
+
+typedef struct _EXECUTABLE_CHECK
+{
+    ULONG_PTR address;
+    BOOL executable;
+} EXECUTABLE_CHECK;
+
+//-------------------------------------------------------------------------
+static BOOL CheckExecutable(ULONG_PTR start, ULONG_PTR end, const char *perms, LPVOID ctx)
+{
+    EXECUTABLE_CHECK *pCheck = (EXECUTABLE_CHECK *)ctx;
+    if (pCheck->address < start)
+        return FALSE;
+    if (pCheck->address < end)
+    {
+        pCheck->executable = perms[2] == 'x';
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+BOOL OsIsExecutable(LPVOID pAddress)
+{
+    EXECUTABLE_CHECK check;
+    check.address = (ULONG_PTR)pAddress;
+    check.executable = FALSE;
+
+    ForEachMapping(CheckExecutable, &check);
+    return check.executable;
+}
+
+//-------------------------------------------------------------------------
+static ULONG_PTR PageStart(LPVOID pAddress)
+{
+    ULONG_PTR pageSize = (ULONG_PTR)sysconf(_SC_PAGESIZE);
+    return (ULONG_PTR)pAddress / pageSize * pageSize;
+}
+
+//-------------------------------------------------------------------------
+static SIZE_T PageSpan(LPVOID pAddress, SIZE_T size)
+{
+    return (ULONG_PTR)pAddress + size - PageStart(pAddress);
+}
+
+typedef struct _PROTECT_QUERY
+{
+    ULONG_PTR address;
+    DWORD protect;
+} PROTECT_QUERY;
+
+//-------------------------------------------------------------------------
+static BOOL QueryProtect(ULONG_PTR start, ULONG_PTR end, const char *perms, LPVOID ctx)
+{
+    PROTECT_QUERY *pQuery = (PROTECT_QUERY *)ctx;
+    if (pQuery->address < start)
+        return FALSE;
+    if (pQuery->address < end)
+    {
+        pQuery->protect = (perms[0] == 'r' ? PROT_READ : 0)
+            | (perms[1] == 'w' ? PROT_WRITE : 0)
+            | (perms[2] == 'x' ? PROT_EXEC : 0);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+BOOL OsBeginPatch(LPVOID pAddress, SIZE_T size, DWORD *pOldProtect)
+{
+    // The patch is at most a few bytes, so the protection of its first page
+    // is taken for all of them.
+    PROTECT_QUERY query;
+    query.address = (ULONG_PTR)pAddress;
+    query.protect = PROT_READ | PROT_EXEC;
+    ForEachMapping(QueryProtect, &query);
+    *pOldProtect = query.protect;
+
+    return mprotect((LPVOID)PageStart(pAddress), PageSpan(pAddress, size),
+        PROT_READ | PROT_WRITE | PROT_EXEC) == 0;
+}
+
+//-------------------------------------------------------------------------
+VOID OsEndPatch(LPVOID pAddress, SIZE_T size, DWORD oldProtect)
+{
+    mprotect((LPVOID)PageStart(pAddress), PageSpan(pAddress, size), (int)oldProtect);
+    __builtin___clear_cache((char *)pAddress, (char *)pAddress + size);
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ *  OS abstraction for the memory that MinHook allocates trampolines from and
+ *  patches (not part of upstream MinHook). The Windows backend is what MinHook
+ *  used to call directly, the Linux one is for running hooks in tests.
+ */
+
+#pragma once
+
+#include "../include/MinHook.h"
+
+// A range of addresses, end is exclusive.
+typedef struct _OS_RANGE
+{
+    ULONG_PTR start;
+    ULONG_PTR end;
+} OS_RANGE, *POS_RANGE;
+
+// Gets the range of addresses that user mode allocations can go at, and the
+// alignment of reservations (= allocation granularity of VirtualAlloc).
+VOID OsGetAddressLimits(ULONG_PTR *pMinAddr, ULONG_PTR *pMaxAddr, DWORD *pGranularity);
+
+// Takes a snapshot of the free ranges between minAddr and maxAddr, sorted by
+// address and aligned inwards to the allocation granularity. Returns the
+// number of ranges written, ranges past maxRanges are left out.
+UINT OsQueryFreeRanges(ULONG_PTR minAddr, ULONG_PTR maxAddr, POS_RANGE pRanges, UINT maxRanges);
+
+// Reserves size bytes of address space at exactly pAddress (anywhere if
+// NULL) without committing any memory. Returns NULL if that's taken.
+LPVOID OsReserve(LPVOID pAddress, SIZE_T size);
+
+// Commits reserved pages as read/write/execute.
+BOOL OsCommit(LPVOID pAddress, SIZE_T size);
+
+// Gives the memory of committed pages back, they stay reserved.
+VOID OsDecommit(LPVOID pAddress, SIZE_T size);
+
+// Releases a whole reservation made with OsReserve().
+VOID OsRelease(LPVOID pAddress, SIZE_T size);
+
+// Checks if the address is committed and executable.
+BOOL OsIsExecutable(LPVOID pAddress);
+
+// Makes code writable (as well as executable) for patching it, the old
+// protection goes in pOldProtect.
+BOOL OsBeginPatch(LPVOID pAddress, SIZE_T size, DWORD *pOldProtect);
+
+// Puts back the protection from OsBeginPatch() once the code is patched.
+VOID OsEndPatch(LPVOID pAddress, SIZE_T size, DWORD oldProtect);
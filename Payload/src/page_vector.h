@@ -0,0 +1,100 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include "platform.h"
+
+/*
+* A growable array for our own long lived state, in memory that comes from platform::AllocPages
+* instead of the CRT heap. Savestates put the game's heap back the way it was on restore, so a
+* std::vector that grew after a capture would be left pointing at memory that the heap thinks is
+* free. Our own pages aren't saved, so whatever's in here stays as it is across restores.
+* Only for types that can be copied with memcpy, the growing functions return false when out of
+* memory (and leave the array the way it was).
+*/
+template <typename T>
+class PageVector {
+	static_assert(std::is_trivially_copyable<T>::value, "PageVector only holds trivially copyable types");
+
+public:
+	PageVector() = default;
+	PageVector(const PageVector&) = delete;
+	PageVector& operator=(const PageVector&) = delete;
+
+	~PageVector() {
+		release();
+	}
+
+	bool reserve(size_t n) {
+		if (n <= cap)
+			return true;
+		size_t bytes = (n * sizeof(T) + platform::PAGE_BYTES - 1) / platform::PAGE_BYTES * platform::PAGE_BYTES;
+		T* bigger = (T*)platform::AllocPages(bytes);
+		if (!bigger)
+			return false;
+		if (count)
+			memcpy(bigger, items, count * sizeof(T));
+		if (items)
+			platform::FreePages(items, alloc_bytes);
+		items = bigger;
+		alloc_bytes = bytes;
+		cap = bytes / sizeof(T);
+		return true;
+	}
+
+	// new elements are zeroed
+	bool resize(size_t n) {
+		if (n > cap && !reserve(n > cap * 2 ? n : cap * 2))
+			return false;
+		if (n > count)
+			memset(items + count, 0, (n - count) * sizeof(T));
+		count = n;
+		return true;
+	}
+
+	bool push_back(const T& value) {
+		if (count == cap && !reserve(cap ? cap * 2 : 1))
+			return false;
+		items[count++] = value;
+		return true;
+	}
+
+	bool assign(const T* p, size_t n) {
+		if (!reserve(n))
+			return false;
+		if (n)
+			memcpy(items, p, n * sizeof(T));
+		count = n;
+		return true;
+	}
+
+	// keeps the memory
+	void clear() {count = 0;}
+
+	// gives the memory back to the OS
+	void release() {
+		if (items)
+			platform::FreePages(items, alloc_bytes);
+		items = nullptr;
+		count = cap = alloc_bytes = 0;
+	}
+
+	size_t size() const {return count;}
+	size_t capacity() const {return cap;}
+	bool empty() const {return count == 0;}
+
+	T* data() {return items;}
+	const T* data() const {return items;}
+	T* begin() {return items;}
+	T* end() {return items + count;}
+	const T* begin() const {return items;}
+	const T* end() const {return items + count;}
+	T& operator[](size_t i) {return items[i];}
+	const T& operator[](size_t i) const {return items[i];}
+
+private:
+	T* items = nullptr;
+	size_t count = 0;
+	size_t cap = 0;
+	size_t alloc_bytes = 0;
+};
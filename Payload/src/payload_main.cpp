@@ -1,5 +1,6 @@
 #include "utils.h"
 #include "hooks.h"
+#include "platform.h"
 #include "./ipc.h"
 
 
@@ -13,7 +14,7 @@ extern "C" {
 
 
 	HMODULE GetSelfModuleHandle() {
-		return g_pInfo->hModule;
+		return (HMODULE)g_pInfo->hModule;
 	}
 
 
@@ -21,6 +22,8 @@ extern "C" {
 	// IPC cleanup is handled in its destructor in DllMain.
 	void PreExitCleanup() {
 		g_pInfo->script_mgr.stopScript(); // must be called before we unhook so we can clear keys
+		g_pInfo->prefetcher.stop(); // its thread runs our code
+		hooks::UnhookAllVirtual();
 		MH_Uninitialize();
 		if (g_szExitReason)
 			MessageBoxA(0, g_szExitReason, nullptr, MB_OK);
@@ -34,24 +37,46 @@ void QueueExit(const char* reason) {
 }
 
 
-void __stdcall Main(void* _) {
+// what the ScriptManager can't do by itself when a script's action runs
+static void OnScriptAction(const TimedAction& action) {
+	if (action.type == TimedAction::Type::Snapshot)
+		g_pInfo->savestates.requestCapture();
+}
+
+
+static void Main(void* _) {
 
-	if (!GetModuleInfo(L"supertuxkart.exe", nullptr, &g_mBase, nullptr)) {
+	if (!platform::FindModule("supertuxkart.exe", &g_mBase, &g_mSize)) {
 		MessageBoxA(0, "Failed to get module info for supertuxkart.exe", nullptr, MB_OK);
-		FreeLibraryAndExitThread(g_pInfo->hModule, 1);
+		FreeLibraryAndExitThread((HMODULE)g_pInfo->hModule, 1);
 	}
+	g_pInfo->savestates.setGameModule(g_mBase, g_mSize);
+	g_pInfo->state_hasher.setModule((const char*)g_mBase);
+	// our own state is in the game's heap, it shouldn't go back in time with the game
+	g_pInfo->savestates.preserve(g_pInfo, sizeof(GlobalInfo));
+	// and neither should our own threads
+	g_pInfo->savestates.skipStack(g_pInfo->prefetcher.stackAddress());
+	g_pInfo->script_mgr.setActionHandler(&OnScriptAction);
+	g_pInfo->script_mgr.setModule((const char*)g_mBase, g_mSize);
+
+	// the game's data dir is next to its exe
+	char data_dir[MAX_PATH];
+	DWORD exe_len = GetModuleFileNameA(nullptr, data_dir, MAX_PATH);
+	char* exe_name = exe_len > 0 && exe_len < MAX_PATH ? strrchr(data_dir, '\\') : nullptr;
+	if (exe_name && strcpy_s(exe_name + 1, MAX_PATH - (exe_name + 1 - data_dir), "data") == 0)
+		g_pInfo->prefetcher.setDataDir(data_dir);
 
 	const char* ipcFailReason = nullptr;
 	g_pInfo->ipc.init(ipcFailReason);
 	if (ipcFailReason) {
 		MessageBoxA(0, ipcFailReason, nullptr, MB_OK);
-		FreeLibraryAndExitThread(g_pInfo->hModule, 1);
+		FreeLibraryAndExitThread((HMODULE)g_pInfo->hModule, 1);
 	}
 
 	if (hooks::HookAll() != MH_OK) {
 		MessageBoxA(0, "Failed to hook one or more functions", nullptr, MB_OK);
 		MH_Uninitialize();
-		FreeLibraryAndExitThread(g_pInfo->hModule, 1);
+		FreeLibraryAndExitThread((HMODULE)g_pInfo->hModule, 1);
 	}
 }
 
@@ -63,7 +88,7 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID lpReserved) {
 		case DLL_PROCESS_ATTACH:
 			g_pInfo = new GlobalInfo(hModule);
 			DisableThreadLibraryCalls(hModule);
-			CreateThread(0, 0, (LPTHREAD_START_ROUTINE)Main, 0, 0, 0);
+			platform::StartThread(&Main, nullptr);
 			break;
 		case DLL_PROCESS_DETACH:
 			delete g_pInfo;
@@ -0,0 +1,679 @@
+#include "platform.h"
+#include <string.h>
+
+
+namespace platform {
+	// these are the same on every OS, see the bottom of the file
+	static void RememberOwnPages(void* p, size_t size);
+	static void ForgetOwnPages(void* p);
+	static bool OnWriteFault(void* addr);
+
+	// these are different for every OS
+	static bool ProtectPages(void* p, size_t size, bool writable);
+	static bool InstallWriteFaultHandler();
+	static void RemoveWriteFaultHandler();
+}
+
+
+#ifdef _WIN32
+
+#include <Windows.h>
+#include <Psapi.h> // must come after Windows.h
+#include <stdio.h>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+
+namespace platform {
+
+	uint64_t TickCountMs() {
+		return GetTickCount64();
+	}
+
+
+	uint64_t TickCountUs() {
+		LARGE_INTEGER freq, count;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&count);
+		return (uint64_t)(count.QuadPart / freq.QuadPart * 1000000 + count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+	}
+
+
+	void SleepMs(int ms) {
+		Sleep(ms);
+	}
+
+
+	void* AllocPages(size_t size) {
+		void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (p)
+			RememberOwnPages(p, size);
+		return p;
+	}
+
+
+	void FreePages(void* p, size_t size) {
+		ForgetOwnPages(p);
+		VirtualFree(p, 0, MEM_RELEASE);
+	}
+
+
+	static bool IsWritableRegion(const MEMORY_BASIC_INFORMATION& mbi) {
+		const DWORD writable = PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+		return mbi.State == MEM_COMMIT && mbi.Type != MEM_MAPPED && (mbi.Protect & writable) && !(mbi.Protect & PAGE_GUARD);
+	}
+
+
+	size_t GetWritableRegions(MemRegion* out, size_t max) {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		MEMORY_BASIC_INFORMATION mbi;
+		size_t n = 0;
+		for (char* p = (char*)si.lpMinimumApplicationAddress;
+			p < (char*)si.lpMaximumApplicationAddress && VirtualQuery(p, &mbi, sizeof(mbi));
+			p = (char*)mbi.BaseAddress + mbi.RegionSize
+		) {
+			if (!IsWritableRegion(mbi))
+				continue;
+			if (n < max)
+				out[n] = {(char*)mbi.BaseAddress, mbi.RegionSize, mbi.Type == MEM_IMAGE};
+			n++;
+		}
+		return n;
+	}
+
+
+	bool IsWritable(const void* p, size_t size) {
+		MEMORY_BASIC_INFORMATION mbi;
+		if (!VirtualQuery(p, &mbi, sizeof(mbi)) || !IsWritableRegion(mbi))
+			return false;
+		return (char*)mbi.BaseAddress + mbi.RegionSize >= (char*)p + size;
+	}
+
+
+	bool TryRead(const void* p, void* out, size_t size) {
+		// no objects that need unwinding in here, so SEH can be used
+		__try {
+			memcpy(out, p, size);
+			return true;
+		} __except (GetExceptionCode() == EXCEPTION_ACCESS_VIOLATION ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+			return false;
+		}
+	}
+
+
+	static bool ProtectPages(void* p, size_t size, bool writable) {
+		DWORD old_protect;
+		return VirtualProtect(p, size, writable ? PAGE_READWRITE : PAGE_READONLY, &old_protect);
+	}
+
+
+	static LONG CALLBACK WriteFaultHandler(EXCEPTION_POINTERS* info) {
+		const EXCEPTION_RECORD* rec = info->ExceptionRecord;
+		// the first parameter is 1 for writes, the second is the address
+		if (rec->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || rec->NumberParameters < 2 || rec->ExceptionInformation[0] != 1)
+			return EXCEPTION_CONTINUE_SEARCH;
+		return OnWriteFault((void*)rec->ExceptionInformation[1]) ? EXCEPTION_CONTINUE_EXECUTION : EXCEPTION_CONTINUE_SEARCH;
+	}
+
+
+	static void* write_fault_handler = nullptr;
+
+
+	static bool InstallWriteFaultHandler() {
+		write_fault_handler = AddVectoredExceptionHandler(1, WriteFaultHandler);
+		return write_fault_handler != nullptr;
+	}
+
+
+	static void RemoveWriteFaultHandler() {
+		if (write_fault_handler)
+			RemoveVectoredExceptionHandler(write_fault_handler);
+		write_fault_handler = nullptr;
+	}
+
+
+	bool ListDir(const char* path, void (*f)(void* ctx, const char* name, bool is_dir), void* ctx) {
+		char pattern[MAX_PATH];
+		if (snprintf(pattern, sizeof(pattern), "%s\\*", path) >= (int)sizeof(pattern))
+			return false;
+		WIN32_FIND_DATAA fd;
+		HANDLE h = FindFirstFileA(pattern, &fd);
+		if (h == INVALID_HANDLE_VALUE)
+			return false;
+		do {
+			if (strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0)
+				f(ctx, fd.cFileName, (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+		} while (FindNextFileA(h, &fd));
+		FindClose(h);
+		return true;
+	}
+
+
+	File OpenFileForReading(const char* path) {
+		HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		return h == INVALID_HANDLE_VALUE ? INVALID_FILE : (File)h;
+	}
+
+
+	int64_t ReadFileChunk(File f, void* buf, size_t size) {
+		DWORD read;
+		if (!ReadFile((HANDLE)f, buf, (DWORD)(size > MAXDWORD ? MAXDWORD : size), &read, nullptr))
+			return -1;
+		return read;
+	}
+
+
+	void CloseFile(File f) {
+		CloseHandle((HANDLE)f);
+	}
+
+
+	void SetBackgroundPriority() {
+		// this lowers the thread's I/O & memory priority along with its CPU priority
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+	}
+
+
+	struct ThreadStart {
+		void (*f)(void* arg);
+		void* arg;
+	};
+
+
+	static DWORD WINAPI RunThread(LPVOID param) {
+		ThreadStart start = *(ThreadStart*)param;
+		delete (ThreadStart*)param;
+		start.f(start.arg);
+		return 0;
+	}
+
+
+	bool StartThread(void (*f)(void* arg), void* arg) {
+		ThreadStart* start = new ThreadStart{f, arg};
+		HANDLE h = CreateThread(nullptr, 0, &RunThread, start, 0, nullptr);
+		if (!h) {
+			delete start;
+			return false;
+		}
+		CloseHandle(h);
+		return true;
+	}
+
+
+	bool FindModule(const char* name, void** base, size_t* size) {
+		HMODULE h = GetModuleHandleA(name);
+		MODULEINFO info;
+		if (!h || !GetModuleInformation(GetCurrentProcess(), h, &info, sizeof(info)))
+			return false;
+		*base = info.lpBaseOfDll;
+		*size = (size_t)info.SizeOfImage;
+		return true;
+	}
+
+
+	bool InitSockets() {
+		WSADATA wsaData;
+		return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+	}
+
+
+	void CleanupSockets() {
+		WSACleanup();
+	}
+
+
+	void CloseSocket(Socket s) {
+		closesocket(s);
+	}
+
+
+	bool SetNonBlocking(Socket s) {
+		u_long block_mode = 1;
+		return ioctlsocket(s, FIONBIO, &block_mode) != SOCKET_ERROR;
+	}
+
+
+	bool AllowRebind(Socket s) {
+		// SO_REUSEADDR means something else on Windows (taking over a port that's in use)
+		(void)s;
+		return true;
+	}
+
+
+	bool LastSocketErrorWouldBlock() {
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+	}
+}
+
+#else
+
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dirent.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+
+namespace platform {
+
+	uint64_t TickCountMs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	}
+
+
+	uint64_t TickCountUs() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+
+	void SleepMs(int ms) {
+		timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+	}
+
+
+	void* AllocPages(size_t size) {
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return nullptr;
+		RememberOwnPages(p, size);
+		return p;
+	}
+
+
+	void FreePages(void* p, size_t size) {
+		ForgetOwnPages(p);
+		munmap(p, size);
+	}
+
+
+	size_t GetWritableRegions(MemRegion* out, size_t max) {
+		FILE* f = fopen("/proc/self/maps", "r");
+		if (!f)
+			return 0;
+		char line[512];
+		size_t n = 0;
+		while (fgets(line, sizeof(line), f)) {
+			// start-end perms offset dev inode [path], only anonymous rw memory has an inode of 0
+			unsigned long start, end, inode;
+			char perms[5];
+			if (sscanf(line, "%lx-%lx %4s %*s %*s %lu", &start, &end, perms, &inode) != 4)
+				continue;
+			if (perms[0] != 'r' || perms[1] != 'w' || inode != 0)
+				continue;
+			if (n < max)
+				out[n] = {(char*)start, end - start, false};
+			n++;
+		}
+		fclose(f);
+		return n;
+	}
+
+
+	bool IsWritable(const void* p, size_t size) {
+		// msync fails with ENOMEM if any of the range isn't mapped (it doesn't check the protection,
+		// but outside of the game we only ever scan our own memory)
+		uintptr_t page = (uintptr_t)p & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+		return msync((void*)page, (uintptr_t)p + size - page, MS_ASYNC) == 0;
+	}
+
+
+	bool TryRead(const void* p, void* out, size_t size) {
+		if (!IsWritable(p, size))
+			return false;
+		memcpy(out, p, size);
+		return true;
+	}
+
+
+	static bool ProtectPages(void* p, size_t size, bool writable) {
+		return mprotect(p, size, writable ? PROT_READ | PROT_WRITE : PROT_READ) == 0;
+	}
+
+
+	static struct sigaction prev_segv_action;
+
+
+	static void WriteFaultHandler(int sig, siginfo_t* info, void* context) {
+		if (OnWriteFault(info->si_addr))
+			return;
+		// not one of ours, so let whoever was there before deal with it
+		if (prev_segv_action.sa_flags & SA_SIGINFO) {
+			prev_segv_action.sa_sigaction(sig, info, context);
+		} else if (prev_segv_action.sa_handler != SIG_DFL && prev_segv_action.sa_handler != SIG_IGN) {
+			prev_segv_action.sa_handler(sig);
+		} else {
+			// returning runs the instruction again, which crashes like it should have
+			sigaction(SIGSEGV, &prev_segv_action, nullptr);
+		}
+	}
+
+
+	static bool InstallWriteFaultHandler() {
+		struct sigaction action = {};
+		action.sa_sigaction = WriteFaultHandler;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		return sigaction(SIGSEGV, &action, &prev_segv_action) == 0;
+	}
+
+
+	static void RemoveWriteFaultHandler() {
+		sigaction(SIGSEGV, &prev_segv_action, nullptr);
+	}
+
+
+	bool ListDir(const char* path, void (*f)(void* ctx, const char* name, bool is_dir), void* ctx) {
+		DIR* dir = opendir(path);
+		if (!dir)
+			return false;
+		while (dirent* e = readdir(dir)) {
+			if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+				continue;
+			bool is_dir = e->d_type == DT_DIR;
+			if (e->d_type == DT_UNKNOWN) {
+				// some file systems don't fill in d_type
+				struct stat st;
+				is_dir = fstatat(dirfd(dir), e->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+			}
+			f(ctx, e->d_name, is_dir);
+		}
+		closedir(dir);
+		return true;
+	}
+
+
+	File OpenFileForReading(const char* path) {
+		int fd = open(path, O_RDONLY);
+		if (fd == -1)
+			return INVALID_FILE;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		return fd;
+	}
+
+
+	int64_t ReadFileChunk(File f, void* buf, size_t size) {
+		ssize_t n;
+		while ((n = read((int)f, buf, size)) == -1 && errno == EINTR) {}
+		return n;
+	}
+
+
+	void CloseFile(File f) {
+		close((int)f);
+	}
+
+
+	void SetBackgroundPriority() {
+		// the idle I/O class only gets the disk when nobody else wants it (with 0, these only
+		// change the calling thread)
+		const int IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3, IOPRIO_CLASS_SHIFT = 13;
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+		setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+	}
+
+
+	struct ThreadStart {
+		void (*f)(void* arg);
+		void* arg;
+	};
+
+
+	static void* RunThread(void* param) {
+		ThreadStart start = *(ThreadStart*)param;
+		delete (ThreadStart*)param;
+		start.f(start.arg);
+		return nullptr;
+	}
+
+
+	bool StartThread(void (*f)(void* arg), void* arg) {
+		ThreadStart* start = new ThreadStart{f, arg};
+		pthread_t thread;
+		if (pthread_create(&thread, nullptr, &RunThread, start) != 0) {
+			delete start;
+			return false;
+		}
+		pthread_detach(thread);
+		return true;
+	}
+
+
+	struct ModuleSearch {
+		const char* name;
+		bool found;
+		uintptr_t start, end;
+	};
+
+
+	static int CheckModule(dl_phdr_info* info, size_t, void* ctx) {
+		ModuleSearch& search = *(ModuleSearch*)ctx;
+		// the main executable comes first, with an empty name
+		if (search.name) {
+			const char* file_name = strrchr(info->dlpi_name, '/');
+			if (strcmp(file_name ? file_name + 1 : info->dlpi_name, search.name) != 0)
+				return 0;
+		}
+		search.start = UINTPTR_MAX;
+		search.end = 0;
+		for (int i = 0; i < info->dlpi_phnum; i++) {
+			const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+			if (ph.p_type != PT_LOAD)
+				continue;
+			uintptr_t seg = info->dlpi_addr + ph.p_vaddr;
+			if (seg < search.start)
+				search.start = seg;
+			if (seg + ph.p_memsz > search.end)
+				search.end = seg + ph.p_memsz;
+		}
+		search.found = search.start < search.end;
+		return 1;
+	}
+
+
+	bool FindModule(const char* name, void** base, size_t* size) {
+		ModuleSearch search = {name, false, 0, 0};
+		dl_iterate_phdr(&CheckModule, &search);
+		if (!search.found)
+			return false;
+		*base = (void*)search.start;
+		*size = search.end - search.start;
+		return true;
+	}
+
+
+	bool InitSockets() {
+		return true;
+	}
+
+
+	void CleanupSockets() {}
+
+
+	void CloseSocket(Socket s) {
+		close(s);
+	}
+
+
+	bool SetNonBlocking(Socket s) {
+		int flags = fcntl(s, F_GETFL, 0);
+		return flags != -1 && fcntl(s, F_SETFL, flags | O_NONBLOCK) != -1;
+	}
+
+
+	bool AllowRebind(Socket s) {
+		int enable = 1;
+		return setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == 0;
+	}
+
+
+	bool LastSocketErrorWouldBlock() {
+		return errno == EWOULDBLOCK || errno == EAGAIN;
+	}
+}
+
+#endif
+
+
+/*
+* Stuff that's the same on every OS.
+*/
+
+#include <atomic>
+#include <mutex>
+
+
+namespace platform {
+
+	// AllocPages remembers what it handed out (up to a point) so that IsOwnPages() works
+	static const size_t MAX_OWN_ALLOCS = 1024;
+	static MemRegion own_allocs[MAX_OWN_ALLOCS];
+	static size_t num_own_allocs = 0;
+	static std::mutex own_allocs_mutex;
+
+
+	static void RememberOwnPages(void* p, size_t size) {
+		std::lock_guard<std::mutex> lock(own_allocs_mutex);
+		if (num_own_allocs < MAX_OWN_ALLOCS)
+			own_allocs[num_own_allocs++] = {(char*)p, size, false};
+	}
+
+
+	static void ForgetOwnPages(void* p) {
+		std::lock_guard<std::mutex> lock(own_allocs_mutex);
+		for (size_t i = 0; i < num_own_allocs; i++) {
+			if (own_allocs[i].base == p) {
+				own_allocs[i] = own_allocs[--num_own_allocs];
+				return;
+			}
+		}
+	}
+
+
+	bool IsOwnPages(const void* p) {
+		std::lock_guard<std::mutex> lock(own_allocs_mutex);
+		for (size_t i = 0; i < num_own_allocs; i++)
+			if ((uintptr_t)p - (uintptr_t)own_allocs[i].base < own_allocs[i].size)
+				return true;
+		return false;
+	}
+
+
+	struct TrackedRegion {
+		char* base;
+		size_t num_pages;
+		std::atomic<uint64_t>* written;  // one bit per page
+	};
+
+	// in the same order as they were passed in (sorted by base), only changed while the fault
+	// handler isn't installed
+	static TrackedRegion* tracked = nullptr;
+	static size_t num_tracked = 0;
+	static size_t tracked_alloc_size = 0;
+
+
+	// called from the fault handler, returns false if addr isn't in a tracked region
+	static bool OnWriteFault(void* addr) {
+		size_t lo = 0, hi = num_tracked;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if ((char*)addr < tracked[mid].base)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		if (lo == 0)
+			return false;
+		TrackedRegion& r = tracked[lo - 1];
+		size_t page = ((char*)addr - r.base) / PAGE_BYTES;
+		if (page >= r.num_pages)
+			return false;
+		r.written[page / 64].fetch_or(1ull << (page % 64));
+		return ProtectPages(r.base + page * PAGE_BYTES, PAGE_BYTES, true);
+	}
+
+
+	bool StartWriteTracking(const MemRegion* regions, size_t num_regions) {
+		StopWriteTracking();
+
+		size_t total_words = 0;
+		for (size_t i = 0; i < num_regions; i++)
+			total_words += (regions[i].size / PAGE_BYTES + 63) / 64;
+		tracked_alloc_size = num_regions * sizeof(TrackedRegion) + total_words * sizeof(uint64_t);
+		tracked = (TrackedRegion*)AllocPages(tracked_alloc_size);
+		if (!tracked)
+			return false;
+
+		// AllocPages zeroes the memory, which is a valid atomic<uint64_t>
+		auto words = (std::atomic<uint64_t>*)(tracked + num_regions);
+		for (size_t i = 0; i < num_regions; i++) {
+			tracked[i] = {regions[i].base, regions[i].size / PAGE_BYTES, words};
+			words += (tracked[i].num_pages + 63) / 64;
+		}
+		num_tracked = num_regions;
+
+		if (!InstallWriteFaultHandler()) {
+			StopWriteTracking();
+			return false;
+		}
+		for (size_t i = 0; i < num_tracked; i++) {
+			if (!ProtectPages(tracked[i].base, tracked[i].num_pages * PAGE_BYTES, false)) {
+				StopWriteTracking();
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	void StopWriteTracking() {
+		if (!tracked)
+			return;
+		for (size_t i = 0; i < num_tracked; i++)
+			ProtectPages(tracked[i].base, tracked[i].num_pages * PAGE_BYTES, true);
+		RemoveWriteFaultHandler();
+		FreePages(tracked, tracked_alloc_size);
+		tracked = nullptr;
+		num_tracked = 0;
+	}
+
+
+	void TakeWrittenPages(size_t region, uint64_t* out) {
+		TrackedRegion& r = tracked[region];
+		size_t num_words = (r.num_pages + 63) / 64;
+		for (size_t w = 0; w < num_words; w++) {
+			/*
+			* Pages are cleared before they're protected again, so a write from another thread in
+			* between is missed. Only the thread that calls this is guaranteed to have all of its
+			* writes tracked.
+			*/
+			uint64_t bits = r.written[w].exchange(0);
+			out[w] = bits;
+			// protect each run of written pages with a single call
+			for (size_t p = 0; p < 64 && (bits >> p);) {
+				if (!((bits >> p) & 1)) {
+					p++;
+					continue;
+				}
+				size_t start = p;
+				while (p < 64 && ((bits >> p) & 1))
+					p++;
+				ProtectPages(r.base + (w * 64 + start) * PAGE_BYTES, (p - start) * PAGE_BYTES, false);
+			}
+		}
+	}
+}
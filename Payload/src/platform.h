@@ -0,0 +1,153 @@
+#pragma once
+
+/*
+* Thin wrappers around the OS services that the tick driver and IPC need, so that neither of
+* them calls Win32 directly and they can be built outside of the game for testing. Stuff that
+* only makes sense when we're injected into the game (DllMain, MinHook, the exit patch) is
+* still Windows-only.
+*/
+
+#ifdef _WIN32
+
+// This is required when using WinSock2.h & Windows.h,
+// so this must come before Windows.h.
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netdb.h>
+
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace platform {
+
+#ifdef _WIN32
+	typedef SOCKET Socket;
+	const Socket INVALID_SOCK = INVALID_SOCKET;
+#else
+	typedef int Socket;
+	const Socket INVALID_SOCK = -1;
+#endif
+
+	// returned by most socket functions on failure (same value for WinSock & BSD sockets)
+	const int SOCK_ERROR = -1;
+
+
+	// milliseconds since some arbitrary point in time
+	uint64_t TickCountMs();
+
+	// microseconds since some arbitrary point in time, for timing things
+	uint64_t TickCountUs();
+
+	void SleepMs(int ms);
+
+
+	// Allocates pages directly from the OS (not from the CRT heap that the game uses), the
+	// memory is zeroed. Returns nullptr on failure.
+	void* AllocPages(size_t size);
+
+	// size must be the same as what was passed to AllocPages
+	void FreePages(void* p, size_t size);
+
+	// is p inside of memory that we got from AllocPages (and haven't freed yet)?
+	bool IsOwnPages(const void* p);
+
+	// the page size that AllocPages & write tracking work with
+	const size_t PAGE_BYTES = 4096;
+
+
+	struct MemRegion {
+		char* base;
+		size_t size;
+		bool image;  // part of a loaded exe or dll (always false outside of Windows)
+	};
+
+	// Fills out with the committed & writable memory regions of this process (that aren't mapped
+	// files), returns the total number of regions, which can be more than max.
+	size_t GetWritableRegions(MemRegion* out, size_t max);
+
+	// is all of [p, p + size) still committed & writable?
+	bool IsWritable(const void* p, size_t size);
+
+	// Copies size bytes from p to out, returns false (instead of crashing) if any of them can't be
+	// read. On Windows this is as cheap as a memcpy when it works, elsewhere it checks the pages
+	// first with a syscall.
+	bool TryRead(const void* p, void* out, size_t size);
+
+
+	/*
+	* Page-granular write tracking (for savestates). The regions are write protected, and the
+	* first write to each page is caught by a fault handler that marks the page as written and
+	* makes it writable again. The kernel doesn't go through the handler, so syscalls that write
+	* into tracked memory (e.g. reading a file into a heap buffer) fail instead. Only one set of
+	* page aligned regions (sorted by base) can be tracked at a time. Returns false if the regions
+	* couldn't be protected.
+	*/
+	bool StartWriteTracking(const MemRegion* regions, size_t num_regions);
+
+	// unprotects everything that's still protected
+	void StopWriteTracking();
+
+	// Fills out with a bitmap of the pages of the given region (an index into the regions passed
+	// to StartWriteTracking) that were written to since the last call, and protects them again.
+	void TakeWrittenPages(size_t region, uint64_t* out);
+
+
+	// Calls f for each entry of a directory (but not "." & ".."), with is_dir set for the ones
+	// that are directories. Returns false if the directory couldn't be opened.
+	bool ListDir(const char* path, void (*f)(void* ctx, const char* name, bool is_dir), void* ctx);
+
+	// a file that's read from start to end, the OS is told so that it can read ahead
+	typedef intptr_t File;
+	const File INVALID_FILE = -1;
+
+	File OpenFileForReading(const char* path);
+
+	// reads up to size bytes, returns how many were read (0 at the end of the file) or -1 on error
+	int64_t ReadFileChunk(File f, void* buf, size_t size);
+
+	void CloseFile(File f);
+
+	// Lowers the I/O & CPU priority of the calling thread, for background work that the game
+	// shouldn't have to wait on. Can't be undone.
+	void SetBackgroundPriority();
+
+	// Starts a detached thread that runs f(arg), returns false if it couldn't be started.
+	bool StartThread(void (*f)(void* arg), void* arg);
+
+
+	// Finds a loaded module by its file name (e.g. "supertuxkart.exe"), or the main executable if
+	// name is nullptr, and gets the range of memory that it's mapped at. Returns false if it isn't
+	// loaded.
+	bool FindModule(const char* name, void** base, size_t* size);
+
+
+	// must be called before any other socket functions, returns false on failure
+	bool InitSockets();
+
+	// call once for every call to InitSockets(), even if it failed
+	void CleanupSockets();
+
+	void CloseSocket(Socket s);
+
+	bool SetNonBlocking(Socket s);
+
+	// Lets s bind to a port that still has connections from an earlier run waiting to time out,
+	// which WinSock does by default. Must be called before bind().
+	bool AllowRebind(Socket s);
+
+	// true if the last socket call only failed because the socket is non-blocking
+	bool LastSocketErrorWouldBlock();
+}
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "pointer_scanner.h"
+
+typedef PointerScanner::Chain Chain;
+
+
+// big regions are split up so that every thread gets about the same amount of work
+static const size_t CHUNK_SIZE = 1 << 20;
+
+// addresses from the last level are handed out to threads this many at a time
+static const size_t NODES_PER_TASK = 256;
+
+static const uint32_t NO_PARENT = UINT32_MAX;
+
+
+/*
+* An address in the search. The target is the only node on the first level, every node after
+* that is the address of a pointer to offset bytes before its parent's address.
+*/
+struct Node {
+	uintptr_t address;
+	uint32_t parent;
+	uint32_t offset;
+};
+
+
+// runs func(thread_index) on num_threads threads (including this one) and waits for all of them
+template<typename Func>
+static void RunOnThreads(int num_threads, Func func) {
+	std::vector<std::thread> threads;
+	for (int i = 1; i < num_threads; i++)
+		threads.emplace_back(func, i);
+	func(0);
+	for (auto& t : threads)
+		t.join();
+}
+
+
+// regions must be sorted by base
+static bool PointsIntoRegions(const std::vector<platform::MemRegion>& regions, uintptr_t p) {
+	auto it = std::upper_bound(regions.begin(), regions.end(), p,
+		[](uintptr_t p, const platform::MemRegion& r) {return p < (uintptr_t)r.base;});
+	if (it == regions.begin())
+		return false;
+	--it;
+	return p - (uintptr_t)it->base < it->size;
+}
+
+
+static Chain MakeChain(const std::vector<Node>& nodes, uintptr_t module_offset, uint32_t offset, uint32_t node) {
+	Chain chain;
+	chain.module_offset = (uint32_t)module_offset;
+	chain.num_offsets = 0;
+	chain.offsets[chain.num_offsets++] = offset;
+	for (; nodes[node].parent != NO_PARENT; node = nodes[node].parent)
+		chain.offsets[chain.num_offsets++] = nodes[node].offset;
+	return chain;
+}
+
+
+// fewer pointers first, then smaller offsets, the rest is just to get the same order every time
+static bool BetterChain(const Chain& a, const Chain& b) {
+	if (a.num_offsets != b.num_offsets)
+		return a.num_offsets < b.num_offsets;
+	uint64_t sum_a = 0, sum_b = 0;
+	for (uint32_t i = 0; i < a.num_offsets; i++) {
+		sum_a += a.offsets[i];
+		sum_b += b.offsets[i];
+	}
+	if (sum_a != sum_b)
+		return sum_a < sum_b;
+	if (a.module_offset != b.module_offset)
+		return a.module_offset < b.module_offset;
+	return std::lexicographical_compare(a.offsets, a.offsets + a.num_offsets, b.offsets, b.offsets + b.num_offsets);
+}
+
+
+bool PointerScanner::buildMap(const char* base, size_t size) {
+	// regions can get mapped between the two calls, so leave some room
+	std::vector<platform::MemRegion> regions(platform::GetWritableRegions(nullptr, 0) + 64);
+	size_t count = platform::GetWritableRegions(regions.data(), regions.size());
+	return buildMap(regions.data(), std::min(count, regions.size()), base, size);
+}
+
+
+bool PointerScanner::buildMap(const platform::MemRegion* mem_regions, size_t count, const char* base, size_t size) {
+	reset();
+	if (count == 0)
+		return false;
+	module_base = base;
+	module_size = size;
+
+	std::vector<platform::MemRegion> regions(mem_regions, mem_regions + count);
+	std::sort(regions.begin(), regions.end(),
+		[](const platform::MemRegion& a, const platform::MemRegion& b) {return a.base < b.base;});
+
+	std::vector<platform::MemRegion> chunks;
+	uintptr_t lowest = (uintptr_t)regions.front().base, highest = 0;
+	for (auto& r : regions) {
+		for (size_t off = 0; off < r.size; off += CHUNK_SIZE)
+			chunks.push_back({r.base + off, std::min(CHUNK_SIZE, r.size - off), r.image});
+		highest = std::max(highest, (uintptr_t)r.base + r.size);
+	}
+
+	int n = threadCount();
+	std::vector<std::vector<Pointer>> shards(n);
+	std::atomic<size_t> next_chunk(0);
+
+	RunOnThreads(n, [&](int thread) {
+		std::vector<Pointer>& shard = shards[thread];
+		for (size_t c; (c = next_chunk++) < chunks.size();) {
+			const platform::MemRegion& chunk = chunks[c];
+			// the game's other threads are still running and might have freed it
+			if (!platform::IsWritable(chunk.base, chunk.size))
+				continue;
+			const uintptr_t* values = (const uintptr_t*)chunk.base;
+			size_t num_values = chunk.size / sizeof(uintptr_t);
+			for (size_t i = 0; i < num_values; i++) {
+				uintptr_t v = values[i];
+				// most values are small numbers or floats, check the whole range before the regions
+				if (v - lowest >= highest - lowest || v % 4 != 0 || !PointsIntoRegions(regions, v))
+					continue;
+				shard.push_back({v, (uintptr_t)(values + i)});
+			}
+		}
+		std::sort(shard.begin(), shard.end(), [](const Pointer& a, const Pointer& b) {return a.value < b.value;});
+	});
+
+	size_t total = 0;
+	for (auto& shard : shards)
+		total += shard.size();
+	if (!pointers.reserve(total) || !shard_ends.reserve(shards.size())) {
+		reset();
+		return false;
+	}
+	for (auto& shard : shards) {
+		for (auto& p : shard)
+			pointers.push_back(p);
+		shard_ends.push_back(pointers.size());
+	}
+	return true;
+}
+
+
+size_t PointerScanner::findChains(uintptr_t target, const Settings& settings, std::vector<Chain>& out) const {
+	out.clear();
+	int max_depth = std::min(settings.max_depth, (int)MAX_DEPTH);
+	if (shard_ends.empty() || max_depth <= 0)
+		return 0;
+
+	std::vector<Node> nodes(1, Node{target, NO_PARENT, 0});
+	// addresses from all levels so far, sorted
+	std::vector<uintptr_t> visited(1, target);
+	size_t level_begin = 0, level_end = 1;
+
+	int n = threadCount();
+	std::vector<std::vector<Node>> children(n);
+	std::vector<std::vector<Chain>> found(n);
+	std::vector<Node> level;
+
+	// every chain from a level is better than the ones from the next, so stop once we have enough
+	for (int depth = 1; depth <= max_depth && level_begin < level_end && out.size() < settings.max_chains; depth++) {
+		std::atomic<size_t> next_node(level_begin);
+
+		RunOnThreads(n, [&](int thread) {
+			children[thread].clear();
+			found[thread].clear();
+			for (size_t begin; (begin = next_node.fetch_add(NODES_PER_TASK)) < level_end;) {
+				size_t end = std::min(begin + NODES_PER_TASK, level_end);
+				for (size_t i = begin; i < end; i++) {
+					uintptr_t addr = nodes[i].address;
+					uintptr_t lowest = addr < settings.max_offset ? 0 : addr - settings.max_offset;
+					for (size_t s = 0; s < shard_ends.size(); s++) {
+						const Pointer* shard_end = pointers.data() + shard_ends[s];
+						const Pointer* it = std::lower_bound(pointers.data() + (s ? shard_ends[s - 1] : 0), shard_end, lowest,
+							[](const Pointer& p, uintptr_t v) {return p.value < v;});
+						for (; it != shard_end && it->value <= addr; ++it) {
+							uint32_t offset = (uint32_t)(addr - it->value);
+							if (inModule(it->address))
+								found[thread].push_back(MakeChain(nodes, it->address - (uintptr_t)module_base, offset, (uint32_t)i));
+							else if (depth < max_depth)
+								children[thread].push_back({it->address, (uint32_t)i, offset});
+						}
+					}
+				}
+			}
+		});
+
+		for (auto& f : found)
+			out.insert(out.end(), f.begin(), f.end());
+
+		// each address only goes on the next level once (with its smallest offset), and only if
+		// it wasn't on an earlier level
+		level.clear();
+		for (auto& c : children)
+			level.insert(level.end(), c.begin(), c.end());
+		std::sort(level.begin(), level.end(), [](const Node& a, const Node& b) {
+			if (a.address != b.address)
+				return a.address < b.address;
+			return a.offset != b.offset ? a.offset < b.offset : a.parent < b.parent;
+		});
+		level.erase(std::unique(level.begin(), level.end(),
+			[](const Node& a, const Node& b) {return a.address == b.address;}), level.end());
+		level.erase(std::remove_if(level.begin(), level.end(),
+			[&](const Node& a) {return std::binary_search(visited.begin(), visited.end(), a.address);}), level.end());
+
+		if (level.size() > settings.max_level_nodes) {
+			std::sort(level.begin(), level.end(), [](const Node& a, const Node& b) {
+				return a.offset != b.offset ? a.offset < b.offset : a.address < b.address;
+			});
+			level.resize(settings.max_level_nodes);
+		}
+
+		level_begin = nodes.size();
+		nodes.insert(nodes.end(), level.begin(), level.end());
+		level_end = nodes.size();
+
+		size_t num_visited = visited.size();
+		for (auto& node : level)
+			visited.push_back(node.address);
+		std::sort(visited.begin() + num_visited, visited.end());
+		std::inplace_merge(visited.begin(), visited.begin() + num_visited, visited.end());
+	}
+
+	std::sort(out.begin(), out.end(), BetterChain);
+	if (out.size() > settings.max_chains)
+		out.resize(settings.max_chains);
+	return out.size();
+}
+
+
+void PointerScanner::reset() {
+	pointers.release();
+	shard_ends.release();
+	module_base = nullptr;
+	module_size = 0;
+}
+
+
+size_t PointerScanner::numPointers() const {
+	return pointers.size();
+}
+
+
+bool PointerScanner::resolve(const char* module_base, const Chain& chain, uintptr_t& out) {
+	if (chain.num_offsets > MAX_DEPTH)
+		return false;
+	uintptr_t addr = (uintptr_t)module_base + chain.module_offset;
+	for (uint32_t i = 0; i < chain.num_offsets; i++) {
+		if (!platform::IsWritable((const void*)addr, sizeof(uintptr_t)))
+			return false;
+		addr = *(const uintptr_t*)addr + chain.offsets[i];
+	}
+	out = addr;
+	return true;
+}
+
+
+int PointerScanner::threadCount() const {
+	if (num_threads > 0)
+		return num_threads;
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "page_vector.h"
+#include "platform.h"
+
+/*
+* Finds pointer chains from the game's globals to an address, e.g. to find a path from m_world to
+* a kart's rigid body after finding the body with the memory scanner. Objects like the World and
+* the karts are reallocated every race, so a chain from something at a fixed offset in
+* supertuxkart.exe is the only way to find them again.
+*
+* First a reverse pointer map is built: every aligned value in writable memory that points into
+* writable memory, sorted by what it points to. Then the search goes backwards from the target,
+* one level at a time: for each address from the last level it looks up all the pointers to at
+* most max_offset bytes before that address (i.e. to the start of an object that has the address
+* as a field). Those pointers are the next level, and any of them that live inside the module
+* end a chain. Both steps are split across threads, and the game must not run while they do.
+*/
+class PointerScanner {
+public:
+	static const int MAX_DEPTH = 7;
+
+	struct Settings {
+		int max_depth = 5;                  // max number of pointers to follow
+		uint32_t max_offset = 0x1000;       // max offset from where a pointer points to the next address
+		size_t max_chains = 1000;
+		// if a level has more addresses than this, only the ones with the smallest offsets are kept
+		size_t max_level_nodes = 1 << 21;
+	};
+
+	/*
+	* To follow a chain, start at module_base + module_offset, then for each offset read the
+	* pointer at the current address and add the offset to it. The last address is the target.
+	*/
+	struct Chain {
+		uint32_t module_offset;
+		uint32_t num_offsets;
+		uint32_t offsets[MAX_DEPTH];
+	};
+
+	PointerScanner() = default;
+	PointerScanner(const PointerScanner&) = delete;
+	PointerScanner& operator=(const PointerScanner&) = delete;
+
+	// Builds the pointer map of all writable memory, [module_base, module_base + module_size) is
+	// where chains can start. Returns false if there's no memory to scan.
+	bool buildMap(const char* module_base, size_t module_size);
+
+	// same as above, but only maps the given regions (used for testing)
+	bool buildMap(const platform::MemRegion* regions, size_t num_regions, const char* module_base, size_t module_size);
+
+	// Finds up to settings.max_chains chains to target and puts them in out, best first (fewer
+	// pointers, then smaller offsets). Returns the number of chains found.
+	size_t findChains(uintptr_t target, const Settings& settings, std::vector<Chain>& out) const;
+
+	// frees the pointer map
+	void reset();
+
+	// the number of pointers in the map
+	size_t numPointers() const;
+
+	// 0 (the default) uses one thread per core
+	void setNumThreads(int n) {num_threads = n;}
+
+	// Follows the chain, returns false if it goes through memory that doesn't exist (anymore).
+	static bool resolve(const char* module_base, const Chain& chain, uintptr_t& out);
+
+private:
+	struct Pointer {
+		uintptr_t value;    // what it points to
+		uintptr_t address;  // where the pointer is
+	};
+
+	// One shard per thread, each sorted by value, back to back. They're in our own pages since the
+	// map is kept between IPC messages, and a savestate restore in between would free it.
+	PageVector<Pointer> pointers;
+	PageVector<size_t> shard_ends;
+	const char* module_base = nullptr;
+	size_t module_size = 0;
+	int num_threads = 0;
+
+	int threadCount() const;
+
+	bool inModule(uintptr_t p) const {return p - (uintptr_t)module_base < module_size;}
+};
@@ -0,0 +1,223 @@
+#include <math.h>
+#include <string.h>
+#include "predicate_vm.h"
+#include "platform.h"
+
+
+static const size_t FIELD_TYPE_SIZES[(size_t)PredicateVM::FieldType::NUM_TYPES] = {4, 8, 4, 4, 2, 2, 1, 1};
+
+
+static bool ReadU32(const char*& buf, const char* buf_end, uint32_t& out) {
+	if (buf_end - buf < 4)
+		return false;
+	memcpy(&out, buf, 4);
+	buf += 4;
+	return true;
+}
+
+
+const char* PredicateVM::measure(const char* buf, const char* buf_end, size_t& arena_bytes) {
+	uint32_t num_fields, num_constants, num_programs;
+	if (!ReadU32(buf, buf_end, num_fields) || num_fields > MAX_FIELDS)
+		return nullptr;
+	for (uint32_t i = 0; i < num_fields; i++) {
+		// type, number of offsets, 2 reserved bytes, module offset, offsets
+		if (buf_end - buf < 8 || (uint8_t)buf[1] > PointerScanner::MAX_DEPTH)
+			return nullptr;
+		size_t size = 8 + (uint8_t)buf[1] * 4;
+		if ((size_t)(buf_end - buf) < size)
+			return nullptr;
+		buf += size;
+	}
+	if (!ReadU32(buf, buf_end, num_constants) || num_constants > 0x10000 || (size_t)(buf_end - buf) / 4 < num_constants)
+		return nullptr;
+	buf += num_constants * 4;
+	if (!ReadU32(buf, buf_end, num_programs) || num_programs > MAX_PROGRAMS)
+		return nullptr;
+	size_t total_instrs = 0;
+	for (uint32_t i = 0; i < num_programs; i++) {
+		uint32_t num_instrs;
+		if (!ReadU32(buf, buf_end, num_instrs) || num_instrs == 0 || num_instrs > MAX_INSTRS)
+			return nullptr;
+		if ((size_t)(buf_end - buf) / sizeof(Instr) < num_instrs)
+			return nullptr;
+		buf += num_instrs * sizeof(Instr);
+		total_instrs += num_instrs;
+	}
+	arena_bytes = num_fields * sizeof(Field) + num_constants * sizeof(float) + total_instrs * sizeof(Instr)
+		+ num_programs * sizeof(Program) + 4 * sizeof(void*);
+	return buf;
+}
+
+
+void PredicateVM::load(const char* buf, Arena& arena, ProgramSet& out) {
+	// measure() has already checked all of this
+	out = ProgramSet();
+	memcpy(&out.num_fields, buf, 4);
+	buf += 4;
+	Field* fields = arena.alloc<Field>(out.num_fields);
+	for (uint32_t i = 0; i < out.num_fields; i++) {
+		fields[i].type = (FieldType)buf[0];
+		fields[i].chain.num_offsets = (uint8_t)buf[1];
+		memcpy(&fields[i].chain.module_offset, buf + 4, 4);
+		memcpy(fields[i].chain.offsets, buf + 8, fields[i].chain.num_offsets * 4);
+		buf += 8 + fields[i].chain.num_offsets * 4;
+	}
+	out.fields = fields;
+
+	memcpy(&out.num_constants, buf, 4);
+	buf += 4;
+	float* constants = arena.alloc<float>(out.num_constants);
+	memcpy(constants, buf, out.num_constants * sizeof(float));
+	buf += out.num_constants * sizeof(float);
+	out.constants = constants;
+
+	memcpy(&out.num_programs, buf, 4);
+	buf += 4;
+	Program* programs = arena.alloc<Program>(out.num_programs);
+	// the instructions of every program go into one array, count them first
+	const char* p = buf;
+	uint32_t total_instrs = 0;
+	for (uint32_t i = 0; i < out.num_programs; i++) {
+		uint32_t num_instrs;
+		memcpy(&num_instrs, p, 4);
+		programs[i] = {total_instrs, num_instrs};
+		total_instrs += num_instrs;
+		p += 4 + num_instrs * sizeof(Instr);
+	}
+	Instr* instrs = arena.alloc<Instr>(total_instrs);
+	for (uint32_t i = 0; i < out.num_programs; i++) {
+		memcpy(instrs + programs[i].first_instr, buf + 4, programs[i].num_instrs * sizeof(Instr));
+		buf += 4 + programs[i].num_instrs * sizeof(Instr);
+	}
+	out.programs = programs;
+	out.instrs = instrs;
+}
+
+
+bool PredicateVM::validate(const ProgramSet& set) {
+	for (uint32_t i = 0; i < set.num_fields; i++)
+		if (set.fields[i].type >= FieldType::NUM_TYPES)
+			return false;
+	for (uint32_t i = 0; i < set.num_programs; i++) {
+		const Program& prog = set.programs[i];
+		uint32_t written = 0;  // bit n is r[n]
+		for (uint32_t j = 0; j < prog.num_instrs; j++) {
+			const Instr& in = set.instrs[prog.first_instr + j];
+			bool last = j == prog.num_instrs - 1;
+			if (in.op >= Op::NUM_OPS || in.a >= NUM_REGS || (in.op == Op::Ret) != last)
+				return false;
+			// what each instruction reads
+			switch (in.op) {
+				case Op::LoadConst:
+					if ((uint32_t)(in.b | in.c << 8) >= set.num_constants)
+						return false;
+					break;
+				case Op::LoadField:
+					if (in.b >= set.num_fields)
+						return false;
+					break;
+				case Op::LoadTick:
+					if (in.b > 1)
+						return false;
+					break;
+				case Op::Mov:
+				case Op::Abs:
+				case Op::Neg:
+				case Op::Not:
+					if (in.b >= NUM_REGS || !(written & (1u << in.b)))
+						return false;
+					break;
+				case Op::Ret:
+					if (!(written & (1u << in.a)))
+						return false;
+					break;
+				default:
+					if (in.b >= NUM_REGS || in.c >= NUM_REGS || !(written & (1u << in.b)) || !(written & (1u << in.c)))
+						return false;
+					break;
+			}
+			written |= 1u << in.a;
+		}
+	}
+	return true;
+}
+
+
+static inline bool Truth(float v) {
+	return v == v && v != 0;
+}
+
+
+bool PredicateVM::eval(const ProgramSet& set, uint32_t program, const Context& ctx) const {
+	float r[NUM_REGS];
+	for (const Instr* in = set.instrs + set.programs[program].first_instr;; in++) {
+		switch (in->op) {
+			case Op::LoadConst: r[in->a] = set.constants[in->b | in->c << 8]; break;
+			case Op::LoadField: r[in->a] = readField(set.fields[in->b]); break;
+			case Op::LoadTick:  r[in->a] = (float)(in->b == 0 ? ctx.tick : ctx.fb_tick); break;
+			case Op::Mov:       r[in->a] = r[in->b]; break;
+			case Op::Add:       r[in->a] = r[in->b] + r[in->c]; break;
+			case Op::Sub:       r[in->a] = r[in->b] - r[in->c]; break;
+			case Op::Mul:       r[in->a] = r[in->b] * r[in->c]; break;
+			case Op::Div:       r[in->a] = r[in->b] / r[in->c]; break;
+			case Op::Min:       r[in->a] = fminf(r[in->b], r[in->c]); break;
+			case Op::Max:       r[in->a] = fmaxf(r[in->b], r[in->c]); break;
+			case Op::Abs:       r[in->a] = fabsf(r[in->b]); break;
+			case Op::Neg:       r[in->a] = -r[in->b]; break;
+			case Op::Not:       r[in->a] = Truth(r[in->b]) ? 0.f : 1.f; break;
+			case Op::Lt:        r[in->a] = r[in->b] < r[in->c] ? 1.f : 0.f; break;
+			case Op::Le:        r[in->a] = r[in->b] <= r[in->c] ? 1.f : 0.f; break;
+			case Op::Eq:        r[in->a] = r[in->b] == r[in->c] ? 1.f : 0.f; break;
+			case Op::Ne:        r[in->a] = r[in->b] != r[in->c] ? 1.f : 0.f; break;
+			case Op::And:       r[in->a] = Truth(r[in->b]) && Truth(r[in->c]) ? 1.f : 0.f; break;
+			case Op::Or:        r[in->a] = Truth(r[in->b]) || Truth(r[in->c]) ? 1.f : 0.f; break;
+			default:            return Truth(r[in->a]);  // Ret, validate() makes sure it's last
+		}
+	}
+}
+
+
+template <typename T>
+static inline float Load(const void* p) {
+	T v;
+	memcpy(&v, p, sizeof(T));
+	return (float)v;
+}
+
+
+static inline float Convert(PredicateVM::FieldType type, const void* p) {
+	typedef PredicateVM::FieldType FieldType;
+	switch (type) {
+		case FieldType::F32: return Load<float>(p);
+		case FieldType::F64: return Load<double>(p);
+		case FieldType::I32: return Load<int32_t>(p);
+		case FieldType::U32: return Load<uint32_t>(p);
+		case FieldType::I16: return Load<int16_t>(p);
+		case FieldType::U16: return Load<uint16_t>(p);
+		case FieldType::I8:  return Load<int8_t>(p);
+		default:             return Load<uint8_t>(p);
+	}
+}
+
+
+float PredicateVM::readField(const Field& field) const {
+	const PointerScanner::Chain& chain = field.chain;
+	// the offset comes from the script, but the exe is always there so a bounds check is enough
+	size_t first_read = chain.num_offsets == 0 ? FIELD_TYPE_SIZES[(size_t)field.type] : sizeof(uintptr_t);
+	if (chain.module_offset > module_size || module_size - chain.module_offset < first_read)
+		return NAN;
+	const char* addr = module_base + chain.module_offset;
+	if (chain.num_offsets == 0)
+		return Convert(field.type, addr);
+	uintptr_t p;
+	memcpy(&p, addr, sizeof(p));
+	for (uint32_t i = 1; i < chain.num_offsets; i++) {
+		if (!platform::TryRead((const char*)(p + chain.offsets[i - 1]), &p, sizeof(p)))
+			return NAN;
+	}
+	char v[8];
+	if (!platform::TryRead((const char*)(p + chain.offsets[chain.num_offsets - 1]), v, FIELD_TYPE_SIZES[(size_t)field.type]))
+		return NAN;
+	return Convert(field.type, v);
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "pointer_scanner.h"
+#include "arena.h"
+
+/*
+* A small register VM for the conditions of reactive scripts, e.g. "skid until speed > 20" or
+* "fire while an item is held". A program is a straight line of instructions (there are no jumps,
+* so every program ends, and what it costs is known when it's uploaded) that load game state
+* fields & constants into float registers, do math & comparisons on them, and return one of them.
+* Anything but 0 (and NaN) is true.
+*
+* Fields are pointer chains from the game's exe, like the ones the state hasher uses. The first
+* read is checked against the exe's size, and the rest are done with platform::TryRead, so a chain
+* that goes through freed memory (e.g. while the world is being loaded) or starts outside of the
+* exe reads as NaN instead of crashing, and NaN makes any comparison false.
+*
+* The client (parser.py) compiles expressions into programs. All of a script's fields, constants
+* and programs are sent along with it, and are checked once when the message is parsed: every
+* register is written before it's read, every field & constant exists, and every program ends
+* with its only Ret. After that eval() doesn't check anything.
+*/
+class PredicateVM {
+public:
+	static const int NUM_REGS = 16;
+	static const uint32_t MAX_INSTRS = 256;   // per program
+	// The most instructions that the conditions of a tick can add up to (the longest until program
+	// plus the MAX_RULES longest rule programs), scripts that could go over are rejected. This
+	// keeps the conditions well under 1 us per tick.
+	static const uint32_t MAX_TICK_INSTRS = 256;
+	static const uint32_t MAX_FIELDS = 64;
+	static const uint32_t MAX_PROGRAMS = 255; // programs are referred to by a byte, 255 means none
+	static const uint8_t NO_PROGRAM = 255;
+
+	enum class Op : uint8_t {
+		LoadConst, // r[a] = constants[b | c << 8]
+		LoadField, // r[a] = fields[b]
+		LoadTick,  // r[a] = Context::tick if b is 0, Context::fb_tick if it's 1
+		Mov,       // r[a] = r[b]
+		Add,       // r[a] = r[b] + r[c], and so on
+		Sub,
+		Mul,
+		Div,
+		Min,
+		Max,
+		Abs,       // r[a] = |r[b]|
+		Neg,
+		Not,       // r[a] = r[b] is false ? 1 : 0
+		Lt,        // r[a] = r[b] < r[c] ? 1 : 0, and so on
+		Le,
+		Eq,
+		Ne,
+		And,       // r[a] = r[b] & r[c] are true ? 1 : 0
+		Or,
+		Ret,       // returns r[a]
+		NUM_OPS,
+	};
+
+	struct Instr {
+		Op op;
+		uint8_t a, b, c;
+	};
+
+	enum class FieldType : uint8_t {
+		F32,
+		F64,
+		I32,
+		U32,
+		I16,
+		U16,
+		I8,
+		U8,
+		NUM_TYPES,
+	};
+
+	struct Field {
+		PointerScanner::Chain chain;
+		FieldType type;
+	};
+
+	struct Program {
+		uint32_t first_instr;
+		uint32_t num_instrs;
+	};
+
+	// everything that a script's programs use, points into the script's arena
+	struct ProgramSet {
+		const Field* fields = nullptr;
+		uint32_t num_fields = 0;
+		const float* constants = nullptr;
+		uint32_t num_constants = 0;
+		const Instr* instrs = nullptr;
+		const Program* programs = nullptr;
+		uint32_t num_programs = 0;
+	};
+
+	// what a program can see besides fields
+	struct Context {
+		uint32_t tick;     // ticks since the map was loaded
+		uint32_t fb_tick;  // ticks since the current framebulk started
+	};
+
+	/*
+	* Reading a script message: measure() checks that the programs section at buf is complete,
+	* and says how many bytes it needs in the arena & where it ends. load() copies it into the
+	* arena, and validate() checks the programs. See parser.py for the layout.
+	*/
+	static const char* measure(const char* buf, const char* buf_end, size_t& arena_bytes);
+	static void load(const char* buf, Arena& arena, ProgramSet& out);
+	static bool validate(const ProgramSet& set);
+
+	// fields are read relative to this (supertuxkart.exe in the game)
+	void setModule(const char* base, size_t size) {
+		module_base = base;
+		module_size = size;
+	}
+
+	// runs a program, which must be from a validated set
+	bool eval(const ProgramSet& set, uint32_t program, const Context& ctx) const;
+
+	// reads a field, NaN if it can't be read
+	float readField(const Field& field) const;
+
+private:
+	const char* module_base = nullptr;
+	size_t module_size = 0;
+};
@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <string.h>
+#include "savestates.h"
+
+using platform::PAGE_BYTES;
+
+
+static uint64_t HashPage(const char* page) {
+	// four independent lanes so that the multiplies overlap, every step is invertible so a
+	// change to any single word always changes the hash
+	const uint64_t K = 0x9e3779b97f4a7c15ull;
+	const uint64_t* w = (const uint64_t*)page;
+	uint64_t h0 = 1, h1 = 2, h2 = 3, h3 = 4;
+	for (size_t i = 0; i < PAGE_BYTES / sizeof(uint64_t); i += 4) {
+		h0 = (h0 ^ w[i]) * K;
+		h1 = (h1 ^ w[i + 1]) * K;
+		h2 = (h2 ^ w[i + 2]) * K;
+		h3 = (h3 ^ w[i + 3]) * K;
+	}
+	return h0 ^ (h1 << 1 | h1 >> 63) ^ (h2 << 2 | h2 >> 62) ^ (h3 << 3 | h3 >> 61);
+}
+
+
+static size_t RoundToPages(size_t size) {
+	return (size + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+}
+
+
+bool SaveStates::init(const platform::MemRegion* mem_regions, size_t count, size_t ring, bool track, uint32_t tick,
+	const ScriptManager::Position& pos
+) {
+	clear();
+	if (count == 0 || ring == 0)
+		return false;
+	// the base counts as one of the snapshots, and there has to be room for one more
+	ring_size = ring < 2 ? 2 : ring < MAX_SNAPSHOTS ? ring : MAX_SNAPSHOTS;
+
+	for (size_t i = 0; i < count; i++) {
+		total_pages += mem_regions[i].size / PAGE_BYTES;
+		bitmap_words += (mem_regions[i].size / PAGE_BYTES + 63) / 64;
+	}
+	meta_size = count * sizeof(Region) + total_pages * (sizeof(uint64_t) + sizeof(uint32_t)) + bitmap_words * sizeof(uint64_t);
+	meta = platform::AllocPages(meta_size);
+	if (!meta) {
+		clear();
+		return false;
+	}
+	regions = (Region*)meta;
+	hashes = (uint64_t*)(regions + count);
+	page_bits = hashes + total_pages;
+	page_list = (uint32_t*)(page_bits + bitmap_words);
+
+	// sorted by base, so that pages are in address order and write tracking can find them
+	for (size_t i = 0; i < count; i++)
+		regions[i] = {mem_regions[i].base, mem_regions[i].size / PAGE_BYTES, 0, 0};
+	std::sort(regions, regions + count, [](const Region& a, const Region& b) {return a.base < b.base;});
+	size_t first_page = 0, word_off = 0;
+	for (size_t i = 0; i < count; i++) {
+		regions[i].first_page = first_page;
+		regions[i].word_off = word_off;
+		first_page += regions[i].num_pages;
+		word_off += (regions[i].num_pages + 63) / 64;
+		st.region_bytes += regions[i].num_pages * PAGE_BYTES;
+	}
+	num_regions = count;
+
+	// the base is a full copy
+	Snapshot& base = snapshots[0];
+	base.alloc_size = total_pages * PAGE_BYTES;
+	base.data = (char*)platform::AllocPages(base.alloc_size);
+	if (!base.data) {
+		clear();
+		return false;
+	}
+	uint64_t start_us = platform::TickCountUs();
+	for (size_t i = 0; i < num_regions; i++) {
+		const Region& r = regions[i];
+		memcpy(base.data + r.first_page * PAGE_BYTES, r.base, r.num_pages * PAGE_BYTES);
+		for (size_t p = 0; p < r.num_pages; p++)
+			hashes[r.first_page + p] = HashPage(r.base + p * PAGE_BYTES);
+	}
+	base.tick = tick;
+	base.pos = pos;
+	base.pages = nullptr;
+	base.num_pages = total_pages;
+	num_snapshots = 1;
+
+	track_writes = track;
+	if (track_writes) {
+		auto list = (platform::MemRegion*)platform::AllocPages(num_regions * sizeof(platform::MemRegion));
+		bool ok = list != nullptr;
+		if (ok) {
+			for (size_t i = 0; i < num_regions; i++)
+				list[i] = {regions[i].base, regions[i].num_pages * PAGE_BYTES, false};
+			ok = platform::StartWriteTracking(list, num_regions);
+			platform::FreePages(list, num_regions * sizeof(platform::MemRegion));
+		}
+		if (!ok) {
+			clear();
+			return false;
+		}
+	}
+
+	st.snapshots = 1;
+	st.regions = num_regions;
+	st.total_bytes = meta_size + base.alloc_size;
+	st.last_capture_bytes = base.alloc_size;
+	st.last_capture_us = platform::TickCountUs() - start_us;
+	return true;
+}
+
+
+bool SaveStates::initFromProcess(size_t ring, bool track, uint32_t tick, const ScriptManager::Position& pos) {
+	clear();
+
+	// regions can get mapped between the two calls, so leave some room
+	size_t max_regions = platform::GetWritableRegions(nullptr, 0) + 64;
+	size_t list_bytes = max_regions * sizeof(platform::MemRegion);
+	auto list = (platform::MemRegion*)platform::AllocPages(list_bytes);
+	if (!list)
+		return false;
+	size_t count = platform::GetWritableRegions(list, max_regions);
+	if (count > max_regions)
+		count = max_regions;
+
+	char stack_var;
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++) {
+		const platform::MemRegion& r = list[i];
+		bool in_game_module = (uintptr_t)r.base - (uintptr_t)game_module < game_module_size;
+		bool has_stack = (uintptr_t)&stack_var - (uintptr_t)r.base < r.size;
+		for (size_t s = 0; s < num_skipped_stacks; s++)
+			has_stack |= (uintptr_t)skipped_stacks[s]->load() - (uintptr_t)r.base < r.size;
+		if ((r.image && !in_game_module) || has_stack || platform::IsOwnPages(r.base))
+			continue;
+		list[n++] = r;
+	}
+
+	bool ok = init(list, n, ring, track, tick, pos);
+	platform::FreePages(list, list_bytes);
+	return ok;
+}
+
+
+bool SaveStates::capture(uint32_t tick, const ScriptManager::Position& pos) {
+	if (!active())
+		return false;
+	if (!regionsStillThere()) {
+		clear();
+		return false;
+	}
+	uint64_t start_us = platform::TickCountUs();
+
+	findChangedPages();
+	size_t num_pages = 0;
+	for (size_t i = 0; i < num_regions; i++) {
+		const Region& r = regions[i];
+		for (size_t w = 0; w < (r.num_pages + 63) / 64; w++) {
+			uint64_t bits = page_bits[r.word_off + w];
+			for (size_t b = 0; bits; b++, bits >>= 1)
+				if (bits & 1)
+					page_list[num_pages++] = (uint32_t)(r.first_page + w * 64 + b);
+		}
+	}
+
+	if (num_snapshots >= ring_size)
+		foldOldest();
+
+	Snapshot& s = snapshots[num_snapshots];
+	size_t list_size = RoundToPages(num_pages * sizeof(uint32_t));
+	s.alloc_size = list_size + num_pages * PAGE_BYTES;
+	s.pages = nullptr;
+	s.data = nullptr;
+	if (s.alloc_size > 0) {
+		s.pages = (uint32_t*)platform::AllocPages(s.alloc_size);
+		if (!s.pages) {
+			// we've already updated the hashes, so this snapshot can't just be skipped
+			clear();
+			return false;
+		}
+		s.data = (char*)s.pages + list_size;
+	}
+	if (num_pages > 0)
+		memcpy(s.pages, page_list, num_pages * sizeof(uint32_t));
+	for (size_t i = 0; i < num_pages; i++)
+		memcpy(s.data + i * PAGE_BYTES, pageAddress(page_list[i]), PAGE_BYTES);
+	s.num_pages = num_pages;
+	s.tick = tick;
+	s.pos = pos;
+	num_snapshots++;
+
+	st.snapshots = num_snapshots;
+	st.total_bytes += s.alloc_size;
+	st.last_capture_bytes = s.alloc_size;
+	st.last_capture_us = platform::TickCountUs() - start_us;
+	return true;
+}
+
+
+bool SaveStates::restore(size_t back, uint32_t& tick, ScriptManager::Position& pos) {
+	if (!active() || back >= num_snapshots)
+		return false;
+	if (!regionsStillThere()) {
+		clear();
+		return false;
+	}
+	uint64_t start_us = platform::TickCountUs();
+	size_t target = num_snapshots - 1 - back;
+
+	// everything that changed since the last snapshot, and everything in the ones after the target
+	findChangedPages();
+	for (size_t i = target + 1; i < num_snapshots; i++) {
+		const Snapshot& s = snapshots[i];
+		size_t r = 0;
+		for (size_t j = 0; j < s.num_pages; j++) {
+			size_t page = s.pages[j];
+			while (page >= regions[r].first_page + regions[r].num_pages)
+				r++;
+			size_t local = page - regions[r].first_page;
+			page_bits[regions[r].word_off + local / 64] |= 1ull << (local % 64);
+		}
+	}
+
+	for (size_t i = 0; i < num_preserved; i++)
+		memcpy(preserved_copy + (preserved[i].base - preserved_lo), preserved[i].base, preserved[i].size);
+
+	size_t num_written = 0;
+	for (size_t i = 0; i < num_regions; i++) {
+		const Region& r = regions[i];
+		for (size_t w = 0; w < (r.num_pages + 63) / 64; w++) {
+			uint64_t bits = page_bits[r.word_off + w];
+			for (size_t b = 0; bits; b++, bits >>= 1) {
+				if (!(bits & 1))
+					continue;
+				size_t page = r.first_page + w * 64 + b;
+				memcpy(pageAddress(page), pageAt(page, target), PAGE_BYTES);
+				page_list[num_written++] = (uint32_t)page;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < num_preserved; i++)
+		memcpy(preserved[i].base, preserved_copy + (preserved[i].base - preserved_lo), preserved[i].size);
+	for (size_t i = 0; i < num_written; i++)
+		hashes[page_list[i]] = HashPage(pageAddress(page_list[i]));
+	// the restore itself wrote to the pages, protect them again
+	if (track_writes)
+		for (size_t i = 0; i < num_regions; i++)
+			platform::TakeWrittenPages(i, page_bits + regions[i].word_off);
+
+	while (num_snapshots > target + 1)
+		dropSnapshot(snapshots[--num_snapshots]);
+	tick = snapshots[target].tick;
+	pos = snapshots[target].pos;
+
+	st.snapshots = num_snapshots;
+	st.last_restore_pages = num_written;
+	st.last_restore_us = platform::TickCountUs() - start_us;
+	return true;
+}
+
+
+void SaveStates::clear() {
+	if (track_writes)
+		platform::StopWriteTracking();
+	track_writes = false;
+	while (num_snapshots > 0)
+		dropSnapshot(snapshots[--num_snapshots]);
+	if (meta)
+		platform::FreePages(meta, meta_size);
+	meta = nullptr;
+	regions = nullptr;
+	hashes = page_bits = nullptr;
+	page_list = nullptr;
+	meta_size = num_regions = total_pages = bitmap_words = ring_size = 0;
+	st = {};
+}
+
+
+void SaveStates::setGameModule(const void* base, size_t size) {
+	game_module = (const char*)base;
+	game_module_size = size;
+}
+
+
+bool SaveStates::skipStack(const std::atomic<const void*>* stack_addr) {
+	if (num_skipped_stacks >= MAX_SKIPPED_STACKS)
+		return false;
+	skipped_stacks[num_skipped_stacks++] = stack_addr;
+	return true;
+}
+
+
+bool SaveStates::preserve(void* p, size_t size) {
+	if (num_preserved >= MAX_PRESERVED)
+		return false;
+	preserved[num_preserved++] = {(char*)p, size, false};
+
+	// one copy that covers all of the ranges, they're small and close to each other
+	char* hi = preserved[0].base + preserved[0].size;
+	preserved_lo = preserved[0].base;
+	for (size_t i = 1; i < num_preserved; i++) {
+		if (preserved[i].base < preserved_lo)
+			preserved_lo = preserved[i].base;
+		if (preserved[i].base + preserved[i].size > hi)
+			hi = preserved[i].base + preserved[i].size;
+	}
+	if (preserved_copy)
+		platform::FreePages(preserved_copy, preserved_copy_size);
+	preserved_copy_size = hi - preserved_lo;
+	preserved_copy = (char*)platform::AllocPages(preserved_copy_size);
+	if (!preserved_copy) {
+		num_preserved = 0;
+		return false;
+	}
+	return true;
+}
+
+
+void SaveStates::requestStart(size_t ring, uint32_t every, bool track) {
+	start_requested = true;
+	requested_ring_size = ring;
+	interval = every;
+	requested_track_writes = track;
+}
+
+
+void SaveStates::stop() {
+	clear();
+	start_requested = capture_requested = false;
+	restore_back = -1;
+	interval = 0;
+}
+
+
+void SaveStates::tick(ScriptManager& script_mgr) {
+	ScriptManager::Position pos;
+	if (!script_mgr.getPosition(pos))
+		return;
+
+	if (start_requested) {
+		start_requested = capture_requested = false;
+		restore_back = -1;
+		cur_tick = last_capture_tick = 0;
+		initFromProcess(requested_ring_size, requested_track_writes, cur_tick, pos);
+		return;
+	}
+	if (!active())
+		return;
+
+	if (restore_back >= 0) {
+		uint32_t tick;
+		if (restore((size_t)restore_back, tick, pos) && script_mgr.setPosition(pos))
+			cur_tick = last_capture_tick = tick;
+		restore_back = -1;
+		return;
+	}
+
+	cur_tick++;
+	if (capture_requested || (interval > 0 && cur_tick - last_capture_tick >= interval)) {
+		capture_requested = false;
+		last_capture_tick = cur_tick;
+		capture(cur_tick, pos);
+	}
+}
+
+
+char* SaveStates::pageAddress(size_t page) const {
+	size_t lo = 0, hi = num_regions;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (page < regions[mid].first_page)
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return regions[lo].base + (page - regions[lo].first_page) * PAGE_BYTES;
+}
+
+
+const char* SaveStates::pageAt(size_t page, size_t snapshot) const {
+	// the newest snapshot (up to the given one) that has the page, or the base
+	for (size_t i = snapshot; i > 0; i--) {
+		const Snapshot& s = snapshots[i];
+		size_t lo = 0, hi = s.num_pages;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (s.pages[mid] < page)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < s.num_pages && s.pages[lo] == page)
+			return s.data + lo * PAGE_BYTES;
+	}
+	return snapshots[0].data + page * PAGE_BYTES;
+}
+
+
+bool SaveStates::regionsStillThere() const {
+	for (size_t i = 0; i < num_regions; i++)
+		if (!platform::IsWritable(regions[i].base, regions[i].num_pages * PAGE_BYTES))
+			return false;
+	return true;
+}
+
+
+void SaveStates::findChangedPages() {
+	if (track_writes) {
+		// only pages that were written to can have changed
+		for (size_t i = 0; i < num_regions; i++)
+			platform::TakeWrittenPages(i, page_bits + regions[i].word_off);
+	} else {
+		memset(page_bits, 0xff, bitmap_words * sizeof(uint64_t));
+	}
+	for (size_t i = 0; i < num_regions; i++) {
+		const Region& r = regions[i];
+		for (size_t w = 0; w < (r.num_pages + 63) / 64; w++) {
+			uint64_t& bits = page_bits[r.word_off + w];
+			if (r.num_pages - w * 64 < 64)
+				bits &= (1ull << (r.num_pages - w * 64)) - 1;
+			for (size_t b = 0; b < 64; b++) {
+				if (!(bits & (1ull << b)))
+					continue;
+				size_t page = r.first_page + w * 64 + b;
+				uint64_t h = HashPage(r.base + (w * 64 + b) * PAGE_BYTES);
+				if (h == hashes[page])
+					bits &= ~(1ull << b);
+				hashes[page] = h;
+			}
+		}
+	}
+}
+
+
+void SaveStates::foldOldest() {
+	if (num_snapshots < 2)
+		return;
+	Snapshot& base = snapshots[0];
+	Snapshot& oldest = snapshots[1];
+	for (size_t i = 0; i < oldest.num_pages; i++)
+		memcpy(base.data + (size_t)oldest.pages[i] * PAGE_BYTES, oldest.data + i * PAGE_BYTES, PAGE_BYTES);
+	base.tick = oldest.tick;
+	base.pos = oldest.pos;
+	dropSnapshot(oldest);
+	for (size_t i = 1; i + 1 < num_snapshots; i++)
+		snapshots[i] = snapshots[i + 1];
+	snapshots[--num_snapshots] = {};
+}
+
+
+void SaveStates::dropSnapshot(Snapshot& s) {
+	if (s.pages)
+		platform::FreePages(s.pages, s.alloc_size);
+	else if (s.data)
+		platform::FreePages(s.data, s.alloc_size);
+	st.total_bytes -= s.alloc_size < st.total_bytes ? s.alloc_size : st.total_bytes;
+	s = {};
+}
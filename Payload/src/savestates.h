@@ -0,0 +1,177 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "platform.h"
+#include "script_data.h"
+
+/*
+* Savestates for retrying the end of a script without replaying all of it. A snapshot is a copy
+* of the game's writable memory plus where the ScriptManager was in the script, taken at a tick
+* boundary (before that tick's inputs are sent).
+*
+* The first snapshot is a full copy (the base), every one after that only stores the pages that
+* changed since the one before. Changed pages are found by hashing pages and comparing against
+* their hashes from the last snapshot. Without write tracking every page has to be hashed, with
+* it only the pages that were written to are. The last ring_size snapshots are kept, and once the
+* ring is full the oldest one is folded into the base. A restore writes back every page that
+* changed since the snapshot (in place), then drops the snapshots after it.
+*
+* This only works while the game's memory layout stays the same (i.e. during a race), the
+* snapshots are cleared if a region goes away. Other threads in the game keep running while we
+* capture and restore, so their state can end up torn. Anything that we allocate from the heap
+* that the game uses after a capture is lost on restore, since the heap itself goes back in time,
+* which is why our own buffers that outlive a tick are in our own pages instead.
+*/
+class SaveStates {
+public:
+	static const size_t MAX_SNAPSHOTS = 64;
+
+	struct Stats {
+		size_t snapshots;           // kept right now (including the base)
+		size_t total_bytes;         // memory used by all of them
+		size_t regions;
+		size_t region_bytes;        // total size of the memory that's saved
+		size_t last_capture_bytes;  // stored by the last capture (the base is a full copy)
+		uint64_t last_capture_us;
+		size_t last_restore_pages;  // pages written by the last restore
+		uint64_t last_restore_us;
+	};
+
+	SaveStates() = default;
+	SaveStates(const SaveStates&) = delete;
+	SaveStates& operator=(const SaveStates&) = delete;
+
+	~SaveStates() {
+		clear();
+		if (preserved_copy)
+			platform::FreePages(preserved_copy, preserved_copy_size);
+	}
+
+	// Takes the base snapshot (a full copy of the regions, which must be page aligned), clearing
+	// any old snapshots. Returns false if we ran out of memory or couldn't start write tracking.
+	bool init(const platform::MemRegion* regions, size_t num_regions, size_t ring_size, bool track_writes,
+		uint32_t tick, const ScriptManager::Position& pos);
+
+	// Same as above, but with all of the game's writable memory: every writable region except
+	// for our own pages, exe/dll images other than the game's, the stack we're running on and the
+	// stacks from skipStack().
+	bool initFromProcess(size_t ring_size, bool track_writes, uint32_t tick, const ScriptManager::Position& pos);
+
+	// stores the pages that changed since the last snapshot, returns false on failure
+	bool capture(uint32_t tick, const ScriptManager::Position& pos);
+
+	// Restores the snapshot from 'back' snapshots ago (0 is the last one), and drops the ones after
+	// it. Returns false if there's no such snapshot or if the memory layout has changed.
+	bool restore(size_t back, uint32_t& tick, ScriptManager::Position& pos);
+
+	// frees all snapshots & stops write tracking
+	void clear();
+
+	bool active() const {return num_regions > 0;}
+
+	const Stats& stats() const {return st;}
+
+	// where the game's exe is, its writable sections are the only image memory that gets saved
+	void setGameModule(const void* base, size_t size);
+
+	// Puts [p, p + size) back the way it was after every restore. For our own state that lives
+	// in the same heap as the game's, the memory that it points to has to be our own pages (see
+	// PageVector). Returns false if there's no room for another range.
+	bool preserve(void* p, size_t size);
+
+	// Leaves the stack of one of our own threads out of initFromProcess, *stack_addr is somewhere
+	// on it while the thread runs (null otherwise). Returns false if there's no room for another.
+	bool skipStack(const std::atomic<const void*>* stack_addr);
+
+
+	/*
+	* The tick driver side: requests (e.g. from IPC) are only done at the next tick boundary
+	* while a script is running, with the ScriptManager's position at that point.
+	*/
+
+	// start taking snapshots (every interval ticks if that's not 0)
+	void requestStart(size_t ring_size, uint32_t interval, bool track_writes);
+
+	void requestCapture() {capture_requested = true;}
+
+	void requestRestore(size_t back) {restore_back = (int64_t)back;}
+
+	// clears all snapshots and cancels all requests
+	void stop();
+
+	// Called at the start of every tick while a script is running, before the script's inputs
+	// for the tick are sent. Handles requests, restores the ScriptManager's position on restore.
+	void tick(ScriptManager& script_mgr);
+
+private:
+	struct Region {
+		char* base;
+		size_t num_pages;
+		size_t first_page;  // index of the region's first page among all pages
+		size_t word_off;    // offset of the region's first word in the bitmaps
+	};
+
+	struct Snapshot {
+		uint32_t tick;
+		ScriptManager::Position pos;
+		// sorted page indices and their contents, pages is null for the base (which has all pages)
+		uint32_t* pages;
+		char* data;
+		size_t num_pages;
+		size_t alloc_size;
+	};
+
+	static const size_t MAX_PRESERVED = 4;
+	static const size_t MAX_SKIPPED_STACKS = 4;
+
+	Region* regions = nullptr;
+	size_t num_regions = 0;
+	size_t total_pages = 0;
+	bool track_writes = false;
+
+	Snapshot snapshots[MAX_SNAPSHOTS] = {};
+	size_t num_snapshots = 0;
+	size_t ring_size = 0;
+
+	// one allocation for the region list, the hashes of every page as of the last snapshot, a
+	// bitmap of pages (with each region starting on a new word), and a list of page indices
+	void* meta = nullptr;
+	size_t meta_size = 0;
+	uint64_t* hashes = nullptr;
+	uint64_t* page_bits = nullptr;
+	size_t bitmap_words = 0;
+	uint32_t* page_list = nullptr;
+
+	const char* game_module = nullptr;
+	size_t game_module_size = 0;
+
+	platform::MemRegion preserved[MAX_PRESERVED] = {};
+	size_t num_preserved = 0;
+	char* preserved_lo = nullptr;  // the lowest address of all the ranges
+	char* preserved_copy = nullptr;
+	size_t preserved_copy_size = 0;
+
+	const std::atomic<const void*>* skipped_stacks[MAX_SKIPPED_STACKS] = {};
+	size_t num_skipped_stacks = 0;
+
+	Stats st = {};
+
+	// tick driver state
+	bool start_requested = false;
+	bool capture_requested = false;
+	int64_t restore_back = -1;
+	size_t requested_ring_size = 0;
+	uint32_t interval = 0;
+	bool requested_track_writes = false;
+	uint32_t cur_tick = 0;
+	uint32_t last_capture_tick = 0;
+
+	char* pageAddress(size_t page) const;
+	const char* pageAt(size_t page, size_t snapshot) const;
+	bool regionsStillThere() const;
+	// sets page_bits for every page that changed since the last snapshot
+	void findChangedPages();
+	void foldOldest();
+	void dropSnapshot(Snapshot& s);
+};
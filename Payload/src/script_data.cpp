@@ -1,12 +1,256 @@
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
 #include "script_data.h"
+#include "platform.h"
 #include "hooks.h"
+#include "game_state.h"
+
+
+// hard coded keys for each flag
+const EKEY_CODE Framebulk::FLAG_KEYS[Framebulk::NUM_BUTTON_FLAGS] = {IRR_KEY_UP, IRR_KEY_DOWN, IRR_KEY_SPACE, IRR_KEY_N, IRR_KEY_V};
+
+// a governed script that's behind (or on its last tick) goes this fast, which still draws now & then
+static const float MAX_GOVERNED_SPEED = 1000;
+
+
+ScriptData* ScriptData::fromMessage(const char* buf, size_t size) {
+	const char* buf_end = buf + size;
+
+	// header: map name, player name, ai count, laps, difficulty, flags
+	// then if the flags say so: duration
+	// then if the flags say so: seed
+	// then if the flags say so: action count, actions
+	// then if the flags say so: programs (see PredicateVM::measure)
+	// then if the flags say so: repeat block count, repeat blocks
+	// then framebulks
+
+	const char* map_name = buf;
+	size_t map_len = strnlen(map_name, size);
+	const char* player_name = map_name + map_len + 1;
+	if (player_name >= buf_end)
+		return nullptr;
+	size_t player_len = strnlen(player_name, buf_end - player_name);
+	const char* fields = player_name + player_len + 1;
+	if (fields + FIELDS_SIZE > buf_end)
+		return nullptr;
+
+	uint8_t flags = *(uint8_t*)(fields + 12);
+
+	const char* actions_buf = fields + FIELDS_SIZE;
+	float duration = 0;
+	if (flags & FLAG_HAS_DURATION) {
+		if (actions_buf + 4 > buf_end)
+			return nullptr;
+		duration = *(float*)actions_buf;
+		actions_buf += 4;
+		if (!(duration > 0))
+			return nullptr;
+	}
+	uint32_t seed = 0;
+	if (flags & FLAG_HAS_SEED) {
+		if (actions_buf + 4 > buf_end)
+			return nullptr;
+		seed = *(uint32_t*)actions_buf;
+		actions_buf += 4;
+	}
+
+	size_t num_actions = 0;
+	if (flags & FLAG_HAS_ACTIONS) {
+		if (actions_buf + 4 > buf_end)
+			return nullptr;
+		num_actions = *(uint32_t*)actions_buf;
+		actions_buf += 4;
+		if (num_actions > (size_t)(buf_end - actions_buf) / TimedAction::SIZE_BYTES)
+			return nullptr;
+		for (size_t i = 0; i < num_actions; i++)
+			if ((uint8_t)actions_buf[i * TimedAction::SIZE_BYTES + 4] >= (uint8_t)TimedAction::Type::NUM_TYPES)
+				return nullptr;
+	}
+
+	const char* programs_buf = actions_buf + num_actions * TimedAction::SIZE_BYTES;
+	const char* repeats_buf = programs_buf;
+	size_t programs_size = 0;
+	if (flags & FLAG_HAS_PROGRAMS) {
+		repeats_buf = PredicateVM::measure(programs_buf, buf_end, programs_size);
+		if (!repeats_buf)
+			return nullptr;
+	}
+
+	size_t num_repeats = 0;
+	if (flags & FLAG_HAS_REPEATS) {
+		if (repeats_buf + 4 > buf_end)
+			return nullptr;
+		num_repeats = *(uint32_t*)repeats_buf;
+		repeats_buf += 4;
+		if (num_repeats > (size_t)(buf_end - repeats_buf) / RepeatBlock::SIZE_BYTES)
+			return nullptr;
+	}
+	const char* fb_buf = repeats_buf + num_repeats * RepeatBlock::SIZE_BYTES;
+
+	size_t fb_size = buf_end - fb_buf;
+	size_t num_framebulks = fb_size / Framebulk::FB_SIZE_BYTES + 2;
+
+	// the arena needs room for the script, both names, the actions & their links, the programs, the
+	// repeat blocks, the framebulks, and some alignment padding
+	Arena arena;
+	size_t actions_size = num_actions * (sizeof(TimedAction) + sizeof(uint32_t));
+	size_t repeats_size = num_repeats * sizeof(RepeatBlock);
+	if (!arena.init(sizeof(ScriptData) + map_len + player_len + 2 + actions_size + programs_size + repeats_size + num_framebulks * sizeof(Framebulk) + 56))
+		return nullptr;
+
+	ScriptData* data = new (arena.alloc<ScriptData>()) ScriptData();
+
+	char* map_copy = arena.alloc<char>(map_len + 1);
+	memcpy(map_copy, map_name, map_len);
+	data->map_name = map_copy;
+
+	char* player_copy = arena.alloc<char>(player_len + 1);
+	memcpy(player_copy, player_name, player_len);
+	data->player_name = player_copy;
+
+	data->ai_count = *(int*)fields;
+	data->laps = *(int*)(fields + 4);
+	data->difficulty = *(Difficulty*)(fields + 8);
+	data->quick_reset = (flags & FLAG_QUICK_RESET) != 0;
+	data->duration = duration;
+	data->has_seed = (flags & FLAG_HAS_SEED) != 0;
+	data->seed = seed;
+
+	static_assert(sizeof(TimedAction) == TimedAction::SIZE_BYTES, "actions are copied straight from the message");
+	data->num_actions = num_actions;
+	if (num_actions > 0) {
+		data->actions = arena.alloc<TimedAction>(num_actions);
+		data->action_links = arena.alloc<uint32_t>(num_actions);
+		memcpy(data->actions, actions_buf, num_actions * sizeof(TimedAction));
+	}
+
+	if (flags & FLAG_HAS_PROGRAMS)
+		PredicateVM::load(programs_buf, arena, data->programs);
+
+	static_assert(sizeof(RepeatBlock) == RepeatBlock::SIZE_BYTES, "repeat blocks are copied straight from the message");
+	data->num_repeats = num_repeats;
+	if (num_repeats > 0) {
+		data->repeats = arena.alloc<RepeatBlock>(num_repeats);
+		memcpy(data->repeats, repeats_buf, num_repeats * sizeof(RepeatBlock));
+		// the indices don't count the framebulk that's put in front of the script's
+		for (size_t i = 0; i < num_repeats; i++) {
+			data->repeats[i].first_fb++;
+			data->repeats[i].end_fb++;
+		}
+	}
+
+	data->framebulks = arena.alloc<Framebulk>(num_framebulks);
+	data->fillFramebulkData(fb_buf, fb_size);
+
+	// the arena (and the script with it) is freed if these fail
+	if (!PredicateVM::validate(data->programs) || !data->validateRepeats())
+		return nullptr;
+	// the longest until program, and the longest rule programs (shortest first)
+	uint32_t until_instrs = 0;
+	uint32_t rule_instrs[ScriptManager::MAX_RULES] = {};
+	for (size_t i = 0; i < data->num_framebulks; i++) {
+		const Framebulk& fb = data->framebulks[i];
+		if (fb.until && (fb.rule || fb.program >= data->programs.num_programs))
+			return nullptr;
+		if (fb.rule && (fb.num_ticks != 0 || (fb.program != PredicateVM::NO_PROGRAM && fb.program >= data->programs.num_programs)))
+			return nullptr;
+		if (fb.until)
+			until_instrs = std::max(until_instrs, data->programs.programs[fb.program].num_instrs);
+		if (fb.rule && fb.program != PredicateVM::NO_PROGRAM && data->programs.programs[fb.program].num_instrs > rule_instrs[0]) {
+			rule_instrs[0] = data->programs.programs[fb.program].num_instrs;
+			std::sort(rule_instrs, rule_instrs + ScriptManager::MAX_RULES);
+		}
+	}
+	uint32_t tick_instrs = until_instrs;
+	for (uint32_t n : rule_instrs)
+		tick_instrs += n;
+	if (tick_instrs > PredicateVM::MAX_TICK_INSTRS)
+		return nullptr;
+
+	if (!data->countTicks(data->total_ticks))
+		return nullptr;
+	data->arena = std::move(arena);
+	return data;
+}
+
+
+void ScriptData::destroy(ScriptData* data) {
+	if (!data)
+		return;
+	// the script lives in its own arena, so move the arena out before freeing it
+	Arena arena = std::move(data->arena);
+	data->~ScriptData();
+}
+
 
 void ScriptData::fillFramebulkData(const char* buf, size_t size) {
-	framebulks.clear();
-	framebulks.push_back(Framebulk()); // to unpress all keys before & after running
+	num_framebulks = 0;
+	framebulks[num_framebulks++] = Framebulk(); // to unpress all keys before & after running
 	for (size_t off = 0; size - off >= Framebulk::FB_SIZE_BYTES; off += Framebulk::FB_SIZE_BYTES)
-		framebulks.push_back(Framebulk(buf + off));
-	framebulks.push_back(Framebulk());
+		framebulks[num_framebulks++] = Framebulk(buf + off);
+	framebulks[num_framebulks++] = Framebulk();
+}
+
+
+bool ScriptData::validateRepeats() const {
+	// the ends of the blocks that the one being checked can be nested in
+	uint32_t ends[ScriptManager::MAX_REPEAT_DEPTH];
+	int depth = 0;
+	for (size_t i = 0; i < num_repeats; i++) {
+		const RepeatBlock& block = repeats[i];
+		// the framebulks from the message are the ones between the first & the last
+		if (block.count == 0 || block.first_fb < 1 || block.first_fb >= block.end_fb || block.end_fb > num_framebulks - 1)
+			return false;
+		if (i > 0 && block.first_fb < repeats[i - 1].first_fb)
+			return false;
+		while (depth > 0 && ends[depth - 1] <= block.first_fb)
+			depth--;
+		if ((depth > 0 && block.end_fb > ends[depth - 1]) || depth == ScriptManager::MAX_REPEAT_DEPTH)
+			return false;
+		ends[depth++] = block.end_fb;
+		// otherwise a block could go around (almost) forever without the game getting a tick, an
+		// until framebulk doesn't count since it can end before its first tick
+		bool takes_ticks = false;
+		for (uint32_t j = block.first_fb; j < block.end_fb && !takes_ticks; j++)
+			takes_ticks = framebulks[j].num_ticks > 0 && !framebulks[j].until;
+		if (!takes_ticks)
+			return false;
+	}
+	return true;
+}
+
+
+bool ScriptData::countTicks(uint64_t& out) const {
+	uint64_t total = 0;
+	// the blocks that framebulk i is in, and the runs of it that they add up to
+	uint32_t ends[ScriptManager::MAX_REPEAT_DEPTH];
+	uint64_t runs[ScriptManager::MAX_REPEAT_DEPTH + 1] = {1};
+	int depth = 0;
+	size_t next = 0;
+	for (size_t i = 0; i < num_framebulks; i++) {
+		while (depth > 0 && ends[depth - 1] <= i)
+			depth--;
+		for (; next < num_repeats && repeats[next].first_fb == i; next++) {
+			ends[depth] = repeats[next].end_fb;
+			if (runs[depth] > UINT64_MAX / repeats[next].count)
+				return false;
+			runs[depth + 1] = runs[depth] * repeats[next].count;
+			depth++;
+		}
+		uint64_t ticks = framebulks[i].num_ticks;
+		if (ticks > 0 && runs[depth] > (UINT64_MAX - total) / ticks)
+			return false;
+		total += ticks * runs[depth];
+	}
+	// a Stop action ends the script before the inputs of its tick
+	for (size_t i = 0; i < num_actions; i++)
+		if (actions[i].type == TimedAction::Type::Stop)
+			total = std::min(total, (uint64_t)actions[i].tick);
+	out = total;
+	return true;
 }
 
 
@@ -17,17 +261,30 @@ void ScriptManager::setNewScript(ScriptData* data) {
 	map_loaded = false;
 	fb_tick = 0;
 	fb_idx = 0;
+	script_tick = 0;
+	num_rules = 0;
+	repeat_depth = 0;
+	next_repeat = 0;
+	skip_tick = false;
+	if (data && data->num_actions > 0)
+		action_wheel.init(&data->actions[0].tick, sizeof(TimedAction), data->action_links);
+	else
+		action_wheel.init(nullptr, 0, nullptr);
+	scheduleActions(0);
 }
 
 
 void ScriptManager::stopScript() {
 	if (!has_active_script)
 		return;
-	delete script_data;
+	ScriptData::destroy(script_data);
 	script_data = nullptr;
+	if (map_loaded)
+		run_stats.us = platform::TickCountUs() - run_start_us;
 	has_active_script = false;
-	play_speed = 1;
-	*hooks::g_is_no_graphics = false;
+	action_wheel.init(nullptr, 0, nullptr);
+	setPlaySpeed(1);
+	sent_known = false;
 	sendFramebulkInputs(Framebulk()); // clear keys
 }
 
@@ -40,61 +297,316 @@ void ScriptManager::tickSignal() {
 	if (!map_loaded) {
 		loadMap();
 		map_loaded = true;
+		// the duration starts once the world is there, loading can take a while
+		run_stats = {0, 0, script_data->duration};
+		run_start_us = platform::TickCountUs();
+		setPlaySpeed(play_speed);
 		return;
 	}
+	run_stats.ticks++;
+
+	// the wheel is always at script_tick, even when there's nothing in it
+	action_wheel.advance([this](uint32_t i) {runAction(script_data->actions[i]);});
+	if (stop_requested) {
+		stopScript();
+		return;
+	}
+
+	PredicateVM::Context ctx = {script_tick++, 0};
 
 	for (;;) {
 		Framebulk& fb = script_data->framebulks[fb_idx];
-		sendFramebulkInputs(fb);
+		ctx.fb_tick = fb_tick;
+
+		if (fb.rule)
+			startRule(fb_idx);
 
-		if (fb.set_speed) {
-			play_speed = fb.new_play_speed;
-			*hooks::g_is_no_graphics = play_speed < 0;
+		// the first tick of the script was taken by a quick reset, see loadMap()
+		bool skipped = false;
+		if (skip_tick && fb.num_ticks > 0) {
+			skip_tick = false;
+			skipped = ++fb_tick >= fb.num_ticks;
+			ctx.fb_tick = fb_tick;
+		}
+
+		// an until framebulk that's done doesn't take up this tick, the next framebulk gets it
+		bool ended_early = skipped || (fb.until && vm.eval(script_data->programs, fb.program, ctx));
+		if (!ended_early) {
+			if (fb_tick == 0)
+				sent_known = false;
+			if (num_rules > 0 && fb.num_ticks > 0) {
+				Framebulk with_rules = fb;
+				applyRules(with_rules, ctx);
+				sendFramebulkInputs(with_rules);
+			} else {
+				sendFramebulkInputs(fb);
+			}
+
+			if (fb.set_speed)
+				setPlaySpeed(fb.new_play_speed);
 		}
 
 		// increment tick
-		if (++fb_tick >= fb.num_ticks) {
+		if (ended_early || ++fb_tick >= fb.num_ticks) {
 			fb_tick = 0;
-			if (++fb_idx >= script_data->framebulks.size()) {
+			if (!nextFramebulk()) {
 				stopScript(); // we're done
 				break;
 			}
 		}
 		// break if we just processed a framebulk with at least one tick or if we set the speed to 0
-		if (fb.num_ticks > 0 || (fb.set_speed && fb.new_play_speed == 0))
+		if ((fb.num_ticks > 0 && !ended_early) || (fb.set_speed && fb.new_play_speed == 0 && getPlaySpeed() == 0))
 			break;
 	}
 }
 
 
+ScriptManager::RunStats ScriptManager::runStats() const {
+	RunStats out = run_stats;
+	if (has_active_script && map_loaded)
+		out.us = platform::TickCountUs() - run_start_us;
+	return out;
+}
+
+
+void ScriptManager::setPlaySpeed(float speed) {
+	play_speed = speed;
+	*hooks::g_is_no_graphics = getPlaySpeed() < 0;
+}
+
+
+float ScriptManager::getPlaySpeed() const {
+	if (governed())
+		return governedSpeed(platform::TickCountUs());
+	return play_speed;
+}
+
+
+float ScriptManager::governedSpeed(uint64_t now_us) const {
+	// The ticks that come after the next one (which is when the playspeed is needed), the last one
+	// is the one after the script's inputs where it stops. A quick reset already did the first one.
+	uint64_t done = script_tick + (skip_tick ? 1 : 0);
+	uint64_t after_next = script_data->total_ticks > done ? script_data->total_ticks - done : 0;
+	double left_us = run_start_us + script_data->duration * 1e6 - now_us;
+	if (after_next == 0 || left_us <= 0)
+		return MAX_GOVERNED_SPEED;
+	double tick_us = 1e6 / (**hooks::stk_config).m_physics_fps;
+	return (float)std::min(after_next * tick_us / left_us, (double)MAX_GOVERNED_SPEED);
+}
+
+
+bool ScriptManager::getPosition(Position& out) const {
+	if (!has_active_script || !script_data || !map_loaded)
+		return false;
+	out = {fb_idx, fb_tick, play_speed, script_tick, {}, {}, num_rules};
+	for (int i = 0; i < repeat_depth; i++)
+		out.repeats_left[i] = repeat_stack[i].left;
+	memcpy(out.rules, rules, num_rules * sizeof(rules[0]));
+	return true;
+}
+
+
+bool ScriptManager::setPosition(const Position& pos) {
+	if (!has_active_script || !script_data || !map_loaded)
+		return false;
+	if (pos.fb_idx < 0 || (size_t)pos.fb_idx >= script_data->num_framebulks || pos.fb_tick < 0)
+		return false;
+	// the blocks that fb_idx is in, which are all of the ones that start at or before it & end after it
+	RepeatFrame stack[MAX_REPEAT_DEPTH];
+	int depth = 0;
+	uint32_t next = 0;
+	for (; next < script_data->num_repeats && script_data->repeats[next].first_fb <= (uint32_t)pos.fb_idx; next++) {
+		const RepeatBlock& block = script_data->repeats[next];
+		if (block.end_fb <= (uint32_t)pos.fb_idx)
+			continue;
+		if (pos.repeats_left[depth] == 0 || pos.repeats_left[depth] > block.count)
+			return false;
+		stack[depth] = {next, pos.repeats_left[depth]};
+		depth++;
+	}
+	if (pos.num_rules < 0 || pos.num_rules > MAX_RULES)
+		return false;
+	for (int i = 0; i < pos.num_rules; i++)
+		if (pos.rules[i] >= script_data->num_framebulks || !script_data->framebulks[pos.rules[i]].rule)
+			return false;
+	memcpy(repeat_stack, stack, depth * sizeof(stack[0]));
+	repeat_depth = depth;
+	next_repeat = next;
+	fb_idx = pos.fb_idx;
+	fb_tick = pos.fb_tick;
+	setPlaySpeed(pos.play_speed);
+	// the restore put the player's keys back the way they were too
+	sent_known = false;
+	script_tick = pos.tick;
+	scheduleActions(script_tick);
+	num_rules = pos.num_rules;
+	memcpy(rules, pos.rules, num_rules * sizeof(rules[0]));
+	return true;
+}
+
+
+void ScriptManager::scheduleActions(uint32_t tick) {
+	action_wheel.reset(tick);
+	stop_requested = false;
+	last_marker = 0;
+	last_marker_tick = -1;
+	if (!script_data)
+		return;
+	for (size_t i = 0; i < script_data->num_actions; i++) {
+		const TimedAction& action = script_data->actions[i];
+		if (action.tick >= tick) {
+			action_wheel.insert((uint32_t)i);
+		} else if (action.type == TimedAction::Type::Marker && (int64_t)action.tick >= last_marker_tick) {
+			last_marker = action.marker_id;
+			last_marker_tick = action.tick;
+		}
+	}
+}
+
+
+void ScriptManager::runAction(const TimedAction& action) {
+	switch (action.type) {
+		case TimedAction::Type::Marker:
+			last_marker = action.marker_id;
+			last_marker_tick = action.tick;
+			break;
+		case TimedAction::Type::SetSpeed:
+			setPlaySpeed(action.new_play_speed);
+			break;
+		case TimedAction::Type::Stop:
+			stop_requested = true;
+			break;
+		default:
+			break;
+	}
+	if (action_handler)
+		action_handler(action);
+}
+
+
+bool ScriptManager::nextFramebulk() {
+	fb_idx++;
+	// the innermost block ends first, blocks that end on the same framebulk are nested
+	while (repeat_depth > 0) {
+		RepeatFrame& top = repeat_stack[repeat_depth - 1];
+		const RepeatBlock& block = script_data->repeats[top.block];
+		if ((uint32_t)fb_idx < block.end_fb)
+			break;
+		if (--top.left > 0) {
+			// back to the start, the blocks in it start over too
+			fb_idx = block.first_fb;
+			next_repeat = top.block + 1;
+			break;
+		}
+		repeat_depth--;
+	}
+	enterRepeats();
+	return (size_t)fb_idx < script_data->num_framebulks;
+}
+
+
+void ScriptManager::enterRepeats() {
+	while (next_repeat < script_data->num_repeats && script_data->repeats[next_repeat].first_fb == (uint32_t)fb_idx) {
+		repeat_stack[repeat_depth++] = {next_repeat, script_data->repeats[next_repeat].count};
+		next_repeat++;
+	}
+}
+
+
+void ScriptManager::startRule(uint32_t idx) {
+	const Framebulk& fb = script_data->framebulks[idx];
+	if (fb.program == PredicateVM::NO_PROGRAM) {
+		num_rules = 0;
+		return;
+	}
+	for (int i = 0; i < num_rules; i++) {
+		const Framebulk& other = script_data->framebulks[rules[i]];
+		if (other.flags == fb.flags && other.turn_angle == fb.turn_angle)
+			return;
+	}
+	if (num_rules == MAX_RULES) {
+		memmove(rules, rules + 1, (MAX_RULES - 1) * sizeof(rules[0]));
+		num_rules--;
+	}
+	rules[num_rules++] = idx;
+}
+
+
+void ScriptManager::applyRules(Framebulk& fb, const PredicateVM::Context& ctx) const {
+	for (int i = 0; i < num_rules; i++) {
+		const Framebulk& rule = script_data->framebulks[rules[i]];
+		if (!vm.eval(script_data->programs, rule.program, ctx))
+			continue;
+		fb.flags |= rule.flags & Framebulk::BUTTON_FLAGS_MASK;
+		if (rule.turn_angle != 0)
+			fb.turn_angle = rule.turn_angle;
+	}
+}
+
+
 void ScriptManager::sendFramebulkInputs(const Framebulk& fb) {
 	// if we're running a script, don't send keypresses/releases from a 0-tick framebulk unless it's the first/last one
 	if (script_data) {
-		if (fb.num_ticks <= 0 && &fb != &script_data->framebulks.back() && &fb != &script_data->framebulks.front())
+		if (fb.num_ticks <= 0 && &fb != &script_data->framebulks[script_data->num_framebulks - 1] && &fb != &script_data->framebulks[0])
 			return;
 	}
 
-	// TODO: send joystick inputs instead of just hard left/right
+	// A turn angle in between steers part of the way, like a joystick's axis, when the keys go
+	// straight to the player's controller. The keyboard can only steer all the way.
+	float amount = fb.turn_angle > 0 ? fb.turn_angle : fb.turn_angle < 0 ? -fb.turn_angle : 0;
+	int steer = (int)std::ceil(std::min(amount, 1.0f) * INPUT_MAX_VALUE);
+
 	// send direction inputs BEFORE skid flag!
-	sendKeyboardInput(IRR_KEY_RIGHT, fb.turn_angle > 0);
-	sendKeyboardInput(IRR_KEY_LEFT, fb.turn_angle < 0);
+	EKEY_CODE keys[NUM_SCRIPT_KEYS] = {IRR_KEY_RIGHT, IRR_KEY_LEFT};
+	int values[NUM_SCRIPT_KEYS] = {fb.turn_angle > 0 ? steer : 0, fb.turn_angle < 0 ? steer : 0};
+	for (int i = 0; i < Framebulk::NUM_BUTTON_FLAGS; i++) {
+		keys[2 + i] = Framebulk::FLAG_KEYS[i];
+		values[2 + i] = fb.flags & (1 << i) ? INPUT_MAX_VALUE : 0;
+	}
+
+	// a held key stays held in the game, so most ticks only have a key or two to send (or none)
+	for (int i = 0; i < NUM_SCRIPT_KEYS; i++) {
+		if (sent_known && values[i] == sent_values[i])
+			continue;
+		sendInput(keys[i], values[i]);
+		sent_values[i] = values[i];
+	}
+	sent_known = true;
+}
 
-	// hard coded keys for each flag
-	const EKEY_CODE flag_keys[] = {IRR_KEY_UP, IRR_KEY_DOWN, IRR_KEY_SPACE, IRR_KEY_N, IRR_KEY_V};
 
-	for (int i = 0; i < Framebulk::NUM_BUTTON_FLAGS; i++)
-		sendKeyboardInput(flag_keys[i], fb.flags & (1 << i));
+// the action that the game's default key bindings have for a key that scripts press
+static PlayerAction KeyAction(EKEY_CODE key) {
+	switch (key) {
+		case IRR_KEY_UP: return PA_ACCEL;
+		case IRR_KEY_DOWN: return PA_BRAKE;
+		case IRR_KEY_LEFT: return PA_STEER_LEFT;
+		case IRR_KEY_RIGHT: return PA_STEER_RIGHT;
+		case IRR_KEY_SPACE: return PA_FIRE;
+		case IRR_KEY_N: return PA_NITRO;
+		case IRR_KEY_V: return PA_DRIFT;
+		default: return PA_BEFORE_FIRST;
+	}
 }
 
 
-void ScriptManager::sendKeyboardInput(EKEY_CODE key, bool key_pressed) {
+void ScriptManager::sendInput(EKEY_CODE key, int value) {
+	PlayerAction action = KeyAction(key);
+	if (player_controller && direct_input && action != PA_BEFORE_FIRST) {
+		// what InputManager::input ends up doing with a key event (or a joystick's axis) for the player's kart
+		hooks::ORIG_LocalPlayerController__action(player_controller, action, value, false);
+		input_stats.direct++;
+		return;
+	}
+	input_stats.dispatched++;
+
 	// Fills an SEvent struct and calls InputManager::input in game code
 	SEvent e = {};
 	e.EventType = EET_KEY_INPUT_EVENT;
 	e.KeyInput.Char = U'\0';
 	e.KeyInput.Key = key;
 	e.KeyInput.SystemKeyCode = 0;
-	e.KeyInput.PressedDown = key_pressed;
+	e.KeyInput.PressedDown = value != 0;
 	e.KeyInput.Shift = false;
 	e.KeyInput.Control = false;
 	hooks::ORIG_InputManager__input(*hooks::input_manager, e);
@@ -116,31 +628,100 @@ void ScriptManager::loadMap() {
 	*/
 	using namespace hooks;
 
-	// can't quick reset if the world isn't loaded yet
-	if (*m_world && script_data->quick_reset) {
+	uint64_t start_us = platform::TickCountUs();
+	// the kart (and its controller) might not be the same one after this, and a full load or a quick
+	// reset both let go of every key
+	player_controller = nullptr;
+	sent_known = false;
+	// whatever the load picks at random (e.g. the AI karts) comes from the seed too, see seedFor()
+	random_stats.has_seed = script_data->has_seed;
+	random_stats.seed = script_data->seed;
+	if (script_data->has_seed)
+		seedRandom();
+	// A world that's already the race that the script wants is reset instead of loaded again,
+	// which takes milliseconds instead of seconds. Quick reset does that with whatever world is
+	// loaded (it can't if the world isn't loaded yet).
+	bool reset = canReset(script_data);
+	if (reset) {
 		CALL_VIRTUAL_FUNC(_World__reset, *m_world, 2, *m_world, true);
 		/*
 		* When loading a map normally, there's 1 tick that gets triggered during the world load.
-		* To make scripts consistent when using quick reload, 1 tick is subtracted from the first
-		* framebulk with at least 1 tick. So technically, if there's any tricks that require inputs
-		* during the map load, they won't work with quick reload.
+		* To make scripts consistent when using quick reload, the first tick of the first
+		* framebulk with at least 1 tick is skipped. So technically, if there's any tricks that
+		* require inputs during the map load, they won't work with quick reload. The framebulk
+		* itself is left alone since it could be in a repeat block.
 		*/
-		for (auto it = script_data->framebulks.begin(); it != script_data->framebulks.end(); it++) {
-			if (it->num_ticks > 0) {
-				it->num_ticks -= 1;
-				break;
-			}
-		}
+		skip_tick = true;
 	} else {
 		ORIG_RaceManager__exitRace(*g_race_manager, true);
-		ORIG_DeviceManager__setAssignMode((**input_manager).m_device_manager, ASSIGN);
-		auto device = ORIG_DeviceManager__getLatestUsedDevice((**input_manager).m_device_manager);
-		auto profile = (**m_player_manager).m_current_player;
+		game_state::DeviceManagerView device_manager = game_state::device_manager();
+		ORIG_DeviceManager__setAssignMode((DeviceManager*)device_manager.ptr(), ASSIGN);
+		auto device = ORIG_DeviceManager__getLatestUsedDevice((DeviceManager*)device_manager.ptr());
+		auto profile = (PlayerProfile*)game_state::current_player().ptr();
 		ORIG_StateManager__resetActivePlayers(*state_manager_singleton);
-		(**input_manager).m_device_manager->m_single_player = nullptr;
+		device_manager.m_single_player() = nullptr;
 		ORIG_StateManager__createActivePlayer(*state_manager_singleton, profile, device);
-		ORIG_RaceManager__setPlayerKart(*g_race_manager, 0, script_data->player_name.c_str());
+		// the names already live in the script's arena, so the game can read them from there
+		ORIG_RaceManager__setPlayerKart(*g_race_manager, 0, std::str_ref(script_data->player_name));
 		(**g_race_manager).setupBasicRace(script_data->difficulty, script_data->laps);
-		ORIG_RaceManager__startSingleRace(*g_race_manager, script_data->map_name.c_str(), script_data->laps, false);
+		ORIG_RaceManager__startSingleRace(*g_race_manager, std::str_ref(script_data->map_name), script_data->laps, false);
+		rememberLoadedRace();
 	}
+	// a load draws more random numbers than a reset does
+	if (script_data->has_seed)
+		seedRandom();
+
+	uint64_t us = platform::TickCountUs() - start_us;
+	(reset ? load_stats.resets : load_stats.full_loads)++;
+	(reset ? load_stats.reset_us : load_stats.full_load_us) += us;
+	load_stats.last_us = us;
+	load_stats.last_was_reset = reset;
+}
+
+
+void ScriptManager::seedRandom() {
+	if (hooks::ORIG_crt_srand)
+		hooks::ORIG_crt_srand(script_data->seed);
+	random_stats.seeded++;
+}
+
+
+uint32_t ScriptManager::seedFor(uint32_t game_seed) {
+	if (!has_active_script || !script_data || !script_data->has_seed)
+		return game_seed;
+	random_stats.game_seeds++;
+	return script_data->seed;
+}
+
+
+bool ScriptManager::canReset(const ScriptData* data) const {
+	return *hooks::m_world && (data->quick_reset || isLoadedRace(data));
+}
+
+
+bool ScriptManager::isLoadedRace(const ScriptData* data) const {
+	const LoadedRace& race = loaded_race;
+	return race.world && race.world == *hooks::m_world
+		&& strcmp(race.map_name, data->map_name) == 0
+		&& strcmp(race.player_name, data->player_name) == 0
+		&& race.ai_count == data->ai_count
+		&& race.laps == data->laps
+		&& race.difficulty == data->difficulty;
+}
+
+
+void ScriptManager::rememberLoadedRace() {
+	LoadedRace& race = loaded_race;
+	race.world = nullptr;
+	// names that don't fit are never the same race, so those maps are always loaded again
+	size_t map_len = strlen(script_data->map_name) + 1;
+	size_t player_len = strlen(script_data->player_name) + 1;
+	if (map_len > sizeof(race.map_name) || player_len > sizeof(race.player_name))
+		return;
+	memcpy(race.map_name, script_data->map_name, map_len);
+	memcpy(race.player_name, script_data->player_name, player_len);
+	race.ai_count = script_data->ai_count;
+	race.laps = script_data->laps;
+	race.difficulty = script_data->difficulty;
+	race.world = *hooks::m_world;
 }
@@ -1,8 +1,8 @@
 #pragma once
-#include <string>
-#include <vector>
-#include <mutex>
 #include "game_structures.h"
+#include "arena.h"
+#include "timer_wheel.h"
+#include "predicate_vm.h"
 
 class Framebulk {
 public:
@@ -15,6 +15,9 @@ public:
 			bool nitro     : 1;
 			bool skid      : 1;
 			bool set_speed : 1;
+			bool until     : 1; // ends early (before its inputs are sent) once program is true
+			bool rule      : 1; // 0 ticks, starts a rule (see ScriptManager::applyRules)
+			uint8_t program;    // index into the script's programs if until or rule is set
 		};
 		uint16_t flags;
 	};
@@ -28,6 +31,10 @@ public:
 	static const int FB_SIZE_BYTES = 8;
 
 	static const int NUM_BUTTON_FLAGS = 5; // flags that correspond to single buttons
+	static const uint16_t BUTTON_FLAGS_MASK = (1 << NUM_BUTTON_FLAGS) - 1;
+
+	// the key that's pressed for each button flag
+	static const EKEY_CODE FLAG_KEYS[NUM_BUTTON_FLAGS];
 
 	Framebulk() = default;
 
@@ -39,23 +46,167 @@ public:
 };
 
 
+/*
+* Something that a script does at a given tick, on top of its inputs. Actions are run right
+* before the inputs of their tick are sent, in the order that they're in the script.
+*/
+struct TimedAction {
+	enum class Type : uint8_t {
+		Marker,   // just remembers id & the tick, so the client can see how far a script got
+		SetSpeed, // same as a framebulk with the set_speed flag
+		Snapshot, // asks for a savestate once the tick is done (if savestates are on)
+		Stop,     // ends the script, before the tick's inputs
+		NUM_TYPES,
+	};
+
+	uint32_t tick;  // ticks since the map was loaded, like ScriptManager::Position::tick
+	Type type;
+	uint8_t reserved[3];
+	union {
+		uint32_t marker_id;
+		float new_play_speed;
+	};
+
+	// size of an action when sent over network, it's the same as in memory
+	static const int SIZE_BYTES = 12;
+};
+
+
+/*
+* A block of framebulks that runs count times in a row. Blocks are kept as they were written
+* instead of being expanded, the ScriptManager goes back to the start of a block when it gets to
+* its end. Blocks can be nested, but they can't overlap otherwise.
+*/
+struct RepeatBlock {
+	uint32_t first_fb;  // index of the first framebulk in the block
+	uint32_t end_fb;    // one past the last one
+	uint32_t count;     // at least 1
+
+	// size of a block when sent over network, it's the same as in memory
+	static const int SIZE_BYTES = 12;
+};
+
+
 class ScriptData {
 public:
-	std::string map_name;
-	std::string player_name;
+	// these point into the arena that the script lives in
+	const char* map_name = nullptr;
+	const char* player_name = nullptr;
 	int ai_count = 0;
 	int laps = 0;
 	Difficulty difficulty = DIFFICULTY_EASY;
-	std::vector<Framebulk> framebulks;
+	Framebulk* framebulks = nullptr;
+	size_t num_framebulks = 0;
+	TimedAction* actions = nullptr;
+	uint32_t* action_links = nullptr;  // for the ScriptManager's timer wheel, one per action
+	size_t num_actions = 0;
+	// the conditions that until & rule framebulks refer to
+	PredicateVM::ProgramSet programs;
+	// sorted by first_fb, and outer blocks come before the ones nested in them
+	RepeatBlock* repeats = nullptr;
+	size_t num_repeats = 0;
 	// can we restart a map without reloading?
-	bool quick_reset;
+	bool quick_reset = false;
+	// real seconds that the script should take once its map is loaded, 0 to go by its playspeeds
+	// (see ScriptManager::governed())
+	float duration = 0;
+	// the ticks of inputs that the script has if none of its until framebulks end early
+	uint64_t total_ticks = 0;
+	// the game's random numbers start from seed on every run if has_seed is set, see ScriptManager::seedFor()
+	bool has_seed = false;
+	uint32_t seed = 0;
+
+	// the header's ai count, laps & difficulty (int32s) and its flags byte, right after the names
+	static const size_t FIELDS_SIZE = 13;
+	// bits of the flags byte at the end of the header
+	static const uint8_t FLAG_QUICK_RESET = 1;
+	static const uint8_t FLAG_HAS_ACTIONS = 2;  // the actions come between the header and the framebulks
+	static const uint8_t FLAG_HAS_PROGRAMS = 4; // the programs come after the actions
+	static const uint8_t FLAG_HAS_REPEATS = 8;  // the repeat blocks come after the programs
+	static const uint8_t FLAG_HAS_DURATION = 32; // a float with the duration comes right after the flags byte
+	static const uint8_t FLAG_HAS_SEED = 64;     // a uint32 with the seed comes after that
+
+	/*
+	* Creates a script from a message (as sent by the parser). The script and everything that
+	* it points to is allocated from a single arena which is sized from the message, so there's
+	* one allocation per script and it's freed all at once by destroy(). Returns nullptr if the
+	* message is malformed or if the arena couldn't be allocated.
+	*/
+	static ScriptData* fromMessage(const char* buf, size_t size);
+
+	static void destroy(ScriptData* data);
+
+private:
+	// the arena that this script (and its data) lives in
+	Arena arena;
+
+	ScriptData() = default;
+	~ScriptData() = default;
 
 	void fillFramebulkData(const char* buf, size_t size);
+	// checks that the repeat blocks are nested properly & that each one takes at least a tick
+	bool validateRepeats() const;
+	// the framebulks' ticks times the counts of the blocks they're in, up to the first Stop action,
+	// returns false if that doesn't fit in 64 bits
+	bool countTicks(uint64_t& out) const;
 };
 
 
 class ScriptManager {
 
+public:
+
+	// how deep repeat blocks can be nested
+	static const int MAX_REPEAT_DEPTH = 8;
+
+	// the most rules that can be going at once
+	static const int MAX_RULES = 8;
+
+	// where we are in a script, savestates keep one of these so they can go back to it
+	struct Position {
+		int fb_idx;
+		int fb_tick;
+		float play_speed;
+		uint32_t tick;
+		// the runs left of each repeat block that fb_idx is in, outermost first
+		uint32_t repeats_left[MAX_REPEAT_DEPTH];
+		// the rules that are going, see applyRules()
+		uint32_t rules[MAX_RULES];
+		int num_rules;
+	};
+
+	// how long getting the world ready for scripts has taken, see loadMap()
+	struct LoadStats {
+		uint32_t full_loads;
+		uint32_t resets;
+		uint64_t full_load_us;  // all of the full loads together
+		uint64_t reset_us;      // all of the resets together
+		uint64_t last_us;       // the last script's load or reset
+		bool last_was_reset;
+	};
+
+	// how the scripts' key events got to the player's kart, see sendInput()
+	struct InputStats {
+		uint64_t direct;      // straight to the player's controller
+		uint64_t dispatched;  // through InputManager::input
+	};
+
+	// how fast a script went once its map was loaded, see runStats()
+	struct RunStats {
+		uint32_t ticks;
+		uint64_t us;
+		float duration;  // the script's duration, 0 if it didn't have one
+	};
+
+	// the game's random numbers, see seedFor()
+	struct RandomStats {
+		uint64_t draws;       // calls to the CRT's rand()
+		uint32_t seeded;      // times that loadMap() gave the generators a script's seed
+		uint32_t game_seeds;  // times that the game seeded them itself during a script with a seed
+		bool has_seed;        // whether the running (or last) script had a seed
+		uint32_t seed;
+	};
+
 private:
 
 	// header/framebulks
@@ -70,23 +221,115 @@ private:
 	int fb_idx = 0;
 	// current playspeed, negative values means as fast as possible
 	float play_speed = 1;
+	// ticks since the map was loaded (that the script has sent inputs for)
+	uint32_t script_tick = 0;
+	// the script's actions that haven't been run, its current tick is always script_tick
+	TimerWheel action_wheel;
+	// set by a Stop action, the script is stopped once all of the tick's actions have run
+	bool stop_requested = false;
+	// the last Marker action that was run
+	uint32_t last_marker = 0;
+	int64_t last_marker_tick = -1;
+	void (*action_handler)(const TimedAction&) = nullptr;
+	// the rules that have been started, as indices of their framebulks
+	uint32_t rules[MAX_RULES];
+	int num_rules = 0;
+	PredicateVM vm;
+	// the repeat blocks that fb_idx is in, outermost first
+	struct RepeatFrame {
+		uint32_t block;  // index into the script's repeats
+		uint32_t left;   // runs left, including the current one
+	};
+	RepeatFrame repeat_stack[MAX_REPEAT_DEPTH];
+	int repeat_depth = 0;
+	// the first block that fb_idx hasn't gotten to yet
+	uint32_t next_repeat = 0;
+	// a quick reset already did the first tick of the script, see loadMap()
+	bool skip_tick = false;
+	/*
+	* The race that the world was last loaded with for a script, so that a script for the same
+	* race can reset the world instead of loading the map again. The names are copied since the
+	* script that they came from is freed when it ends, and world is nullptr if there's no such
+	* race (e.g. the player has left it).
+	*/
+	struct LoadedRace {
+		World* world;
+		char map_name[64];
+		char player_name[64];
+		int ai_count;
+		int laps;
+		Difficulty difficulty;
+	};
+	LoadedRace loaded_race = {};
+	LoadStats load_stats = {};
+	RunStats run_stats = {};
+	uint64_t run_start_us = 0;
+	// the controller that the player's keys go to, nullptr until the game has been seen using it
+	LocalPlayerController* player_controller = nullptr;
+	bool direct_input = true;
+	// the keys that scripts press, the two steering directions and then Framebulk::FLAG_KEYS
+	static const int NUM_SCRIPT_KEYS = 2 + Framebulk::NUM_BUTTON_FLAGS;
+	// What each of those was last sent as, only the ones that change are sent again. It's not
+	// known after anything that might have changed the player's keys without us (e.g. a load,
+	// which lets go of everything), and then they're all sent. They're all sent at the start of
+	// every framebulk too, in case the game changed them in a way that we didn't see.
+	int sent_values[NUM_SCRIPT_KEYS] = {};
+	bool sent_known = false;
+	InputStats input_stats = {};
+	RandomStats random_stats = {};
 
-	// loads the map in script data
+	// the game only renders when the playspeed isn't unlimited
+	void setPlaySpeed(float speed);
+	// the playspeed that gets the script to its last tick at the end of its duration from now
+	float governedSpeed(uint64_t now_us) const;
+	// loads the map in script data, or resets the world if it's already the same race
 	void loadMap();
-	// convert framebulk to key/controller inputs
+	// seeds the CRT's random numbers (the only ones that a seed pins) with the script's seed
+	void seedRandom();
+	// is the world still the race that loaded_race has, and is that the race that data wants?
+	bool isLoadedRace(const ScriptData* data) const;
+	// sets loaded_race to the script's race after a full load
+	void rememberLoadedRace();
+	// convert framebulk to key/controller inputs, the keys that are the same as last time aren't sent
 	void sendFramebulkInputs(const Framebulk&);
-	// only handles key codes
-	void sendKeyboardInput(EKEY_CODE key, bool key_pressed);
+	// Sends the action that key is bound to, value goes from 0 to INPUT_MAX_VALUE. Anything but 0
+	// is a key press if it goes through InputManager::input, see setPlayerController().
+	void sendInput(EKEY_CODE key, int value);
+	// puts every action from tick on into the wheel, and finds the last marker before it
+	void scheduleActions(uint32_t tick);
+	void runAction(const TimedAction& action);
+	// Moves on to the next framebulk, going back to the start of a repeat block at its end.
+	// Returns false at the end of the script.
+	bool nextFramebulk();
+	// pushes the repeat blocks that start at fb_idx
+	void enterRepeats();
+	// starts (or clears) the rule of a rule framebulk
+	void startRule(uint32_t fb_idx);
+	// Presses the buttons (and sets the steering) of the rules whose programs are true on top of
+	// the framebulk's. A rule lasts until the script ends or until all rules are cleared, and if
+	// there's already MAX_RULES going, a new one replaces the oldest. Starting a rule that's
+	// already going (e.g. in a repeat block) does nothing.
+	void applyRules(Framebulk& fb, const PredicateVM::Context& ctx) const;
 
 public:
 
 	~ScriptManager() {
-		delete script_data;
+		ScriptData::destroy(script_data);
 	}
 
 	bool runningScript() {return has_active_script;}
 
-	float getPlaySpeed() {return play_speed;}
+	// a governed script's playspeed is worked out again every time, see governed()
+	float getPlaySpeed() const;
+
+	/*
+	* Is a script with a duration running (with its map loaded)? Its playspeed is the one that
+	* takes the ticks that it has left in the time that it has left, so it makes up for slow
+	* frames (and savestate restores) as it goes; the frame pacer then draws as many of its ticks
+	* as it can at that speed. It ignores its own playspeeds and pauses. A
+	* script whose until framebulks end early finishes early, runStats() has how far off it was.
+	*/
+	bool governed() const {return has_active_script && map_loaded && script_data->duration > 0;}
 
 	// we've just parsed a new script via IPC, stops the existing script
 	void setNewScript(ScriptData* data);
@@ -95,4 +338,85 @@ public:
 
 	// signal that we're on a new game tick
 	void tickSignal();
+
+	// Gets where we are in the script, returns false if there's no script running or if its map
+	// hasn't been loaded yet.
+	bool getPosition(Position& out) const;
+
+	// Goes back to a position from getPosition() in the current script, returns false if the
+	// position isn't valid for it.
+	bool setPosition(const Position& pos);
+
+	// Called for every action after the ScriptManager has done its part, for the ones that need
+	// more than the ScriptManager has (e.g. Snapshot). nullptr for none.
+	void setActionHandler(void (*handler)(const TimedAction&)) {action_handler = handler;}
+
+	// fields in scripts' programs are read relative to this (supertuxkart.exe in the game)
+	void setModule(const char* base, size_t size) {vm.setModule(base, size);}
+
+	size_t pendingActions() const {return action_wheel.pending();}
+
+	// would data reset the world instead of loading its map if it was started now? see loadMap()
+	bool canReset(const ScriptData* data) const;
+
+	const LoadStats& loadStats() const {return load_stats;}
+
+	// the running script's ticks & time so far, or the last one's if there's none running
+	RunStats runStats() const;
+
+	// The world that was loaded for scripts isn't there anymore or the player has left it, so
+	// the next script has to load its map again.
+	void forgetLoadedRace() {
+		loaded_race.world = nullptr;
+		player_controller = nullptr;
+		sent_known = false;
+	}
+
+	/*
+	* InputManager::input takes each key event through the key bindings, the input devices and
+	* the GUI before it gets to the player's controller. Once the game has been seen sending a key
+	* to the controller (see DETOUR_LocalPlayerController__action), the scripts' keys go straight
+	* to it instead, as the action that the key is bound to by default with the value that the
+	* game would've sent (or the steering's value, which can be anything from 0 to INPUT_MAX_VALUE,
+	* like a joystick's axis). They go through InputManager::input until then, i.e. the first key after
+	* each load (the controller is forgotten whenever a script loads its map or the player leaves
+	* the race), and all of the time if the function hasn't been found.
+	*/
+	void setPlayerController(LocalPlayerController* controller) {
+		if (controller != player_controller)
+			sent_known = false;
+		player_controller = controller;
+	}
+
+	// The game might have changed the player's keys (e.g. an event that we let through to it), so
+	// the next tick sends all of the script's keys instead of only the ones that changed.
+	void forgetSentKeys() {sent_known = false;}
+
+	// off sends every key through InputManager::input, for comparing
+	void setDirectInput(bool on) {
+		direct_input = on;
+		sent_known = false;
+	}
+
+	const InputStats& inputStats() const {return input_stats;}
+
+	/*
+	* The game seeds the CRT's random numbers with the time, so the AI and some of the physics go
+	* differently on every run of a script. A script with a seed has srand() called with it before
+	* its map is loaded (or the world is reset) and again right after, so that the race starts from
+	* the same random numbers whether it was loaded or reset. While it's running, the game's own
+	* srand() calls get the script's seed too, which is what the detour passes on instead of
+	* game_seed. Item boxes have their own generator, whose seeding hasn't been found, so a seed
+	* doesn't pin them.
+	*/
+	uint32_t seedFor(uint32_t game_seed);
+
+	// the detour counts the game's rand() calls, the count is only for the stats
+	void countRandomDraw() {random_stats.draws++;}
+
+	const RandomStats& randomStats() const {return random_stats;}
+
+	// the id of the last Marker action that was run, and its tick (-1 if there's been none)
+	uint32_t lastMarker() const {return last_marker;}
+	int64_t lastMarkerTick() const {return last_marker_tick;}
 };
@@ -0,0 +1,311 @@
+#include <string.h>
+#include "state_hash.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define STATE_HASH_SSE2
+#endif
+
+
+/*
+* The hash works on 64-byte blocks with eight 64-bit accumulators, one per word of the block
+* (the same idea as XXH3). Each word is mixed with a key and multiplied (low half by high half)
+* into its own accumulator, and added as is to its neighbour's. After every block each
+* accumulator is scrambled, so that moving data to a different block changes the hash. Every
+* step works on each 64-bit lane by itself, which is exactly what SSE2 can do two at a time.
+*/
+
+static const uint64_t BLOCK_KEYS[8] = {
+	0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+	0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+
+static const uint64_t SCRAMBLE_KEYS[8] = {
+	0xcb00c391bb52283cull, 0xa32e531b8b65d088ull, 0x4ef90da297486471ull, 0xd8acdea946ef1938ull,
+	0x3f349ce33f76faa8ull, 0x1d4f0bc7c7bbdcf9ull, 0x3159b4cd4be0518aull, 0x647378d9c97e9fc8ull,
+};
+
+static const uint64_t PRIME32_1 = 0x9e3779b1u;
+static const uint64_t PRIME64_1 = 0x9e3779b185ebca87ull;
+static const uint64_t PRIME64_2 = 0xc2b2ae3d27d4eb4full;
+static const uint64_t PRIME64_3 = 0x165667b19e3779f9ull;
+
+static const size_t BLOCK_SIZE = 64;
+
+// hashed instead of a range whose chain is broken, so that the hash still changes
+static const uint64_t MISSING_RANGE = 0x6d697373696e6721ull;
+
+
+static void InitAccs(uint64_t* acc, uint64_t seed) {
+	for (int i = 0; i < 8; i++)
+		acc[i] = seed + BLOCK_KEYS[i] * (i + 1);
+}
+
+
+static uint64_t Finish(const uint64_t* acc, size_t size, uint64_t seed) {
+	uint64_t h = seed ^ (size * PRIME64_1);
+	for (int i = 0; i < 8; i++) {
+		h = (h ^ acc[i]) * PRIME64_2;
+		h ^= h >> 29;
+	}
+	h *= PRIME64_3;
+	return h ^ (h >> 32);
+}
+
+
+static void ScalarBlock(uint64_t* acc, const char* block) {
+	uint64_t w[8];
+	memcpy(w, block, BLOCK_SIZE);
+	for (int i = 0; i < 8; i++) {
+		uint64_t dk = w[i] ^ BLOCK_KEYS[i];
+		acc[i] += (dk & 0xffffffff) * (dk >> 32);
+		acc[i ^ 1] += w[i];
+	}
+	for (int i = 0; i < 8; i++) {
+		acc[i] ^= acc[i] >> 47;
+		acc[i] ^= SCRAMBLE_KEYS[i];
+		acc[i] *= PRIME32_1;
+	}
+}
+
+
+uint64_t StateHasher::hashScalar(const void* data, size_t size, uint64_t seed) {
+	uint64_t acc[8];
+	InitAccs(acc, seed);
+	const char* p = (const char*)data;
+	size_t full = size / BLOCK_SIZE * BLOCK_SIZE;
+	for (size_t off = 0; off < full; off += BLOCK_SIZE)
+		ScalarBlock(acc, p + off);
+	if (size > full) {
+		char last[BLOCK_SIZE] = {};
+		memcpy(last, p + full, size - full);
+		ScalarBlock(acc, last);
+	}
+	return Finish(acc, size, seed);
+}
+
+
+#ifdef STATE_HASH_SSE2
+
+static void Sse2Block(__m128i* acc, const char* block, const __m128i* keys, const __m128i* scramble_keys) {
+	const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+	for (int i = 0; i < 4; i++) {
+		__m128i d = _mm_loadu_si128((const __m128i*)block + i);
+		__m128i dk = _mm_xor_si128(d, keys[i]);
+		__m128i product = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+		// swapping the two words adds each one to its neighbour's accumulator
+		__m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+	}
+	for (int i = 0; i < 4; i++) {
+		__m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+		a = _mm_xor_si128(a, scramble_keys[i]);
+		// a 64 by 32-bit multiply out of two 32 by 32-bit ones
+		__m128i lo = _mm_mul_epu32(a, prime);
+		__m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+		acc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+	}
+}
+
+
+uint64_t StateHasher::hash(const void* data, size_t size, uint64_t seed) {
+	alignas(16) uint64_t acc_words[8];
+	InitAccs(acc_words, seed);
+	__m128i acc[4], keys[4], scramble_keys[4];
+	for (int i = 0; i < 4; i++) {
+		acc[i] = _mm_load_si128((const __m128i*)acc_words + i);
+		keys[i] = _mm_loadu_si128((const __m128i*)BLOCK_KEYS + i);
+		scramble_keys[i] = _mm_loadu_si128((const __m128i*)SCRAMBLE_KEYS + i);
+	}
+
+	const char* p = (const char*)data;
+	size_t full = size / BLOCK_SIZE * BLOCK_SIZE;
+	for (size_t off = 0; off < full; off += BLOCK_SIZE)
+		Sse2Block(acc, p + off, keys, scramble_keys);
+	if (size > full) {
+		char last[BLOCK_SIZE] = {};
+		memcpy(last, p + full, size - full);
+		Sse2Block(acc, last, keys, scramble_keys);
+	}
+
+	for (int i = 0; i < 4; i++)
+		_mm_store_si128((__m128i*)acc_words + i, acc[i]);
+	return Finish(acc_words, size, seed);
+}
+
+#else
+
+uint64_t StateHasher::hash(const void* data, size_t size, uint64_t seed) {
+	return hashScalar(data, size, seed);
+}
+
+#endif
+
+
+bool StateHasher::addChain(const PointerScanner::Chain& chain, uint32_t size) {
+	if (num_ranges >= MAX_RANGES || chain.num_offsets > PointerScanner::MAX_DEPTH)
+		return false;
+	ranges[num_ranges++] = {chain, nullptr, size};
+	st.ranges = num_ranges;
+	return true;
+}
+
+
+bool StateHasher::addAddress(const void* p, uint32_t size) {
+	if (num_ranges >= MAX_RANGES)
+		return false;
+	Range& r = ranges[num_ranges++];
+	r = {};
+	r.address = (const char*)p;
+	r.size = size;
+	st.ranges = num_ranges;
+	return true;
+}
+
+
+void StateHasher::clearRanges() {
+	num_ranges = 0;
+	st.ranges = 0;
+}
+
+
+bool StateHasher::start(const Schedule& new_schedule) {
+	stop();
+	schedule = new_schedule;
+	if (schedule.interval == 0)
+		schedule.interval = 1;
+	hashes_per_tick = schedule.per_range && num_ranges > 0 ? num_ranges : 1;
+	if (!reserve(1 << 16))
+		return false;
+	st.ticks = st.hashes = 0;
+	st.first_divergence = -1;
+	st.last_tick = -1;
+	return true;
+}
+
+
+void StateHasher::stop() {
+	if (log)
+		platform::FreePages(log, log_capacity * sizeof(uint32_t));
+	log = nullptr;
+	log_capacity = 0;
+	st.ticks = st.hashes = 0;
+}
+
+
+bool StateHasher::setReference(const uint32_t* hashes, size_t count) {
+	if (reference)
+		platform::FreePages(reference, reference_alloc_size);
+	reference = nullptr;
+	reference_alloc_size = 0;
+	st.reference_hashes = 0;
+	st.first_divergence = -1;
+	if (!hashes || count == 0)
+		return true;
+	reference_alloc_size = count * sizeof(uint32_t);
+	reference = (uint32_t*)platform::AllocPages(reference_alloc_size);
+	if (!reference)
+		return false;
+	memcpy(reference, hashes, reference_alloc_size);
+	st.reference_hashes = count;
+	return true;
+}
+
+
+uint64_t StateHasher::hashRange(const Range& r, uint64_t seed, bool& missing) const {
+	uintptr_t addr = (uintptr_t)r.address;
+	missing = false;
+	if (!r.address) {
+		// the chain can go through freed memory while the world is being loaded
+		if (!PointerScanner::resolve(module_base, r.chain, addr) || !platform::IsWritable((const void*)addr, r.size)) {
+			missing = true;
+			return hash(&MISSING_RANGE, sizeof(MISSING_RANGE), seed);
+		}
+	}
+	return hash((const void*)addr, r.size, seed);
+}
+
+
+static uint32_t Fold(uint64_t h) {
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+
+uint32_t StateHasher::hashRanges() {
+	uint64_t h = 0;
+	st.missing_ranges = 0;
+	st.last_tick_bytes = 0;
+	for (size_t i = 0; i < num_ranges; i++) {
+		bool missing;
+		h = hashRange(ranges[i], h, missing);
+		if (missing)
+			st.missing_ranges++;
+		else
+			st.last_tick_bytes += ranges[i].size;
+	}
+	return Fold(h);
+}
+
+
+void StateHasher::hashEachRange(uint32_t* out) {
+	st.missing_ranges = 0;
+	st.last_tick_bytes = 0;
+	for (size_t i = 0; i < num_ranges; i++) {
+		bool missing;
+		out[i] = Fold(hashRange(ranges[i], 0, missing));
+		if (missing)
+			st.missing_ranges++;
+		else
+			st.last_tick_bytes += ranges[i].size;
+	}
+}
+
+
+void StateHasher::tick(uint32_t tick) {
+	if (!log)
+		return;
+	st.last_tick = tick;
+	// going back in time (a new script or a savestate), the hashes from this tick on are stale
+	if (tick < nextTick()) {
+		st.ticks = tick <= schedule.first ? 0 : (tick - schedule.first + schedule.interval - 1) / schedule.interval;
+		st.hashes = st.ticks * hashesPerTick();
+		if (st.first_divergence >= (int64_t)tick)
+			st.first_divergence = -1;
+	}
+	// not one of the ticks to hash, or a tick was skipped (e.g. recording was started halfway
+	// through) and there's nothing to compare
+	if (tick != nextTick() || tick > schedule.last)
+		return;
+	if (!reserve(st.hashes + hashesPerTick()))
+		return;
+
+	uint32_t* out = log + st.hashes;
+	if (hashesPerTick() > 1)
+		hashEachRange(out);
+	else
+		*out = hashRanges();
+	for (size_t i = 0; i < hashesPerTick(); i++, st.hashes++)
+		if (st.first_divergence < 0 && st.hashes < st.reference_hashes && reference[st.hashes] != log[st.hashes])
+			st.first_divergence = tick;
+	st.ticks++;
+}
+
+
+bool StateHasher::reserve(size_t count) {
+	if (count <= log_capacity)
+		return true;
+	// this only happens every 2^n ticks, and not from the game's heap
+	size_t capacity = log_capacity ? log_capacity : 1;
+	while (capacity < count)
+		capacity *= 2;
+	auto bigger = (uint32_t*)platform::AllocPages(capacity * sizeof(uint32_t));
+	if (!bigger)
+		return false;
+	if (log) {
+		memcpy(bigger, log, st.hashes * sizeof(uint32_t));
+		platform::FreePages(log, log_capacity * sizeof(uint32_t));
+	}
+	log = bigger;
+	log_capacity = capacity;
+	return true;
+}
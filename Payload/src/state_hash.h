@@ -0,0 +1,150 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "pointer_scanner.h"
+
+/*
+* Hashes chosen game state (e.g. kart transforms & velocities, found with the scanners) once per
+* tick, so that two playbacks of the same script can be compared tick by tick. Each range is
+* either a pointer chain from the game's exe (resolved every tick, since karts move every race)
+* or a fixed address, and all of them are hashed together into a single 32-bit hash per tick.
+*
+* The hashes are kept in a log indexed by the script's tick. With a reference log (e.g. from an
+* earlier run of the same script) every new hash is also compared against the reference, and the
+* first tick that doesn't match is remembered. Going back to an earlier tick (a new script or a
+* savestate restore) throws out the hashes after it.
+*
+* By default every tick is hashed, a schedule can instead hash every interval ticks in a window
+* of ticks (checkpoints), and/or hash each range by itself so that the ranges that differ can be
+* told apart. Either way the log is just the hashes in order, for the ticks that were hashed.
+*/
+class StateHasher {
+public:
+	static const size_t MAX_RANGES = 32;
+
+	// which ticks to hash, and how
+	struct Schedule {
+		uint32_t interval = 1;
+		uint32_t first = 0;
+		uint32_t last = UINT32_MAX;
+		bool per_range = false;  // a hash per range instead of one for all of them
+	};
+
+	struct Stats {
+		size_t ranges;
+		size_t ticks;            // ticks that were hashed
+		size_t hashes;           // hashes in the log
+		size_t reference_hashes;
+		int64_t first_divergence;  // first tick that didn't match the reference, or -1
+		int64_t last_tick;         // the last tick that tick() got while recording, or -1
+		size_t missing_ranges;   // ranges whose chain couldn't be followed on the last tick
+		size_t last_tick_bytes;  // bytes hashed on the last tick
+	};
+
+	StateHasher() {
+		st.first_divergence = -1;
+		st.last_tick = -1;
+	}
+
+	StateHasher(const StateHasher&) = delete;
+	StateHasher& operator=(const StateHasher&) = delete;
+
+	~StateHasher() {
+		stop();
+		setReference(nullptr, 0);
+	}
+
+	// chains start from here, the ranges are read at module_base + chain.module_offset for chains
+	// with no offsets
+	void setModule(const char* base) {module_base = base;}
+
+	// Adds size bytes at the end of the chain. Returns false if there's no room for another range.
+	bool addChain(const PointerScanner::Chain& chain, uint32_t size);
+
+	// adds size bytes at p, for memory that never moves
+	bool addAddress(const void* p, uint32_t size);
+
+	void clearRanges();
+
+	// Starts a new (empty) log. The log has to start at the schedule's first tick, so if we're past
+	// that, hashes are only recorded from the start of the next script. Returns false if we ran
+	// out of memory.
+	bool start(const Schedule& schedule);
+
+	// same as above, hashing every tick
+	bool start() {return start(Schedule());}
+
+	// stops recording & frees the log
+	void stop();
+
+	bool recording() const {return log != nullptr;}
+
+	// are we past the last tick of the schedule?
+	bool finished() const {return recording() && nextTick() > schedule.last;}
+
+	const Schedule& currentSchedule() const {return schedule;}
+
+	// the tick that a hash in the log is from
+	uint32_t tickOf(size_t hash_index) const {
+		return schedule.first + (uint32_t)(hash_index / hashesPerTick()) * schedule.interval;
+	}
+
+	// Copies a reference log to compare against, nullptr to stop comparing. Returns false if we
+	// ran out of memory.
+	bool setReference(const uint32_t* hashes, size_t count);
+
+	// Hashes the ranges if the schedule says so and adds the hash(es) to the log, throwing out
+	// anything from after tick (the ticks since the script started). Does nothing if we're not
+	// recording.
+	void tick(uint32_t tick);
+
+	const uint32_t* hashes() const {return log;}
+
+	const Stats& stats() const {return st;}
+
+	// hashes all of the ranges right now, without touching the log
+	uint32_t hashRanges();
+
+	// same as above, but each range by itself, out needs room for a hash per range
+	void hashEachRange(uint32_t* out);
+
+	/*
+	* The hash itself, 64 bytes at a time with SSE2 (which every x64 CPU has) when we're built for
+	* it, otherwise with plain 64-bit math that gives the exact same result. It's meant to be fast
+	* and to catch any change, not to be hard to collide on purpose.
+	*/
+	static uint64_t hash(const void* data, size_t size, uint64_t seed);
+
+	// the plain version of hash(), for checking that both give the same results
+	static uint64_t hashScalar(const void* data, size_t size, uint64_t seed);
+
+private:
+	struct Range {
+		PointerScanner::Chain chain;
+		const char* address;  // used instead of the chain if it's not null
+		uint32_t size;
+	};
+
+	Range ranges[MAX_RANGES];
+	size_t num_ranges = 0;
+	const char* module_base = nullptr;
+
+	Schedule schedule;
+	size_t hashes_per_tick = 1;  // fixed when the log is started
+	uint32_t* log = nullptr;
+	size_t log_capacity = 0;
+	uint32_t* reference = nullptr;
+	size_t reference_alloc_size = 0;
+
+	Stats st = {};
+
+	// makes room for at least count hashes in the log, returns false if we ran out of memory
+	bool reserve(size_t count);
+
+	size_t hashesPerTick() const {return hashes_per_tick;}
+
+	uint32_t nextTick() const {return schedule.first + (uint32_t)st.ticks * schedule.interval;}
+
+	// hashes one range, sets missing if its chain is broken
+	uint64_t hashRange(const Range& r, uint64_t seed, bool& missing) const;
+};
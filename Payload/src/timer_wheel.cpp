@@ -0,0 +1,62 @@
+#include "timer_wheel.h"
+
+
+void TimerWheel::init(const uint32_t* first_tick, size_t tick_stride, uint32_t* links) {
+	ticks = (const char*)first_tick;
+	stride = tick_stride;
+	next = links;
+	reset(cur_tick);
+}
+
+
+void TimerWheel::reset(uint32_t now) {
+	for (auto& level : slots)
+		for (Slot& slot : level)
+			slot.head = slot.tail = NONE;
+	cur_tick = now;
+	num_pending = 0;
+}
+
+
+void TimerWheel::insert(uint32_t item) {
+	uint32_t tick = tickOf(item);
+	num_pending++;
+	if (tick <= cur_tick) {
+		append(slots[0][cur_tick & (SLOTS - 1)], item);
+		return;
+	}
+	// the highest byte that differs picks the level, that byte of the tick picks the slot
+	uint32_t diff = tick ^ cur_tick;
+	int level = 0;
+	while (level < LEVELS - 1 && (diff >> (SLOT_BITS * (level + 1))) != 0)
+		level++;
+	append(slots[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)], item);
+}
+
+
+void TimerWheel::cascade() {
+	// higher levels first, what comes down from them might have to go down further
+	for (int level = LEVELS - 1; level > 0; level--) {
+		if ((cur_tick & ((1u << (SLOT_BITS * level)) - 1)) != 0)
+			continue;
+		Slot& slot = slots[level][(cur_tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+		uint32_t item = slot.head;
+		slot.head = slot.tail = NONE;
+		while (item != NONE) {
+			uint32_t following = next[item];
+			num_pending--;
+			insert(item);
+			item = following;
+		}
+	}
+}
+
+
+void TimerWheel::append(Slot& slot, uint32_t item) {
+	next[item] = NONE;
+	if (slot.tail == NONE)
+		slot.head = item;
+	else
+		next[slot.tail] = item;
+	slot.tail = item;
+}
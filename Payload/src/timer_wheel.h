@@ -0,0 +1,86 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* A hierarchical timer wheel: items that are due at some absolute tick go into one of 256 slots
+* on one of 4 levels, by the highest byte where their tick differs from the current one. Level 0
+* is the next 256 ticks (one slot per tick), level 1 is the rest of the next 65536 ticks (one slot
+* per 256 ticks), and so on. A slot on a higher level is moved down a level (cascaded) when the
+* current tick gets to it, so an item is moved at most 3 times before it's due. Going to the next
+* tick only looks at one slot per level, no matter how many items are waiting.
+*
+* The wheel doesn't own the items, they're indices into the caller's arrays: the tick that each
+* one is due at is read from the caller's items, and the links between the items in a slot go in
+* an array that the caller gives us (one per item), so the wheel never allocates. Items in the
+* same slot stay in the order they were inserted in, so items due at the same tick are fired in
+* that order.
+*/
+class TimerWheel {
+public:
+	static const uint32_t NONE = UINT32_MAX;
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 8;
+	static const uint32_t SLOTS = 1 << SLOT_BITS;
+
+	TimerWheel() {
+		reset(0);
+	}
+
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+
+	/*
+	* The tick of item i is the uint32_t at first_tick + i * tick_stride bytes, and next needs
+	* room for a link per item. Both have to stay around as long as any item is in the wheel.
+	* Empties the wheel.
+	*/
+	void init(const uint32_t* first_tick, size_t tick_stride, uint32_t* next);
+
+	// empties the wheel, the next call to advance() fires the items that are due at now
+	void reset(uint32_t now);
+
+	// adds an item, one that's due before the current tick is fired on the next advance()
+	void insert(uint32_t item);
+
+	// Fires (calls fire(item) for) everything that's due at the current tick, then goes to the
+	// next one. fire must not insert anything.
+	template <typename F>
+	void advance(F&& fire) {
+		cascade();
+		Slot& slot = slots[0][cur_tick & (SLOTS - 1)];
+		uint32_t item = slot.head;
+		slot.head = slot.tail = NONE;
+		while (item != NONE) {
+			uint32_t following = next[item];
+			num_pending--;
+			fire(item);
+			item = following;
+		}
+		cur_tick++;
+	}
+
+	// the tick that the next advance() is for
+	uint32_t now() const {return cur_tick;}
+
+	size_t pending() const {return num_pending;}
+
+private:
+	struct Slot {
+		uint32_t head, tail;
+	};
+
+	Slot slots[LEVELS][SLOTS];
+	uint32_t cur_tick = 0;
+	size_t num_pending = 0;
+
+	const char* ticks = nullptr;
+	size_t stride = 0;
+	uint32_t* next = nullptr;
+
+	uint32_t tickOf(uint32_t item) const {return *(const uint32_t*)(ticks + item * stride);}
+
+	// moves the slots on the higher levels that the current tick just got to down
+	void cascade();
+	void append(Slot& slot, uint32_t item);
+};
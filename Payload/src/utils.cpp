@@ -1,24 +1,90 @@
 #include "utils.h"
-#include <Psapi.h> // must come after Windows.h
-
-
-bool GetModuleInfo(void* hModule, void** mBase, size_t* mSize) {
-	if (!hModule)
-		return false;
-	MODULEINFO Info;
-	GetModuleInformation(GetCurrentProcess(), reinterpret_cast<HMODULE>(hModule), &Info, sizeof(Info));
-	if (mBase)
-		*mBase = Info.lpBaseOfDll;
-	if (mSize)
-		*mSize = (size_t)Info.SizeOfImage;
-	return true;
+
+
+void* GetImportedFunc(void* mBase, const char* funcName) {
+	auto base = (uintptr_t)mBase;
+	auto dos = (IMAGE_DOS_HEADER*)base;
+	auto nt = (IMAGE_NT_HEADERS*)(base + dos->e_lfanew);
+	auto& dir = nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+	if (dir.VirtualAddress == 0)
+		return nullptr;
+
+	for (auto desc = (IMAGE_IMPORT_DESCRIPTOR*)(base + dir.VirtualAddress); desc->Name; desc++) {
+		// the original thunks have the names, the first thunks have the resolved addresses
+		auto names = (IMAGE_THUNK_DATA*)(base + (desc->OriginalFirstThunk ? desc->OriginalFirstThunk : desc->FirstThunk));
+		auto funcs = (IMAGE_THUNK_DATA*)(base + desc->FirstThunk);
+		for (; names->u1.AddressOfData; names++, funcs++) {
+			if (IMAGE_SNAP_BY_ORDINAL(names->u1.Ordinal))
+				continue;
+			auto import = (IMAGE_IMPORT_BY_NAME*)(base + names->u1.AddressOfData);
+			if (strcmp((const char*)import->Name, funcName) == 0)
+				return (void*)funcs->u1.Function;
+		}
+	}
+	return nullptr;
 }
 
 
-bool GetModuleInfo(const std::wstring& mName, void** hModule, void** mBase, size_t* mSize) {
-	HMODULE Handle = GetModuleHandleW(mName.c_str());
-	auto ret = GetModuleInfo(Handle, mBase, mSize);
-	if (ret && hModule)
-		*hModule = Handle;
-	return ret;
+// the parts of MSVC's RTTI that lead to a vtable, see FindVTable()
+struct CompleteObjectLocator {
+	DWORD signature;      // 1 on x64, where the rest are RVAs
+	DWORD offset;         // where the vtable's pointer is in the object, 0 unless it's for a base class
+	DWORD cdOffset;
+	DWORD typeDescriptor; // type_info of the class, its decorated name comes after 2 pointers
+	DWORD classDescriptor;
+	DWORD self;
+};
+
+
+// calls func with every readable section of the module until it returns true, returns that section's address
+template <typename Func>
+static uintptr_t FindInSections(uintptr_t base, Func func) {
+	auto nt = (IMAGE_NT_HEADERS*)(base + ((IMAGE_DOS_HEADER*)base)->e_lfanew);
+	auto section = IMAGE_FIRST_SECTION(nt);
+	for (WORD i = 0; i < nt->FileHeader.NumberOfSections; i++, section++) {
+		if (!(section->Characteristics & IMAGE_SCN_MEM_READ))
+			continue;
+		uintptr_t found = func(base + section->VirtualAddress, (size_t)section->Misc.VirtualSize);
+		if (found)
+			return found;
+	}
+	return 0;
+}
+
+
+void** FindVTable(void* mBase, const char* className) {
+	auto base = (uintptr_t)mBase;
+
+	// the type descriptor, found by the decorated name at its end
+	std::string name = std::string(".?AV") + className + "@@";
+	uintptr_t type_desc = FindInSections(base, [&](uintptr_t start, size_t size) -> uintptr_t {
+		for (size_t i = 2 * sizeof(void*); i + name.size() < size; i += sizeof(void*))
+			if (memcmp((const void*)(start + i), name.c_str(), name.size() + 1) == 0)
+				return start + i - 2 * sizeof(void*);
+		return 0;
+	});
+	if (!type_desc)
+		return nullptr;
+
+	// the locator of the class's own vtable, which points back at itself
+	uintptr_t locator = FindInSections(base, [&](uintptr_t start, size_t size) -> uintptr_t {
+		for (size_t i = 0; i + sizeof(CompleteObjectLocator) <= size; i += sizeof(DWORD)) {
+			auto col = (const CompleteObjectLocator*)(start + i);
+			if (col->typeDescriptor == type_desc - base && col->signature == 1 &&
+				col->offset == 0 && col->self == start + i - base)
+				return start + i;
+		}
+		return 0;
+	});
+	if (!locator)
+		return nullptr;
+
+	// the vtable comes right after a pointer to its locator
+	uintptr_t meta = FindInSections(base, [&](uintptr_t start, size_t size) -> uintptr_t {
+		for (size_t i = 0; i + 2 * sizeof(void*) <= size; i += sizeof(void*))
+			if (*(const uintptr_t*)(start + i) == locator)
+				return start + i;
+		return 0;
+	});
+	return meta ? (void**)(meta + sizeof(void*)) : nullptr;
 }
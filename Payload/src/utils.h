@@ -7,31 +7,14 @@
 #endif
 
 #include <Windows.h>
-#include <string>
-#include "script_data.h"
-#include "ipc.h"
+#include "global_info.h"
 
 
-// any sort of stuff we might need to keep track of so that we can cleanup in Exit()
-struct GlobalInfo {
-public:
-	// handle to this dll, we'll need this to unload
-	HMODULE hModule;
-	// singleton ipc object
-	IPC ipc;
-	// single object to keep track of where we are in the TAS script
-	ScriptManager script_mgr;
+// Looks up a function that the module imports from any dll by reading its import address
+// table, returns nullptr if the module doesn't import it by name.
+void* GetImportedFunc(void* mBase, const char* funcName);
 
-	GlobalInfo(HMODULE hModule) : hModule(hModule) {}
-};
-
-
-extern GlobalInfo* g_pInfo;
-
-
-// Signal that we want to exit as soon as possible (will exit during next engine loop).
-// Only usable after hooks have been initialized. If reason is specified, will display
-// a message box with the reason on exit.
-void QueueExit(const char* reason = nullptr);
-
-bool GetModuleInfo(const std::wstring& mName, void** hModule, void** mBase, size_t* mSize);
+// Finds the vtable of a class by its RTTI (e.g. "LocalPlayerController" for
+// class LocalPlayerController), for hooking virtual functions of classes that don't have an
+// object yet. Returns nullptr if the module doesn't have RTTI for the class.
+void** FindVTable(void* mBase, const char* className);
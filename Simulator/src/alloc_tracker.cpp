@@ -0,0 +1,52 @@
+#include <new>
+#include <stdlib.h>
+#include "mock_game.h"
+
+/*
+* Replaces the global operator new/delete so that the simulator can count how many heap
+* allocations the payload does per tick. This only catches C++ allocations (new, std::string,
+* std::vector, etc.), but the payload doesn't call malloc directly anyways.
+*/
+
+
+namespace sim {
+	uint64_t num_allocs = 0;
+}
+
+
+static void* TrackedAlloc(size_t size) {
+	sim::num_allocs++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+
+void* operator new(size_t size) {
+	return TrackedAlloc(size);
+}
+
+
+void* operator new[](size_t size) {
+	return TrackedAlloc(size);
+}
+
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+
+void operator delete[](void* p, size_t) noexcept {
+	free(p);
+}
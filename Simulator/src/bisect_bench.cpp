@@ -0,0 +1,175 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string.h>
+#include <vector>
+#include "bisect_bench.h"
+#include "state_hash_bench.h"
+#include "mock_game.h"
+
+/*
+* Each field of the fake kart is hashed as its own range, so that the bisector can tell which
+* ones differ. What it finds is checked against brute force: both sides run once with a hash of
+* every range on every tick (and of the state that the script ended with).
+*/
+
+
+static const char* FIELD_NAMES[] = {"x", "z", "heading", "speed", "keys_held"};
+static const size_t NUM_FIELDS = sizeof(FIELD_NAMES) / sizeof(FIELD_NAMES[0]);
+static const uint32_t HEADING_MASK = 1u << 2;
+
+// side 1 gets its heading nudged at the end of this tick (counted like sim::after_tick does)
+static int64_t nudge_tick = -1;
+static int running_side = 0;
+static DesyncBisector* bisector = nullptr;
+
+
+static void NudgeHeading(uint32_t tick) {
+	int side = running_side;
+	DesyncBisector::Run run;
+	if (bisector && bisector->nextRun(run))
+		side = run.side;
+	if (side == 1 && (int64_t)tick == nudge_tick)
+		sim::fake_kart.heading += 0.001f;
+}
+
+
+struct Divergence {
+	int64_t tick;
+	uint32_t ranges;
+};
+
+
+// runs each side once with every range hashed on every tick, and once more at the end
+static Divergence BruteForce(StateHasher& hasher, const std::vector<char>* msgs[2]) {
+	std::vector<uint32_t> logs[2];
+	for (int side = 0; side < 2; side++) {
+		StateHasher::Schedule schedule;
+		schedule.per_range = true;
+		hasher.start(schedule);
+		running_side = side;
+		sim::UnloadWorld();
+		sim::RunScript(ScriptData::fromMessage(msgs[side]->data(), msgs[side]->size()));
+		logs[side].assign(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+		logs[side].resize(logs[side].size() + NUM_FIELDS);
+		hasher.hashEachRange(logs[side].data() + logs[side].size() - NUM_FIELDS);
+	}
+	size_t n = logs[0].size() < logs[1].size() ? logs[0].size() : logs[1].size();
+	for (size_t t = 0; t < n / NUM_FIELDS; t++) {
+		uint32_t ranges = 0;
+		for (size_t i = 0; i < NUM_FIELDS; i++)
+			if (logs[0][t * NUM_FIELDS + i] != logs[1][t * NUM_FIELDS + i])
+				ranges |= 1u << i;
+		if (ranges)
+			return {(int64_t)t, ranges};
+	}
+	return {logs[0].size() == logs[1].size() ? -1 : (int64_t)(n / NUM_FIELDS), 0};
+}
+
+
+static std::string RangeNames(uint32_t ranges) {
+	std::string names;
+	for (size_t i = 0; i < NUM_FIELDS; i++) {
+		if (ranges & (1u << i))
+			names += std::string(names.empty() ? "" : ", ") + FIELD_NAMES[i];
+	}
+	return names.empty() ? "-" : names;
+}
+
+
+static bool CheckCase(const char* name, StateHasher& hasher, const std::vector<char>& a, const std::vector<char>& b, uint32_t expected_ranges) {
+	const std::vector<char>* msgs[2] = {&a, &b};
+	Divergence expected = BruteForce(hasher, msgs);
+	bool ok = expected.ranges == expected_ranges || expected_ranges == 0;
+	if (!ok)
+		std::cout << "  ERROR: " << name << ": brute force found " << RangeNames(expected.ranges) << "\n";
+
+	for (uint32_t interval : {600u, 37u}) {
+		for (uint32_t split : {2u, 4u}) {
+			DesyncBisector& bisect = g_pInfo->bisector;
+			DesyncBisector::Settings settings;
+			settings.checkpoint_interval = interval;
+			settings.split = split;
+			bisect.setScripts(a.data(), a.size(), b.data(), b.size());
+			bisect.start(settings);
+			bisector = &bisect;
+			sim::UnloadWorld();
+			sim::Stats st = sim::RunBisection();
+			bisector = nullptr;
+
+			bool match = bisect.phase() == DesyncBisector::Phase::Done && bisect.firstDivergence() == expected.tick
+				&& (expected.tick < 0 || bisect.differingRanges() == expected.ranges);
+			std::cout << "  " << name << " (interval " << interval << ", split " << split << "): ";
+			if (bisect.firstDivergence() < 0)
+				std::cout << "no divergence";
+			else
+				std::cout << "tick " << bisect.firstDivergence() << " in " << RangeNames(bisect.differingRanges());
+			std::cout << ", " << bisect.runsDone() << " runs, " << st.ticks << " ticks\n";
+			if (!match) {
+				std::cout << "  ERROR: expected ";
+				if (expected.tick < 0)
+					std::cout << "no divergence\n";
+				else
+					std::cout << "tick " << expected.tick << " in " << RangeNames(expected.ranges) << "\n";
+				ok = false;
+			}
+			if (st.tick_allocs > 0) {
+				std::cout << "  ERROR: allocations outside of map load\n";
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+
+int RunBisectCheck(const char* path) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> msg((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	ScriptData* data = msg.empty() ? nullptr : ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "Could not read a script from '" << path << "'\n";
+		return 1;
+	}
+
+	// The mock world doesn't take a tick while loading like the game's does, so a quick reset run
+	// is a tick off from one with a full load. Every run has to start the same way.
+	size_t map_len = strnlen(msg.data(), msg.size());
+	size_t player_len = strnlen(msg.data() + map_len + 1, msg.size() - map_len - 1);
+	msg[map_len + player_len + 2 + 12] &= ~1;
+
+	std::cout << path << ":\n";
+	sim::Init();
+	StateHasher& hasher = g_pInfo->state_hasher;
+	sim::FakeKart& k = sim::fake_kart;
+	hasher.addAddress(&k.x, sizeof(k.x));
+	hasher.addAddress(&k.z, sizeof(k.z));
+	hasher.addAddress(&k.heading, sizeof(k.heading));
+	hasher.addAddress(&k.speed, sizeof(k.speed));
+	hasher.addAddress(&k.keys_held, sizeof(k.keys_held));
+	sim::after_tick = &NudgeHeading;
+
+	sim::UnloadWorld();
+	uint64_t ticks = sim::RunScript(data).ticks;
+	std::cout << "  ticks:        " << ticks << "\n";
+
+	bool ok = CheckCase("same script", hasher, msg, msg, 0);
+
+	std::vector<char> changed_msg = msg;
+	if (ChangeOneInput(changed_msg))
+		ok &= CheckCase("changed input", hasher, msg, changed_msg, 0);
+
+	// a change that no input explains, only in the heading
+	nudge_tick = (int64_t)(ticks * 2 / 3);
+	ok &= CheckCase("nudged heading", hasher, msg, msg, HEADING_MASK);
+
+	// and after the last tick, where there's no checkpoint
+	nudge_tick = (int64_t)ticks - 1;
+	ok &= CheckCase("nudged at the end", hasher, msg, msg, HEADING_MASK);
+	nudge_tick = -1;
+
+	sim::after_tick = nullptr;
+	hasher.stop();
+	return ok ? 0 : 3;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Checks the desync bisector against the mock game with a script: the same script on both sides
+// has to find no divergence, and a changed input or a changed kart field on one side has to be
+// found at the same tick (and in the same fields) as hashing every tick of both runs would.
+// Also prints how many runs & ticks it took. Returns non-zero if any of the checks fail.
+int RunBisectCheck(const char* path);
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <vector>
+#include "buffer_bench.h"
+#include "sim_util.h"
+
+extern "C" {
+#include "../../Payload/src/minhook/src/os.h"
+#include "../../Payload/src/minhook/src/buffer.h"
+}
+
+/*
+* MinHook allocates a trampoline for every hook within a rel32 jump of the hooked function. Every
+* reservation used to search the address space from the function outwards, a query per region,
+* so with lots of hooks that's most of what hooking costs. Now the address space is looked at once
+* and reservations come from an index of the free ranges, so the number of snapshots shouldn't go
+* up with the number of buffers. The buffers are allocated near a function of ours, since there's
+* no game here.
+*/
+
+
+// the furthest that a trampoline can be from its target and still be reached with a rel32 jump
+static const int64_t MAX_REACH = 0x7fff0000;
+
+
+int RunBufferCheck(uint32_t num_buffers) {
+	// any function of ours will do as the target
+	char* target = (char*)&RunBufferCheck;
+	std::vector<void*> buffers(num_buffers);
+	bool ok = true;
+
+	InitializeBuffer();
+	double alloc_secs = sim::TimeSecs([&] {
+		for (void*& b : buffers)
+			b = AllocateBuffer(target);
+	});
+	BUFFER_STATS allocated;
+	GetBufferStats(&allocated);
+
+	uint32_t failed = 0, unreachable = 0;
+	for (void* b : buffers) {
+		if (!b)
+			failed++;
+		else if (std::abs((int64_t)((char*)b - target)) > MAX_REACH)
+			unreachable++;
+	}
+	if (failed || unreachable) {
+		std::cout << "  ERROR: " << failed << " buffers failed to allocate, " << unreachable << " are out of reach\n";
+		ok = false;
+	}
+
+	// what searching the address space around the target costs, which used to happen for every
+	// new block
+	OS_RANGE ranges[256];
+	UINT num_ranges = 0;
+	double snapshot_secs = sim::TimeSecs([&] {
+		num_ranges = OsQueryFreeRanges((ULONG_PTR)target - 0x40000000, (ULONG_PTR)target + 0x40000000, ranges, 256);
+	});
+
+	// every other one, then the rest, the blocks should be given back once they're empty
+	double free_secs = sim::TimeSecs([&] {
+		for (size_t i = 0; i < buffers.size(); i += 2)
+			if (buffers[i])
+				FreeBuffer(buffers[i]);
+		for (size_t i = 1; i < buffers.size(); i += 2)
+			if (buffers[i])
+				FreeBuffer(buffers[i]);
+	});
+	BUFFER_STATS freed;
+	GetBufferStats(&freed);
+	if (freed.committedBlocks != 0) {
+		std::cout << "  ERROR: " << freed.committedBlocks << " blocks are still committed after freeing every buffer\n";
+		ok = false;
+	}
+
+	// freed blocks get committed again without reserving anything new
+	void* again = AllocateBuffer(target);
+	BUFFER_STATS reused;
+	GetBufferStats(&reused);
+	if (!again || reused.reservedRegions != allocated.reservedRegions || reused.snapshots != allocated.snapshots) {
+		std::cout << "  ERROR: allocating after freeing everything didn't reuse a region\n";
+		ok = false;
+	}
+	UninitializeBuffer();
+	BUFFER_STATS uninitialized;
+	GetBufferStats(&uninitialized);
+	if (uninitialized.snapshots || uninitialized.reservedRegions || uninitialized.committedBlocks) {
+		std::cout << "  ERROR: the stats weren't reset when the buffers were uninitialized\n";
+		ok = false;
+	}
+
+	// a handful of snapshots at most (one, plus any that something else took a range from)
+	if (allocated.snapshots > 4) {
+		std::cout << "  ERROR: the address space was looked at " << allocated.snapshots << " times\n";
+		ok = false;
+	}
+
+	std::cout << num_buffers << " buffers:\n"
+		<< "  allocate:    " << alloc_secs * 1e9 / num_buffers << " ns/buffer\n"
+		<< "  free:        " << free_secs * 1e9 / num_buffers << " ns/buffer\n"
+		<< "  regions:     " << allocated.reservedRegions << " reserved, " << allocated.committedBlocks << " blocks committed\n"
+		<< "  snapshots:   " << allocated.snapshots << " (each " << snapshot_secs * 1e6 << " us, " << num_ranges << " free ranges)\n";
+	return ok ? 0 : 3;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+// Allocates num_buffers of MinHook's trampoline buffers near a function, checks that they're all
+// within a rel32 jump of it and that freeing them gives their memory back, and prints what it
+// cost. Returns non-zero if any of the checks fail.
+int RunBufferCheck(uint32_t num_buffers);
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "container_bench.h"
+#include "sim_util.h"
+#include "../../Payload/src/game_std.h"
+
+/*
+* The game frees what we put into its containers and we free what it put into them, so vec_wrap &
+* str_wrap have to grow and hand memory over the same way that libstdc++'s do, and only ever
+* through g_game_malloc & g_game_free. Those get pointed at an allocator that knows every block
+* that's live, which catches leaks, double frees and frees of memory that it didn't hand out.
+*/
+
+
+// the "game's" heap
+static std::unordered_map<void*, size_t> live;
+static uint64_t num_allocs = 0;
+static uint64_t bad_frees = 0;
+
+static void* TrackedMalloc(size_t size) {
+	void* p = malloc(size);
+	live[p] = size;
+	num_allocs++;
+	return p;
+}
+
+static void TrackedFree(void* ptr) {
+	if (!ptr)
+		return;
+	if (live.erase(ptr) == 0)
+		bad_frees++;
+	else
+		free(ptr);
+}
+
+
+static bool ok = true;
+
+static void Check(bool cond, const char* what) {
+	if (!cond) {
+		std::cout << "  ERROR: " << what << "\n";
+		ok = false;
+	}
+}
+
+
+static void CheckVector() {
+	std::vec_wrap<int> v;
+	bool grew_right = true;
+	for (int i = 0; i < 1000; i++) {
+		// like libstdc++, a full vector doubles (or goes to 1), which is the only time it allocates
+		size_t capacity = v.capacity();
+		size_t want = v.size() == capacity ? (capacity ? capacity * 2 : 1) : capacity;
+		uint64_t allocs_before = num_allocs;
+		v.push_back(i);
+		grew_right &= v.capacity() == want && num_allocs - allocs_before == (want != capacity ? 1u : 0u);
+	}
+	bool kept = true;
+	for (int i = 0; i < 1000; i++)
+		kept &= v[i] == i;
+	Check(grew_right, "vec_wrap didn't grow like std::vector");
+	Check(kept, "vec_wrap lost elements when it grew");
+	Check(live.size() == 1 && live.begin()->second == v.capacity() * sizeof(int), "vec_wrap kept its old storage around");
+
+	std::vec_wrap<int> reserved;
+	uint64_t allocs_before = num_allocs;
+	reserved.reserve(100);
+	for (int i = 0; i < 100; i++)
+		reserved.push_back(i);
+	Check(reserved.capacity() == 100 && num_allocs - allocs_before == 1, "vec_wrap allocated again after reserve()");
+	reserved.push_back(100);
+	Check(reserved.capacity() == 200, "vec_wrap didn't double after reserve()");
+
+	// moving hands the storage over without allocating, and assigning frees what was there
+	allocs_before = num_allocs;
+	std::vec_wrap<int> moved(std::move(v));
+	Check(moved.size() == 1000 && v.empty() && v.capacity() == 0, "moving a vec_wrap didn't take its elements");
+	reserved = std::move(moved);
+	Check(reserved.size() == 1000 && moved.capacity() == 0 && num_allocs == allocs_before && live.size() == 1, "move assigning a vec_wrap didn't free its old storage");
+
+	// an element of the vector itself, when pushing it makes the vector grow
+	std::vec_wrap<std::str_wrap> strings;
+	strings.emplace_back("a string that's too long to be local");
+	strings.push_back(strings[0]);
+	Check(strings.size() == 2 && strings[1] == "a string that's too long to be local", "pushing a vec_wrap's own element lost it");
+	strings.clear();
+	Check(strings.capacity() == 2 && live.size() == 2, "clearing a vec_wrap didn't free its strings");
+}
+
+
+static void CheckString() {
+	uint64_t allocs_before = num_allocs;
+	std::str_wrap s("123456789012345");
+	Check(s.isLocal() && s.capacity() == std::str_wrap::LOCAL_CAPACITY && num_allocs == allocs_before, "a 15 char str_wrap wasn't local");
+	s = "1234567890123456";
+	Check(!s.isLocal() && s.capacity() == 16 && num_allocs - allocs_before == 1, "a 16 char str_wrap wasn't on the heap");
+
+	// like std::string, a shorter string reuses the heap buffer instead of going back to the local one
+	allocs_before = num_allocs;
+	s = "short";
+	Check(!s.isLocal() && s == "short" && num_allocs == allocs_before, "assigning a short string didn't reuse the heap buffer");
+	s.assign(s.c_str() + 1, 3);
+	Check(s == "hor", "assigning part of a str_wrap to itself went wrong");
+
+	// moving a heap string steals its buffer, moving a local one copies it
+	std::str_wrap stolen(std::move(s));
+	Check(!stolen.isLocal() && stolen == "hor" && s.isLocal() && s.empty() && num_allocs == allocs_before, "moving a heap str_wrap didn't steal its buffer");
+	std::str_wrap local("local");
+	std::str_wrap moved(std::move(local));
+	Check(moved.isLocal() && moved == "local" && local.empty() && num_allocs == allocs_before, "moving a local str_wrap allocated");
+	std::str_wrap copy(stolen);
+	Check(copy.isLocal() && copy == "hor" && num_allocs == allocs_before, "a copy of a short string wasn't local");
+
+	moved.reserve(100);
+	Check(!moved.isLocal() && moved.capacity() == 100 && moved == "local" && num_allocs - allocs_before == 1, "reserve() didn't move the str_wrap to the heap");
+
+	// str_ref never allocates
+	allocs_before = num_allocs;
+	std::str_ref ref("a name that the arena owns");
+	const std::str_wrap& as_wrap = ref;
+	Check(as_wrap == "a name that the arena owns" && num_allocs == allocs_before, "str_ref copied its string");
+}
+
+
+int RunContainerCheck(uint32_t num_elements) {
+	void* (*prev_malloc)(size_t) = g_game_malloc;
+	void (*prev_free)(void*) = g_game_free;
+	g_game_malloc = &TrackedMalloc;
+	g_game_free = &TrackedFree;
+	CheckVector();
+	Check(live.empty(), "vec_wrap leaked");
+	CheckString();
+	Check(live.empty(), "str_wrap leaked");
+	Check(bad_frees == 0, "freed memory that g_game_malloc didn't hand out (or freed it twice)");
+	std::cout << "  game heap:    " << num_allocs << " allocations, " << live.size() << " left, " << bad_frees << " bad frees\n";
+	g_game_malloc = prev_malloc;
+	g_game_free = prev_free;
+
+	volatile int sink = 0;
+	double wrap_secs = sim::TimeSecs([&] {
+		std::vec_wrap<int> v;
+		for (uint32_t i = 0; i < num_elements; i++)
+			v.push_back((int)i);
+		sink = sink + (int)v.size();
+	});
+	double std_secs = sim::TimeSecs([&] {
+		std::vector<int> v;
+		for (uint32_t i = 0; i < num_elements; i++)
+			v.push_back((int)i);
+		sink = sink + (int)v.size();
+	});
+	std::cout << "  push_back:    " << wrap_secs / num_elements * 1e9 << " ns (std::vector: " << std_secs / num_elements * 1e9 << " ns)\n";
+	return ok ? 0 : 3;
+}
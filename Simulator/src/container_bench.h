@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+// Checks that vec_wrap grows the way the game's std::vector does and that str_wrap switches between
+// its local buffer and the heap the way the game's std::string does, all through g_game_malloc &
+// g_game_free without leaking, and times num_elements push_backs against std::vector's. Returns
+// non-zero if any of the checks fail.
+int RunContainerCheck(uint32_t num_elements);
@@ -0,0 +1,140 @@
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "governor_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+// the same made up frame as the pacing check, drawing every tick only keeps up at 2x
+static const sim::FrameCosts COSTS = {150, 4000, 0};
+static const int PHYSICS_FPS = 120;
+// how long the frame that hangs takes, longer than the pacer catches up on
+static const int HANG_MS = 150;
+// how far off a duration can be, a couple of ticks at 1x
+static const float MAX_ERROR_MS = 20;
+
+
+struct TestScript {
+	const char* name;
+	float duration;  // 0 for none
+	std::vector<Framebulk> framebulks;
+	std::vector<TimedAction> actions;
+	std::vector<RepeatBlock> repeats;
+	uint32_t expected_ticks;  // of inputs
+	uint32_t hang_tick;  // 0 for none
+};
+
+
+static std::vector<char> MakeScript(const TestScript& script) {
+	std::vector<char> msg = sim::ScriptHeader((script.actions.empty() ? 0 : ScriptData::FLAG_HAS_ACTIONS)
+		| (script.repeats.empty() ? 0 : ScriptData::FLAG_HAS_REPEATS) | (script.duration > 0 ? ScriptData::FLAG_HAS_DURATION : 0));
+	if (script.duration > 0)
+		sim::Append(msg, &script.duration, sizeof(script.duration));
+	uint32_t count = (uint32_t)script.actions.size();
+	if (count > 0) {
+		sim::Append(msg, &count, sizeof(count));
+		sim::Append(msg, script.actions.data(), count * sizeof(TimedAction));
+	}
+	count = (uint32_t)script.repeats.size();
+	if (count > 0) {
+		sim::Append(msg, &count, sizeof(count));
+		sim::Append(msg, script.repeats.data(), count * sizeof(RepeatBlock));
+	}
+	for (const Framebulk& fb : script.framebulks)
+		sim::Append(msg, &fb, Framebulk::FB_SIZE_BYTES);
+	return msg;
+}
+
+
+static Framebulk Ticks(uint16_t num_ticks) {
+	Framebulk fb = {};
+	fb.accel = true;
+	fb.num_ticks = num_ticks;
+	return fb;
+}
+
+
+static Framebulk Speed(float play_speed) {
+	Framebulk fb = {};
+	fb.set_speed = true;
+	fb.new_play_speed = play_speed;
+	return fb;
+}
+
+
+static uint32_t hang_tick = 0;
+
+static void Hang(uint32_t tick) {
+	if (hang_tick && tick == hang_tick)
+		platform::SleepMs(HANG_MS);
+}
+
+
+int RunGovernorCheck() {
+	sim::Init(PHYSICS_FPS);
+	sim::frame_costs = COSTS;
+	FramePacer& pacer = g_pInfo->pacer;
+	pacer.setRealTime(true);
+	sim::after_tick = &Hang;
+	bool ok = true;
+
+	TimedAction stop = {};
+	stop.tick = 300;
+	stop.type = TimedAction::Type::Stop;
+	const TestScript scripts[] = {
+		{"3 s in 0.5 s", 0.5f, {Ticks(360)}, {}, {}, 360, 0},
+		{"1 s in 1.5 s", 1.5f, {Ticks(120)}, {}, {}, 120, 0},
+		{"3 s in 1 s, hangs", 1, {Ticks(360)}, {}, {}, 360, 100},
+		{"playspeed 3, hangs", 0, {Speed(3), Ticks(360)}, {}, {}, 360, 100},
+		{"own playspeeds", 1, {Speed(0.25f), Ticks(120), Speed(0), Speed(30), Ticks(240)}, {}, {}, 360, 0},
+		// 2 * (3 * 40 + 20) + 60 = 340 ticks, less the ones after the Stop
+		{"repeats, stops", 0.5f, {Ticks(40), Ticks(20), Ticks(60)}, {stop}, {{0, 2, 2}, {0, 1, 3}}, 300, 0},
+	};
+
+	std::cout << "frame costs: " << COSTS.update_us << " us update, " << COSTS.render_us << " us draw (made up), "
+		<< "the hangs are " << HANG_MS << " ms\n" << std::fixed << std::setprecision(1);
+	for (const TestScript& script : scripts) {
+		std::vector<char> msg = MakeScript(script);
+		ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+		if (!data || data->total_ticks != script.expected_ticks) {
+			std::cout << "  ERROR: '" << script.name << "' counted " << (data ? data->total_ticks : 0) << " ticks instead of " << script.expected_ticks << "\n";
+			ScriptData::destroy(data);
+			ok = false;
+			continue;
+		}
+		sim::UnloadWorld();
+		pacer.reset();
+		hang_tick = script.hang_tick;
+		sim::RunScript(data);
+		ScriptManager::RunStats run = sim::GetScriptManager().runStats();
+
+		// the fixed playspeed is held to the duration that it would've had
+		float duration = script.duration > 0 ? script.duration : (float)script.expected_ticks / PHYSICS_FPS / 3;
+		float error_ms = run.us / 1e3f - duration * 1e3f;
+		std::cout << "  " << std::setw(20) << std::left << script.name << std::right << std::setw(7) << duration << " s, took "
+			<< std::setw(7) << run.us / 1e6f << " s (" << std::showpos << error_ms << std::noshowpos << " ms), "
+			<< run.ticks << " ticks\n";
+
+		// the run's ticks have the one that the script stops on too
+		if (run.ticks != script.expected_ticks + 1 || run.duration != script.duration) {
+			std::cout << "  ERROR: the run stats are wrong\n";
+			ok = false;
+		}
+		if (script.duration > 0 && std::fabs(error_ms) > MAX_ERROR_MS) {
+			std::cout << "  ERROR: the script didn't keep to its duration\n";
+			ok = false;
+		}
+		if (script.duration == 0 && error_ms < HANG_MS / 2) {
+			std::cout << "  ERROR: the fixed playspeed made up for the hang, it's not much of a comparison\n";
+			ok = false;
+		}
+	}
+
+	hang_tick = 0;
+	sim::after_tick = nullptr;
+	pacer.setRealTime(false);
+	sim::frame_costs = {};
+	return ok ? 0 : 3;
+}
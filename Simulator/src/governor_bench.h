@@ -0,0 +1,9 @@
+#pragma once
+
+// Runs made up scripts with a duration in real time on a mock game that's slow to draw: faster
+// and slower than 1x, with a frame that hangs partway through (and the same script at the fixed
+// playspeed that its duration comes out to), with playspeeds & pauses of its own, and with repeat
+// blocks & a Stop action. Reports how far off each one's duration was, and checks that they all
+// ended within a few ticks of it and that the tick counts from the framebulks were right.
+// Returns non-zero if any of the checks fail.
+int RunGovernorCheck();
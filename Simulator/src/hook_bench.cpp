@@ -0,0 +1,155 @@
+#include <iostream>
+#include "hook_bench.h"
+#include "sim_util.h"
+
+#include "../../Payload/src/minhook/include/MinHook.h"
+extern "C" {
+#include "../../Payload/src/minhook/src/os.h"
+}
+
+/*
+* The payload hooks most of the game's functions with MinHook, which overwrites the start of the
+* function with a jump to the detour, and the detour calls the original through a trampoline (the
+* overwritten instructions plus a jump back). LocalPlayerController::action is hooked by swapping
+* its vtable slot instead (see hooks::HookVTableSlot()), so the detour is called straight from the
+* game's virtual call and calls the original directly. This times a call to each sort of detour
+* against a call to the same function unhooked. Since there's no game here, the hooked functions
+* are ours.
+*/
+
+
+#ifdef _MSC_VER
+	#define NOINLINE __declspec(noinline)
+#else
+	#define NOINLINE __attribute__((noinline))
+#endif
+
+
+static bool ok = true;
+
+static void Check(bool cond, const char* what) {
+	if (!cond) {
+		std::cout << "  ERROR: " << what << "\n";
+		ok = false;
+	}
+}
+
+
+// made up work, long enough for MinHook to have a few instructions to move to the trampoline
+NOINLINE static int Mix(int x) {
+	uint32_t h = (uint32_t)x;
+	h ^= h >> 7;
+	h *= 0x2545f491;
+	return (int)(h ^ (h >> 13));
+}
+
+struct Target {
+	virtual int action(int x);
+};
+
+NOINLINE int Target::action(int x) {
+	return Mix(x) + 1;
+}
+
+
+typedef int(*MixFunc)(int);
+typedef int(*ActionFunc)(Target*, int);
+
+static MixFunc ORIG_Mix = nullptr;
+static ActionFunc ORIG_action = nullptr;
+static uint32_t mix_detour_calls = 0;
+static uint32_t action_detour_calls = 0;
+
+static int DETOUR_Mix(int x) {
+	mix_detour_calls++;
+	return ORIG_Mix(x);
+}
+
+// in place of a member function: the object comes first, which is where the ABI passes this
+static int DETOUR_action(Target* self, int x) {
+	action_detour_calls++;
+	return ORIG_action(self, x);
+}
+
+
+// like hooks.cpp's SwapVTableSlot(), which needs Windows
+static bool SwapSlot(void** slot, void* new_func) {
+	DWORD old_protect;
+	if (!OsBeginPatch(slot, sizeof(void*), &old_protect))
+		return false;
+	*slot = new_func;
+	OsEndPatch(slot, sizeof(void*), old_protect);
+	return true;
+}
+
+
+// the sum of num_calls calls, through pointers that the compiler can't see through so that it
+// can't inline the calls or skip the vtable
+static int CallMix(MixFunc volatile& func, uint32_t num_calls) {
+	int sum = 0;
+	for (uint32_t i = 0; i < num_calls; i++)
+		sum += func((int)i);
+	return sum;
+}
+
+static int CallAction(Target* volatile& obj, uint32_t num_calls) {
+	int sum = 0;
+	for (uint32_t i = 0; i < num_calls; i++)
+		sum += obj->action((int)i);
+	return sum;
+}
+
+
+int RunHookCheck(uint32_t num_calls) {
+	Target target;
+	Target* volatile obj = &target;
+	MixFunc volatile mix = &Mix;
+
+	int mix_sum = 0, action_sum = 0;
+	double mix_secs = sim::TimeSecs([&] { mix_sum = CallMix(mix, num_calls); });
+	double action_secs = sim::TimeSecs([&] { action_sum = CallAction(obj, num_calls); });
+
+	// an inline detour on Mix()
+	Check(MH_Initialize() == MH_OK, "MinHook didn't initialize");
+	Check(MH_CreateHook((LPVOID)&Mix, (LPVOID)&DETOUR_Mix, (LPVOID*)&ORIG_Mix) == MH_OK, "couldn't create the hook on Mix()");
+	Check(MH_EnableHook(MH_ALL_HOOKS) == MH_OK, "couldn't enable the hook on Mix()");
+	if (!ok) {
+		MH_Uninitialize();
+		return 3;
+	}
+	int detoured_sum = 0;
+	double detoured_secs = sim::TimeSecs([&] { detoured_sum = CallMix(mix, num_calls); });
+	Check(mix_detour_calls == num_calls, "the detour on Mix() missed calls");
+	Check(detoured_sum == mix_sum, "Mix() gave different results through its trampoline");
+	MH_DisableHook(MH_ALL_HOOKS);
+	MH_Uninitialize();
+	uint32_t calls_before = mix_detour_calls;
+	CallMix(mix, 100);
+	Check(mix_detour_calls == calls_before, "Mix() still went to the detour after unhooking");
+
+	// a vtable hook on Target::action(), which swaps the slot's function but leaves its code alone
+	void** slot = *(void***)&target;
+	void* original = *slot;
+	ORIG_action = (ActionFunc)original;
+	Check(SwapSlot(slot, (void*)&DETOUR_action), "couldn't make the vtable writable");
+	if (!ok)
+		return 3;
+	int swapped_sum = 0;
+	double swapped_secs = sim::TimeSecs([&] { swapped_sum = CallAction(obj, num_calls); });
+	Check(action_detour_calls == num_calls, "the vtable hook on Target::action() missed calls");
+	Check(swapped_sum == action_sum, "Target::action() gave different results through the vtable hook");
+
+	// the catch: calls that don't go through the vtable aren't hooked
+	calls_before = action_detour_calls;
+	obj->Target::action(1);
+	Check(action_detour_calls == calls_before, "a call that named Target::action() went through the vtable");
+
+	SwapSlot(slot, original);
+	CallAction(obj, 100);
+	Check(action_detour_calls == calls_before, "Target::action() still went to the detour after unhooking");
+
+	std::cout << num_calls << " calls:\n"
+		<< "  plain call:    " << mix_secs * 1e9 / num_calls << " ns, " << detoured_secs * 1e9 / num_calls << " ns with a MinHook detour\n"
+		<< "  virtual call:  " << action_secs * 1e9 / num_calls << " ns, " << swapped_secs * 1e9 / num_calls << " ns with its vtable slot swapped\n";
+	return ok ? 0 : 3;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+// Hooks a virtual function by swapping its vtable slot and a plain function with a MinHook detour,
+// checks that both detours see every call (and that unhooking puts things back), and prints what
+// a call costs with each over num_calls calls. Returns non-zero if any of the checks fail.
+int RunHookCheck(uint32_t num_calls);
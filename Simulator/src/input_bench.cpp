@@ -0,0 +1,103 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "input_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+/*
+* The made up cost of a key event in InputManager::input. The game looks the key up in each
+* device's bindings, checks the device's player and offers the event to the GUI before it gets to
+* the kart, a few microseconds is about what that much pointer chasing costs on a cold cache.
+*/
+static const uint32_t DISPATCH_US = 2;
+
+
+static sim::Stats Run(const std::vector<char>& msg, bool direct) {
+	sim::GetScriptManager().setDirectInput(direct);
+	return sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+}
+
+
+// ns per tick for runs runs of the script, each one with a full load
+static double NsPerTick(const std::vector<char>& msg, bool direct, int runs) {
+	uint64_t ticks = 0;
+	double secs = sim::TimeSecs([&] {
+		for (int i = 0; i < runs; i++) {
+			sim::UnloadWorld();
+			ticks += Run(msg, direct).ticks;
+		}
+	});
+	return ticks ? secs / ticks * 1e9 : 0;
+}
+
+
+int RunInputCheck(const char* path, int runs) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> msg((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	ScriptData* data = msg.empty() ? nullptr : ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "Could not read a script from '" << path << "'\n";
+		return 1;
+	}
+	ScriptData::destroy(data);
+
+	std::cout << path << ":\n";
+	sim::Init();
+	StateHasher& hasher = g_pInfo->state_hasher;
+	hasher.addAddress(&sim::fake_kart, sizeof(sim::fake_kart));
+	sim::record_events = true;
+	int ret = 0;
+
+	sim::UnloadWorld();
+	hasher.start();
+	sim::Stats dispatched = Run(msg, false);
+	std::vector<uint32_t> reference(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+	std::vector<sim::RecordedEvent> dispatched_events = sim::Events();
+
+	sim::UnloadWorld();
+	hasher.setReference(reference.data(), reference.size());
+	hasher.start();
+	sim::Stats direct = Run(msg, true);
+	std::vector<uint32_t> hashes(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+	int64_t divergence = hasher.stats().first_divergence;
+
+	std::cout << "  key events:   " << direct.events << ", " << direct.dispatched << " of them through InputManager::input ("
+		<< dispatched.dispatched << " without the direct path)\n"
+		<< "  hashes:       " << (divergence < 0 && hashes == reference ? "the same on all " + std::to_string(hashes.size()) + " ticks"
+			: "diverged at tick " + std::to_string(divergence)) << "\n";
+
+	if (divergence >= 0 || hashes != reference || sim::Events() != dispatched_events) {
+		std::cout << "  ERROR: the direct path changed the kart's state\n";
+		ret = 3;
+	}
+	// Only the first key (which shows which controller is the player's) goes through InputManager::input.
+	// This is what makes the direct path cheaper, the timings below are only reported since they're
+	// too close (and too noisy) to fail on.
+	if (dispatched.dispatched != dispatched.events || direct.dispatched == 0 || direct.dispatched >= direct.events / 2) {
+		std::cout << "  ERROR: the keys didn't go the way they should have\n";
+		ret = 3;
+	}
+
+	// a held key stays held, only the keys that change are sent
+	if (direct.events >= direct.ticks) {
+		std::cout << "  ERROR: keys that didn't change were sent again\n";
+		ret = 3;
+	}
+
+	hasher.stop();
+	sim::record_events = false;
+	double own_dispatched = NsPerTick(msg, false, runs);
+	double own_direct = NsPerTick(msg, true, runs);
+	sim::frame_costs.dispatch_us = DISPATCH_US;
+	double game_dispatched = NsPerTick(msg, false, runs);
+	double game_direct = NsPerTick(msg, true, runs);
+	sim::frame_costs = {};
+	sim::GetScriptManager().setDirectInput(true);
+
+	std::cout << "  per tick:     " << own_dispatched << " ns through InputManager::input, " << own_direct << " ns direct (the payload's side)\n"
+		<< "                " << game_dispatched / 1e3 << " us through InputManager::input, " << game_direct / 1e3 << " us direct (with "
+		<< DISPATCH_US << " us per event in the game, made up)\n";
+	return ret;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Runs a script with every key going through InputManager::input and then with them going
+// straight to the player's controller (see ScriptManager::setPlayerController()), and checks that
+// both runs have the same state hash on every tick and the same key events. Then reports what
+// the inputs cost per tick each way over runs runs: the payload's side on its own, and with a made
+// up cost for InputManager::input's trip through the bindings, devices & GUI. Returns non-zero if
+// any of the checks fail.
+int RunInputCheck(const char* path, int runs);
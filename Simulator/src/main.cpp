@@ -0,0 +1,330 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "mock_game.h"
+#include "scan_bench.h"
+#include "pointer_bench.h"
+#include "savestate_bench.h"
+#include "state_hash_bench.h"
+#include "bisect_bench.h"
+#include "record_bench.h"
+#include "timer_bench.h"
+#include "predicate_bench.h"
+#include "repeat_bench.h"
+#include "warm_load_bench.h"
+#include "prefetch_bench.h"
+#include "pacing_bench.h"
+#include "governor_bench.h"
+#include "input_bench.h"
+#include "steering_bench.h"
+#include "seed_bench.h"
+#include "buffer_bench.h"
+#include "container_bench.h"
+#include "hook_bench.h"
+
+
+/*
+* Runs scripts through the ScriptManager against the mock game and reports how fast it goes.
+* Scripts are read in the same format that the parser sends over IPC, use parser.py with the
+* -o flag to create them:
+*
+*   parser.py -p scripts/abyss.peng -o abyss.bin
+*   Simulator.exe -r 1000 abyss.bin
+*
+* Returns 2 if the payload did any heap allocations on a tick other than the one where the
+* map gets loaded, the game calls us every frame so that should never happen.
+*
+* With -s, benchmarks the memory scanner on that many MB of fake memory instead:
+*
+*   Simulator.exe -s 2048
+*
+* And with -p, checks & benchmarks the pointer scanner on a fake heap of that many MB:
+*
+*   Simulator.exe -p 256
+*
+* And with -v, checks & benchmarks savestates on that many MB of fake game memory:
+*
+*   Simulator.exe -v 512
+*
+* And with -H, checks that per-tick state hashes are the same for every run of a script (and
+* catch a changed input), and reports what hashing costs per tick:
+*
+*   Simulator.exe -H -r 100 abyss.bin
+*
+* And with -B, checks that the desync bisector finds where two runs of a script first differ
+* (with a changed input, or with a kart field nudged in the second run):
+*
+*   Simulator.exe -B abyss.bin
+*
+* And with -R, records that many minutes of made up input after a script, and checks that the
+* script plus the recording plays back the same way:
+*
+*   Simulator.exe -R 30 abyss.bin
+*
+* And with -T, checks & benchmarks scheduling that many timed actions for a script:
+*
+*   Simulator.exe -T 1000000
+*
+* And with -P, checks reactive scripts' conditions and benchmarks them on a script that's that
+* many ticks long:
+*
+*   Simulator.exe -P 1000000
+*
+* And with -L, checks that that many made up scripts with repeat blocks send the same inputs as
+* they do with their blocks written out:
+*
+*   Simulator.exe -L 1000
+*
+* And with -W, checks that scripts for the race that's already loaded reset the world instead of
+* loading the map again, and that other scripts still load it:
+*
+*   Simulator.exe -W abyss.bin
+*
+* And with -F, checks the asset prefetcher & times map loads with and without it, on a made up
+* data dir with a track & kart of that many MB (Linux only):
+*
+*   Simulator.exe -F 256
+*
+* And with -D, checks that scripts at high playspeeds keep to them in real time by only drawing
+* some of their ticks:
+*
+*   Simulator.exe -D
+*
+* And with -G, checks that scripts with a duration take that long, also when a frame hangs:
+*
+*   Simulator.exe -G
+*
+* And with -I, checks that the script's keys going straight to the player's controller give the
+* same state hashes as them going through InputManager::input, and compares what each costs:
+*
+*   Simulator.exe -I [-r runs] abyss.bin
+*
+* And with -A, checks that turn angles in between steer part of the way:
+*
+*   Simulator.exe -A
+*
+* And with -S, checks that a script with a seed has the same state hashes on every run, even with
+* random item boxes:
+*
+*   Simulator.exe -S [-r runs] abyss.bin
+*
+* And with -M, checks & benchmarks allocating that many of MinHook's trampoline buffers:
+*
+*   Simulator.exe -M 100000
+*
+* And with -C, checks that the payload's std::string & std::vector replacements grow & free the
+* way the game's do, and times that many push_backs:
+*
+*   Simulator.exe -C 1000000
+*
+* And with -V, checks a vtable hook & a MinHook detour on functions of ours, and compares what
+* that many calls cost through each:
+*
+*   Simulator.exe -V 10000000
+*/
+
+
+static bool ReadFile(const char* path, std::vector<char>& out) {
+	std::ifstream f(path, std::ios::binary);
+	if (!f)
+		return false;
+	out.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return true;
+}
+
+
+static void PrintUsage() {
+	std::cout << "usage: Simulator [-r runs] script.bin [script.bin ...]\n"
+		"       Simulator -s scan_size_mb\n"
+		"       Simulator -p heap_size_mb\n"
+		"       Simulator -v memory_size_mb\n"
+		"       Simulator -H [-r runs] script.bin\n"
+		"       Simulator -B script.bin\n"
+		"       Simulator -R minutes script.bin\n"
+		"       Simulator -T num_actions\n"
+		"       Simulator -P num_ticks\n"
+		"       Simulator -L num_scripts\n"
+		"       Simulator -W script.bin\n"
+		"       Simulator -F data_size_mb\n"
+		"       Simulator -D\n"
+		"       Simulator -G\n"
+		"       Simulator -I [-r runs] script.bin\n"
+		"       Simulator -A\n"
+		"       Simulator -S [-r runs] script.bin\n"
+		"       Simulator -M num_buffers\n"
+		"       Simulator -C num_elements\n"
+		"       Simulator -V num_calls\n";
+}
+
+
+int main(int argc, char* argv[]) {
+
+	int runs = 100;
+	bool check_hashes = false;
+	bool check_bisect = false;
+	bool check_warm_load = false;
+	bool check_input = false;
+	bool check_seed = false;
+	uint32_t record_minutes = 0;
+	std::vector<const char*> paths;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-r" && i + 1 < argc) {
+			runs = std::stoi(argv[++i]);
+		} else if (arg == "-s" && i + 1 < argc) {
+			return RunScanBenchmark(std::stoul(argv[++i]));
+		} else if (arg == "-p" && i + 1 < argc) {
+			return RunPointerScanBenchmark(std::stoul(argv[++i]));
+		} else if (arg == "-v" && i + 1 < argc) {
+			return RunSaveStateBenchmark(std::stoul(argv[++i]));
+		} else if (arg == "-T" && i + 1 < argc) {
+			return RunTimerWheelBenchmark(std::stoul(argv[++i]));
+		} else if (arg == "-P" && i + 1 < argc) {
+			return RunPredicateBenchmark(std::stoul(argv[++i]));
+		} else if (arg == "-D") {
+			return RunPacingCheck();
+		} else if (arg == "-G") {
+			return RunGovernorCheck();
+		} else if (arg == "-A") {
+			return RunSteeringCheck();
+		} else if (arg == "-M" && i + 1 < argc) {
+			return RunBufferCheck(std::stoul(argv[++i]));
+		} else if (arg == "-C" && i + 1 < argc) {
+			return RunContainerCheck(std::stoul(argv[++i]));
+		} else if (arg == "-V" && i + 1 < argc) {
+			return RunHookCheck(std::stoul(argv[++i]));
+		} else if (arg == "-L" && i + 1 < argc) {
+			return RunRepeatCheck(std::stoul(argv[++i]));
+		} else if (arg == "-F" && i + 1 < argc) {
+			return RunPrefetchCheck(std::stoul(argv[++i]));
+		} else if (arg == "-H") {
+			check_hashes = true;
+		} else if (arg == "-B") {
+			check_bisect = true;
+		} else if (arg == "-W") {
+			check_warm_load = true;
+		} else if (arg == "-I") {
+			check_input = true;
+		} else if (arg == "-S") {
+			check_seed = true;
+		} else if (arg == "-R" && i + 1 < argc) {
+			record_minutes = std::stoul(argv[++i]);
+		} else if (arg[0] == '-') {
+			PrintUsage();
+			return 1;
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+
+	if (paths.empty() || runs <= 0) {
+		PrintUsage();
+		return 1;
+	}
+
+	if (check_hashes) {
+		int ret = 0;
+		for (const char* path : paths)
+			if (int r = RunStateHashCheck(path, runs))
+				ret = r;
+		return ret;
+	}
+
+	if (record_minutes > 0) {
+		int ret = 0;
+		for (const char* path : paths)
+			if (int r = RunRecordCheck(path, record_minutes))
+				ret = r;
+		return ret;
+	}
+
+	if (check_bisect) {
+		int ret = 0;
+		for (const char* path : paths)
+			if (int r = RunBisectCheck(path))
+				ret = r;
+		return ret;
+	}
+
+	if (check_warm_load) {
+		int ret = 0;
+		for (const char* path : paths)
+			if (int r = RunWarmLoadCheck(path))
+				ret = r;
+		return ret;
+	}
+
+	if (check_input) {
+		int ret = 0;
+		for (const char* path : paths)
+			if (int r = RunInputCheck(path, runs))
+				ret = r;
+		return ret;
+	}
+
+	if (check_seed) {
+		int ret = 0;
+		for (const char* path : paths)
+			if (int r = RunSeedCheck(path, runs))
+				ret = r;
+		return ret;
+	}
+
+	sim::Init();
+	bool allocated_on_tick = false;
+
+	for (const char* path : paths) {
+		std::vector<char> msg;
+		if (!ReadFile(path, msg) || msg.empty()) {
+			std::cout << "Could not read '" << path << "'\n";
+			return 1;
+		}
+
+		// every script starts from an unloaded world, so the first run always does a full load and
+		// the others reset the world
+		sim::UnloadWorld();
+		sim::Stats total;
+
+		auto start = std::chrono::steady_clock::now();
+		uint64_t msg_allocs = 0;
+		for (int i = 0; i < runs; i++) {
+			uint64_t allocs_before = sim::num_allocs;
+			ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+			if (!data) {
+				std::cout << "Bad script message in '" << path << "'\n";
+				return 1;
+			}
+			msg_allocs += sim::num_allocs - allocs_before;
+			sim::Stats stats = sim::RunScript(data);
+			total.ticks += stats.ticks;
+			total.events += stats.events;
+			total.full_loads += stats.full_loads;
+			total.quick_resets += stats.quick_resets;
+			total.load_allocs += stats.load_allocs;
+			total.tick_allocs += stats.tick_allocs;
+		}
+		double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << path << ":\n"
+			<< "  ticks/run:    " << total.ticks / runs << "\n"
+			<< "  events/tick:  " << (double)total.events / total.ticks << "\n"
+			<< "  full loads:   " << total.full_loads << "\n"
+			<< "  quick resets: " << total.quick_resets << "\n"
+			<< "  ticks/sec:    " << (uint64_t)(total.ticks / secs) << "\n"
+			<< "  allocs/msg:   " << (double)msg_allocs / runs << "\n"
+			<< "  allocs/load:  " << (double)total.load_allocs / runs << "\n"
+			<< "  allocs/tick:  " << (double)total.tick_allocs / total.ticks << "\n"
+			<< "  script mem:   " << Arena::peakReserved() << " bytes (peak)\n";
+
+		if (total.tick_allocs > 0) {
+			std::cout << "  ERROR: allocations outside of map load\n";
+			allocated_on_tick = true;
+		}
+	}
+
+	return allocated_on_tick ? 2 : 0;
+}
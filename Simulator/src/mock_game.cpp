@@ -0,0 +1,444 @@
+#include <iostream>
+#include "mock_game.h"
+#include "../../Payload/src/platform.h"
+#include "../../Payload/src/global_info.h"
+
+
+// the simulator is the payload without the hooks being installed, the detours (and the hooks::
+// globals & ORIG_ functions in detours.cpp) get called & pointed at the mock game directly
+GlobalInfo* g_pInfo = nullptr;
+
+
+void QueueExit(const char* reason) {
+	// there's nothing to unload, and nothing in the simulator should get here
+	std::cout << "QueueExit: " << (reason ? reason : "no reason") << "\n";
+}
+
+
+namespace sim {
+
+	bool record_events = false;
+	FakeKart fake_kart = {};
+	void (*after_tick)(uint32_t tick) = nullptr;
+	void (*on_full_load)(const char* map, const char* kart) = nullptr;
+	FrameCosts frame_costs = {};
+	uint32_t item_box_ticks = 0;
+
+	static std::vector<RecordedEvent> events;
+	static Stats stats;
+	static uint32_t cur_tick = 0;
+
+	/*
+	* The fake game objects. Some of the structs in game_structures.h don't have a default
+	* constructor (or are only forward declared), so these are just zeroed buffers that are
+	* big enough. The game never sees them, so the layout only matters for the fields that
+	* the payload reads & writes.
+	*/
+
+	alignas(RaceManager) static char race_manager_obj[sizeof(RaceManager)];
+	alignas(InputManager) static char input_manager_obj[sizeof(InputManager)];
+	alignas(DeviceManager) static char device_manager_obj[sizeof(DeviceManager)];
+	alignas(PlayerManager) static char player_manager_obj[sizeof(PlayerManager)];
+	alignas(STKConfig) static char stk_config_obj[sizeof(STKConfig)];
+	alignas(void*) static char state_manager_obj[64];
+	alignas(void*) static char main_loop_obj[64];
+	alignas(void*) static char player_profile_obj[64];
+	alignas(void*) static char input_device_obj[64];
+	alignas(void*) static char player_controller_obj[64];
+
+	// the first thing in World is its vtable, World::reset is at index 2
+	static void* world_vtable[8];
+	static void* world_obj[16] = {world_vtable};
+
+	static RaceManager* p_race_manager = (RaceManager*)race_manager_obj;
+	static InputManager* p_input_manager = (InputManager*)input_manager_obj;
+	static PlayerManager* p_player_manager = (PlayerManager*)player_manager_obj;
+	static StateManager* p_state_manager = (StateManager*)state_manager_obj;
+	static MainLoop* p_main_loop = (MainLoop*)main_loop_obj;
+	static STKConfig* p_stk_config = (STKConfig*)stk_config_obj;
+	static World* p_world = nullptr;
+	static bool is_no_graphics = false;
+	// the kart that the next race will be loaded with, and the race that the world was loaded with
+	static std::string player_kart;
+	static LoadedRace loaded_race;
+
+
+	// the game's random numbers, the CRT's is the same LCG as MSVC's rand()
+
+	static uint32_t crt_random_state = 1;
+	static const uint32_t NUM_ITEMS = 4;
+
+	static void Mockcrt_srand(unsigned int seed) {
+		crt_random_state = seed;
+	}
+
+	static int Mockcrt_rand() {
+		crt_random_state = crt_random_state * 214013 + 2531011;
+		return (crt_random_state >> 16) & 0x7fff;
+	}
+
+	// the game's calls go through the detours
+
+	static void GameSrand(unsigned int seed) {
+		hooks::DETOUR_crt_srand(seed);
+	}
+
+	static int GameRand() {
+		return hooks::DETOUR_crt_rand();
+	}
+
+
+	// the fake kart
+
+	enum KeyBit : uint32_t {
+		KEY_ACCEL = 1 << 0,
+		KEY_BRAKE = 1 << 1,
+		KEY_LEFT  = 1 << 2,
+		KEY_RIGHT = 1 << 3,
+		KEY_FIRE  = 1 << 4,
+		KEY_NITRO = 1 << 5,
+		KEY_SKID  = 1 << 6,
+	};
+
+	// the game's default key bindings, and the bit of each action in FakeKart::keys_held
+	struct Binding {
+		EKEY_CODE key;
+		PlayerAction action;
+		uint32_t bit;
+	};
+
+	static const Binding BINDINGS[] = {
+		{IRR_KEY_UP, PA_ACCEL, KEY_ACCEL},
+		{IRR_KEY_DOWN, PA_BRAKE, KEY_BRAKE},
+		{IRR_KEY_LEFT, PA_STEER_LEFT, KEY_LEFT},
+		{IRR_KEY_RIGHT, PA_STEER_RIGHT, KEY_RIGHT},
+		{IRR_KEY_SPACE, PA_FIRE, KEY_FIRE},
+		{IRR_KEY_N, PA_NITRO, KEY_NITRO},
+		{IRR_KEY_V, PA_DRIFT, KEY_SKID},
+	};
+
+	static const Binding* FindBinding(EKEY_CODE key) {
+		for (const Binding& b : BINDINGS)
+			if (b.key == key)
+				return &b;
+		return nullptr;
+	}
+
+	static const Binding* FindBinding(PlayerAction action) {
+		for (const Binding& b : BINDINGS)
+			if (b.action == action)
+				return &b;
+		return nullptr;
+	}
+
+	static void ResetFakeKart() {
+		fake_kart = {};
+	}
+
+	static void StepFakeKart() {
+		float dt = 1.0f / p_stk_config->m_physics_fps;
+		FakeKart& k = fake_kart;
+		float max_speed = (k.keys_held & KEY_NITRO) ? 30.0f : 20.0f;
+		if (k.keys_held & KEY_ACCEL)
+			k.speed += 10.0f * dt;
+		else if (k.keys_held & KEY_BRAKE)
+			k.speed -= 20.0f * dt;
+		else
+			k.speed -= 2.0f * dt;
+		k.speed = k.speed < 0 ? 0 : k.speed > max_speed ? max_speed : k.speed;
+		k.heading += k.steer * ((k.keys_held & KEY_SKID) ? 2.0f : 1.0f) * dt;
+		if (k.item && (k.keys_held & KEY_FIRE)) {
+			k.speed += k.item * 2.0f;
+			k.item = 0;
+		}
+		if (item_box_ticks && cur_tick % item_box_ticks == 0) {
+			k.item = 1 + GameRand() % NUM_ITEMS;
+			k.bump = (GameRand() % 201 - 100) * 1e-4f;
+			k.heading += k.bump;
+		}
+		// a cheap stand-in for sin/cos, it only has to depend on the heading
+		k.x += k.speed * dt * (1.0f - k.heading * k.heading * 0.5f);
+		k.z += k.speed * dt * k.heading;
+	}
+
+
+	// mock game functions
+
+	static void BusyWait(uint32_t us) {
+		if (us == 0)
+			return;
+		uint64_t end = platform::TickCountUs() + us;
+		while (platform::TickCountUs() < end) {}
+	}
+
+	static bool MockLocalPlayerController__action(LocalPlayerController* thisptr, PlayerAction action, int value, bool dry_run) {
+		const Binding* binding = FindBinding(action);
+		if (!binding || dry_run)
+			return binding != nullptr;
+		stats.events++;
+		uint32_t bit = binding->bit;
+		bool down = value != 0;
+		FakeKart& k = fake_kart;
+		k.keys_held = down ? k.keys_held | bit : k.keys_held & ~bit;
+		// like the game's PlayerController, letting go of one direction goes back to the other
+		if (bit == KEY_LEFT) {
+			k.steer_left = value;
+			k.steer = -(float)(down ? value : -k.steer_right) / INPUT_MAX_VALUE;
+		} else if (bit == KEY_RIGHT) {
+			k.steer_right = value;
+			k.steer = (float)(down ? value : -k.steer_left) / INPUT_MAX_VALUE;
+		}
+		if (record_events)
+			events.push_back({cur_tick, binding->key, down});
+		return true;
+	}
+
+	// the bindings & devices are made up, key events for the kart end up at its controller through the detour
+	static EventPropagation MockInputManager__input(InputManager* thisptr, SEvent& event) {
+		stats.dispatched++;
+		BusyWait(frame_costs.dispatch_us);
+		const Binding* binding = event.EventType == EET_KEY_INPUT_EVENT ? FindBinding(event.KeyInput.Key) : nullptr;
+		if (binding) {
+			LocalPlayerController* controller = (LocalPlayerController*)player_controller_obj;
+			hooks::DETOUR_LocalPlayerController__action(controller, binding->action, event.KeyInput.PressedDown ? INPUT_MAX_VALUE : 0, false);
+		}
+		return EVENT_LET;
+	}
+
+	static void MockRaceManager__startSingleRace(RaceManager* thisptr, const std::str_wrap& track_ident, const int num_laps, bool from_overworld) {
+		stats.full_loads++;
+		p_world = (World*)world_obj;
+		loaded_race.map.assign(track_ident.ptr, track_ident.len);
+		loaded_race.kart = player_kart;
+		loaded_race.laps = num_laps;
+		loaded_race.difficulty = thisptr->m_difficulty;
+		if (on_full_load)
+			on_full_load(loaded_race.map.c_str(), loaded_race.kart.c_str());
+		// the game picks the AI karts at random, then the mock seeds rand() with the time, to stand in
+		// for any seeding that the game does while a script runs
+		for (int i = 0; i < 3; i++)
+			GameRand();
+		GameSrand((unsigned int)platform::TickCountUs());
+		ResetFakeKart();
+	}
+
+	static InputDevice* MockDeviceManager__getLatestUsedDevice(DeviceManager* thisptr) {
+		return (InputDevice*)input_device_obj;
+	}
+
+	static int MockStateManager__createActivePlayer(StateManager* thisptr, PlayerProfile* profile, InputDevice* device) {
+		return 0;
+	}
+
+	static void MockRaceManager__setPlayerKart(RaceManager* thisptr, uint32_t player_id, const std::str_wrap& kart_name) {
+		player_kart.assign(kart_name.ptr, kart_name.len);
+	}
+
+	static void MockDeviceManager__setAssignMode(DeviceManager* thisptr, const PlayerAssignMode assignMode) {}
+
+	static float MockMainLoop__getLimitedDt(MainLoop* thisptr) {
+		return 1.0f / p_stk_config->m_physics_fps;
+	}
+
+	static void MockRaceManager__exitRace(RaceManager* thisptr, bool delete_world) {
+		if (delete_world)
+			p_world = nullptr;
+	}
+
+	static void MockStateManager__resetActivePlayers(StateManager* thisptr) {}
+
+	static void MockWorld__reset(World* thisptr, bool restart) {
+		stats.quick_resets++;
+		ResetFakeKart();
+	}
+
+
+	void Init(int physics_fps) {
+		using namespace hooks;
+
+		delete g_pInfo;
+		g_pInfo = new GlobalInfo(nullptr);
+		// the mock game takes no time, scripts run as fast as they can unless a test turns this on
+		g_pInfo->pacer.setRealTime(false);
+		// RaceManager has containers in it, so it needs to be constructed properly
+		new (race_manager_obj) RaceManager();
+		p_input_manager->m_device_manager = (DeviceManager*)device_manager_obj;
+		p_player_manager->m_current_player = (PlayerProfile*)player_profile_obj;
+		p_stk_config->m_physics_fps = physics_fps;
+		world_vtable[2] = (void*)&MockWorld__reset;
+		// there's no exe, scripts' fields are read from the fake kart instead
+		g_pInfo->script_mgr.setModule((const char*)&fake_kart, sizeof(fake_kart));
+
+		g_race_manager = &p_race_manager;
+		input_manager = &p_input_manager;
+		m_player_manager = &p_player_manager;
+		state_manager_singleton = &p_state_manager;
+		main_loop = &p_main_loop;
+		stk_config = &p_stk_config;
+		m_world = &p_world;
+		g_is_no_graphics = &is_no_graphics;
+
+		#define SET_MOCK_FUNC(name) ORIG_##name = &Mock##name;
+
+		SET_MOCK_FUNC(InputManager__input);
+		SET_MOCK_FUNC(LocalPlayerController__action);
+		SET_MOCK_FUNC(RaceManager__startSingleRace);
+		SET_MOCK_FUNC(DeviceManager__getLatestUsedDevice);
+		SET_MOCK_FUNC(StateManager__createActivePlayer);
+		SET_MOCK_FUNC(RaceManager__setPlayerKart);
+		SET_MOCK_FUNC(DeviceManager__setAssignMode);
+		SET_MOCK_FUNC(MainLoop__getLimitedDt);
+		SET_MOCK_FUNC(RaceManager__exitRace);
+		SET_MOCK_FUNC(StateManager__resetActivePlayers);
+		SET_MOCK_FUNC(crt_srand);
+		SET_MOCK_FUNC(crt_rand);
+
+		#undef SET_MOCK_FUNC
+
+		// like the game does on startup
+		GameSrand((unsigned int)platform::TickCountUs());
+	}
+
+
+	const std::vector<RecordedEvent>& Events() {
+		return events;
+	}
+
+
+	// the game's frame after getLimitedDt(): the race's update (if there's a world & time passed),
+	// the render (unless it's off), and the sounds & GUI
+	static void RestOfFrame(float dt) {
+		if (dt > 0 && p_world) {
+			StepFakeKart();
+			BusyWait(frame_costs.update_us);
+		}
+		if (!is_no_graphics)
+			BusyWait(frame_costs.render_us);
+	}
+
+
+	/*
+	* One frame of the game's main loop. DETOUR_MainLoop__getLimitedDt_Func does the script's tick
+	* (or the recorder's, or starts a bisection run) and picks the timestep, then the rest of the
+	* frame happens. Returns whether the race moved on a tick, which is what the stats count.
+	*/
+	static bool Frame() {
+		uint64_t allocs_before = num_allocs;
+		float dt = hooks::DETOUR_MainLoop__getLimitedDt_Func(p_main_loop);
+		bool ticked = dt > 0 && p_world;
+		RestOfFrame(dt);
+		if (!ticked)
+			return false;
+		if (after_tick)
+			after_tick(cur_tick);
+		(cur_tick == 0 ? stats.load_allocs : stats.tick_allocs) += num_allocs - allocs_before;
+		cur_tick++;
+		return true;
+	}
+
+
+	// the tick of the last position that the script had before a frame
+	static uint32_t last_pos_tick = 0;
+
+
+	// frames until the script is done, a paused one is stopped since the game would just wait for
+	// the next script
+	static void RunFrames() {
+		ScriptManager& script_mgr = g_pInfo->script_mgr;
+		while (script_mgr.runningScript()) {
+			ScriptManager::Position pos;
+			if (script_mgr.getPosition(pos))
+				last_pos_tick = pos.tick;
+			if (!Frame() && script_mgr.runningScript() && script_mgr.getPlaySpeed() == 0)
+				script_mgr.stopScript();
+		}
+	}
+
+
+	Stats RunScript(ScriptData* data) {
+		stats = Stats();
+		events.clear();
+		cur_tick = 0;
+		g_pInfo->script_mgr.setNewScript(data);
+		RunFrames();
+		stats.ticks = cur_tick;
+		return stats;
+	}
+
+
+	Stats RunBisection() {
+		Stats total;
+		events.clear();
+		for (;;) {
+			// The mock world doesn't take a tick while loading like the game's does, so a run that
+			// resets the world would be a tick off from the first one. Every run loads it instead.
+			p_world = nullptr;
+			// with no script running, the detour's frame finishes the last run & starts the next one
+			Frame();
+			if (!g_pInfo->script_mgr.runningScript())
+				break;
+			stats = Stats();
+			cur_tick = 0;
+			RunFrames();
+			total.ticks += cur_tick;
+			total.events += stats.events;
+			total.full_loads += stats.full_loads;
+			total.quick_resets += stats.quick_resets;
+			total.load_allocs += stats.load_allocs;
+			total.tick_allocs += stats.tick_allocs;
+		}
+		return total;
+	}
+
+
+	void SetActionHandler(void (*handler)(const TimedAction&)) {
+		g_pInfo->script_mgr.setActionHandler(handler);
+	}
+
+
+	ScriptManager& GetScriptManager() {
+		return g_pInfo->script_mgr;
+	}
+
+
+	void PressKey(EKEY_CODE key, bool pressed) {
+		SEvent e = {};
+		e.EventType = EET_KEY_INPUT_EVENT;
+		e.KeyInput.Key = key;
+		e.KeyInput.PressedDown = pressed;
+		hooks::DETOUR_InputManager__input(p_input_manager, e);
+	}
+
+
+	Stats RunRecording(ScriptData* data, uint32_t ticks, void (*human)(uint32_t tick)) {
+		RunScript(data);
+		// the script's last tick (where it let go of every key) was the one after the last position
+		uint32_t replay_tick = last_pos_tick + 1;
+		for (uint32_t i = 0; i < ticks; i++) {
+			uint64_t allocs_before = num_allocs;
+			// the detour doesn't hash the recorder's ticks, a replay would
+			g_pInfo->state_hasher.tick(replay_tick);
+			stats.tick_allocs += num_allocs - allocs_before;
+			Frame();
+			human(i);
+			replay_tick++;
+		}
+		stats.ticks = cur_tick;
+		return stats;
+	}
+
+
+	void UnloadWorld() {
+		p_world = nullptr;
+	}
+
+
+	const LoadedRace& GetLoadedRace() {
+		return loaded_race;
+	}
+
+
+	void ExitRace() {
+		hooks::DETOUR_RaceManager__exitRace(p_race_manager, true);
+	}
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "../../Payload/src/hooks.h"
+#include "../../Payload/src/script_data.h"
+#include "../../Payload/src/global_info.h"
+
+/*
+* A fake version of the game that's just enough for the payload to run. All of the hooks::
+* globals get pointed at zeroed objects that have the same layout as the ones in
+* game_structures.h, and all of the ORIG_ functions get pointed at mock functions that keep
+* track of what the payload asked the game to do. The mock game's main loop calls the detours
+* from detours.cpp the way the hooked game would, with g_pInfo's objects behind them. There's
+* no physics or rendering, and the pacer doesn't keep to real time (see
+* FramePacer::setRealTime()), so scripts run as fast as the payload can go - this is meant for
+* benchmarking and for checking that changes to the payload don't change the inputs that it
+* sends.
+*/
+
+namespace sim {
+
+	// a key event as it got to the player's controller (as the key that its action is bound to)
+	struct RecordedEvent {
+		uint32_t tick;
+		EKEY_CODE key;
+		bool pressed;
+
+		bool operator==(const RecordedEvent& o) const {
+			return tick == o.tick && key == o.key && pressed == o.pressed;
+		}
+	};
+
+	struct Stats {
+		// number of frames where the race moved on (a tick of the script, or of the recorder)
+		uint64_t ticks = 0;
+		// number of key events that got to the player's controller
+		uint64_t events = 0;
+		// number of those that went through InputManager::input, see ScriptManager::setPlayerController()
+		uint64_t dispatched = 0;
+		// number of calls to RaceManager::startSingleRace
+		uint32_t full_loads = 0;
+		// number of calls to World::reset
+		uint32_t quick_resets = 0;
+		// heap allocations during the first tick (that's when the map gets loaded)
+		uint64_t load_allocs = 0;
+		// heap allocations during all other ticks, this should always be 0
+		uint64_t tick_allocs = 0;
+	};
+
+	/*
+	* A stand-in for the kart's physics state. It speeds up, slows down and turns with the keys
+	* that are held, once per tick, so its state depends on every input the script has sent.
+	* It's reset whenever the map is (re)loaded.
+	*/
+	struct FakeKart {
+		float x, z;
+		float heading;
+		float speed;
+		uint32_t keys_held;  // one bit per key from the script, see BINDINGS in mock_game.cpp
+		float steer;         // -1 to 1, if both directions are held the last one pressed wins
+		// how far each direction is held, 0 to INPUT_MAX_VALUE (the keyboard only does all or nothing)
+		int steer_left, steer_right;
+		uint32_t item;       // from the last item box (see item_box_ticks), 0 for none
+		float bump;          // how much the last item box turned the kart
+
+		// field by field, so that a steer of 0 is the same as -0
+		bool operator==(const FakeKart& o) const {
+			return x == o.x && z == o.z && heading == o.heading && speed == o.speed && keys_held == o.keys_held &&
+				steer == o.steer && steer_left == o.steer_left && steer_right == o.steer_right && item == o.item && bump == o.bump;
+		}
+	};
+
+	extern FakeKart fake_kart;
+
+	// if set, called at the end of every tick (after the fake kart has moved), for messing with
+	// the game's state in tests
+	extern void (*after_tick)(uint32_t tick);
+
+	// if set, called by every full load with the map & kart, for standing in for the game reading
+	// their files
+	extern void (*on_full_load)(const char* map, const char* kart);
+
+	/*
+	* Made up costs (microseconds of busy waiting) of the game's frame: the race's update, which
+	* always happens, and rendering, which the game skips while *g_is_no_graphics is set. dispatch_us is
+	* InputManager::input's trip through the key bindings, devices & GUI, for each key event that
+	* goes through it. They're all 0 unless a test sets them.
+	*/
+	struct FrameCosts {
+		uint32_t update_us;
+		uint32_t render_us;
+		uint32_t dispatch_us;
+	};
+
+	extern FrameCosts frame_costs;
+
+	/*
+	* If set, the fake kart drives through an item box every this many ticks, which gives it a
+	* random item and a random bump, both from the CRT's rand() (which the mock seeds with the time
+	* in Init() and on every full load). The game's item boxes have their own generator, which a
+	* seed doesn't pin, so these only stand in for what the CRT's numbers decide. Firing uses the
+	* item up for a boost. 0 (the default) for none, so that the kart only depends on the script's
+	* inputs. The random numbers go through the detours in detours.cpp either way, see
+	* ScriptManager::seedFor().
+	*/
+	extern uint32_t item_box_ticks;
+
+	// sets the ScriptManager's action handler, see ScriptManager::setActionHandler()
+	void SetActionHandler(void (*handler)(const TimedAction&));
+
+	// g_pInfo's ScriptManager that scripts run on, e.g. for going back to an earlier position
+	// from after_tick the way savestates do
+	ScriptManager& GetScriptManager();
+
+	// A key event from someone playing, through DETOUR_InputManager__input: it's dropped while a
+	// script is running, and g_pInfo->recorder sees it while it's active.
+	void PressKey(EKEY_CODE key, bool pressed);
+
+	// incremented on every call to operator new, see alloc_tracker.cpp
+	extern uint64_t num_allocs;
+
+	// Creates g_pInfo and the fake game objects, and points the hooks:: globals at them. The
+	// benchmarks use g_pInfo's state hasher, recorder, bisector & pacer. Fields in scripts'
+	// programs are read relative to fake_kart (instead of the exe) from then on, e.g. a field with
+	// a module offset of offsetof(FakeKart, speed) and no offsets reads the speed.
+	// Must be called before anything else, calling it again starts over with a new g_pInfo.
+	void Init(int physics_fps = 120);
+
+	// If set, every event is stored (see Events()), otherwise they're only counted. Storing
+	// events allocates, so this should be off when checking the number of allocations.
+	extern bool record_events;
+
+	// events recorded during the last call to RunScript()
+	const std::vector<RecordedEvent>& Events();
+
+	// Runs a script to completion, one frame of the main loop (and DETOUR_MainLoop__getLimitedDt)
+	// at a time. Takes ownership of data. A script that pauses (playspeed 0) is stopped there,
+	// the game would wait for the next one. The fake world is kept around between calls, so
+	// quick_reset works.
+	Stats RunScript(ScriptData* data);
+
+	// Does every run of a bisection that has been started on g_pInfo->bisector (with scripts set):
+	// the detour starts each run on a frame without a script, and stops it once the state hasher
+	// has hashed its last tick. Every run does a full load. Returns the stats of all runs together.
+	Stats RunBisection();
+
+	// Runs a script to completion, then does ticks more frames with g_pInfo->recorder (which must
+	// be started) recording through the detour. human is called at the end of each of those
+	// frames, to press keys with PressKey() for the next one. The state hasher is ticked with the
+	// ticks that a replay of the script & the recording would have.
+	Stats RunRecording(ScriptData* data, uint32_t ticks, void (*human)(uint32_t tick));
+
+	// unloads the fake world so that the next script has to do a full load
+	void UnloadWorld();
+
+	// what the fake world was last fully loaded with
+	struct LoadedRace {
+		std::string map;
+		std::string kart;
+		int laps;
+		Difficulty difficulty;
+	};
+
+	const LoadedRace& GetLoadedRace();
+
+	// leaves the race the way the game does when the player goes back to the menu, through
+	// DETOUR_RaceManager__exitRace
+	void ExitRace();
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <iomanip>
+#include <string.h>
+#include <vector>
+#include "pacing_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+/*
+* The frame costs are made up: a race update that's fast enough for about 50x, and a draw that only
+* just keeps up at 2x. Each skipping run is about a second of real time, the runs that draw every
+* tick are two seconds of game time, which is plenty for seeing how far behind they are.
+*/
+static const sim::FrameCosts COSTS = {150, 4000, 0};
+static const int PHYSICS_FPS = 120;
+
+
+// a script that sets the playspeed and then holds accelerate for ticks
+static std::vector<char> MakeScript(float play_speed, uint16_t ticks) {
+	std::vector<char> msg = sim::ScriptHeader(0);
+	Framebulk fbs[2] = {};
+	fbs[0].set_speed = true;
+	fbs[0].new_play_speed = play_speed;
+	fbs[1].accel = true;
+	fbs[1].num_ticks = ticks;
+	for (const Framebulk& fb : fbs)
+		sim::Append(msg, &fb, Framebulk::FB_SIZE_BYTES);
+	return msg;
+}
+
+
+// runs the script in real time, returns the speed that it got to
+static float Run(FramePacer& pacer, float play_speed, uint16_t ticks) {
+	std::vector<char> msg = MakeScript(play_speed, ticks);
+	sim::UnloadWorld();
+	pacer.reset();
+	sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	ScriptManager::RunStats run = sim::GetScriptManager().runStats();
+	return run.us ? (float)run.ticks / PHYSICS_FPS / (run.us / 1e6f) : 0;
+}
+
+
+int RunPacingCheck() {
+	sim::Init(PHYSICS_FPS);
+	sim::frame_costs = COSTS;
+	FramePacer& pacer = g_pInfo->pacer;
+	pacer.setRealTime(true);
+	bool ok = true;
+
+	std::cout << "frame costs: " << COSTS.update_us << " us update, " << COSTS.render_us << " us draw (made up)\n"
+		<< "  requested   every tick   skipping   draws every   achieved (pacer)\n" << std::fixed << std::setprecision(2);
+	for (float speed : {1.0f, 2.0f, 8.0f, 30.0f}) {
+		float every_tick = 0;
+		if (speed > 1) {
+			pacer.setSkipping(false);
+			every_tick = Run(pacer, speed, 2 * PHYSICS_FPS);
+		}
+		pacer.setSkipping(true);
+		FramePacer::Stats before = pacer.stats();
+		float skipping = Run(pacer, speed, (uint16_t)(speed * PHYSICS_FPS));
+		const FramePacer::Stats& st = pacer.stats();
+		uint64_t drawn = st.frames_drawn - before.frames_drawn;
+		uint64_t skipped = st.frames_skipped - before.frames_skipped;
+		// at 1x there's nothing to skip, so drawing every tick is the same run as skipping
+		std::cout << "  " << std::setw(8) << speed << "x   ";
+		if (speed > 1)
+			std::cout << std::setw(9) << every_tick << "x   ";
+		else
+			std::cout << std::setw(9) << "-" << "    ";
+		std::cout << std::setw(7) << skipping << "x   " << std::setw(11) << (drawn ? (float)(drawn + skipped) / drawn : 0) << "   " << std::setw(7) << st.achieved_speed << "x\n";
+
+		if (skipping < speed * 0.85f || skipping > speed * 1.05f) {
+			std::cout << "  ERROR: the skipping run didn't keep to its playspeed\n";
+			ok = false;
+		}
+		if (speed > 2 && every_tick > speed * 0.5f) {
+			std::cout << "  ERROR: the run that drew every tick kept up, the frame costs are off\n";
+			ok = false;
+		}
+		if (speed == 1 && skipped > 0) {
+			std::cout << "  ERROR: ticks were skipped at a speed that doesn't need it\n";
+			ok = false;
+		}
+		if (*hooks::g_is_no_graphics) {
+			std::cout << "  ERROR: drawing didn't come back after the script\n";
+			ok = false;
+		}
+	}
+
+	pacer.setRealTime(false);
+	sim::frame_costs = {};
+	return ok ? 0 : 3;
+}
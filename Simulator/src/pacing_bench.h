@@ -0,0 +1,8 @@
+#pragma once
+
+// Runs made up scripts at 1x to 30x in real time on a mock game whose frames take much longer
+// to draw than to tick, with the frame pacer drawing every tick and with it skipping the ones it
+// needs to. Reports the speed that each one got to and how often it drew, and checks that the
+// skipping runs keep to their playspeed (and that the ones that draw every tick can't). Returns
+// non-zero if any of the checks fail.
+int RunPacingCheck();
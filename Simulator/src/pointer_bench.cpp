@@ -0,0 +1,159 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "pointer_bench.h"
+#include "../../Payload/src/pointer_scanner.h"
+
+/*
+* The heap is split into regions of fixed size objects, like a real allocator would. Every object
+* is filled with junk (small ints & floats) plus a couple of pointers to random objects, and the
+* fake module has a few random pointers into the heap as well, so there are plenty of dead ends
+* and other valid chains. On top of that, this path is planted (like m_world -> karts -> body):
+*
+*   module + 0x87100 -> world
+*   world + 0x30     -> kart list
+*   kart list + 0    -> kart
+*   kart + 0x1a0     -> body
+*   target = body + 0x40
+*/
+
+
+static const size_t MODULE_SIZE = 1 << 20;
+static const size_t REGION_SIZE = 16 << 20;
+static const size_t OBJECT_SIZE = 512;
+static const int POINTERS_PER_OBJECT = 2;
+static const int NUM_STATIC_POINTERS = 200;
+
+static const uint32_t PLANTED_OFFSETS[] = {0x30, 0x0, 0x1a0, 0x40};
+static const uint32_t PLANTED_MODULE_OFFSET = 0x87100;
+
+
+struct Graph {
+	std::vector<platform::MemRegion> regions;  // the module is the first one
+	std::vector<char*> objects;
+	uintptr_t target;
+};
+
+
+static uint32_t NextRand(uint32_t& rng) {
+	// xorshift32
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+
+static bool BuildGraph(size_t heap_mb, Graph& g) {
+	size_t num_regions = (heap_mb * (1 << 20) + REGION_SIZE - 1) / REGION_SIZE;
+	char* module = (char*)platform::AllocPages(MODULE_SIZE);
+	if (!module)
+		return false;
+	g.regions.push_back({module, MODULE_SIZE, false});
+	for (size_t i = 0; i < num_regions; i++) {
+		char* p = (char*)platform::AllocPages(REGION_SIZE);
+		if (!p)
+			return false;
+		g.regions.push_back({p, REGION_SIZE, false});
+		for (size_t off = 0; off < REGION_SIZE; off += OBJECT_SIZE)
+			g.objects.push_back(p + off);
+	}
+
+	uint32_t rng = 0x12345678;
+	auto random_object = [&] {return g.objects[NextRand(rng) % g.objects.size()];};
+
+	for (char* obj : g.objects) {
+		uint64_t* fields = (uint64_t*)obj;
+		for (size_t i = 0; i < OBJECT_SIZE / 8; i++) {
+			uint32_t r = NextRand(rng);
+			if (r & 1)
+				fields[i] = r >> 16;
+			else
+				fields[i] = ((uint64_t)r << 32) | NextRand(rng);  // two floats
+		}
+		for (int i = 0; i < POINTERS_PER_OBJECT; i++)
+			fields[NextRand(rng) % (OBJECT_SIZE / 8)] = (uintptr_t)random_object();
+	}
+	for (int i = 0; i < NUM_STATIC_POINTERS; i++)
+		((uintptr_t*)module)[NextRand(rng) % (MODULE_SIZE / 8)] = (uintptr_t)random_object();
+
+	uintptr_t addr = (uintptr_t)(module + PLANTED_MODULE_OFFSET);
+	for (uint32_t offset : PLANTED_OFFSETS) {
+		char* obj = random_object();
+		*(uintptr_t*)addr = (uintptr_t)obj;
+		addr = (uintptr_t)obj + offset;
+	}
+	g.target = addr;
+	return true;
+}
+
+
+int RunPointerScanBenchmark(size_t heap_mb) {
+	Graph g;
+	if (!BuildGraph(heap_mb, g)) {
+		std::cout << "Could not allocate " << heap_mb << " MB\n";
+		return 1;
+	}
+	std::cout << "pointer scan over " << g.objects.size() << " objects (" << (g.regions.size() - 1) * (REGION_SIZE >> 20) << " MB)\n";
+
+	const char* module = g.regions[0].base;
+	PointerScanner::Settings settings;
+	settings.max_depth = 5;
+	settings.max_offset = 0x800;
+
+	int ret = 0;
+	std::vector<PointerScanner::Chain> first_chains;
+	std::vector<int> thread_counts = {1};
+	if (std::thread::hardware_concurrency() > 1)
+		thread_counts.push_back((int)std::thread::hardware_concurrency());
+
+	for (int threads : thread_counts) {
+		PointerScanner scanner;
+		scanner.setNumThreads(threads);
+		std::vector<PointerScanner::Chain> chains;
+
+		auto t0 = std::chrono::steady_clock::now();
+		scanner.buildMap(g.regions.data(), g.regions.size(), module, MODULE_SIZE);
+		auto t1 = std::chrono::steady_clock::now();
+		scanner.findChains(g.target, settings, chains);
+		auto t2 = std::chrono::steady_clock::now();
+
+		int planted_rank = -1, bad_chains = 0;
+		for (size_t i = 0; i < chains.size(); i++) {
+			const PointerScanner::Chain& c = chains[i];
+			uintptr_t resolved;
+			if (!PointerScanner::resolve(module, c, resolved) || resolved != g.target)
+				bad_chains++;
+			bool planted = c.module_offset == PLANTED_MODULE_OFFSET && c.num_offsets == 4;
+			for (uint32_t j = 0; planted && j < c.num_offsets; j++)
+				planted = c.offsets[j] == PLANTED_OFFSETS[j];
+			if (planted)
+				planted_rank = (int)i;
+		}
+
+		std::cout << "  " << threads << " thread(s):\n"
+			<< "    map:          " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms ("
+			<< scanner.numPointers() << " pointers)\n"
+			<< "    search:       " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms ("
+			<< chains.size() << " chains)\n"
+			<< "    planted rank: " << planted_rank << "\n";
+
+		bool same = threads == 1 || (chains.size() == first_chains.size() &&
+			std::equal(chains.begin(), chains.end(), first_chains.begin(), [](const PointerScanner::Chain& a, const PointerScanner::Chain& b) {
+				return a.module_offset == b.module_offset && a.num_offsets == b.num_offsets &&
+					std::equal(a.offsets, a.offsets + a.num_offsets, b.offsets);
+			}));
+		if (planted_rank < 0 || bad_chains > 0 || !same) {
+			std::cout << "  ERROR: the planted chain wasn't found, a chain doesn't lead to the target, or the thread counts don't agree\n";
+			ret = 3;
+		}
+		if (threads == 1)
+			first_chains = chains;
+	}
+
+	for (auto& r : g.regions)
+		platform::FreePages(r.base, r.size);
+	return ret;
+}
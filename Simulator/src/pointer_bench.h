@@ -0,0 +1,8 @@
+#pragma once
+#include <stddef.h>
+
+// Builds a synthetic object graph of heap_mb with a known chain from a fake module to a target,
+// then times the pointer scanner on it with one thread and with one thread per core. Returns
+// non-zero if the known chain isn't found, if any chain doesn't lead to the target, or if the
+// thread counts don't agree.
+int RunPointerScanBenchmark(size_t heap_mb);
@@ -0,0 +1,333 @@
+#include <iostream>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "predicate_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+/*
+* Scripts are put together here the way parser.py would send them, with the programs written
+* out by hand. Fields are read from the fake kart, see sim::Init(). The speed of the fake kart
+* goes up by 10/sec while accelerating, so it takes about a second to get past 10.
+*/
+
+
+typedef PredicateVM::Op Op;
+typedef PredicateVM::FieldType FieldType;
+
+
+// the programs section of a script, before it's encoded
+struct Programs {
+	std::vector<PredicateVM::Field> fields;
+	std::vector<float> constants;
+	std::vector<std::vector<PredicateVM::Instr>> programs;
+};
+
+
+static PredicateVM::Field KartField(size_t offset, FieldType type = FieldType::F32) {
+	PredicateVM::Field field = {};
+	field.chain.module_offset = (uint32_t)offset;
+	field.type = type;
+	return field;
+}
+
+
+static std::vector<char> MakeScript(const Programs& progs, const std::vector<Framebulk>& framebulks) {
+	std::vector<char> msg = sim::ScriptHeader(progs.programs.empty() ? 0 : ScriptData::FLAG_HAS_PROGRAMS);
+	if (!progs.programs.empty()) {
+		uint32_t n = (uint32_t)progs.fields.size();
+		sim::Append(msg, &n, sizeof(n));
+		for (const PredicateVM::Field& field : progs.fields) {
+			uint8_t head[4] = {(uint8_t)field.type, (uint8_t)field.chain.num_offsets, 0, 0};
+			sim::Append(msg, head, sizeof(head));
+			sim::Append(msg, &field.chain.module_offset, 4);
+			sim::Append(msg, field.chain.offsets, field.chain.num_offsets * 4);
+		}
+		n = (uint32_t)progs.constants.size();
+		sim::Append(msg, &n, sizeof(n));
+		sim::Append(msg, progs.constants.data(), n * sizeof(float));
+		n = (uint32_t)progs.programs.size();
+		sim::Append(msg, &n, sizeof(n));
+		for (const auto& instrs : progs.programs) {
+			n = (uint32_t)instrs.size();
+			sim::Append(msg, &n, sizeof(n));
+			sim::Append(msg, instrs.data(), n * sizeof(PredicateVM::Instr));
+		}
+	}
+	sim::Append(msg, framebulks.data(), framebulks.size() * sizeof(Framebulk));
+	return msg;
+}
+
+
+// field > constant
+static std::vector<PredicateVM::Instr> Greater(uint8_t field, uint8_t constant) {
+	return {{Op::LoadConst, 0, constant, 0}, {Op::LoadField, 1, field, 0}, {Op::Lt, 0, 0, 1}, {Op::Ret, 0, 0, 0}};
+}
+
+
+static Framebulk Ticks(uint16_t num_ticks, bool accel, float angle = 0) {
+	Framebulk fb = {};
+	fb.accel = accel;
+	fb.num_ticks = num_ticks;
+	fb.turn_angle = angle;
+	return fb;
+}
+
+
+static Framebulk Until(Framebulk fb, uint8_t program) {
+	fb.until = true;
+	fb.program = program;
+	return fb;
+}
+
+
+static Framebulk Rule(uint8_t program, uint16_t button_flags, float angle = 0) {
+	Framebulk fb = {};
+	fb.flags = button_flags;
+	fb.rule = true;
+	fb.program = program;
+	fb.turn_angle = angle;
+	return fb;
+}
+
+
+// the ticks of the first press & the first release of a key after from, -1 if there's none
+static void FindKey(EKEY_CODE key, int64_t from, int64_t& pressed, int64_t& released) {
+	pressed = released = -1;
+	for (const sim::RecordedEvent& e : sim::Events()) {
+		if (e.key != key || e.tick < from)
+			continue;
+		if (e.pressed && pressed < 0)
+			pressed = e.tick;
+		if (!e.pressed && pressed >= 0 && released < 0)
+			released = e.tick;
+	}
+}
+
+
+static int64_t first_over_5 = -1, first_over_10 = -1;
+
+
+static void WatchSpeed(uint32_t tick) {
+	if (sim::fake_kart.speed > 5 && first_over_5 < 0)
+		first_over_5 = tick;
+	if (sim::fake_kart.speed > 10 && first_over_10 < 0)
+		first_over_10 = tick;
+}
+
+
+static bool CheckReactions() {
+	bool ok = true;
+	Programs progs;
+	progs.fields = {KartField(offsetof(sim::FakeKart, speed)), KartField(offsetof(sim::FakeKart, keys_held)), KartField(0xF0000000)};
+	// keys_held & steer make a pointer that goes nowhere, and the last one is a "global" that's
+	// way past the end of the module
+	progs.fields[1].chain.num_offsets = 1;
+	progs.constants = {10, 5};
+	std::vector<PredicateVM::Instr> unreadable = {
+		{Op::LoadField, 0, 1, 0}, {Op::Eq, 0, 0, 0}, {Op::LoadField, 1, 2, 0}, {Op::Eq, 1, 1, 1}, {Op::Or, 0, 0, 1}, {Op::Ret, 0, 0, 0},
+	};
+	progs.programs = {Greater(0, 0), Greater(0, 1), unreadable};
+
+	// nitro once the speed is over 5, accelerate until it's over 10, then accelerate some more
+	// without nitro
+	std::vector<char> msg = MakeScript(progs, {
+		Ticks(10, false),
+		Rule(1, 1 << 3),
+		Until(Ticks(1000, true), 0),
+		Rule(PredicateVM::NO_PROGRAM, 0),
+		Ticks(50, true),
+		Ticks(1, false),
+		Until(Ticks(200, true), 2),
+		Ticks(10, false),
+	});
+	sim::record_events = true;
+	sim::after_tick = &WatchSpeed;
+	sim::UnloadWorld();
+	sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	sim::after_tick = nullptr;
+	sim::record_events = false;
+
+	int64_t nitro_on, nitro_off, accel_on, accel_off, until_on, until_off;
+	FindKey(IRR_KEY_N, 0, nitro_on, nitro_off);
+	FindKey(IRR_KEY_UP, 0, accel_on, accel_off);
+	// the accel key is held until the tick before the last until framebulk
+	FindKey(IRR_KEY_UP, accel_off, until_on, until_off);
+	std::cout << "  until:         speed > 10 after tick " << first_over_10 << ", released tick " << nitro_off << "\n";
+	if (first_over_10 < 0 || nitro_off != first_over_10 + 1 || accel_off != first_over_10 + 51) {
+		std::cout << "  ERROR: the until framebulk didn't end on the tick after its condition was true\n";
+		ok = false;
+	}
+	if (first_over_5 < 0 || nitro_on != first_over_5 + 1) {
+		std::cout << "  ERROR: the rule pressed nitro on tick " << nitro_on << " instead of " << first_over_5 + 1 << "\n";
+		ok = false;
+	}
+	if (until_off - until_on != 200) {
+		std::cout << "  ERROR: an unreadable field ended an until framebulk after " << until_off - until_on << " of 200 ticks\n";
+		ok = false;
+	}
+	return ok;
+}
+
+
+// A program of length instructions that reads a field every 3 instructions, and where most
+// instructions depend on the one before them. It's never true, constant c has to be huge.
+static std::vector<PredicateVM::Instr> Long(uint32_t length, uint8_t c) {
+	std::vector<PredicateVM::Instr> instrs = {{Op::LoadField, 0, 0, 0}};
+	while (instrs.size() < length - 3) {
+		instrs.push_back({Op::LoadField, 1, 1, 0});
+		instrs.push_back({Op::Mul, 1, 1, 1});
+		instrs.push_back({Op::Add, 0, 0, 1});
+	}
+	instrs.resize(length - 3);
+	instrs.push_back({Op::LoadConst, 1, c, 0});
+	instrs.push_back({Op::Lt, 0, 1, 0});
+	instrs.push_back({Op::Ret, 0, 0, 0});
+	return instrs;
+}
+
+
+static bool CheckValidation() {
+	Programs good;
+	good.fields = {KartField(offsetof(sim::FakeKart, speed))};
+	good.constants = {10};
+	good.programs = {Greater(0, 0)};
+	std::vector<Framebulk> framebulks = {Until(Ticks(100, true), 0)};
+
+	struct Bad {
+		const char* what;
+		Programs progs;
+		std::vector<Framebulk> framebulks;
+	};
+	std::vector<Bad> bad(10, {"", good, framebulks});
+	bad[0].what = "a register that's read before it's written";
+	bad[0].progs.programs[0][2] = {Op::Lt, 0, 0, 2};
+	bad[1].what = "a field that doesn't exist";
+	bad[1].progs.programs[0][1] = {Op::LoadField, 1, 1, 0};
+	bad[2].what = "a constant that doesn't exist";
+	bad[2].progs.programs[0][0] = {Op::LoadConst, 0, 0, 1};
+	bad[3].what = "a missing Ret";
+	bad[3].progs.programs[0].pop_back();
+	bad[4].what = "a Ret that isn't last";
+	bad[4].progs.programs[0].push_back({Op::Mov, 2, 0, 0});
+	bad[5].what = "a register that doesn't exist";
+	bad[5].progs.programs[0][0] = {Op::LoadConst, PredicateVM::NUM_REGS, 0, 0};
+	bad[6].what = "an unknown instruction";
+	bad[6].progs.programs[0][2].op = Op::NUM_OPS;
+	bad[7].what = "an until framebulk without a program";
+	bad[7].framebulks[0].program = 1;
+	bad[8].what = "a rule with ticks";
+	bad[8].framebulks.push_back(Rule(0, 1));
+	bad[8].framebulks.back().num_ticks = 5;
+	bad[9].what = "conditions that could take too long in one tick";
+	bad[9].progs.constants.push_back(1e9f);
+	bad[9].progs.programs.push_back(Long(PredicateVM::MAX_TICK_INSTRS - 3, 1));
+	bad[9].framebulks.push_back(Rule(1, 1));
+
+	bool ok = true;
+	std::vector<char> msg = MakeScript(good, framebulks);
+	ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "  ERROR: a good program was rejected\n";
+		ok = false;
+	}
+	ScriptData::destroy(data);
+	// and one that's cut off in the middle of the instructions
+	msg.resize(msg.size() - sizeof(Framebulk) - 2);
+	if (ScriptData::fromMessage(msg.data(), msg.size())) {
+		std::cout << "  ERROR: a cut off programs section wasn't rejected\n";
+		ok = false;
+	}
+	for (const Bad& b : bad) {
+		msg = MakeScript(b.progs, b.framebulks);
+		if (ScriptData* d = ScriptData::fromMessage(msg.data(), msg.size())) {
+			std::cout << "  ERROR: a program with " << b.what << " wasn't rejected\n";
+			ScriptData::destroy(d);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+// speed > c and abs(heading) < 0.5 and fb_tick > 3, what a condition usually looks like
+static std::vector<PredicateVM::Instr> Typical(uint8_t c) {
+	return {
+		{Op::LoadConst, 0, c, 0}, {Op::LoadField, 1, 0, 0}, {Op::Lt, 0, 0, 1},
+		{Op::LoadField, 1, 1, 0}, {Op::Abs, 1, 1, 0}, {Op::LoadConst, 2, 0, 0}, {Op::Lt, 1, 1, 2}, {Op::And, 0, 0, 1},
+		{Op::LoadConst, 1, 1, 0}, {Op::LoadTick, 2, 1, 0}, {Op::Lt, 1, 1, 2}, {Op::And, 0, 0, 1},
+		{Op::Ret, 0, 0, 0},
+	};
+}
+
+
+// ns per tick of running a script of about ticks ticks, with every framebulk ending early on a
+// condition that's never true and with MAX_RULES rules going (that are true now & then). If
+// longest is set, the conditions are as long as they can be and still fit in MAX_TICK_INSTRS.
+static double ScriptTickNs(uint32_t ticks, bool with_programs, bool longest, uint64_t& tick_allocs) {
+	Programs progs;
+	progs.fields = {KartField(offsetof(sim::FakeKart, speed)), KartField(offsetof(sim::FakeKart, heading))};
+	progs.constants = {0.5f, 3, 1e9f};
+	const uint32_t LONGEST = PredicateVM::MAX_TICK_INSTRS / (ScriptManager::MAX_RULES + 1);
+	std::vector<Framebulk> framebulks;
+	for (int i = 0; i < ScriptManager::MAX_RULES; i++) {
+		progs.constants.push_back(2.0f * i);
+		progs.programs.push_back(longest ? Long(LONGEST, 2) : Typical((uint8_t)progs.constants.size() - 1));
+		if (with_programs)
+			framebulks.push_back(Rule((uint8_t)i, 1 << (i % Framebulk::NUM_BUTTON_FLAGS)));
+	}
+	progs.programs.push_back(longest ? Long(LONGEST, 2) : Greater(0, 2));
+	if (!with_programs)
+		progs.programs.clear();
+	for (uint32_t i = 0; i < ticks / 100; i++) {
+		Framebulk fb = Ticks(100, i % 4 != 3, (float)(i % 3) - 1);
+		framebulks.push_back(with_programs ? Until(fb, ScriptManager::MAX_RULES) : fb);
+	}
+
+	std::vector<char> msg = MakeScript(progs, framebulks);
+	double best = 0;
+	for (int rep = 0; rep < 3; rep++) {
+		ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+		if (!data)
+			return -1;
+		sim::UnloadWorld();
+		sim::Stats stats;
+		double secs = sim::TimeSecs([&] {stats = sim::RunScript(data);});
+		tick_allocs += stats.tick_allocs;
+		double ns = secs * 1e9 / stats.ticks;
+		if (rep == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+
+int RunPredicateBenchmark(uint32_t ticks) {
+	if (ticks < 1000)
+		return 1;
+	sim::Init();
+	bool ok = CheckReactions();
+	ok &= CheckValidation();
+
+	uint64_t tick_allocs = 0;
+	double without = ScriptTickNs(ticks, false, false, tick_allocs);
+	double typical = ScriptTickNs(ticks, true, false, tick_allocs);
+	double longest = ScriptTickNs(ticks, true, true, tick_allocs);
+	if (without < 0 || typical < 0 || longest < 0) {
+		std::cout << "  ERROR: bad script message\n";
+		return 3;
+	}
+	std::cout << "  tick:          " << without << " ns without conditions\n"
+		<< "  conditions:    " << typical - without << " ns/tick for " << ScriptManager::MAX_RULES + 1 << " typical ones, "
+		<< longest - without << " ns/tick at the limit of " << PredicateVM::MAX_TICK_INSTRS << " instructions\n";
+	if (longest - without > 1000) {
+		std::cout << "  ERROR: conditions take more than 1 us per tick\n";
+		ok = false;
+	}
+	if (tick_allocs > 0) {
+		std::cout << "  ERROR: allocations outside of map load\n";
+		ok = false;
+	}
+	return ok ? 0 : 3;
+}
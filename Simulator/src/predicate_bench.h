@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// Checks & benchmarks the predicate VM that reactive scripts' conditions run on: an until
+// framebulk has to end on the tick after its condition became true, a rule has to press its
+// buttons only while its condition is true, a field that can't be read has to be false, and
+// programs that read registers before writing them (and other broken programs) have to be
+// rejected when the script is parsed. Then a script of ticks ticks with the most rules that can
+// be going at once runs with & without its conditions. Returns non-zero if any of the checks
+// fail, if the conditions cost more than 1 us per tick, or if a tick allocated.
+int RunPredicateBenchmark(uint32_t ticks);
@@ -0,0 +1,286 @@
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "prefetch_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+#include "../../Payload/src/asset_prefetch.h"
+
+/*
+* The made up data dir is in /tmp: a track ("dummy") with models, textures & sounds, a kart
+* ("tux"), and another track of the same size for checking cancels. The mock's full load reads
+* every file of the script's track & kart and hashes every byte of them, which stands in for the
+* game decoding them. Every case starts with the files dropped from the cache (they're synced
+* first, then dropped with posix_fadvise, which doesn't need root).
+*/
+
+#ifdef _WIN32
+
+int RunPrefetchCheck(uint32_t size_mb) {
+	std::cout << "The prefetch check only runs on Linux\n";
+	return 1;
+}
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+static sim::Rng rng = {0x9e3779b9};
+
+
+// calls f with the path of every file under dir, and then with dir itself
+static void WalkTree(const std::string& dir, const std::function<void(const std::string&, bool)>& f) {
+	std::vector<std::pair<std::string, bool>> entries;
+	platform::ListDir(dir.c_str(), [](void* ctx, const char* name, bool is_dir) {
+		((std::vector<std::pair<std::string, bool>>*)ctx)->push_back({name, is_dir});
+	}, &entries);
+	for (auto& e : entries) {
+		std::string path = dir + "/" + e.first;
+		if (e.second)
+			WalkTree(path, f);
+		else
+			f(path, false);
+	}
+	f(dir, true);
+}
+
+
+// fills dir with files of random sizes that add up to about size bytes
+static bool MakeAssets(const std::string& dir, uint64_t size) {
+	const char* subdirs[] = {"models", "textures", "sounds"};
+	if (mkdir(dir.c_str(), 0755) != 0)
+		return false;
+	for (const char* sub : subdirs)
+		if (mkdir((dir + "/" + sub).c_str(), 0755) != 0)
+			return false;
+	std::vector<uint32_t> buf;
+	for (int i = 0; size > 0; i++) {
+		uint64_t file_size = 64 * 1024 + rng(2 * 1024 * 1024);
+		file_size = file_size > size ? size : file_size;
+		size -= file_size;
+		buf.resize((size_t)(file_size + 3) / 4);
+		for (uint32_t& x : buf)
+			x = rng.next();
+		std::string path = dir + "/" + subdirs[i % 3] + "/" + std::to_string(i) + ".bin";
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f)
+			return false;
+		bool ok = fwrite(buf.data(), 1, (size_t)file_size, f) == file_size;
+		if (fclose(f) != 0 || !ok)
+			return false;
+	}
+	return true;
+}
+
+
+static void DropFromCache(const std::string& root) {
+	WalkTree(root, [](const std::string& path, bool is_dir) {
+		if (is_dir)
+			return;
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return;
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	});
+}
+
+
+// the fraction of the pages of the files under dir that are in the cache
+static double CachedFraction(const std::string& dir) {
+	uint64_t pages = 0, cached = 0;
+	WalkTree(dir, [&](const std::string& path, bool is_dir) {
+		if (is_dir)
+			return;
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0) {
+			if (fd != -1)
+				close(fd);
+			return;
+		}
+		void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return;
+		size_t n = ((size_t)st.st_size + platform::PAGE_BYTES - 1) / platform::PAGE_BYTES;
+		std::vector<unsigned char> vec(n);
+		if (mincore(p, (size_t)st.st_size, vec.data()) == 0) {
+			pages += n;
+			for (unsigned char v : vec)
+				cached += v & 1;
+		}
+		munmap(p, (size_t)st.st_size);
+	});
+	return pages ? (double)cached / pages : 0;
+}
+
+
+static std::string root;
+static uint64_t load_hash = 0;
+static std::vector<char> load_buf(1 << 20);
+
+
+// what the game does in startSingleRace, minus everything that isn't reading files
+static void LoadAssets(const char* map, const char* kart) {
+	for (std::string dir : {root + "/tracks/" + map, root + "/karts/" + kart}) {
+		WalkTree(dir, [](const std::string& path, bool is_dir) {
+			if (is_dir)
+				return;
+			platform::File f = platform::OpenFileForReading(path.c_str());
+			if (f == platform::INVALID_FILE)
+				return;
+			int64_t n;
+			while ((n = platform::ReadFileChunk(f, load_buf.data(), load_buf.size())) > 0)
+				for (int64_t i = 0; i < n; i++)
+					load_hash = load_hash * 31 + (uint8_t)load_buf[(size_t)i];
+			platform::CloseFile(f);
+		});
+	}
+}
+
+
+static std::vector<char> ScriptMessage(const char* map, const char* kart) {
+	std::vector<char> msg = sim::ScriptHeader(0, map, kart);
+	Framebulk fb = {};
+	fb.accel = true;
+	fb.num_ticks = 100;
+	sim::Append(msg, &fb, sizeof(fb));
+	return msg;
+}
+
+
+// how a new script is handled, the same way that IPC::process_msg does it
+static ScriptData* ReceiveScript(AssetPrefetcher& prefetcher, const std::vector<char>& msg) {
+	ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+	if (sim::GetScriptManager().canReset(data))
+		prefetcher.cancel();
+	else
+		prefetcher.prefetch(data->map_name, data->player_name);
+	return data;
+}
+
+
+// runs a script with a full load, returns how long the load took in ms
+static double TimeLoad(AssetPrefetcher* prefetcher, const std::vector<char>& msg, bool wait_for_prefetch) {
+	sim::UnloadWorld();
+	DropFromCache(root);
+	ScriptData* data = prefetcher ? ReceiveScript(*prefetcher, msg) : ScriptData::fromMessage(msg.data(), msg.size());
+	if (prefetcher && wait_for_prefetch)
+		prefetcher->waitIdle(60000);
+	sim::RunScript(data);
+	if (prefetcher)
+		prefetcher->waitIdle(60000);
+	return sim::GetScriptManager().loadStats().last_us / 1000.0;
+}
+
+
+static bool RunChecks(uint32_t size_mb) {
+	uint64_t size = (uint64_t)size_mb << 20;
+	if (mkdir((root + "/tracks").c_str(), 0755) != 0 || mkdir((root + "/karts").c_str(), 0755) != 0
+		|| !MakeAssets(root + "/tracks/dummy", size * 85 / 100) || !MakeAssets(root + "/tracks/other", size * 85 / 100)
+		|| !MakeAssets(root + "/karts/tux", size * 15 / 100)) {
+		std::cout << "  ERROR: couldn't write the data dir\n";
+		return false;
+	}
+	sim::Init();
+	sim::on_full_load = &LoadAssets;
+	AssetPrefetcher prefetcher;
+	prefetcher.setDataDir(root.c_str());
+	std::vector<char> msg = ScriptMessage("dummy", "tux");
+	bool ok = true;
+
+	DropFromCache(root);
+	double cached = CachedFraction(root + "/tracks/dummy");
+	if (cached > 0.1)
+		std::cout << "  (the files couldn't be dropped from the cache, " << (int)(cached * 100) << "% are still in it)\n";
+	double cold_ms = TimeLoad(nullptr, msg, false);
+	double racing_ms = TimeLoad(&prefetcher, msg, false);
+	double prefetched_ms = TimeLoad(&prefetcher, msg, true);
+	AssetPrefetcher::Stats st = prefetcher.stats();
+	std::cout << "  data:          " << size_mb << " MB (track & kart)\n"
+		<< "  cold load:     " << cold_ms << " ms\n"
+		<< "  prefetching:   " << racing_ms << " ms (the prefetch started when the script arrived)\n"
+		<< "  prefetched:    " << prefetched_ms << " ms (after a prefetch that took " << st.last_us / 1000.0 << " ms for "
+		<< (st.last_bytes >> 20) << " MB)\n";
+	if (st.last_bytes < size * 99 / 100) {
+		std::cout << "  ERROR: the prefetch didn't read the track & kart\n";
+		ok = false;
+	}
+
+	// running it again resets the world, which doesn't read anything
+	uint32_t jobs = st.jobs;
+	sim::RunScript(ReceiveScript(prefetcher, msg));
+	if (prefetcher.stats().jobs != jobs || !sim::GetScriptManager().loadStats().last_was_reset) {
+		std::cout << "  ERROR: a reset started a prefetch\n";
+		ok = false;
+	}
+
+	// a new script cancels the prefetch for the last one, whether it's started reading or not
+	bool cancel_ok = true;
+	for (bool started : {false, true}) {
+		DropFromCache(root);
+		sim::UnloadWorld();
+		uint32_t cancelled = prefetcher.stats().cancelled;
+		ScriptData::destroy(ReceiveScript(prefetcher, ScriptMessage("other", "tux")));
+		for (int i = 0; started && !prefetcher.stats().busy && i < 1000; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		ScriptData::destroy(ReceiveScript(prefetcher, msg));
+		prefetcher.waitIdle(60000);
+		double other = CachedFraction(root + "/tracks/other"), dummy = CachedFraction(root + "/tracks/dummy");
+		std::cout << "  replaced:      " << (started ? "while reading, " : "before reading, ") << (int)(other * 100)
+			<< "% of the old track & " << (int)(dummy * 100) << "% of the new one cached\n";
+		cancel_ok &= other < 0.5 && dummy > 0.9 && (!started || prefetcher.stats().cancelled > cancelled);
+	}
+	if (!cancel_ok) {
+		std::cout << "  ERROR: the replaced prefetch wasn't cancelled\n";
+		ok = false;
+	}
+
+	// stopping (when the dll unloads) doesn't wait for the prefetch to finish
+	DropFromCache(root);
+	prefetcher.prefetch("other", "tux");
+	uint64_t start = platform::TickCountUs();
+	prefetcher.stop();
+	double stop_ms = (platform::TickCountUs() - start) / 1000.0;
+	std::cout << "  stop:          " << stop_ms << " ms\n";
+	if (stop_ms > 500) {
+		std::cout << "  ERROR: stopping waited for the prefetch\n";
+		ok = false;
+	}
+	sim::on_full_load = nullptr;
+	return ok;
+}
+
+
+int RunPrefetchCheck(uint32_t size_mb) {
+	if (size_mb == 0)
+		return 1;
+	char dir[] = "/tmp/stk_prefetch_XXXXXX";
+	if (!mkdtemp(dir)) {
+		std::cout << "Could not make a temp dir\n";
+		return 1;
+	}
+	root = dir;
+	bool ok = RunChecks(size_mb);
+	WalkTree(root, [](const std::string& path, bool is_dir) {
+		if (is_dir)
+			rmdir(path.c_str());
+		else
+			unlink(path.c_str());
+	});
+	return ok ? 0 : 3;
+}
+
+#endif
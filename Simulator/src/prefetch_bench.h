@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+// Checks & benchmarks the asset prefetcher on a made up data dir with a track & a kart of about
+// size_mb MB, where the mock game reads (and looks at) all of their files when it loads the map.
+// Reports how long the load takes with the files out of the OS's cache, with a prefetch started
+// when the script arrives, and with a prefetch that has finished, and checks that a new request
+// cancels the last one, that a reset doesn't prefetch, and that stopping doesn't wait for a
+// prefetch. Linux only, since it has to drop the files from the cache. Returns non-zero if any
+// of the checks fail.
+int RunPrefetchCheck(uint32_t size_mb);
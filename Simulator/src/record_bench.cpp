@@ -0,0 +1,145 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <string>
+#include <string.h>
+#include <vector>
+#include "record_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+/*
+* The made up player holds accel most of the time, steers for a while then goes straight (rolling
+* from one direction to the other now and then, so both are held for a bit), skids in some of the
+* turns, and taps nitro, fire & brake every so often. Held keys repeat like a keyboard does.
+*/
+
+
+// how often the client polls, in ticks (it's every quarter second in record.py)
+static const uint32_t POLL_INTERVAL = 30;
+
+static sim::Rng rng = {0x2545f491};
+
+
+struct HeldKey {
+	EKEY_CODE key;
+	bool held;
+	uint32_t next_change;  // tick of the next press/release
+};
+
+static HeldKey keys[] = {
+	{IRR_KEY_UP, false, 0},
+	{IRR_KEY_LEFT, false, 0},
+	{IRR_KEY_RIGHT, false, 0},
+	{IRR_KEY_V, false, 0},
+	{IRR_KEY_N, false, 0},
+	{IRR_KEY_SPACE, false, 0},
+	{IRR_KEY_DOWN, false, 0},
+};
+
+// how long each key stays held & released for (min, range) in ticks
+static const uint32_t HOLD_TICKS[][2] = {{600, 3000}, {20, 200}, {20, 200}, {60, 150}, {1, 30}, {1, 4}, {5, 40}};
+static const uint32_t RELEASE_TICKS[][2] = {{5, 60}, {40, 400}, {40, 400}, {100, 600}, {300, 900}, {200, 800}, {1000, 3000}};
+
+static InputRecorder* recorder = nullptr;
+static std::vector<char> recorded;
+
+
+static void Human(uint32_t tick) {
+	for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		HeldKey& k = keys[i];
+		if (tick >= k.next_change) {
+			k.held = !k.held;
+			const uint32_t* range = k.held ? HOLD_TICKS[i] : RELEASE_TICKS[i];
+			k.next_change = tick + range[0] + rng(range[1]);
+			sim::PressKey(k.key, k.held);
+		} else if (k.held && tick % 4 == 0) {
+			// keyboard repeat
+			sim::PressKey(k.key, true);
+		}
+	}
+	// what the client does while recording
+	if (tick % POLL_INTERVAL == 0) {
+		const char* msg;
+		size_t size;
+		recorder->poll(msg, size);
+		recorded.insert(recorded.end(), msg + sizeof(InputRecorder::PollHeader), msg + size);
+	}
+}
+
+
+int RunRecordCheck(const char* path, uint32_t minutes) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> msg((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	if (msg.empty() || !ScriptData::fromMessage(msg.data(), msg.size())) {
+		std::cout << "Could not read a script from '" << path << "'\n";
+		return 1;
+	}
+
+	sim::Init();
+	// the keys are left out, a replay presses them a tick later than the player did (at the start
+	// of the tick instead of at the end of the last one), which doesn't change anything else
+	StateHasher& hasher = g_pInfo->state_hasher;
+	sim::FakeKart& k = sim::fake_kart;
+	hasher.addAddress(&k.x, sizeof(k.x));
+	hasher.addAddress(&k.z, sizeof(k.z));
+	hasher.addAddress(&k.heading, sizeof(k.heading));
+	hasher.addAddress(&k.speed, sizeof(k.speed));
+
+	InputRecorder& rec = g_pInfo->recorder;
+	recorder = &rec;
+	uint32_t ticks = minutes * 60 * 120;
+	// room for a framebulk per tick, so that polling doesn't allocate either
+	recorded.clear();
+	recorded.reserve((ticks + 1) * Framebulk::FB_SIZE_BYTES);
+
+	sim::UnloadWorld();
+	hasher.start();
+	rec.start();
+	auto start = std::chrono::steady_clock::now();
+	sim::Stats st = sim::RunRecording(ScriptData::fromMessage(msg.data(), msg.size()), ticks, &Human);
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	rec.stop();
+	const char* poll_msg;
+	size_t poll_size;
+	do {
+		rec.poll(poll_msg, poll_size);
+		recorded.insert(recorded.end(), poll_msg + sizeof(InputRecorder::PollHeader), poll_msg + poll_size);
+	} while (poll_size > sizeof(InputRecorder::PollHeader));
+	InputRecorder::PollHeader header = rec.header();
+	std::vector<uint32_t> live(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+
+	// the script with the recording after it
+	std::vector<char> replay_msg = msg;
+	replay_msg.insert(replay_msg.end(), recorded.begin(), recorded.end());
+	sim::UnloadWorld();
+	hasher.setReference(live.data(), live.size());
+	hasher.start();
+	sim::RunScript(ScriptData::fromMessage(replay_msg.data(), replay_msg.size()));
+	int64_t divergence = hasher.stats().first_divergence;
+	size_t replay_hashes = hasher.stats().hashes;
+	hasher.setReference(nullptr, 0);
+	hasher.stop();
+
+	size_t num_fbs = recorded.size() / Framebulk::FB_SIZE_BYTES;
+	std::cout << path << ":\n"
+		<< "  recorded:     " << header.ticks << " ticks (" << minutes << " min) in " << secs * 1000 << " ms\n"
+		<< "  framebulks:   " << num_fbs << " (" << recorded.size() << " bytes, " << (double)header.ticks / num_fbs << " ticks each)\n"
+		<< "  replay:       " << (divergence < 0 ? "same state on every tick" : "diverged at tick " + std::to_string(divergence)) << "\n";
+
+	int ret = 0;
+	if (header.overflowed) {
+		std::cout << "  ERROR: the ring overflowed\n";
+		ret = 3;
+	}
+	if (divergence >= 0 || replay_hashes < live.size()) {
+		std::cout << "  ERROR: the replay didn't match the recording\n";
+		ret = 3;
+	}
+	if (st.tick_allocs > 0) {
+		std::cout << "  ERROR: allocations while recording\n";
+		ret = 2;
+	}
+	return ret;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Plays a script on the mock game, then records minutes of made up human input after it the
+// way the payload does, streaming the framebulks out while it records. The script & recording
+// together are then played back, and the kart has to end up in the same state on every tick.
+// Prints how compact the recording is. Returns non-zero if the replay differs or if recording
+// allocated on a tick.
+int RunRecordCheck(const char* path, uint32_t minutes);
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <iostream>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "repeat_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+/*
+* The made up scripts are kept short (a few thousand ticks at most once they're expanded) so that
+* lots of them can be checked, and half of them start with a block so that the tick a quick reset
+* skips is in one.
+*/
+
+
+typedef PredicateVM::Op Op;
+
+
+static sim::Rng rng = {0x2545f491};
+
+
+// a script as it's written, the blocks are sorted the way the payload wants them
+struct Script {
+	std::vector<Framebulk> framebulks;
+	std::vector<RepeatBlock> repeats;
+	bool quick_reset = false;
+};
+
+
+static Framebulk RandomFramebulk(bool needs_ticks) {
+	Framebulk fb = {};
+	fb.flags = (uint16_t)rng(1 << Framebulk::NUM_BUTTON_FLAGS);
+	fb.turn_angle = (float)rng(3) - 1;
+	fb.num_ticks = (uint16_t)(needs_ticks || rng(5) > 0 ? 1 + rng(20) : 0);
+	uint32_t kind = rng(20);
+	if (kind == 0 && !needs_ticks) {
+		// a rule, or clearing them
+		fb.num_ticks = 0;
+		fb.rule = true;
+		fb.program = rng(4) == 0 ? PredicateVM::NO_PROGRAM : (uint8_t)rng(2);
+	} else if (kind == 1 && fb.num_ticks > 0 && !needs_ticks) {
+		fb.until = true;
+		fb.program = (uint8_t)rng(2);
+	}
+	return fb;
+}
+
+
+// Adds a block's body (or the whole script at depth 0) to script, returns how many ticks it
+// takes at most once it's expanded.
+static uint64_t RandomBody(Script& script, int depth, bool starts_with_block) {
+	uint64_t ticks = 0;
+	bool has_ticks = false;
+	int num_items = 1 + (int)rng(depth == 0 ? 12 : 4);
+	for (int i = 0; i < num_items; i++) {
+		bool block = depth < ScriptManager::MAX_REPEAT_DEPTH && ((i == 0 && starts_with_block) || rng(4) == 0);
+		if (block && ticks < 2000) {
+			size_t idx = script.repeats.size();
+			RepeatBlock r = {(uint32_t)script.framebulks.size(), 0, 1 + rng(depth < 2 ? 5 : 2)};
+			script.repeats.push_back(r);
+			uint64_t body = RandomBody(script, depth + 1, rng(3) == 0);
+			script.repeats[idx].end_fb = (uint32_t)script.framebulks.size();
+			ticks += body * r.count;
+			has_ticks = true;
+		} else {
+			Framebulk fb = RandomFramebulk(i == num_items - 1 && !has_ticks && depth > 0);
+			script.framebulks.push_back(fb);
+			ticks += fb.num_ticks;
+			has_ticks |= fb.num_ticks > 0 && !fb.until;
+		}
+	}
+	return ticks;
+}
+
+
+// writes the blocks of script out, first_block is the first one that can be in [first, end)
+static void Expand(const Script& script, uint32_t first, uint32_t end, size_t first_block, std::vector<Framebulk>& out) {
+	for (uint32_t i = first; i < end;) {
+		size_t b = first_block;
+		while (b < script.repeats.size() && (script.repeats[b].first_fb < i || script.repeats[b].end_fb > end))
+			b++;
+		if (b < script.repeats.size() && script.repeats[b].first_fb == i) {
+			const RepeatBlock& r = script.repeats[b];
+			for (uint32_t n = 0; n < r.count; n++)
+				Expand(script, r.first_fb, r.end_fb, b + 1, out);
+			i = r.end_fb;
+		} else {
+			out.push_back(script.framebulks[i++]);
+		}
+	}
+}
+
+
+static Script Flatten(const Script& script) {
+	Script flat;
+	Expand(script, 0, (uint32_t)script.framebulks.size(), 0, flat.framebulks);
+	flat.quick_reset = script.quick_reset;
+	return flat;
+}
+
+
+static std::vector<char> Encode(const Script& script) {
+	std::vector<char> msg = sim::ScriptHeader((script.quick_reset ? ScriptData::FLAG_QUICK_RESET : 0) | ScriptData::FLAG_HAS_PROGRAMS
+		| (script.repeats.empty() ? 0 : ScriptData::FLAG_HAS_REPEATS));
+
+	// one field (the speed), and the programs speed > 8 & fb_tick > 5
+	uint32_t n = 1;
+	sim::Append(msg, &n, 4);
+	uint8_t field[8] = {(uint8_t)PredicateVM::FieldType::F32, 0, 0, 0, (uint8_t)offsetof(sim::FakeKart, speed)};
+	sim::Append(msg, field, sizeof(field));
+	float constants[2] = {8, 5};
+	n = 2;
+	sim::Append(msg, &n, 4);
+	sim::Append(msg, constants, sizeof(constants));
+	PredicateVM::Instr programs[2][4] = {
+		{{Op::LoadConst, 0, 0, 0}, {Op::LoadField, 1, 0, 0}, {Op::Lt, 0, 0, 1}, {Op::Ret, 0, 0, 0}},
+		{{Op::LoadConst, 0, 1, 0}, {Op::LoadTick, 1, 1, 0}, {Op::Lt, 0, 0, 1}, {Op::Ret, 0, 0, 0}},
+	};
+	n = 2;
+	sim::Append(msg, &n, 4);
+	for (auto& program : programs) {
+		n = 4;
+		sim::Append(msg, &n, 4);
+		sim::Append(msg, program, sizeof(program));
+	}
+
+	if (!script.repeats.empty()) {
+		n = (uint32_t)script.repeats.size();
+		sim::Append(msg, &n, 4);
+		sim::Append(msg, script.repeats.data(), n * sizeof(RepeatBlock));
+	}
+	sim::Append(msg, script.framebulks.data(), script.framebulks.size() * sizeof(Framebulk));
+	return msg;
+}
+
+
+// Runs a script from an unloaded world, and again with a quick reset if it has that set. The stats
+// are for both runs, first_ticks is how long the first one took. Returns false if the script is
+// rejected.
+static bool Run(const Script& script, sim::Stats& stats, uint32_t& first_ticks, std::vector<sim::RecordedEvent>& events) {
+	std::vector<char> msg = Encode(script);
+	ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data)
+		return false;
+	sim::UnloadWorld();
+	stats = sim::RunScript(data);
+	first_ticks = (uint32_t)stats.ticks;
+	events = sim::Events();
+	if (script.quick_reset) {
+		sim::Stats again = sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+		for (const sim::RecordedEvent& e : sim::Events())
+			events.push_back({e.tick + (uint32_t)stats.ticks, e.key, e.pressed});
+		stats.ticks += again.ticks;
+		stats.tick_allocs += again.tick_allocs;
+	}
+	return true;
+}
+
+
+// for going back from tick rewind_to to tick rewind_from once, see CheckRewind()
+static uint32_t rewind_from, rewind_to;
+static bool rewound;
+static ScriptManager::Position rewind_pos;
+static sim::FakeKart rewind_kart;
+// the kart at the end of every tick, the keys after a rewind are sent again even if they didn't change
+static std::vector<sim::FakeKart> karts;
+
+
+static void Rewind(uint32_t tick) {
+	karts.resize(tick + 1);
+	karts[tick] = sim::fake_kart;
+	if (tick == rewind_from) {
+		sim::GetScriptManager().getPosition(rewind_pos);
+		rewind_kart = sim::fake_kart;
+	} else if (tick == rewind_to && !rewound) {
+		rewound = sim::GetScriptManager().setPosition(rewind_pos);
+		sim::fake_kart = rewind_kart;
+	}
+}
+
+
+// goes back once from the end of a tick to the end of an earlier one (ticks is how long the script
+// takes from an unloaded world), the ticks after that have to play out the same way as the first time
+static bool CheckRewind(const Script& script, uint32_t ticks) {
+	if (ticks < 8)
+		return true;
+	// the script has stopped by the end of its last tick, so that's never gone back from
+	rewind_from = 1 + rng(ticks / 2 - 1);
+	rewind_to = rewind_from + 1 + rng(ticks / 2 - 2);
+	rewound = false;
+	karts.clear();
+	std::vector<char> msg = Encode(script);
+	sim::after_tick = &Rewind;
+	sim::UnloadWorld();
+	sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	sim::after_tick = nullptr;
+	uint32_t len = rewind_to - rewind_from;
+	return rewound && karts.size() > rewind_to + len &&
+		std::equal(karts.begin() + rewind_from + 1, karts.begin() + rewind_to + 1, karts.begin() + rewind_to + 1);
+}
+
+
+static bool CheckRandomScripts(uint32_t num_scripts) {
+	sim::record_events = true;
+	uint64_t total_ticks = 0, total_fbs = 0, total_flat_fbs = 0;
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < num_scripts; i++) {
+		// deep blocks can multiply out to a lot of ticks, those scripts are skipped
+		Script script;
+		do {
+			script = Script();
+		} while (RandomBody(script, 0, i % 2 == 0) > 100000);
+		script.quick_reset = i % 3 == 0;
+		Script flat = Flatten(script);
+		sim::Stats stats, flat_stats;
+		uint32_t first_ticks, flat_first_ticks;
+		std::vector<sim::RecordedEvent> events, flat_events;
+		if (!Run(script, stats, first_ticks, events) || !Run(flat, flat_stats, flat_first_ticks, flat_events)) {
+			std::cout << "  ERROR: script " << i << " was rejected\n";
+			failed++;
+			continue;
+		}
+		// recording the events allocates, so allocations are only checked with the periodic script
+		bool ok = stats.ticks == flat_stats.ticks && events == flat_events;
+		if (ok && !CheckRewind(script, first_ticks)) {
+			std::cout << "  ERROR: script " << i << " didn't play out the same way after going back from tick "
+				<< rewind_to << " to " << rewind_from << "\n";
+			ok = false;
+		} else if (!ok) {
+			std::cout << "  ERROR: script " << i << " took " << stats.ticks << " ticks & sent " << events.size()
+				<< " key events, written out it took " << flat_stats.ticks << " & sent " << flat_events.size() << "\n";
+		}
+		failed += !ok;
+		total_ticks += stats.ticks;
+		total_fbs += script.framebulks.size();
+		total_flat_fbs += flat.framebulks.size();
+	}
+	sim::record_events = false;
+	std::cout << "  scripts:       " << num_scripts << " (" << total_ticks << " ticks), "
+		<< total_fbs << " framebulks as written, " << total_flat_fbs << " written out\n";
+	return failed == 0;
+}
+
+
+// lots of alternating skids with a bit of driving straight every now and then
+static bool CheckPeriodic() {
+	Script script;
+	Framebulk fb = {};
+	fb.accel = true;
+	fb.num_ticks = 10;
+	script.framebulks.push_back(fb);
+	script.repeats.push_back({1, 5, 1000});
+	script.repeats.push_back({1, 3, 20});
+	fb.skid = true;
+	fb.turn_angle = -1;
+	script.framebulks.push_back(fb);
+	fb.turn_angle = 1;
+	script.framebulks.push_back(fb);
+	fb.skid = false;
+	fb.turn_angle = 0;
+	fb.num_ticks = 30;
+	script.framebulks.push_back(fb);
+	fb.accel = false;
+	fb.brake = true;
+	fb.num_ticks = 5;
+	script.framebulks.push_back(fb);
+	Script flat = Flatten(script);
+
+	bool ok = true;
+	size_t mem[2];
+	double secs[2];
+	sim::Stats stats[2];
+	const Script* scripts[2] = {&script, &flat};
+	for (int i = 0; i < 2; i++) {
+		std::vector<char> msg = Encode(*scripts[i]);
+		size_t before = Arena::totalReserved();
+		ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+		if (!data) {
+			std::cout << "  ERROR: bad script message\n";
+			return false;
+		}
+		mem[i] = Arena::totalReserved() - before;
+		sim::UnloadWorld();
+		secs[i] = sim::TimeSecs([&] {stats[i] = sim::RunScript(data);});
+		if (stats[i].tick_allocs > 0) {
+			std::cout << "  ERROR: allocations outside of map load\n";
+			ok = false;
+		}
+	}
+	std::cout << "  periodic:      " << stats[0].ticks << " ticks from " << script.framebulks.size() << " framebulks, "
+		<< flat.framebulks.size() << " written out\n"
+		<< "  script mem:    " << mem[0] << " bytes with repeat blocks, " << mem[1] << " written out\n"
+		<< "  ticks/sec:     " << (uint64_t)(stats[0].ticks / secs[0]) << " with repeat blocks, "
+		<< (uint64_t)(stats[1].ticks / secs[1]) << " written out\n";
+	if (stats[0].ticks != stats[1].ticks || stats[0].events != stats[1].events) {
+		std::cout << "  ERROR: the periodic script played differently written out\n";
+		ok = false;
+	}
+	return ok;
+}
+
+
+static bool CheckRejected() {
+	Script good;
+	Framebulk fb = {};
+	fb.num_ticks = 5;
+	good.framebulks.assign(4, fb);
+	good.repeats = {{0, 4, 2}, {1, 3, 2}};
+
+	std::vector<std::pair<const char*, std::vector<RepeatBlock>>> bad = {
+		{"overlapping blocks", {{0, 2, 2}, {1, 3, 2}}},
+		{"a block that runs 0 times", {{0, 2, 0}}},
+		{"an empty block", {{1, 1, 2}}},
+		{"a block past the end", {{2, 5, 2}}},
+		{"blocks out of order", {{1, 3, 2}, {0, 4, 2}}},
+		{"blocks nested too deep", std::vector<RepeatBlock>(ScriptManager::MAX_REPEAT_DEPTH + 1, {0, 4, 2})},
+	};
+	bool ok = true;
+	std::vector<char> msg = Encode(good);
+	ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "  ERROR: good repeat blocks were rejected\n";
+		ok = false;
+	}
+	ScriptData::destroy(data);
+	for (auto& b : bad) {
+		Script script = good;
+		script.repeats = b.second;
+		msg = Encode(script);
+		if (ScriptData* d = ScriptData::fromMessage(msg.data(), msg.size())) {
+			std::cout << "  ERROR: " << b.first << " weren't rejected\n";
+			ScriptData::destroy(d);
+			ok = false;
+		}
+	}
+	// and blocks that don't have to take any ticks, or take more than fit in 64 bits
+	std::vector<std::pair<const char*, Script>> bad_scripts(3, {"", good});
+	bad_scripts[0].first = "a block without ticks";
+	bad_scripts[0].second.framebulks[1].num_ticks = bad_scripts[0].second.framebulks[2].num_ticks = 0;
+	bad_scripts[1].first = "a block of only until framebulks";
+	bad_scripts[1].second.framebulks[1].until = bad_scripts[1].second.framebulks[2].until = true;
+	bad_scripts[2].first = "a script that takes more than 2^64 ticks";
+	bad_scripts[2].second.repeats = std::vector<RepeatBlock>(3, {0, 4, UINT32_MAX});
+	for (auto& b : bad_scripts) {
+		msg = Encode(b.second);
+		if (ScriptData* d = ScriptData::fromMessage(msg.data(), msg.size())) {
+			std::cout << "  ERROR: " << b.first << " wasn't rejected\n";
+			ScriptData::destroy(d);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+int RunRepeatCheck(uint32_t num_scripts) {
+	if (num_scripts == 0)
+		return 1;
+	sim::Init();
+	bool ok = CheckRandomScripts(num_scripts);
+	ok &= CheckPeriodic();
+	ok &= CheckRejected();
+	return ok ? 0 : 3;
+}
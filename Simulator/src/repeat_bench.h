@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Checks repeat blocks with num_scripts made up scripts (with nested blocks, conditions and 0
+// tick framebulks): each one has to send exactly the same inputs on the same ticks as the same
+// script with its blocks written out, also after a quick reset and after going back to an earlier
+// position. Then compares the memory & speed of a long periodic script with & without repeat
+// blocks. Returns non-zero if any of the checks fail or if a tick allocated.
+int RunRepeatCheck(uint32_t num_scripts);
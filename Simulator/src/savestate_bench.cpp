@@ -0,0 +1,151 @@
+#include <iostream>
+#include <string.h>
+#include <vector>
+#include "savestate_bench.h"
+#include "../../Payload/src/savestates.h"
+
+/*
+* Most of the game's memory doesn't change from tick to tick (meshes, textures, the track), and
+* most writes go to a small set of hot objects (karts, physics, particles). The fake game writes
+* to WRITES_PER_TICK spots every tick, most of them in the first HOT_PERCENT of the memory. A
+* savestate is taken every CAPTURE_INTERVAL ticks with a ring that's smaller than the number of
+* captures (so the oldest ones get folded into the base), then the fake game keeps going for a bit
+* and rewinds to one of the savestates.
+*/
+
+
+static const size_t REGION_SIZE = 16 << 20;
+static const int WRITES_PER_TICK = 200;
+static const int HOT_PERCENT = 2;
+static const uint32_t CAPTURE_INTERVAL = 120;
+static const int NUM_CAPTURES = 10;
+static const size_t RING_SIZE = 8;
+// which capture to go back to, this one has to be in the ring after NUM_CAPTURES
+static const int CHECKED_CAPTURE = 7;
+
+
+struct FakeGame {
+	std::vector<platform::MemRegion> regions;
+	size_t total_size = 0;
+	uint32_t rng = 0x12345678;
+
+	uint32_t nextRand() {
+		// xorshift32
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng;
+	}
+
+	char* at(size_t off) {
+		return regions[off / REGION_SIZE].base + off % REGION_SIZE;
+	}
+
+	void tick() {
+		size_t hot_size = total_size / 100 * HOT_PERCENT;
+		for (int i = 0; i < WRITES_PER_TICK; i++) {
+			uint64_t r = ((uint64_t)nextRand() << 32) | nextRand();
+			size_t off = (r % 10 == 0 ? r % total_size : r % hot_size) & ~(size_t)7;
+			*(uint64_t*)at(off) = r;
+		}
+	}
+
+	void copyTo(char* out) {
+		for (size_t i = 0; i < regions.size(); i++)
+			memcpy(out + i * REGION_SIZE, regions[i].base, REGION_SIZE);
+	}
+
+	bool equals(const char* copy) {
+		for (size_t i = 0; i < regions.size(); i++)
+			if (memcmp(copy + i * REGION_SIZE, regions[i].base, REGION_SIZE) != 0)
+				return false;
+		return true;
+	}
+};
+
+
+static bool RunMode(FakeGame& game, char* checked_copy, bool track_writes) {
+	SaveStates savestates;
+	ScriptManager::Position pos = {0, 0, 1, 0, {}, {}, 0};
+
+	if (!savestates.init(game.regions.data(), game.regions.size(), RING_SIZE, track_writes, 0, pos)) {
+		std::cout << "  could not init savestates\n";
+		return false;
+	}
+	size_t base_bytes = savestates.stats().last_capture_bytes;
+	uint64_t base_us = savestates.stats().last_capture_us;
+
+	uint32_t tick = 0;
+	size_t delta_bytes = 0;
+	uint64_t capture_us = 0;
+	for (int c = 1; c <= NUM_CAPTURES; c++) {
+		for (uint32_t i = 0; i < CAPTURE_INTERVAL; i++, tick++)
+			game.tick();
+		pos = {c, 0, 1, 0, {}, {}, 0};
+		if (!savestates.capture(tick, pos)) {
+			std::cout << "  capture failed\n";
+			return false;
+		}
+		delta_bytes += savestates.stats().last_capture_bytes;
+		capture_us += savestates.stats().last_capture_us;
+		if (c == CHECKED_CAPTURE)
+			game.copyTo(checked_copy);
+	}
+	for (uint32_t i = 0; i < CAPTURE_INTERVAL / 2; i++)
+		game.tick();
+
+	uint32_t restored_tick;
+	ScriptManager::Position restored_pos;
+	bool ok = savestates.restore(NUM_CAPTURES - CHECKED_CAPTURE, restored_tick, restored_pos);
+	ok = ok && restored_tick == CHECKED_CAPTURE * CAPTURE_INTERVAL && restored_pos.fb_idx == CHECKED_CAPTURE;
+	ok = ok && game.equals(checked_copy);
+
+	// and once more after the game has kept going from the restored state
+	for (uint32_t i = 0; i < CAPTURE_INTERVAL; i++)
+		game.tick();
+	ok = ok && savestates.restore(0, restored_tick, restored_pos) && game.equals(checked_copy);
+
+	const SaveStates::Stats& st = savestates.stats();
+	std::cout << (track_writes ? "  write tracking:\n" : "  hashing:\n")
+		<< "    base:         " << (base_bytes >> 20) << " MB in " << base_us / 1000.0 << " ms\n"
+		<< "    capture:      " << delta_bytes / NUM_CAPTURES / 1024 << " KB avg in "
+		<< capture_us / NUM_CAPTURES / 1000.0 << " ms avg (every " << CAPTURE_INTERVAL << " ticks)\n"
+		<< "    restore:      " << st.last_restore_pages << " pages in " << st.last_restore_us / 1000.0 << " ms\n"
+		<< "    ring memory:  " << (st.total_bytes >> 20) << " MB for " << st.snapshots << " snapshots\n";
+	if (!ok)
+		std::cout << "  ERROR: the restored memory or position doesn't match the savestate\n";
+	return ok;
+}
+
+
+int RunSaveStateBenchmark(size_t size_mb) {
+	FakeGame game;
+	size_t num_regions = (size_mb * (1 << 20) + REGION_SIZE - 1) / REGION_SIZE;
+	for (size_t i = 0; i < num_regions; i++) {
+		char* p = (char*)platform::AllocPages(REGION_SIZE);
+		if (!p) {
+			std::cout << "Could not allocate " << size_mb << " MB\n";
+			return 1;
+		}
+		game.regions.push_back({p, REGION_SIZE, false});
+		for (size_t off = 0; off < REGION_SIZE; off += sizeof(uint32_t))
+			*(uint32_t*)(p + off) = game.nextRand();
+	}
+	game.total_size = num_regions * REGION_SIZE;
+	char* checked_copy = (char*)platform::AllocPages(game.total_size);
+	if (!checked_copy) {
+		std::cout << "Could not allocate " << size_mb << " MB\n";
+		return 1;
+	}
+
+	std::cout << "savestates over " << (game.total_size >> 20) << " MB, " << WRITES_PER_TICK << " writes/tick\n";
+	int ret = 0;
+	for (bool track_writes : {false, true})
+		if (!RunMode(game, checked_copy, track_writes))
+			ret = 3;
+
+	platform::FreePages(checked_copy, game.total_size);
+	for (auto& r : game.regions)
+		platform::FreePages(r.base, r.size);
+	return ret;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <stddef.h>
+
+// Runs a fake game over size_mb of memory that writes to a few pages every tick, takes a
+// savestate every second, then rewinds and checks that the memory is exactly what it was when
+// the savestate was taken. Done with & without write tracking, prints snapshot sizes & times.
+// Returns non-zero if a restore didn't match.
+int RunSaveStateBenchmark(size_t size_mb);
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+#include "scan_bench.h"
+#include "sim_util.h"
+#include "../../Payload/src/mem_scanner.h"
+
+/*
+* The game only has a few hundred MB of writable memory, but the scanner should hold up with a
+* lot more than that. The memory is split into regions like a real process would be, and filled
+* with random floats with a single known value planted in the middle. Each scanner step is then
+* timed: the new scan (a copy of everything), an exact value filter over every value, a relation
+* filter over every value, and a relation filter with only one candidate left.
+*/
+
+
+static const size_t REGION_SIZE = 64 << 20;
+static const float PLANTED_VALUE = 123.5f;
+
+
+struct StepTimes {
+	double new_scan, exact, unchanged, sparse;
+	size_t exact_candidates, unchanged_candidates, sparse_candidates;
+	uintptr_t found;
+};
+
+
+static StepTimes RunSteps(bool simd, std::vector<platform::MemRegion>& regions, float* planted) {
+	MemScanner scanner;
+	scanner.setUseSimd(simd);
+	StepTimes t = {};
+
+	t.new_scan = sim::TimeSecs([&] {scanner.newScan(MemScanner::ValueType::Float, regions.data(), regions.size());});
+	t.unchanged = sim::TimeSecs([&] {t.unchanged_candidates = scanner.filter(MemScanner::Compare::Unchanged);});
+	t.exact = sim::TimeSecs([&] {t.exact_candidates = scanner.filter(MemScanner::Compare::Between, PLANTED_VALUE, PLANTED_VALUE);});
+	*planted += 1;
+	t.sparse = sim::TimeSecs([&] {t.sparse_candidates = scanner.filter(MemScanner::Compare::Increased);});
+	*planted -= 1;
+
+	MemScanner::Candidate c;
+	if (scanner.getCandidates(0, &c, 1) == 1)
+		t.found = c.address;
+	return t;
+}
+
+
+// Bounds outside of int32's range have to be clamped, not cast. Returns false if an int32 filter
+// with them kept the wrong values.
+static bool CheckIntBounds(bool simd) {
+	const size_t NUM_VALUES = 256;
+	int32_t* values = (int32_t*)platform::AllocPages(NUM_VALUES * sizeof(int32_t));
+	for (size_t i = 0; i < NUM_VALUES; i++)
+		values[i] = (int32_t)(i * 1000) - 100000;
+	values[0] = INT32_MIN;
+	values[1] = INT32_MAX;
+	platform::MemRegion region = {(char*)values, NUM_VALUES * sizeof(int32_t), false};
+
+	struct Case {
+		double lo, hi;
+		size_t expected;
+	};
+	const Case cases[] = {
+		{-1e300, 1e300, NUM_VALUES},
+		{3e9, 4e9, 0},
+		{-4e9, -3e9, 0},
+		{INT32_MAX, 1e20, 1},
+		{-1e20, INT32_MIN, 1},
+		{NAN, 5, 0},
+		{0.5, 0.7, 0},
+	};
+	bool ok = true;
+	MemScanner scanner;
+	scanner.setUseSimd(simd);
+	for (const Case& c : cases) {
+		scanner.newScan(MemScanner::ValueType::Int32, &region, 1);
+		ok &= scanner.filter(MemScanner::Compare::Between, c.lo, c.hi) == c.expected;
+	}
+	platform::FreePages(values, NUM_VALUES * sizeof(int32_t));
+	return ok;
+}
+
+
+int RunScanBenchmark(size_t size_mb) {
+	size_t num_regions = (size_mb * (1 << 20) + REGION_SIZE - 1) / REGION_SIZE;
+	std::vector<platform::MemRegion> regions;
+	uint32_t rng = 0x12345678;
+	for (size_t i = 0; i < num_regions; i++) {
+		char* p = (char*)platform::AllocPages(REGION_SIZE);
+		if (!p) {
+			std::cout << "Could not allocate " << size_mb << " MB\n";
+			return 1;
+		}
+		regions.push_back({p, REGION_SIZE, false});
+		float* values = (float*)p;
+		for (size_t j = 0; j < REGION_SIZE / sizeof(float); j++) {
+			// xorshift32, kept away from the planted value
+			rng ^= rng << 13;
+			rng ^= rng >> 17;
+			rng ^= rng << 5;
+			values[j] = (float)(rng % 100000) * 0.01f;
+			if (values[j] == PLANTED_VALUE)
+				values[j] = 0;
+		}
+	}
+	float* planted = (float*)regions[num_regions / 2].base + 12345;
+	*planted = PLANTED_VALUE;
+
+	double gb = (double)num_regions * REGION_SIZE / (1 << 30);
+	std::cout << "scanning " << gb << " GB in " << num_regions << " regions\n";
+
+	int ret = 0;
+	StepTimes scalar = RunSteps(false, regions, planted);
+	for (bool simd : {false, true}) {
+		if (simd && !MemScanner::cpuHasAvx2()) {
+			std::cout << "  (no AVX2)\n";
+			break;
+		}
+		StepTimes t = simd ? RunSteps(true, regions, planted) : scalar;
+		std::cout << (simd ? "  avx2:\n" : "  scalar:\n")
+			<< "    new scan:       " << gb / t.new_scan << " GB/s\n"
+			<< "    unchanged:      " << gb / t.unchanged << " GB/s (" << t.unchanged_candidates << " left)\n"
+			<< "    exact value:    " << gb / t.exact << " GB/s (" << t.exact_candidates << " left)\n"
+			<< "    increased:      " << t.sparse * 1000 << " ms (" << t.sparse_candidates << " left)\n";
+		if (t.found != (uintptr_t)planted || t.sparse_candidates != 1 ||
+			t.exact_candidates != scalar.exact_candidates || t.unchanged_candidates != scalar.unchanged_candidates
+		) {
+			std::cout << "  ERROR: the planted value wasn't found, or SIMD and scalar don't agree\n";
+			ret = 3;
+		}
+		if (!CheckIntBounds(simd)) {
+			std::cout << "  ERROR: an int32 filter with bounds outside of int32's range kept the wrong values\n";
+			ret = 3;
+		}
+	}
+
+	for (auto& r : regions)
+		platform::FreePages(r.base, r.size);
+	return ret;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stddef.h>
+
+// Runs the memory scanner over size_mb of synthetic memory with and without SIMD and prints how
+// fast each step was. Returns non-zero if the two disagree or if the planted value wasn't found.
+int RunScanBenchmark(size_t size_mb);
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+#include <vector>
+#include "seed_bench.h"
+#include "mock_game.h"
+
+// about an item box a second
+static const uint32_t ITEM_BOX_TICKS = 120;
+static const uint32_t SEED = 0x5eed;
+
+
+// the message with its seed replaced (or taken out if has_seed is false)
+static std::vector<char> WithSeed(std::vector<char> msg, bool has_seed, uint32_t seed) {
+	size_t map_len = strnlen(msg.data(), msg.size());
+	size_t player_len = strnlen(msg.data() + map_len + 1, msg.size() - map_len - 1);
+	size_t flags_pos = map_len + player_len + 2 + ScriptData::FIELDS_SIZE - 1;
+	uint8_t& flags = (uint8_t&)msg[flags_pos];
+	size_t seed_pos = flags_pos + 1 + (flags & ScriptData::FLAG_HAS_DURATION ? 4 : 0);
+	if (flags & ScriptData::FLAG_HAS_SEED)
+		msg.erase(msg.begin() + seed_pos, msg.begin() + seed_pos + 4);
+	flags = has_seed ? flags | ScriptData::FLAG_HAS_SEED : flags & ~ScriptData::FLAG_HAS_SEED;
+	if (has_seed)
+		msg.insert(msg.begin() + seed_pos, (const char*)&seed, (const char*)&seed + 4);
+	return msg;
+}
+
+
+// what the kart got from each item box of the last run
+struct ItemBox {
+	uint32_t item;
+	float bump;
+
+	bool operator==(const ItemBox& o) const {return item == o.item && bump == o.bump;}
+};
+
+static std::vector<ItemBox> item_boxes;
+
+static void RecordItemBox(uint32_t tick) {
+	if (tick % ITEM_BOX_TICKS == 0)
+		item_boxes.push_back({sim::fake_kart.item, sim::fake_kart.bump});
+}
+
+
+// the state hashes of every tick of a run, with a full load or with a reset
+static std::vector<uint32_t> Run(StateHasher& hasher, const std::vector<char>& msg, bool load) {
+	if (load)
+		sim::UnloadWorld();
+	item_boxes.clear();
+	hasher.setReference(nullptr, 0);
+	hasher.start();
+	sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	return std::vector<uint32_t>(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+}
+
+
+/*
+* Runs the script runs times, every other one with a full load. The mock's reset runs are a tick
+* off from its loaded ones, so each kind is compared to its own first run, but they should get the
+* same things from their item boxes (same_boxes). Returns how many runs didn't have the same hashes
+* as the first one of their kind.
+*/
+static int DifferentRuns(StateHasher& hasher, const std::vector<char>& msg, int runs, std::vector<uint32_t>& loaded, bool& same_boxes) {
+	std::vector<uint32_t> reset;
+	std::vector<ItemBox> loaded_boxes;
+	int different = 0;
+	for (int i = 0; i < runs; i++) {
+		bool load = i % 2 == 0;
+		std::vector<uint32_t> hashes = Run(hasher, msg, load);
+		std::vector<uint32_t>& first = load ? loaded : reset;
+		if (i == 0)
+			loaded_boxes = item_boxes;
+		if (i == 1)
+			same_boxes = item_boxes == loaded_boxes;
+		if (i < 2)
+			first = hashes;
+		else if (hashes != first)
+			different++;
+	}
+	return different;
+}
+
+
+int RunSeedCheck(const char* path, int runs) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> msg((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	ScriptData* data = msg.empty() ? nullptr : ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "Could not read a script from '" << path << "'\n";
+		return 1;
+	}
+	ScriptData::destroy(data);
+	if (runs < 4)
+		runs = 4;
+
+	std::cout << path << ":\n";
+	sim::Init();
+	sim::item_box_ticks = ITEM_BOX_TICKS;
+	StateHasher& hasher = g_pInfo->state_hasher;
+	hasher.addAddress(&sim::fake_kart, sizeof(sim::fake_kart));
+	sim::after_tick = &RecordItemBox;
+	const ScriptManager::RandomStats& random = sim::GetScriptManager().randomStats();
+	int ret = 0;
+
+	std::vector<char> unseeded = WithSeed(msg, false, 0);
+	std::vector<char> seeded = WithSeed(msg, true, SEED);
+	std::vector<uint32_t> unseeded_hashes, seeded_hashes, other_hashes;
+
+	bool unseeded_same_boxes, seeded_same_boxes;
+	int unseeded_different = DifferentRuns(hasher, unseeded, runs, unseeded_hashes, unseeded_same_boxes);
+	uint32_t unseeded_game_seeds = random.game_seeds;
+	ScriptManager::RandomStats before = random;
+	int seeded_different = DifferentRuns(hasher, seeded, runs, seeded_hashes, seeded_same_boxes);
+	uint32_t seeded_game_seeds = random.game_seeds - before.game_seeds;
+	uint64_t draws = random.draws - before.draws;
+	Run(hasher, WithSeed(msg, true, SEED + 1), true);
+	other_hashes.assign(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+
+	std::cout << "  ticks:        " << seeded_hashes.size() << "\n"
+		<< "  without seed: " << runs - 2 - unseeded_different << " of " << runs - 2 << " reruns had the same hashes as the first\n"
+		<< "  seed " << SEED << ":   " << runs - 2 - seeded_different << " of " << runs - 2 << " reruns had the same hashes as the first ("
+		<< (runs + 1) / 2 << " loaded, " << runs / 2 << " reset)\n"
+		<< "  item boxes:   " << (seeded_same_boxes ? "the same" : "different") << " after a reset as after a load with the seed ("
+			<< (unseeded_same_boxes ? "the same" : "different") << " without)\n"
+		<< "  seed " << SEED + 1 << ":   " << (other_hashes == seeded_hashes ? "the same" : "different") << " hashes\n"
+		<< "  random:       " << (double)draws / runs << " draws/run, " << seeded_game_seeds << " of the game's seedings pinned\n";
+
+	if (unseeded_different == 0 || unseeded_hashes.size() < ITEM_BOX_TICKS) {
+		std::cout << "  ERROR: the runs without a seed were all the same, the script is too short for item boxes\n";
+		ret = 3;
+	}
+	if (seeded_different > 0) {
+		std::cout << "  ERROR: the seed didn't make the runs the same\n";
+		ret = 3;
+	}
+	if (!seeded_same_boxes || unseeded_same_boxes) {
+		std::cout << "  ERROR: a reset run didn't start from the seed the way that a loaded one does\n";
+		ret = 3;
+	}
+	if (other_hashes == seeded_hashes) {
+		std::cout << "  ERROR: a different seed gave the same race\n";
+		ret = 3;
+	}
+	// every full load seeds rand() with the time, which only a script's seed replaces
+	if (unseeded_game_seeds > 0 || seeded_game_seeds != (uint32_t)(runs + 1) / 2 || random.seeded != (uint32_t)(runs + 1) * 2) {
+		std::cout << "  ERROR: the game's seeding was replaced when it shouldn't have been (or wasn't when it should)\n";
+		ret = 3;
+	}
+
+	hasher.stop();
+	sim::after_tick = nullptr;
+	sim::item_box_ticks = 0;
+	return ret;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Runs a script runs times on a mock game with item boxes (that give items & bumps from rand()), with
+// half of the runs loading the map and the other half resetting the world, and checks that every
+// run has the same state hash on every tick as the first one of its kind once the script has a
+// seed (and that they don't without one, or the check wouldn't show anything). Also checks that a
+// different seed gives a different race, and that the game's own seeding is only replaced while a
+// script with a seed is running. Returns non-zero if any of the checks fail.
+int RunSeedCheck(const char* path, int runs);
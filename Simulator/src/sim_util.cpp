@@ -0,0 +1,23 @@
+#include <string.h>
+#include "sim_util.h"
+
+
+namespace sim {
+
+	void Append(std::vector<char>& msg, const void* p, size_t size) {
+		msg.resize(msg.size() + size);
+		memcpy(msg.data() + msg.size() - size, p, size);
+	}
+
+
+	std::vector<char> ScriptHeader(uint8_t flags, const char* map, const char* kart) {
+		std::vector<char> msg;
+		Append(msg, map, strlen(map) + 1);
+		Append(msg, kart, strlen(kart) + 1);
+		int32_t fields[3] = {0, 1, 0};
+		Append(msg, fields, sizeof(fields));
+		msg.push_back((char)flags);
+		return msg;
+	}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bits that the benches all need: timing, building script messages and repeatable random numbers.
+
+namespace sim {
+
+	// how long f() took, in seconds
+	template <typename F>
+	double TimeSecs(F f) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// adds size bytes from p to the end of msg
+	void Append(std::vector<char>& msg, const void* p, size_t size);
+
+	/*
+	* The start of a script message, as the parser sends it: the map & kart names, the race's fields
+	* (no AI, 1 lap, easy) and flags, which is made of ScriptData::FLAG_ bits. Whatever the flags say
+	* comes next (the duration, the actions...) and then the framebulks go after this.
+	*/
+	std::vector<char> ScriptHeader(uint8_t flags, const char* map = "abyss", const char* kart = "tux");
+
+	// an LCG, so that the benches make the same "random" data on every run
+	struct Rng {
+		uint32_t state;
+
+		uint32_t next() {
+			state = state * 1664525 + 1013904223;
+			return state;
+		}
+
+		// 0 to n - 1
+		uint32_t operator()(uint32_t n) {
+			return (uint32_t)(((uint64_t)next() * n) >> 32);
+		}
+	};
+
+}
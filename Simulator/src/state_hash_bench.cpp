@@ -0,0 +1,177 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+#include <vector>
+#include "state_hash_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+/*
+* The fake kart only has a few floats, the real game state that would be hashed (the rigid body,
+* controls & kart of each kart) is more like half a KB per kart, so a block of that size is
+* hashed along with it to get a realistic cost.
+*/
+
+
+static const size_t FAKE_KART_STATE_BYTES = 8 * 512;
+
+
+static bool CheckHashesAgree() {
+	std::vector<char> buf(1 << 20);
+	uint32_t rng = 0x12345678;
+	for (auto& c : buf) {
+		rng = rng * 1664525 + 1013904223;
+		c = (char)(rng >> 24);
+	}
+	for (size_t size = 0; size < 1024; size++) {
+		for (size_t off = 0; off < 4; off++) {
+			if (StateHasher::hash(buf.data() + off, size, size) != StateHasher::hashScalar(buf.data() + off, size, size)) {
+				std::cout << "  ERROR: SIMD & plain hashes differ for " << size << " bytes\n";
+				return false;
+			}
+		}
+	}
+
+	// flipping any single bit has to change the hash
+	uint64_t h = StateHasher::hash(buf.data(), 4096, 0);
+	for (size_t bit = 0; bit < 4096 * 8; bit++) {
+		buf[bit / 8] ^= 1 << (bit % 8);
+		bool same = StateHasher::hash(buf.data(), 4096, 0) == h;
+		buf[bit / 8] ^= 1 << (bit % 8);
+		if (same) {
+			std::cout << "  ERROR: flipping bit " << bit << " doesn't change the hash\n";
+			return false;
+		}
+	}
+
+	const int REPS = 200;
+	volatile uint64_t sink = 0;
+	double simd = sim::TimeSecs([&] {for (int i = 0; i < REPS; i++) sink = sink + StateHasher::hash(buf.data(), buf.size(), i);});
+	double plain = sim::TimeSecs([&] {for (int i = 0; i < REPS; i++) sink = sink + StateHasher::hashScalar(buf.data(), buf.size(), i);});
+	double gb = (double)buf.size() * REPS / (1 << 30);
+	std::cout << "  hash speed:   " << gb / simd << " GB/s (plain: " << gb / plain << " GB/s)\n";
+	return true;
+}
+
+
+static std::vector<uint32_t> RunWithHashes(StateHasher& hasher, const std::vector<char>& msg, const uint32_t* reference, size_t reference_size) {
+	hasher.setReference(reference, reference_size);
+	hasher.start();
+	sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	return std::vector<uint32_t>(hasher.hashes(), hasher.hashes() + hasher.stats().hashes);
+}
+
+
+bool ChangeOneInput(std::vector<char>& msg) {
+	size_t map_len = strnlen(msg.data(), msg.size());
+	size_t player_len = strnlen(msg.data() + map_len + 1, msg.size() - map_len - 1);
+	size_t fb_start = map_len + player_len + 2 + 13;
+	if (fb_start >= msg.size())
+		return false;
+	// skip the actions if there are any
+	if (msg[fb_start - 1] & 2) {
+		uint32_t num_actions;
+		memcpy(&num_actions, msg.data() + fb_start, sizeof(num_actions));
+		fb_start += 4 + (size_t)num_actions * TimedAction::SIZE_BYTES;
+		if (fb_start >= msg.size())
+			return false;
+	}
+	size_t num_fbs = (msg.size() - fb_start) / Framebulk::FB_SIZE_BYTES;
+	for (size_t i = num_fbs / 2; i < num_fbs; i++) {
+		char* fb = msg.data() + fb_start + i * Framebulk::FB_SIZE_BYTES;
+		uint16_t num_ticks;
+		memcpy(&num_ticks, fb + 2, sizeof(uint16_t));
+		if (num_ticks > 0) {
+			fb[0] ^= 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// the first tick (counted the same way as the hashes) where the key events differ, or -1
+static int64_t FirstInputDifference(const std::vector<sim::RecordedEvent>& a, const std::vector<sim::RecordedEvent>& b) {
+	size_t n = a.size() < b.size() ? a.size() : b.size();
+	for (size_t i = 0; i < n; i++)
+		if (!(a[i] == b[i]))
+			return (a[i].tick < b[i].tick ? a[i].tick : b[i].tick);
+	return n < a.size() ? a[n].tick : n < b.size() ? b[n].tick : -1;
+}
+
+
+int RunStateHashCheck(const char* path, int runs) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> msg((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	if (msg.empty() || !ScriptData::fromMessage(msg.data(), msg.size())) {
+		std::cout << "Could not read a script from '" << path << "'\n";
+		return 1;
+	}
+
+	std::cout << path << ":\n";
+	if (!CheckHashesAgree())
+		return 3;
+
+	sim::Init();
+	static char kart_state[FAKE_KART_STATE_BYTES];
+	StateHasher& hasher = g_pInfo->state_hasher;
+	hasher.addAddress(&sim::fake_kart, sizeof(sim::fake_kart));
+	hasher.addAddress(kart_state, sizeof(kart_state));
+	sim::record_events = true;
+
+	// two runs of the same script have to give the same hashes
+	sim::UnloadWorld();
+	std::vector<uint32_t> first = RunWithHashes(hasher, msg, nullptr, 0);
+	std::vector<sim::RecordedEvent> first_events = sim::Events();
+	sim::UnloadWorld();
+	std::vector<uint32_t> second = RunWithHashes(hasher, msg, first.data(), first.size());
+	int64_t same_divergence = hasher.stats().first_divergence;
+
+	// and one with a different input has to diverge on the first tick after that input
+	std::vector<char> changed_msg = msg;
+	bool changed = ChangeOneInput(changed_msg);
+	sim::UnloadWorld();
+	RunWithHashes(hasher, changed_msg, first.data(), first.size());
+	int64_t changed_divergence = hasher.stats().first_divergence;
+	int64_t expected_divergence = changed ? FirstInputDifference(first_events, sim::Events()) : -1;
+
+	std::cout << "  ticks:        " << first.size() << "\n"
+		<< "  bytes/tick:   " << hasher.stats().last_tick_bytes << "\n"
+		<< "  rerun:        " << (same_divergence < 0 ? "same hashes" : "diverged at tick " + std::to_string(same_divergence)) << "\n"
+		<< "  changed:      diverged at tick " << changed_divergence << " (input changed at tick " << expected_divergence << ")\n";
+
+	// how much hashing slows the simulator down, without recording events
+	sim::record_events = false;
+	hasher.stop();
+	uint64_t ticks = 0;
+	double without = sim::TimeSecs([&] {
+		for (int i = 0; i < runs; i++)
+			ticks += sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size())).ticks;
+	});
+	uint64_t tick_allocs = 0;
+	double with = sim::TimeSecs([&] {
+		for (int i = 0; i < runs; i++) {
+			hasher.start();
+			tick_allocs += sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size())).tick_allocs;
+		}
+	});
+	hasher.stop();
+	std::cout << "  ticks/sec:    " << (uint64_t)(ticks / without) << " without hashing, " << (uint64_t)(ticks / with) << " with\n"
+		<< "  overhead:     " << (with - without) / ticks * 1e9 << " ns/tick\n";
+
+	int ret = 0;
+	if (same_divergence >= 0 || second != first) {
+		std::cout << "  ERROR: the same script gave different hashes\n";
+		ret = 3;
+	}
+	if (changed_divergence != expected_divergence) {
+		std::cout << "  ERROR: the changed script didn't diverge where the input changed\n";
+		ret = 3;
+	}
+	if (tick_allocs > 0) {
+		std::cout << "  ERROR: allocations outside of map load\n";
+		ret = 2;
+	}
+	return ret;
+}
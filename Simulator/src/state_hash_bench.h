@@ -0,0 +1,12 @@
+#pragma once
+#include <vector>
+
+// Checks the state hasher against the mock game with a script: the SIMD & plain hashes have to
+// agree, a second run of the script has to match the first one tick for tick, and a run with one
+// input changed has to diverge on the first tick after that input. Also prints how much slower
+// the simulator gets with hashing on. Returns non-zero if any of the checks fail.
+int RunStateHashCheck(const char* path, int runs);
+
+// Flips the accel flag of the framebulk in the middle of a script message (there's always some
+// change in speed when it does), returns false if there's no framebulk with any ticks.
+bool ChangeOneInput(std::vector<char>& msg);
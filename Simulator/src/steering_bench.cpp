@@ -0,0 +1,80 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "steering_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+
+// the turn angles, past 1 is the same as 1 and a tiny one still steers (a little)
+static const float ANGLES[] = {0.25f, -0.5f, 1, -1, 0.75f, 0, 2, -0.001f, 0.3f, -0.3f};
+static const uint16_t TICKS_PER_ANGLE = 10;
+
+
+static std::vector<char> MakeScript() {
+	std::vector<char> msg = sim::ScriptHeader(0);
+	for (float angle : ANGLES) {
+		Framebulk fb = {};
+		fb.accel = true;
+		fb.num_ticks = TICKS_PER_ANGLE;
+		fb.turn_angle = angle;
+		sim::Append(msg, &fb, Framebulk::FB_SIZE_BYTES);
+	}
+	return msg;
+}
+
+
+static std::vector<float> steering;
+
+static void RecordSteering(uint32_t tick) {
+	// the first tick is the load, and the last one is where the script stops (and lets go of everything)
+	if (tick > 0 && sim::GetScriptManager().runningScript())
+		steering.push_back(sim::fake_kart.steer);
+}
+
+
+// how many ticks of the last run didn't steer the way that they should have
+static int WrongTicks(bool analog) {
+	int wrong = 0;
+	for (size_t i = 0; i < sizeof(ANGLES) / sizeof(ANGLES[0]); i++) {
+		float angle = ANGLES[i] > 1 ? 1 : ANGLES[i] < -1 ? -1 : ANGLES[i];
+		float expected = analog ? angle : angle > 0 ? 1.0f : angle < 0 ? -1.0f : 0;
+		for (size_t t = i * TICKS_PER_ANGLE; t < (i + 1) * TICKS_PER_ANGLE; t++)
+			// the steering's value is a whole number out of INPUT_MAX_VALUE, rounded away from 0
+			if (t >= steering.size() || std::fabs(steering[t] - expected) > 1.0f / INPUT_MAX_VALUE)
+				wrong++;
+	}
+	return wrong;
+}
+
+
+int RunSteeringCheck() {
+	sim::Init();
+	sim::after_tick = &RecordSteering;
+	std::vector<char> msg = MakeScript();
+	ScriptManager& mgr = sim::GetScriptManager();
+	bool ok = true;
+
+	for (bool direct : {true, false}) {
+		mgr.setDirectInput(direct);
+		sim::UnloadWorld();
+		steering.clear();
+		sim::Stats st = sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+		int wrong = WrongTicks(direct);
+		std::cout << (direct ? "  straight to the controller: " : "  through InputManager::input: ")
+			<< (double)st.dispatched / st.ticks << " events/tick through InputManager::input, "
+			<< (direct ? "analog" : "all or nothing") << " steering " << (wrong ? "wrong on " + std::to_string(wrong) + " ticks" : "right on every tick") << "\n";
+		if (wrong > 0 || steering.size() != sizeof(ANGLES) / sizeof(ANGLES[0]) * TICKS_PER_ANGLE) {
+			std::cout << "  ERROR: the kart didn't steer the way that the script says\n";
+			ok = false;
+		}
+		// only the first key goes through InputManager::input, that's how the controller is found
+		if (direct ? st.dispatched != 1 : st.dispatched != st.events) {
+			std::cout << "  ERROR: the keys didn't go the way they should have\n";
+			ok = false;
+		}
+	}
+
+	mgr.setDirectInput(true);
+	sim::after_tick = nullptr;
+	return ok ? 0 : 3;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Runs a made up script that steers part of the way in both directions, and checks that the
+// fake kart's steering follows each framebulk's turn angle on every tick when the keys go straight
+// to the player's controller, and that it's all or nothing when they go through
+// InputManager::input (like the keyboard). Reports the key events per tick that went through
+// InputManager::input each way. Returns non-zero if any of the checks fail.
+int RunSteeringCheck();
@@ -0,0 +1,242 @@
+#include <iostream>
+#include <chrono>
+#include <string.h>
+#include <vector>
+#include "timer_bench.h"
+#include "sim_util.h"
+#include "mock_game.h"
+#include "../../Payload/src/timer_wheel.h"
+
+/*
+* The actions are spread over a few hours of ticks so that all 3 levels above the first one get
+* used. Ticks are timed one at a time for the worst case, which adds the clock's own overhead to
+* every tick, so the averages are timed without it.
+*/
+
+
+static const uint32_t SPAN_TICKS = 1 << 21;  // ~4.8 hours at 120 ticks/sec
+
+static sim::Rng rng = {0x9e3779b9};
+
+
+// Advances from the wheel's current tick up to end, checking that every item fires on its tick
+// and after the items before it on the same tick. Returns how many fired, or -1 on an error.
+static int64_t FireAll(TimerWheel& wheel, const std::vector<uint32_t>& ticks, uint32_t end, double& worst_ns) {
+	int64_t fired = 0;
+	bool ok = true;
+	uint32_t prev_item = 0;
+	worst_ns = 0;
+	while (wheel.now() < end) {
+		uint32_t now = wheel.now();
+		bool first = true;
+		auto start = std::chrono::steady_clock::now();
+		wheel.advance([&](uint32_t item) {
+			if (ticks[item] != now || (!first && item < prev_item))
+				ok = false;
+			first = false;
+			prev_item = item;
+			fired++;
+		});
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (ns > worst_ns)
+			worst_ns = ns;
+	}
+	return ok ? fired : -1;
+}
+
+
+static bool CheckWheel(size_t count) {
+	std::vector<uint32_t> ticks(count), links(count);
+	for (auto& t : ticks)
+		t = rng(SPAN_TICKS);
+	TimerWheel wheel;
+	wheel.init(ticks.data(), sizeof(uint32_t), links.data());
+
+	double insert_secs = sim::TimeSecs([&] {
+		for (size_t i = 0; i < count; i++)
+			wheel.insert((uint32_t)i);
+	});
+	size_t pending = wheel.pending();
+	double worst_ns;
+	int64_t fired = 0;
+	double fire_secs = sim::TimeSecs([&] {fired = FireAll(wheel, ticks, SPAN_TICKS, worst_ns);});
+	bool ok = fired == (int64_t)count && pending == count && wheel.pending() == 0;
+
+	// without timing every tick
+	wheel.reset(0);
+	for (size_t i = 0; i < count; i++)
+		wheel.insert((uint32_t)i);
+	volatile uint32_t sink = 0;
+	double run_secs = sim::TimeSecs([&] {
+		while (wheel.now() < SPAN_TICKS)
+			wheel.advance([&](uint32_t item) {sink = sink + item;});
+	});
+
+	// going back halfway, the way a savestate restore does
+	uint32_t back_to = SPAN_TICKS / 4;
+	wheel.reset(0);
+	for (size_t i = 0; i < count; i++)
+		wheel.insert((uint32_t)i);
+	while (wheel.now() < SPAN_TICKS / 2)
+		wheel.advance([](uint32_t) {});
+	wheel.reset(back_to);
+	int64_t expected = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (ticks[i] >= back_to) {
+			wheel.insert((uint32_t)i);
+			expected++;
+		}
+	}
+	double rewind_worst_ns;
+	bool rewind_ok = FireAll(wheel, ticks, SPAN_TICKS, rewind_worst_ns) == expected;
+
+	std::cout << "  actions:       " << count << " over " << SPAN_TICKS << " ticks\n"
+		<< "  insert:        " << insert_secs * 1e9 / count << " ns/action\n"
+		<< "  tick:          " << run_secs * 1e9 / SPAN_TICKS << " ns avg, " << worst_ns << " ns worst (timed alone)\n"
+		<< "  fire:          " << run_secs * 1e9 / count << " ns/action (ticks included)\n"
+		<< "  checked:       " << fire_secs << " s\n";
+	if (!ok)
+		std::cout << "  ERROR: " << fired << " of " << count << " actions fired on their tick, in order\n";
+	if (!rewind_ok)
+		std::cout << "  ERROR: actions after going back to tick " << back_to << " didn't fire right\n";
+	return ok && rewind_ok;
+}
+
+
+// ns per tick with pending actions that are all due after the ticks that get timed
+static double IdleTickNs(size_t pending) {
+	const uint32_t TICKS = 1 << 20;
+	std::vector<uint32_t> ticks(pending), links(pending);
+	for (auto& t : ticks)
+		t = (1u << 24) + rng(1u << 24);
+	TimerWheel wheel;
+	wheel.init(ticks.data(), sizeof(uint32_t), links.data());
+	for (size_t i = 0; i < pending; i++)
+		wheel.insert((uint32_t)i);
+	bool fired = false;
+	double secs = sim::TimeSecs([&] {
+		for (uint32_t i = 0; i < TICKS; i++)
+			wheel.advance([&](uint32_t) {fired = true;});
+	});
+	return fired ? -1 : secs * 1e9 / TICKS;
+}
+
+
+static uint32_t ticks_done = 0;
+static uint32_t actions_fired = 0;
+static bool actions_ok = true;
+static const TimedAction* prev_action = nullptr;
+
+
+static void CountTick(uint32_t) {
+	ticks_done++;
+}
+
+
+static void CheckAction(const TimedAction& action) {
+	// the map gets loaded on the first tick, and the actions of tick t run on the tick after t ticks
+	if (ticks_done != action.tick + 1 || (prev_action && prev_action->tick == action.tick && prev_action > &action))
+		actions_ok = false;
+	prev_action = &action;
+	actions_fired++;
+}
+
+
+// a script with lots of accel and count actions (markers, plus a speed change now & then)
+static std::vector<char> MakeScript(size_t count, uint32_t script_ticks, uint32_t stop_tick) {
+	std::vector<char> msg = sim::ScriptHeader(count > 0 ? ScriptData::FLAG_HAS_ACTIONS : 0);
+	if (count > 0) {
+		uint32_t n = (uint32_t)count;
+		sim::Append(msg, &n, sizeof(n));
+	}
+	for (size_t i = 0; i < count; i++) {
+		TimedAction action = {};
+		action.tick = rng(script_ticks);
+		action.type = TimedAction::Type::Marker;
+		action.marker_id = (uint32_t)i;
+		if (i % 1000 == 0) {
+			action.type = TimedAction::Type::SetSpeed;
+			action.new_play_speed = -1;
+		}
+		if (i == count - 1 && stop_tick > 0) {
+			action.tick = stop_tick;
+			action.type = TimedAction::Type::Stop;
+		}
+		sim::Append(msg, &action, sizeof(action));
+	}
+	for (uint32_t left = script_ticks; left > 0;) {
+		Framebulk fb = {};
+		fb.accel = true;
+		fb.num_ticks = left < 0x7fff ? left : 0x7fff;
+		left -= fb.num_ticks;
+		sim::Append(msg, &fb, sizeof(fb));
+	}
+	return msg;
+}
+
+
+static bool CheckScript(size_t count) {
+	const uint32_t SCRIPT_TICKS = SPAN_TICKS / 4;
+	sim::Init();
+	sim::after_tick = &CountTick;
+	sim::SetActionHandler(&CheckAction);
+	bool ok = true;
+	double secs[2] = {};
+	sim::Stats stats[2];
+	for (int with_actions = 0; with_actions < 2; with_actions++) {
+		std::vector<char> msg = MakeScript(with_actions ? count : 0, SCRIPT_TICKS, 0);
+		ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+		if (!data) {
+			std::cout << "  ERROR: bad script message\n";
+			return false;
+		}
+		ticks_done = actions_fired = 0;
+		prev_action = nullptr;
+		actions_ok = true;
+		sim::UnloadWorld();
+		secs[with_actions] = sim::TimeSecs([&] {stats[with_actions] = sim::RunScript(data);});
+		if (stats[with_actions].tick_allocs > 0) {
+			std::cout << "  ERROR: allocations outside of map load\n";
+			ok = false;
+		}
+	}
+	std::cout << "  script ticks:  " << stats[1].ticks << "\n"
+		<< "  ticks/sec:     " << (uint64_t)(stats[0].ticks / secs[0]) << " without actions, "
+		<< (uint64_t)(stats[1].ticks / secs[1]) << " with\n";
+	if (!actions_ok || actions_fired != count) {
+		std::cout << "  ERROR: " << actions_fired << " of " << count << " script actions fired on their tick, in order\n";
+		ok = false;
+	}
+
+	// and one that stops itself halfway
+	uint32_t stop_tick = SCRIPT_TICKS / 2;
+	std::vector<char> msg = MakeScript(count, SCRIPT_TICKS, stop_tick);
+	ticks_done = actions_fired = 0;
+	prev_action = nullptr;
+	sim::UnloadWorld();
+	sim::Stats stopped = sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	if (stopped.ticks != stop_tick + 2) {
+		std::cout << "  ERROR: a stop at tick " << stop_tick << " ended the script after " << stopped.ticks << " ticks\n";
+		ok = false;
+	}
+	sim::after_tick = nullptr;
+	sim::SetActionHandler(nullptr);
+	return ok;
+}
+
+
+int RunTimerWheelBenchmark(size_t count) {
+	if (count == 0)
+		return 1;
+	bool ok = CheckWheel(count);
+
+	double few = IdleTickNs(1000), many = IdleTickNs(count);
+	std::cout << "  idle tick:     " << few << " ns with 1000 pending, " << many << " ns with " << count << "\n";
+	if (few < 0 || many < 0) {
+		std::cout << "  ERROR: an action fired early\n";
+		ok = false;
+	}
+
+	ok &= CheckScript(count);
+	return ok ? 0 : 3;
+}
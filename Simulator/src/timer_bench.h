@@ -0,0 +1,10 @@
+#pragma once
+#include <stddef.h>
+
+// Checks & benchmarks the timer wheel that scripts' actions are scheduled with, with count
+// actions: every action has to fire exactly on its tick (in the order they were added in) both
+// straight through and after going back to an earlier tick, and the cost of a tick with nothing
+// due is compared between a few & count pending actions. Then a script with count actions runs
+// through the ScriptManager on the mock game. Returns non-zero if any of the checks fail or if a
+// tick allocated.
+int RunTimerWheelBenchmark(size_t count);
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string.h>
+#include <vector>
+#include "warm_load_bench.h"
+#include "mock_game.h"
+
+/*
+* The mock's loads & resets are instant, so the load times that the payload keeps are only printed
+* to show that they're kept, the game's are what stats.py shows.
+*/
+
+
+// the race in a script's header
+struct Race {
+	std::string map;
+	std::string kart;
+	int32_t ai_count;
+	int32_t laps;
+	uint32_t difficulty;
+};
+
+
+static Race ReadRace(const std::vector<char>& msg) {
+	Race race;
+	race.map = msg.data();
+	race.kart = msg.data() + race.map.size() + 1;
+	const char* fields = msg.data() + race.map.size() + race.kart.size() + 2;
+	memcpy(&race.ai_count, fields, 4);
+	memcpy(&race.laps, fields + 4, 4);
+	memcpy(&race.difficulty, fields + 8, 4);
+	return race;
+}
+
+
+// the message with its header changed to race (and without quick reset)
+static std::vector<char> WithRace(const std::vector<char>& msg, const Race& race) {
+	Race old = ReadRace(msg);
+	size_t header_size = old.map.size() + old.kart.size() + 2 + 12;
+	std::vector<char> out(race.map.begin(), race.map.end());
+	out.push_back('\0');
+	out.insert(out.end(), race.kart.begin(), race.kart.end());
+	out.push_back('\0');
+	int32_t fields[3] = {race.ai_count, race.laps, (int32_t)race.difficulty};
+	out.insert(out.end(), (const char*)fields, (const char*)fields + sizeof(fields));
+	out.push_back(msg[header_size] & ~1);
+	out.insert(out.end(), msg.begin() + header_size + 1, msg.end());
+	return out;
+}
+
+
+static bool RunCase(const char* name, const std::vector<char>& msg, bool expect_reset) {
+	ScriptData* data = ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "  ERROR: " << name << ": bad script message\n";
+		return false;
+	}
+	sim::Stats stats = sim::RunScript(data);
+	bool reset = stats.quick_resets > 0;
+	std::cout << "  " << name << ": " << (reset ? "reset" : "full load") << "\n";
+	if (reset != expect_reset || stats.full_loads + stats.quick_resets != 1) {
+		std::cout << "  ERROR: expected a " << (expect_reset ? "reset" : "full load") << "\n";
+		return false;
+	}
+	// whatever happened, the world has to be the script's race now
+	Race race = ReadRace(msg);
+	const sim::LoadedRace& loaded = sim::GetLoadedRace();
+	if (loaded.map != race.map || loaded.kart != race.kart || loaded.laps != race.laps || loaded.difficulty != race.difficulty) {
+		std::cout << "  ERROR: the world is a different race than the script's\n";
+		return false;
+	}
+	return true;
+}
+
+
+// the keys that were held at the end of each tick of the last run
+static std::vector<uint32_t> keys_held;
+
+
+static void RecordKeys(uint32_t tick) {
+	keys_held.push_back(sim::fake_kart.keys_held);
+}
+
+
+// A reset run has to hold the keys that a full load run does on the tick after. The events aren't
+// compared since framebulks without ticks send theirs on the same tick as the next one.
+static bool CheckSameInputs(const std::vector<char>& msg) {
+	sim::after_tick = &RecordKeys;
+	sim::UnloadWorld();
+	keys_held.clear();
+	sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	std::vector<uint32_t> loaded(keys_held.begin() + 1, keys_held.end());
+	keys_held.clear();
+	sim::Stats stats = sim::RunScript(ScriptData::fromMessage(msg.data(), msg.size()));
+	sim::after_tick = nullptr;
+	// the first tick of either run is the load or the reset
+	if (stats.quick_resets != 1 || keys_held.size() != loaded.size() || !std::equal(keys_held.begin() + 1, keys_held.end(), loaded.begin() + 1)) {
+		std::cout << "  ERROR: a reset run held different keys than a full load run\n";
+		return false;
+	}
+	std::cout << "  inputs:       same after a reset as after a full load\n";
+	return true;
+}
+
+
+int RunWarmLoadCheck(const char* path) {
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> msg((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	ScriptData* data = msg.empty() ? nullptr : ScriptData::fromMessage(msg.data(), msg.size());
+	if (!data) {
+		std::cout << "Could not read a script from '" << path << "'\n";
+		return 1;
+	}
+	ScriptData::destroy(data);
+
+	std::cout << path << ":\n";
+	sim::Init();
+	Race race = ReadRace(msg);
+	msg = WithRace(msg, race);
+	Race other_map = race, other_kart = race, other_ai = race, other_laps = race, other_difficulty = race, long_name = race;
+	other_map.map += "_2";
+	other_kart.kart += "_2";
+	other_ai.ai_count++;
+	other_laps.laps++;
+	other_difficulty.difficulty = (race.difficulty + 1) % DIFFICULTY_COUNT;
+	// too long to be remembered, so it's always loaded again
+	long_name.map = std::string(100, 'a');
+
+	sim::UnloadWorld();
+	bool ok = RunCase("first run   ", msg, false);
+	ok &= RunCase("same race   ", msg, true);
+	ok &= RunCase("other map   ", WithRace(msg, other_map), false);
+	ok &= RunCase("first race  ", msg, false);
+	ok &= RunCase("other kart  ", WithRace(msg, other_kart), false);
+	ok &= RunCase("other ai    ", WithRace(msg, other_ai), false);
+	ok &= RunCase("other laps  ", WithRace(msg, other_laps), false);
+	ok &= RunCase("other diff  ", WithRace(msg, other_difficulty), false);
+	ok &= RunCase("same again  ", WithRace(msg, other_difficulty), true);
+	sim::ExitRace();
+	ok &= RunCase("after exit  ", WithRace(msg, other_difficulty), false);
+	ok &= RunCase("long name   ", WithRace(msg, long_name), false);
+	ok &= RunCase("long again  ", WithRace(msg, long_name), false);
+	ok &= CheckSameInputs(msg);
+
+	const ScriptManager::LoadStats& loads = sim::GetScriptManager().loadStats();
+	std::cout << "  full loads:   " << loads.full_loads << " (" << loads.full_load_us << " us)\n"
+		<< "  resets:       " << loads.resets << " (" << loads.reset_us << " us)\n";
+	return ok ? 0 : 3;
+}
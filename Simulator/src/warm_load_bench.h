@@ -0,0 +1,8 @@
+#pragma once
+
+// Checks that a script whose race (map, kart, AI count, laps & difficulty) is the one that the
+// world was loaded with resets the world instead of loading the map again, and that anything else
+// (a different race, or the player having left the race) still does a full load. A reset run has
+// to send the same inputs as a full load run, a tick earlier since the reset skips the tick that
+// the game takes while loading. Returns non-zero if any of the checks fail.
+int RunWarmLoadCheck(const char* path);
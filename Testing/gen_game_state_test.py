@@ -0,0 +1,79 @@
+import unittest
+import sys
+
+sys.path.append("../Payload")
+
+import gen_game_state as gen
+
+class TestGenGameState(unittest.TestCase):
+
+    def test_fields(self):
+        """This test makes sure that plain and pointer fields are parsed
+        """
+        schema = gen.parse_schema(
+            "struct World\n"
+            "\t0x10 -> Kart    m_kart\n"
+            "\t0x18 int        m_phase\n"
+            "struct Kart\n"
+            "\t8    float      m_speed\n"
+            "\t0x20 -> World   m_world\n"
+        )
+        self.assertEqual(schema.structs["World"].fields, [
+            gen.Field("m_kart", 0x10, gen.KIND_PTR, "Kart"),
+            gen.Field("m_phase", 0x18, gen.KIND_VALUE, "int"),
+        ])
+        self.assertEqual(schema.structs["Kart"].fields, [
+            gen.Field("m_speed", 8, gen.KIND_VALUE, "float"),
+            gen.Field("m_world", 0x20, gen.KIND_PTR, "World"),
+        ])
+
+    def test_chains(self):
+        """This test makes sure that chains are resolved to the struct at the end, and get a cached
+        accessor each
+        """
+        schema = gen.parse_schema(
+            "global m_world 0xc87100 -> World\n"
+            "struct World\n"
+            "\t0x10 -> Kart    m_kart\n"
+            "struct Kart\n"
+            "\t0x20 -> Body    m_body\n"
+            "struct Body\n"
+            "chain player_kart m_world m_kart\n"
+            "chain player_body m_world m_kart m_body\n"
+        )
+        kart, body = schema.chains
+        self.assertEqual((kart.target, body.target), ("Kart", "Body"))
+
+        header, source = gen.generate(schema)
+        self.assertIn("inline KartView player_kart()", header)
+        self.assertIn("inline BodyView player_body()", header)
+        self.assertIn("detail::cache[1]", header)
+        self.assertIn("void* Resolve_player_body()", source)
+
+    def test_errors(self):
+        """This test makes sure that bad schemas are rejected with the line number of the problem
+        """
+        bad_schemas = [
+            ("\t0x10 int m_x\n", 1),                                   # field outside of a struct
+            ("struct A\n\t0x10 -> B m_b\n", 2),                         # unknown struct
+            ("struct A\n\t0x10 int m_x\n\t0x14 int m_x\n", 3),          # duplicate field
+            ("struct A\n\tzz int m_x\n", 2),                            # bad offset
+            ("struct A\n\t? int m_x\n", 2),                             # field without an offset
+            ("global g ? -> A\nstruct A\n", 1),                         # global without an offset
+            ("global g 0x10 -> A\nstruct A\n\t0 int m_a\nchain c g m_a\n", 4),  # chain through a value
+            ("global g 0x10 int\nchain c g m_a\n", 2),                  # chain from a value
+        ]
+        for text, line_num in bad_schemas:
+            with self.assertRaises(gen.SchemaError, msg=text) as ctx:
+                gen.parse_schema(text)
+            self.assertIn(f"line {line_num}:", str(ctx.exception))
+
+    def test_generated_files_up_to_date(self):
+        """This test makes sure that game_state.h/.cpp were regenerated after the schema changed
+        """
+        header, source = gen.generate(gen.parse_schema(gen.SCHEMA_PATH.read_text()))
+        self.assertEqual(gen.HEADER_PATH.read_text(), header)
+        self.assertEqual(gen.SOURCE_PATH.read_text(), source)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -8,6 +8,7 @@ import struct
 sys.path.append("../Parser")
 
 import parser
+import predicate
 
 class TestParser(unittest.TestCase):
 
@@ -27,7 +28,9 @@ class TestParser(unittest.TestCase):
             parser.KW_NUM_LAPS : 1,
             parser.KW_DIFFICULTY : 2,
             parser.KW_NUM_AI : 0,
-            parser.KW_QUICK_RESET : False 
+            parser.KW_QUICK_RESET : False,
+            parser.KW_DURATION : 0.0,
+            parser.KW_SEED : None
         }
         
         self.assertEqual(test_output, expected_output)
@@ -87,7 +90,9 @@ class TestParser(unittest.TestCase):
             parser.KW_NUM_LAPS : 1,
             parser.KW_DIFFICULTY : 0,
             parser.KW_NUM_AI : 0,
-            parser.KW_QUICK_RESET : False 
+            parser.KW_QUICK_RESET : False,
+            parser.KW_DURATION : 0.0,
+            parser.KW_SEED : None
         }
         self.assertEqual(test_header_output, expected_header_output)
 
@@ -132,6 +137,57 @@ class TestParser(unittest.TestCase):
         )
         self.assertEqual(test_output, expected_output)
 
+    def test_duration_header(self):
+        """This method tests that 'duration' is an optional number of seconds, which goes right after
+        the flags with its own flag
+        """
+        test_header = [
+            (1, f"{parser.KW_MAP} = abyss"),
+            (2, f"{parser.KW_KART_NAME} = tux"),
+            (3, f"{parser.KW_NUM_LAPS} = 1"),
+            (4, f"{parser.KW_DIFFICULTY} = 2"),
+            (5, f"{parser.KW_DURATION} = 30")
+        ]
+        header = parser.parse_header(test_header)
+        self.assertEqual(header[parser.KW_DURATION], 30.0)
+        encoded = parser.encode_header(header)
+        self.assertEqual(encoded[-5], parser.HEADER_FLAG_HAS_DURATION)
+        self.assertEqual(struct.unpack('<f', encoded[-4:])[0], 30.0)
+
+        header[parser.KW_DURATION] = 0.0
+        self.assertEqual(parser.encode_header(header), encoded[:-5] + b'\x00')
+
+    def test_seed_header(self):
+        """This method tests that 'seed' is an optional 32 bit integer, which goes after the flags
+        (and the duration, if there is one) with its own flag, and that a seed of 0 is still a seed
+        """
+        test_header = [
+            (1, f"{parser.KW_MAP} = abyss"),
+            (2, f"{parser.KW_KART_NAME} = tux"),
+            (3, f"{parser.KW_NUM_LAPS} = 1"),
+            (4, f"{parser.KW_DIFFICULTY} = 2"),
+            (5, f"{parser.KW_SEED} = 0xdeadbeef")
+        ]
+        header = parser.parse_header(test_header)
+        self.assertEqual(header[parser.KW_SEED], 0xdeadbeef)
+        encoded = parser.encode_header(header)
+        self.assertEqual(encoded[-5], parser.HEADER_FLAG_HAS_SEED)
+        self.assertEqual(struct.unpack('<I', encoded[-4:])[0], 0xdeadbeef)
+
+        header[parser.KW_SEED] = 0
+        self.assertEqual(parser.encode_header(header), encoded[:-4] + b'\x00' * 4)
+
+        header[parser.KW_DURATION] = 30.0
+        encoded = parser.encode_header(header)
+        self.assertEqual(encoded[-9], parser.HEADER_FLAG_HAS_DURATION | parser.HEADER_FLAG_HAS_SEED)
+        self.assertEqual(struct.unpack('<fI', encoded[-8:]), (30.0, 0))
+
+        header[parser.KW_SEED] = None
+        self.assertEqual(parser.encode_header(header), encoded[:-9] + bytes([parser.HEADER_FLAG_HAS_DURATION]) + encoded[-8:-4])
+
+        with self.assertRaises(SystemExit):
+            parser.parse_header(test_header[:4] + [(5, f"{parser.KW_SEED} = {2**32}")])
+
     def test_framebulk_encoding(self):
         """This method tests that the parser is correctly encoding framebulks
         """
@@ -144,6 +200,211 @@ class TestParser(unittest.TestCase):
         self.assertEqual(test_output_0, expected_output_0)
         self.assertEqual(test_output_1, expected_output_1)
 
+    def test_framebulk_decoding(self):
+        """This method tests that framebulks survive being encoded & decoded
+        """
+        framebulks = [
+            parser.Framebulk(100, 0.0, parser.Framebulk.Flags(accel=True)),
+            parser.Framebulk(35, -1.0, parser.Framebulk.Flags(accel=True, nitro=True, skid=True)),
+            parser.Framebulk(1, 1.0, parser.Framebulk.Flags(decel=True, ability=True)),
+            parser.Framebulk(0, 3.0, parser.Framebulk.Flags(set_speed=True))
+        ]
+        data = b''.join(fb.encode() for fb in framebulks)
+        test_output = [parser.Framebulk.decode(data, i * 8) for i in range(len(framebulks))]
+
+        self.assertEqual(test_output, framebulks)
+
+    def test_framebulk_to_script(self):
+        """This method tests that framebulks are written out the same way that they're parsed
+        """
+        lines = ["a-|---|0|100|", "ab|fns|-1|5|", "--|-n-|0.5|32767|", f"{parser.KW_PLAYSPEED} 3"]
+        framebulks = parser.parse_framebulks(list(enumerate(lines)))
+        test_output = [fb.to_script() for fb in framebulks]
+
+        self.assertEqual(test_output, lines)
+
+    def test_actions(self):
+        """This method tests that 'at' lines become actions and are left out of the framebulks
+        """
+        lines = list(enumerate([
+            "a-|---|0|100|",
+            f"{parser.KW_AT} 50 speed 0.5",
+            f"{parser.KW_AT} 600 marker 3",
+            "--|---|1|20|",
+            f"{parser.KW_AT} 10 snapshot",
+            f"{parser.KW_AT} 700 stop"
+        ]))
+        framebulks = parser.parse_framebulks(lines)
+        actions = parser.parse_actions(lines)
+
+        self.assertEqual(framebulks, [
+            parser.Framebulk(100, 0.0, parser.Framebulk.Flags(accel=True)),
+            parser.Framebulk(20, 1.0, parser.Framebulk.Flags())
+        ])
+        self.assertEqual(actions, [
+            parser.TimedAction(50, parser.TimedAction.TYPE_SET_SPEED, 0.5),
+            parser.TimedAction(600, parser.TimedAction.TYPE_MARKER, 3),
+            parser.TimedAction(10, parser.TimedAction.TYPE_SNAPSHOT),
+            parser.TimedAction(700, parser.TimedAction.TYPE_STOP)
+        ])
+
+    def test_action_encoding(self):
+        """This method tests that actions are encoded after the header, which has a flag for them
+        """
+        header = {
+            parser.KW_MAP : "abyss",
+            parser.KW_KART_NAME : "tux",
+            parser.KW_NUM_LAPS : 1,
+            parser.KW_DIFFICULTY : 2,
+            parser.KW_NUM_AI : 0,
+            parser.KW_QUICK_RESET : True
+        }
+        actions = [
+            parser.TimedAction(600, parser.TimedAction.TYPE_SET_SPEED, 4.0),
+            parser.TimedAction(70000, parser.TimedAction.TYPE_MARKER, 9)
+        ]
+        test_output = parser.encode_header(header, True) + parser.encode_actions(actions)
+        expected_output = (
+            parser.encode_header(header)[:-1] +
+            b'\x03' +                               # quick reset | has actions
+            struct.pack('<I', 2) +                  # action count
+            struct.pack('<IB3xf', 600, 1, 4.0) +    # tick, type, value
+            struct.pack('<IB3xI', 70000, 0, 9)
+        )
+        self.assertEqual(test_output, expected_output)
+        self.assertEqual(parser.encode_actions([]), b'')
+
+
+    def test_predicates(self):
+        """This method tests that 'until' and 'when' lines get compiled conditions, and that
+        identical conditions share a program
+        """
+        compiler = parser.Compiler([parser.Field.from_script("field speed f32 c")])
+        lines = list(enumerate([
+            f"{parser.KW_WHEN} speed > 5 -> nitro left",
+            f"a-|---|0|100| {parser.KW_UNTIL} speed > 10 and fb_tick > 3",
+            f"{parser.KW_WHEN} off",
+            f"--|---|1|20| {parser.KW_UNTIL} speed > 5"
+        ]))
+        framebulks = parser.parse_framebulks(lines, compiler)
+
+        self.assertEqual(framebulks, [
+            parser.Framebulk(0, -1.0, parser.Framebulk.Flags(nitro=True, rule=True), 0),
+            parser.Framebulk(100, 0.0, parser.Framebulk.Flags(accel=True, until=True), 1),
+            parser.Framebulk(0, 0.0, parser.Framebulk.Flags(rule=True), parser.RULE_CLEAR),
+            parser.Framebulk(20, 1.0, parser.Framebulk.Flags(until=True), 0)
+        ])
+        self.assertEqual(compiler.constants, [5.0, 10.0, 3.0])
+        self.assertEqual(compiler.programs[0], [
+            (predicate.OP_LOAD_CONST, 0, 0, 0),   # speed > 5 is 5 < speed
+            (predicate.OP_LOAD_FIELD, 1, 0, 0),
+            (predicate.OP_LT, 0, 0, 1),
+            (predicate.OP_RET, 0, 0, 0)
+        ])
+        for bad in ["speed >", "spede > 5", "speed.x > 5", "f(speed)", "min(speed)", "1+(" * 20 + "1" + ")" * 20]:
+            with self.assertRaises(parser.CompileError):
+                parser.Compiler([parser.Field.from_script("field speed f32 c")]).compile(bad)
+
+    def test_predicate_encoding(self):
+        """This method tests the programs section and the condition of a framebulk in its flags
+        """
+        compiler = parser.Compiler([parser.Field.from_script("field lap u8 1a2b 10 4")])
+        compiler.compile("lap == 2")
+        expected_output = (
+            struct.pack('<IBB2xIII', 1, 7, 2, 0x1a2b, 0x10, 4) +  # fields
+            struct.pack('<If', 1, 2.0) +                          # constants
+            struct.pack('<II', 1, 4) +                            # programs, instructions
+            bytes([predicate.OP_LOAD_FIELD, 0, 0, 0, predicate.OP_LOAD_CONST, 1, 0, 0,
+                   predicate.OP_EQ, 0, 0, 1, predicate.OP_RET, 0, 0, 0])
+        )
+        self.assertEqual(compiler.encode(), expected_output)
+
+        fb = parser.Framebulk(30, 0.0, parser.Framebulk.Flags(skid=True, until=True), 200)
+        self.assertEqual(fb.encode(), struct.pack('<Hhf', (1 << 4) | (1 << 6) | 200 << 8, 30, 0.0))
+        self.assertEqual(parser.Framebulk.decode(fb.encode()), fb)
+
+
+    def test_repeats(self):
+        """This method tests that repeat blocks are kept as written, nested & sorted outer first,
+        and that they stand for the same framebulks as writing them all out
+        """
+        lines = list(enumerate([
+            "--|---|0|10|",
+            f"{parser.KW_REPEAT} 3",
+            f"{parser.KW_REPEAT} 2",
+            "a-|--s|-1|15|",
+            "a-|--s|1|15|",
+            parser.KW_END,
+            "a-|---|0|5|",
+            parser.KW_END,
+            f"{parser.KW_REPEAT} 2",
+            f"{parser.KW_REPEAT} 4",
+            "-b|---|0|1|",
+            parser.KW_END,
+            parser.KW_END
+        ]))
+        framebulks = parser.parse_framebulks(lines)
+        repeats = parser.parse_repeats(lines, framebulks)
+
+        self.assertEqual(len(framebulks), 5)
+        self.assertEqual(repeats, [
+            parser.RepeatBlock(1, 4, 3),
+            parser.RepeatBlock(1, 3, 2),
+            parser.RepeatBlock(4, 5, 2),
+            parser.RepeatBlock(4, 5, 4)
+        ])
+
+        def expand(first, end, outer=-1):
+            out = []
+            i = first
+            while i < end:
+                # the outermost block that starts here and is in the one being expanded
+                block = next((j for j, r in enumerate(repeats) if j > outer and r.first_fb == i and r.end_fb <= end), None)
+                if block is not None:
+                    r = repeats[block]
+                    out += expand(r.first_fb, r.end_fb, block) * r.count
+                    i = r.end_fb
+                else:
+                    out.append(framebulks[i].to_script())
+                    i += 1
+            return out
+
+        flat = ["--|---|0|10|"] + (["a-|--s|-1|15|", "a-|--s|1|15|"] * 2 + ["a-|---|0|5|"]) * 3 + ["-b|---|0|1|"] * 8
+        self.assertEqual(expand(0, len(framebulks)), flat)
+
+        # an until framebulk can end before its first tick, so it doesn't count as the block's ticks
+        compiler = parser.Compiler([parser.Field.from_script("field speed f32 c")])
+        lines = list(enumerate([
+            f"{parser.KW_REPEAT} 1000",
+            f"a-|---|0|100| {parser.KW_UNTIL} speed > 10",
+            parser.KW_END
+        ]))
+        with self.assertRaises(SystemExit):
+            parser.parse_repeats(lines, parser.parse_framebulks(lines, compiler))
+
+    def test_repeat_encoding(self):
+        """This method tests that repeat blocks are encoded after the programs, with a header flag
+        """
+        header = {
+            parser.KW_MAP : "abyss",
+            parser.KW_KART_NAME : "tux",
+            parser.KW_NUM_LAPS : 1,
+            parser.KW_DIFFICULTY : 2,
+            parser.KW_NUM_AI : 0,
+            parser.KW_QUICK_RESET : False
+        }
+        repeats = [parser.RepeatBlock(0, 2, 100), parser.RepeatBlock(1, 2, 3)]
+        test_output = parser.encode_header(header, False, False, True) + parser.encode_repeats(repeats)
+        expected_output = (
+            parser.encode_header(header)[:-1] +
+            b'\x08' +                              # has repeats
+            struct.pack('<I', 2) +                  # block count
+            struct.pack('<III', 0, 2, 100) +        # first, end, count
+            struct.pack('<III', 1, 2, 3)
+        )
+        self.assertEqual(test_output, expected_output)
+        self.assertEqual(parser.encode_repeats([]), b'')
+
 
 if __name__ == '__main__':
     unittest.main()